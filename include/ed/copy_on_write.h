@@ -0,0 +1,83 @@
+#ifndef ED_COPY_ON_WRITE_H_
+#define ED_COPY_ON_WRITE_H_
+
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace ed
+{
+
+/// Returns the object of 'p' for changing it, after creating it if 'p' is null, or copying it if other pointers
+/// share it. Worlds that are shared between threads are const, so the world that changes an object is the only
+/// one that can add owners to it.
+template<typename T>
+T& writable(boost::shared_ptr<T>& p)
+{
+    if (!p)
+        p = boost::make_shared<T>();
+    else if (!p.unique())
+        p = boost::make_shared<T>(*p);
+
+    return *p;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Array that is shared between its copies in chunks of CHUNK_SIZE elements. Copying it only copies a pointer
+/// per chunk, and a copy that changes an element only copies the chunk of that element.
+template<typename T>
+class ChunkedArray
+{
+
+public:
+
+    enum { CHUNK_SIZE = 256 };
+
+    ChunkedArray() : size_(0) {}
+
+    std::size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    const T& operator[](std::size_t i) const { return (*chunks_[i / CHUNK_SIZE])[i % CHUNK_SIZE]; }
+
+    void set(std::size_t i, const T& value) { writable(chunks_[i / CHUNK_SIZE])[i % CHUNK_SIZE] = value; }
+
+    void push_back(const T& value)
+    {
+        if (size_ % CHUNK_SIZE == 0)
+        {
+            chunks_.push_back(boost::make_shared<std::vector<T> >());
+            chunks_.back()->reserve(CHUNK_SIZE);
+        }
+
+        writable(chunks_.back()).push_back(value);
+        ++size_;
+    }
+
+    void clear()
+    {
+        chunks_.clear();
+        size_ = 0;
+    }
+
+    void swap(ChunkedArray& other)
+    {
+        chunks_.swap(other.chunks_);
+        std::swap(size_, other.size_);
+    }
+
+private:
+
+    std::vector<boost::shared_ptr<std::vector<T> > > chunks_;
+
+    std::size_t size_;
+
+};
+
+} // end namespace ed
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef ED_DIRTY_ENTITY_H_
+#define ED_DIRTY_ENTITY_H_
+
+#include "ed/uuid.h"
+
+namespace ed
+{
+
+/// Entity that changed, and which of its components changed. Used for the entities a plugin gets in
+/// PluginInput::dirty and for the result of WorldModel::diff().
+struct DirtyEntity
+{
+    enum Component
+    {
+        POSE = 1,
+        SHAPE = 2,
+        CONVEX_HULL = 4,
+        DATA = 8,
+        TYPE = 16,
+        FLAGS = 32,
+        REMOVED = 64,
+        OTHER = 128,
+        ALL = 255
+    };
+
+    DirtyEntity(const UUID& id_, unsigned int components_) : id(id_), components(components_) {}
+
+    bool changed(Component c) const { return (components & c) != 0; }
+
+    UUID id;
+
+    /// Bitwise or of Component
+    unsigned int components;
+};
+
+} // end namespace ed
+
+#endif
@@ -5,6 +5,7 @@
 #include "ed/convex_hull_2d.h"
 #include "ed/convex_hull.h"
 #include "ed/uuid.h"
+#include "ed/symbol.h"
 
 #include <tue/config/data.h>
 
@@ -38,12 +39,16 @@ public:
     const UUID& id() const { return id_; }
 
     const TYPE& type() const { return type_; }
-    void setType(const TYPE& type) { type_ = type; types_.insert(type); }
+    void setType(const TYPE& type) { type_ = type; types_.insert(internSymbol(type)); }
 
-    const std::set<TYPE>& types() const { return types_; }
-    void addType(const TYPE& type) { types_.insert(type); }
-    void removeType(const TYPE& type) { types_.erase(type); }
-    bool hasType(const TYPE& type) const { return types_.find(type) != types_.end(); }
+    /// Builds a set with the names of the types. Queries should use hasType() or typeSymbols(), which do not create
+    /// strings.
+    std::set<TYPE> typeNames() const { return types_.names(); }
+    const SymbolSet& typeSymbols() const { return types_; }
+    void addType(const TYPE& type) { types_.insert(internSymbol(type)); }
+    void removeType(const TYPE& type) { SymbolId id; if (findSymbol(type, id)) types_.erase(id); }
+    bool hasType(const TYPE& type) const { SymbolId id; return findSymbol(type, id) && types_.contains(id); }
+    bool hasType(SymbolId type) const { return types_.contains(type); }
 
     void measurements(std::vector<MeasurementConstPtr>& measurements, double min_timestamp = 0) const;
     void measurements(std::vector<MeasurementConstPtr>& measurements, unsigned int num) const;
@@ -53,6 +58,9 @@ public:
 
     void addMeasurement(MeasurementConstPtr measurement);
 
+    /// Bytes used in memory by the measurements of this entity (images shared by measurements are counted once)
+    std::size_t measurementMemoryUsage() const;
+
     inline geo::ShapeConstPtr shape() const { return shape_; }
     void setShape(const geo::ShapeConstPtr& shape);
 
@@ -167,6 +175,10 @@ public:
     inline const tue::config::DataConstPointer& data() const { return config_; }
     inline void setData(const tue::config::DataConstPointer& data) { config_ = data; }
 
+    /// Revision of the world model at which the data was last set (0 if it was never set by the world model)
+    unsigned long dataRevision() const { return data_revision_; }
+    void setDataRevision(unsigned long revision) { data_revision_ = revision; }
+
     //! For debugging purposes
     bool in_frustrum;
     bool object_in_front;
@@ -177,6 +189,13 @@ public:
 
     inline void setRelationFrom(Idx parent_idx, Idx r_idx) { relations_from_[parent_idx] = r_idx; }
 
+    inline void removeRelationTo(Idx child_idx) { relations_to_.erase(child_idx); }
+
+    inline void removeRelationFrom(Idx parent_idx) { relations_from_.erase(parent_idx); }
+
+    /// Replaces the entity and relation indices in the relations by the ones they map to
+    void remapRelations(const std::vector<Idx>& entity_map, const std::vector<Idx>& relation_map);
+
     inline Idx relationTo(Idx child_idx) const
     {
         std::map<Idx, Idx>::const_iterator it = relations_to_.find(child_idx);
@@ -273,13 +292,19 @@ public:
 
     double lastUpdateTimestamp() const { return last_update_timestamp_; }
 
-    void setFlag(const std::string& flag) { flags_.insert(flag); }
+    void setFlag(const std::string& flag) { flags_.insert(internSymbol(flag)); }
+
+    void removeFlag(const std::string& flag) { SymbolId id; if (findSymbol(flag, id)) flags_.erase(id); }
+
+    bool hasFlag(const std::string& flag) const { SymbolId id; return findSymbol(flag, id) && flags_.contains(id); }
 
-    void removeFlag(const std::string& flag) { flags_.erase(flag); }
+    bool hasFlag(SymbolId flag) const { return flags_.contains(flag); }
 
-    bool hasFlag(const std::string& flag) const { return flags_.find(flag) != flags_.end(); }
+    /// Builds a set with the names of the flags. Queries should use hasFlag() or flagSymbols(), which do not create
+    /// strings.
+    std::set<std::string> flagNames() const { return flags_.names(); }
 
-    const std::set<std::string>& flags() const { return flags_; }
+    const SymbolSet& flagSymbols() const { return flags_; }
 
 private:
 
@@ -289,7 +314,7 @@ private:
 
     TYPE type_;
 
-    std::set<TYPE> types_;
+    SymbolSet types_;
 
     double existence_prob_;
 
@@ -324,6 +349,7 @@ private:
 //    double creation_time_;
 
     tue::config::DataConstPointer config_;
+    unsigned long data_revision_;
 
     std::map<Idx, Idx> relations_from_;
     std::map<Idx, Idx> relations_to_;
@@ -335,7 +361,7 @@ private:
 
     void updateConvexHullFromShape();
 
-    std::set<std::string> flags_;
+    SymbolSet flags_;
 
 };
 
@@ -0,0 +1,104 @@
+#ifndef ED_EVICTOR_H_
+#define ED_EVICTOR_H_
+
+#include "ed/types.h"
+#include "ed/symbol.h"
+#include "ed/uuid.h"
+
+#include <boost/unordered_map.hpp>
+
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace ed
+{
+
+/**
+ * Removes entities that were not updated for some time (their time-to-live), configured per type or flag.
+ * Entities are kept in a queue ordered by the time at which they expire, such that evicting does not scan
+ * the world. Each entity is in the queue at most once: when an entity comes up, its expiry time is computed
+ * again from its current last update timestamp, types and flags, and it is queued again if it was updated.
+ *
+ * Entities without last update timestamp (such as the ones loaded from the world description) never expire.
+ */
+class Evictor
+{
+
+public:
+
+    struct Policy
+    {
+        Policy() : is_flag(false), symbol(INVALID_SYMBOL), ttl(0), num_evicted(0) {}
+
+        /// Type or flag
+        std::string name;
+        bool is_flag;
+        SymbolId symbol;
+
+        /// Time-to-live in seconds
+        double ttl;
+
+        unsigned long num_evicted;
+    };
+
+    Evictor();
+
+    ~Evictor();
+
+    /// Entities with type 'type' are removed 'ttl' seconds after their last update. If an entity matches
+    /// multiple policies, the shortest time-to-live applies.
+    void addTypePolicy(const std::string& type, double ttl);
+
+    /// Entities with flag 'flag' are removed 'ttl' seconds after their last update
+    void addFlagPolicy(const std::string& flag, double ttl);
+
+    /// Removes all policies and queued entities
+    void clear();
+
+    bool empty() const { return policies_.empty(); }
+
+    /// Queues all entities of 'world'. Only needed if 'world' was not built with requests passed to update().
+    void schedule(const WorldModel& world);
+
+    /// Queues the entities that 'req' changed. 'world' is the world after applying 'req'.
+    void update(const WorldModel& world, const UpdateRequest& req);
+
+    /// Adds the removal of all entities that expired at 'time' to 'req'
+    void evict(const WorldModel& world, double time, UpdateRequest& req);
+
+    const std::vector<Policy>& policies() const { return policies_; }
+
+    /// Number of entities in the queue
+    std::size_t numScheduled() const { return scheduled_.size(); }
+
+private:
+
+    struct Item
+    {
+        Item(double expiry_, const UUID& id_) : expiry(expiry_), id(id_) {}
+
+        bool operator>(const Item& other) const { return expiry > other.expiry; }
+
+        double expiry;
+        UUID id;
+    };
+
+    std::vector<Policy> policies_;
+
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item> > queue_;
+
+    // Expiry time of the item that is in the queue for each entity. Items with another expiry time are outdated.
+    boost::unordered_map<UUID, double> scheduled_;
+
+    /// Returns the index of the policy with the shortest time-to-live that applies to 'e', or -1
+    int findPolicy(const Entity& e) const;
+
+    void schedule(const Entity& e);
+
+};
+
+} // end namespace ed
+
+#endif
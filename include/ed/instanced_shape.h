@@ -0,0 +1,63 @@
+#ifndef ED_INSTANCED_SHAPE_H_
+#define ED_INSTANCED_SHAPE_H_
+
+#include <geolib/datatypes.h>
+#include <geolib/Shape.h>
+
+#include <boost/thread/mutex.hpp>
+
+namespace ed
+{
+
+/**
+ * Shape that shares the (immutable) mesh of another shape and places it with a transform, such that
+ * identical objects at different offsets hold one mesh. Code that knows about instances should use
+ * sharedMesh(). getMesh() creates the transformed mesh on first use and keeps it.
+ */
+class InstancedShape : public geo::Shape
+{
+
+public:
+
+    /// Instance of 'base' with pose 'transform' in the frame of this shape. Instances of instances share
+    /// the mesh of the original shape.
+    InstancedShape(const geo::ShapeConstPtr& base, const geo::Pose3D& transform);
+
+    const geo::ShapeConstPtr& base() const { return base_; }
+
+    const geo::Pose3D& transform() const { return transform_; }
+
+    geo::Shape* clone() const;
+
+    const geo::Mesh& getMesh() const;
+
+    void setMesh(const geo::Mesh& mesh);
+
+    double getMaxRadius() const;
+
+    geo::Box getBoundingBox() const;
+
+    bool contains(const geo::Vector3& p) const;
+
+private:
+
+    geo::ShapeConstPtr base_;
+
+    geo::Pose3D transform_;
+
+    mutable boost::mutex mutex_;
+
+    mutable bool has_mesh_;
+
+};
+
+/// Returns the mesh that 'shape' shares with its other instances, and sets 'transform' to the pose of that mesh
+/// in the frame of 'shape'. For shapes that are not instanced, that is their own mesh and the identity.
+const geo::Mesh& sharedMesh(const geo::Shape& shape, geo::Pose3D& transform);
+
+/// Returns whether 'pose' is exactly the identity
+bool isIdentity(const geo::Pose3D& pose);
+
+} // end namespace ed
+
+#endif
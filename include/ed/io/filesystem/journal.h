@@ -0,0 +1,113 @@
+#ifndef ED_IO_FILESYSTEM_JOURNAL_H_
+#define ED_IO_FILESYSTEM_JOURNAL_H_
+
+#include "ed/types.h"
+
+#include <boost/thread.hpp>
+
+#include <string>
+#include <vector>
+
+namespace ed
+{
+
+class PropertyKeyDB;
+
+/**
+ * Append-only journal of the update requests applied to the world model, used to recover the
+ * world after a crash. Requests are serialized on the calling thread and handed to a writer thread,
+ * which writes all pending records at once and flushes them with a single fdatasync (group commit),
+ * so appending never blocks on disk I/O.
+ *
+ * The journal is split in segments. A checkpoint writes a snapshot of the world and starts a new
+ * segment, after which older checkpoints and segments are deleted. Recovery loads the newest valid
+ * checkpoint and replays the records written after it, up to the first torn or corrupt record. Only a
+ * torn record at the end of the journal is cut off: checkpoints and segments that can not be recovered
+ * are renamed to '<name>.unrecovered', so nothing is lost.
+ *
+ * Measurements are not journaled.
+ */
+class Journal
+{
+
+public:
+
+    Journal();
+
+    ~Journal();
+
+    /// Opens the journal in 'directory' (which is created if needed) and recovers its contents.
+    /// 'checkpoint' recreates the checkpointed world (null if there is none) and 'records' must be
+    /// applied after it, in order. Afterwards, new records are appended.
+    bool open(const std::string& directory, const PropertyKeyDB& property_key_db,
+              UpdateRequestPtr& checkpoint, std::vector<UpdateRequestPtr>& records);
+
+    /// Writes all pending records and closes the journal
+    void close();
+
+    bool isOpen() const { return thread_.get() != 0; }
+
+    /// Appends the request. It is written in the background.
+    void append(const UpdateRequest& req);
+
+    /// Writes a snapshot of 'world' in the background. The world must contain all appended requests.
+    void checkpoint(const WorldModelConstPtr& world);
+
+    /// Number of records appended since the last checkpoint
+    unsigned long numRecordsSinceCheckpoint() const { return sequence_ - checkpoint_sequence_; }
+
+private:
+
+    std::string directory_;
+
+    // Sequence number of the last appended record
+    unsigned long sequence_;
+
+    // Sequence number of the last record contained in the last checkpoint
+    unsigned long checkpoint_sequence_;
+
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Shared with the writer thread
+
+    struct Task
+    {
+        // Serialized record (empty for a checkpoint)
+        std::string record;
+
+        // World to checkpoint
+        WorldModelConstPtr world;
+
+        unsigned long sequence;
+    };
+
+    boost::mutex mutex_;
+
+    boost::condition_variable cond_;
+
+    std::vector<Task> pending_;
+
+    bool request_stop_;
+
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Only used by the writer thread
+
+    boost::shared_ptr<boost::thread> thread_;
+
+    // File descriptor of the current segment
+    int fd_;
+
+    void run();
+
+    bool openSegment(unsigned long first_sequence);
+
+    bool flush(const std::string& data);
+
+    void writeCheckpoint(const WorldModel& world, unsigned long sequence);
+
+};
+
+} // end namespace ed
+
+#endif
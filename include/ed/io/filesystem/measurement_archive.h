@@ -0,0 +1,134 @@
+#ifndef ED_IO_FILESYSTEM_MEASUREMENT_ARCHIVE_H_
+#define ED_IO_FILESYSTEM_MEASUREMENT_ARCHIVE_H_
+
+#include "ed/types.h"
+
+#include <rgbd/types.h>
+
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ed
+{
+
+namespace binary
+{
+class MappedFile;
+}
+
+/**
+ * Single append-only file with the measurements of entities. Every record is length-prefixed, and an
+ * index of all measurements is written as footer when the archive is closed. An image shared by
+ * multiple measurements is stored once.
+ */
+class MeasurementArchiveWriter
+{
+
+public:
+
+    MeasurementArchiveWriter();
+
+    ~MeasurementArchiveWriter();
+
+    /// Opens the archive. Measurements in an existing archive are kept and new ones are appended.
+    bool open(const std::string& filename);
+
+    /// Writes all pending measurements and the index, and closes the archive
+    void close();
+
+    bool isOpen() const { return thread_.get() != 0; }
+
+    const std::string& filename() const { return filename_; }
+
+    /// Queues the measurement of entity 'id'. It is written in the background.
+    void add(const UUID& id, const MeasurementConstPtr& msr);
+
+    struct IndexEntry
+    {
+        std::string id;
+        double timestamp;
+        unsigned long long offset;
+    };
+
+private:
+
+    std::string filename_;
+
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Shared with the writer thread
+
+    boost::mutex mutex_;
+
+    boost::condition_variable cond_;
+
+    std::vector<std::pair<std::string, MeasurementConstPtr> > pending_;
+
+    bool request_stop_;
+
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Only used by the writer thread
+
+    boost::shared_ptr<boost::thread> thread_;
+
+    std::ofstream out_;
+
+    unsigned long long offset_;
+
+    std::vector<IndexEntry> index_;
+
+    // Offsets of the images written in this session. The weak pointer detects re-used addresses.
+    std::map<const rgbd::Image*, std::pair<boost::weak_ptr<const rgbd::Image>, unsigned long long> > image_offsets_;
+
+    void run();
+
+    void write(const std::string& id, const Measurement& msr, std::string& buffer);
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Memory maps a measurement archive for random access by entity id and timestamp
+class MeasurementArchiveReader
+{
+
+public:
+
+    MeasurementArchiveReader();
+
+    ~MeasurementArchiveReader();
+
+    /// Opens the archive. If it has no index (e.g. the writer crashed), the records are scanned.
+    bool open(const std::string& filename);
+
+    void getEntityIds(std::vector<std::string>& ids) const;
+
+    /// Timestamps of the measurements of the entity, in ascending order
+    void getTimestamps(const std::string& id, std::vector<double>& timestamps) const;
+
+    /// Reads the latest measurement of the entity at or before 'timestamp'
+    bool read(const std::string& id, double timestamp, Measurement& msr) const;
+
+    /// Reads the latest measurement of the entity
+    bool read(const std::string& id, Measurement& msr) const;
+
+private:
+
+    boost::shared_ptr<binary::MappedFile> file_;
+
+    // Per entity: timestamp -> record offset
+    std::map<std::string, std::map<double, unsigned long long> > index_;
+
+    bool readRecord(unsigned long long offset, Measurement& msr) const;
+
+};
+
+} // end namespace ed
+
+#endif
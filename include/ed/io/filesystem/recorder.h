@@ -0,0 +1,85 @@
+#ifndef ED_IO_FILESYSTEM_RECORDER_H_
+#define ED_IO_FILESYSTEM_RECORDER_H_
+
+#include "ed/types.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <fstream>
+#include <string>
+
+namespace ed
+{
+
+class PropertyKeyDB;
+
+namespace binary
+{
+class MappedFile;
+}
+
+/**
+ * Records the initial world and all update requests applied to it, with wall clock timestamps, such
+ * that the update stream can be replayed offline (see ed_replay). A recording is a directory with a
+ * snapshot of the initial world ('world.snapshot') and the serialized requests ('requests.rec').
+ *
+ * Measurements are not recorded.
+ */
+class Recorder
+{
+
+public:
+
+    Recorder();
+
+    ~Recorder();
+
+    /// Starts a recording in 'directory' (which is created if needed) from the given world
+    bool open(const std::string& directory, const WorldModel& world);
+
+    void close();
+
+    bool isOpen() const { return out_.is_open(); }
+
+    /// Records the request with the current time
+    void record(const UpdateRequest& req);
+
+    unsigned long numRecords() const { return num_records_; }
+
+private:
+
+    std::ofstream out_;
+
+    unsigned long num_records_;
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Reads a recording written by the Recorder
+class RecordingReader
+{
+
+public:
+
+    RecordingReader();
+
+    ~RecordingReader();
+
+    /// Opens the recording and reads the request that creates the initial world
+    bool open(const std::string& directory, const PropertyKeyDB& property_key_db, UpdateRequest& world);
+
+    /// Reads the next request. Returns false at the end of the recording.
+    bool next(const PropertyKeyDB& property_key_db, double& timestamp, UpdateRequest& req);
+
+private:
+
+    boost::shared_ptr<binary::MappedFile> file_;
+
+    std::size_t offset_;
+
+};
+
+} // end namespace ed
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef ED_IO_FILESYSTEM_SNAPSHOT_H_
+#define ED_IO_FILESYSTEM_SNAPSHOT_H_
+
+#include <map>
+#include <string>
+
+namespace ed
+{
+
+class WorldModel;
+class UpdateRequest;
+class PropertyKeyDB;
+
+// ----------------------------------------------------------------------------------------------------
+
+struct SnapshotHeader
+{
+    /// What the world was created from (e.g., the world name)
+    std::string source;
+
+    /// Files the world was created from, with their modification times
+    std::map<std::string, double> dependencies;
+
+    /// Adds the file with its current modification time. Returns false if the file does not exist.
+    bool addDependency(const std::string& filename);
+
+    /// Returns true if none of the dependencies changed since the snapshot was written
+    bool upToDate() const;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Writes a binary snapshot of the complete world model. Shapes shared by entities are written once.
+bool writeSnapshot(const std::string& filename, const WorldModel& world, const SnapshotHeader& header);
+
+/// Only reads the header of a snapshot
+bool readSnapshotHeader(const std::string& filename, SnapshotHeader& header);
+
+/// Memory maps the snapshot and fills 'req' such that it recreates the world when applied to an empty world model
+bool readSnapshot(const std::string& filename, const PropertyKeyDB& property_key_db, SnapshotHeader& header, UpdateRequest& req);
+
+}
+
+#endif
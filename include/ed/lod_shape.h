@@ -0,0 +1,53 @@
+#ifndef ED_LOD_SHAPE_H_
+#define ED_LOD_SHAPE_H_
+
+#include <geolib/datatypes.h>
+#include <geolib/Shape.h>
+
+#include <vector>
+
+namespace ed
+{
+
+/**
+ * Shape with coarser versions (levels of detail) of its mesh, for consumers that do not need the full mesh,
+ * such as top-down rendering and convex hull extraction. getMesh() returns the full mesh.
+ */
+class LODShape : public geo::Shape
+{
+
+public:
+
+    LODShape();
+
+    geo::Shape* clone() const;
+
+    /// Adds a coarser mesh that deviates at most 'error' (m) from the full mesh. Levels are added from fine to coarse.
+    void addLevel(double error, const geo::Mesh& mesh);
+
+    unsigned int numLevels() const { return errors_.size(); }
+
+    double levelError(unsigned int i) const { return errors_[i]; }
+
+    const geo::Mesh& levelMesh(unsigned int i) const { return meshes_[i]; }
+
+    /// Returns the coarsest mesh that deviates at most 'tolerance' (m) from the full mesh
+    const geo::Mesh& getMesh(double tolerance) const;
+
+    using geo::Shape::getMesh;
+
+private:
+
+    std::vector<double> errors_;
+
+    std::vector<geo::Mesh> meshes_;
+
+};
+
+/// As sharedMesh(), but returns the coarsest level of detail of the shared mesh that deviates at most 'tolerance' (m)
+/// from it. Shapes without levels of detail return their full mesh.
+const geo::Mesh& levelOfDetail(const geo::Shape& shape, double tolerance, geo::Pose3D& transform);
+
+} // end namespace ed
+
+#endif
@@ -13,19 +13,37 @@
 namespace ed
 {
 
-/** Support for scanning an image as a number of sub-image scans. */
+/**
+ * Set of pixels of an image, stored as runs of consecutive pixels per scan line. The runs are kept
+ * sorted (by scan line, then by x) and never overlap or touch, such that area, union and intersection
+ * take time linear in the number of runs. Adding pixels in scan order takes constant time.
+ */
 class ImageMask {
 
 public:
 
-    ImageMask() {}
+    /// Pixels x_min up to and including x_max of scan line y
+    struct Run
+    {
+        Run() {}
+
+        Run(int y_, int x_min_, int x_max_) : y(y_), x_min(x_min_), x_max(x_max_) {}
+
+        inline int length() const { return x_max - x_min + 1; }
+
+        int y;
+        int x_min;
+        int x_max;
+    };
+
+    ImageMask() : width_(0), height_(0), area_(0) {}
 
     /**
      * Construct the mask, while setting the mask size.
      * @paran width Width of the mask.
      * @param height Height of the mask.
      */
-    ImageMask(int width, int height) : width_(width), height_(height)
+    ImageMask(int width, int height) : width_(width), height_(height), area_(0)
     {
     }
 
@@ -40,17 +58,21 @@ public:
         height_ = height;
     }
 
-    /** Remove all sub-images. */
+    /** Remove all pixels. */
     inline void clear()
     {
-        points_.clear();
+        runs_.clear();
+        area_ = 0;
     }
 
     /**
-     * Get the number of sub-images.
-     * @return The number of sub-images in the mask.
+     * Get the number of pixels.
+     * @return The number of pixels in the mask.
      */
-    inline int getSize() const { return points_.size(); }
+    inline int getSize() const { return area_; }
+
+    /** Number of pixels in the mask. */
+    inline int area() const { return area_; }
 
     /**
      * Get the width of the mask.
@@ -64,27 +86,42 @@ public:
      */
     inline int height() const { return height_; }
 
+    /** Runs of the mask, sorted by scan line and x. */
+    inline const std::vector<Run>& runs() const { return runs_; }
+
     /**
-     * Add a sub-image.
-     * @param p Base-point of the new sub-image.
+     * Add a pixel.
+     * @param p Position of the pixel.
      */
     inline void addPoint(const cv::Point2i& p)
     {
-         points_.push_back(p);
+        addPoint(p.x, p.y);
     }
 
     /**
-     * Add a sub-image.
-     * @param x X coordinate of the new sub-image.
-     * @param y Y coordinate of the new sub-image.
+     * Add a pixel.
+     * @param x X coordinate of the pixel.
+     * @param y Y coordinate of the pixel.
      */
     inline void addPoint(int x, int y)
     {
-        addPoint(cv::Point2i(x, y));
+        if (!runs_.empty())
+        {
+            Run& last = runs_.back();
+            if (last.y == y && last.x_max + 1 == x)
+            {
+                // Extends the last run (the common case when adding in scan order)
+                ++last.x_max;
+                ++area_;
+                return;
+            }
+        }
+
+        addRun(y, x, x);
     }
 
     /**
-     * Add a one-pixel sub-image.
+     * Add a pixel.
      * @param idx Index number of the pixel (scanning horizontally, from top to bottom).
      */
     inline void addPoint(int idx)
@@ -93,8 +130,8 @@ public:
     }
 
     /**
-     * Add a number of sub-images.
-     * @param ps Base points of the new sub-images.
+     * Add a number of pixels.
+     * @param ps Positions of the pixels.
      */
     inline void addPoints(const std::vector<cv::Point2i>& ps)
     {
@@ -105,22 +142,135 @@ public:
     }
 
     /**
-     * Iterator that scans all sub-images in turn, scanning each sub-image from
-     * left to right, from top to bottom (assuming base position of a sub-image
-     * is its top-left corner).
+     * Add the pixels x_min up to and including x_max of scan line y.
+     */
+    void addRun(int y, int x_min, int x_max)
+    {
+        if (x_max < x_min)
+            return;
+
+        Run run(y, x_min, x_max);
+
+        if (runs_.empty() || endsBefore(runs_.back(), run))
+        {
+            runs_.push_back(run);
+            area_ += run.length();
+            return;
+        }
+
+        // Merge with all runs it overlaps or touches
+        std::vector<Run>::iterator first = std::lower_bound(runs_.begin(), runs_.end(), run, endsBefore);
+        std::vector<Run>::iterator last = first;
+        while(last != runs_.end() && last->y == y && last->x_min <= x_max + 1)
+        {
+            run.x_min = std::min(run.x_min, last->x_min);
+            run.x_max = std::max(run.x_max, last->x_max);
+            area_ -= last->length();
+            ++last;
+        }
+
+        if (first == last)
+        {
+            runs_.insert(first, run);
+        }
+        else
+        {
+            *first = run;
+            runs_.erase(first + 1, last);
+        }
+
+        area_ += run.length();
+    }
+
+    /** Returns the pixels that are in this mask, in 'other' or in both. */
+    ImageMask unite(const ImageMask& other) const
+    {
+        ImageMask result(width_, height_);
+        result.runs_.reserve(runs_.size() + other.runs_.size());
+
+        std::vector<Run>::const_iterator it1 = runs_.begin();
+        std::vector<Run>::const_iterator it2 = other.runs_.begin();
+        while(it1 != runs_.end() || it2 != other.runs_.end())
+        {
+            const Run* r;
+            if (it2 == other.runs_.end() || (it1 != runs_.end() && startsBefore(*it1, *it2)))
+                r = &*(it1++);
+            else
+                r = &*(it2++);
+
+            // Runs come in order, so they can only merge with the last one
+            if (!result.runs_.empty() && result.runs_.back().y == r->y && result.runs_.back().x_max + 1 >= r->x_min)
+            {
+                Run& last = result.runs_.back();
+                if (r->x_max > last.x_max)
+                {
+                    result.area_ += r->x_max - last.x_max;
+                    last.x_max = r->x_max;
+                }
+            }
+            else
+            {
+                result.runs_.push_back(*r);
+                result.area_ += r->length();
+            }
+        }
+
+        return result;
+    }
+
+    /** Returns the pixels that are in both this mask and 'other'. */
+    ImageMask intersect(const ImageMask& other) const
+    {
+        ImageMask result(width_, height_);
+
+        std::vector<Run>::const_iterator it1 = runs_.begin();
+        std::vector<Run>::const_iterator it2 = other.runs_.begin();
+        while(it1 != runs_.end() && it2 != other.runs_.end())
+        {
+            if (it1->y != it2->y)
+            {
+                if (it1->y < it2->y)
+                    ++it1;
+                else
+                    ++it2;
+                continue;
+            }
+
+            int x_min = std::max(it1->x_min, it2->x_min);
+            int x_max = std::min(it1->x_max, it2->x_max);
+            if (x_min <= x_max)
+            {
+                result.runs_.push_back(Run(it1->y, x_min, x_max));
+                result.area_ += x_max - x_min + 1;
+            }
+
+            // Advance the run that ends first
+            if (it1->x_max < it2->x_max)
+                ++it1;
+            else
+                ++it2;
+        }
+
+        return result;
+    }
+
+    /**
+     * Iterator that scans all pixels, run by run. If the mask is scaled up (the iterated image is
+     * larger than the mask), every pixel of a run covers a square of image pixels.
      */
     class const_iterator
     {
     public:
         /**
          * Iterator constructor.
-         * @param points Base points of the sub-images.
-         * @param index Index of the first sub-image to scan.
-         * @param factor Size of a rectangular sub-image.
+         * @param runs Runs of the mask.
+         * @param index Index of the first run to scan.
+         * @param factor Scale factor from the mask to the iterated image.
          */
-        const_iterator(const std::vector<cv::Point2i> &points, size_t index, int factor)
-            : points_(points), index_(index), dx_(0), dy_(0), factor_(factor)
+        const_iterator(const std::vector<Run>& runs, size_t index, int factor)
+            : runs_(&runs), index_(index), dy_(0), factor_(factor)
         {
+            x_ = index_ < runs_->size() ? (*runs_)[index_].x_min * factor_ : 0;
         }
 
         // post increment operator
@@ -133,67 +283,76 @@ public:
 
         /**
          * Pre-increment operator.
-         * Increment the X position of the scan line, wrapping to the start of
-         * the next scan line, jump to the next sub-image at the end of the
-         * current sub-image.
+         * Increment the X position, wrapping to the next scan line of the scaled run, and jump to the
+         * next run at the end of the current one.
          */
         inline const_iterator& operator++()
         {
-            ++dx_;
+            const Run& run = (*runs_)[index_];
 
-            // If reached end of the scan line of a sub-image, jump to next scan line.
-            if (dx_ == factor_)
+            ++x_;
+            if (x_ == (run.x_max + 1) * factor_)
             {
-                dy_++;
-                dx_ = 0;
-            }
+                ++dy_;
+                x_ = run.x_min * factor_;
 
-            // Reached underneath the last scan line, jump back to the start.
-            if (dy_ == factor_)
-            {
-                dx_ = 0;
-                dy_ = 0;
-                ++index_;
+                if (dy_ == factor_)
+                {
+                    dy_ = 0;
+                    ++index_;
+                    x_ = index_ < runs_->size() ? (*runs_)[index_].x_min * factor_ : 0;
+                }
             }
+
             return *this;
         }
 
-        /** Compute the xy mask position of the iterator. */
-        inline cv::Point2i operator()()
+        /** Compute the xy position of the iterator. */
+        inline cv::Point2i operator()() const
         {
-            const cv::Point2i &pt = points_[index_];
-            return cv::Point2i(pt.x * factor_ + dx_, pt.y * factor_ + dy_);
+            return cv::Point2i(x_, (*runs_)[index_].y * factor_ + dy_);
         }
 
-        // Note: iterator equality only checks base-point index, and not dx/dy
-        // sub-image position.
-        inline bool operator==(const const_iterator& rhs) { return index_ == rhs.index_; }
-        inline bool operator!=(const const_iterator& rhs) { return index_ != rhs.index_; }
+        inline bool operator==(const const_iterator& rhs) const { return index_ == rhs.index_ && x_ == rhs.x_ && dy_ == rhs.dy_; }
+        inline bool operator!=(const const_iterator& rhs) const { return !(*this == rhs); }
+
     private:
 
-        const std::vector<cv::Point2i> &points_; ///< Base points of the sub-images.
-        size_t index_;  ///< Current sub-image being scanned.
-        int dx_, dy_;   ///< Variables tracking the x/y position in the current sub-image.
-        int factor_;    ///< Sub-image X/Y size (sub-image is rectangular).
+        const std::vector<Run>* runs_;
+        size_t index_;  ///< Current run being scanned.
+        int x_, dy_;    ///< X position and scan line offset within the (scaled) run.
+        int factor_;    ///< Scale factor from the mask to the iterated image.
     };
 
     const_iterator begin(int width = 0) const
     {
         if (width <= 0)
-            return const_iterator(points_, 0, 1);
+            return const_iterator(runs_, 0, 1);
 
-        return const_iterator(points_, 0, width / width_);
+        return const_iterator(runs_, 0, width / width_);
     }
 
     const_iterator end() const
     {
-        return const_iterator(points_, points_.size(), 0);
+        return const_iterator(runs_, runs_.size(), 0);
     }
 
 private:
     int width_;  ///< Width of the mask.
     int height_; ///< Height of the mask.
-    std::vector<cv::Point2i> points_; ///< Base points of the sub-images.
+    int area_;   ///< Number of pixels in the mask.
+    std::vector<Run> runs_; ///< Sorted, non-touching runs.
+
+    /// True if 'a' ends before 'b' starts, with at least one pixel in between if they are on the same scan line
+    static bool endsBefore(const Run& a, const Run& b)
+    {
+        return a.y < b.y || (a.y == b.y && a.x_max + 1 < b.x_min);
+    }
+
+    static bool startsBefore(const Run& a, const Run& b)
+    {
+        return a.y < b.y || (a.y == b.y && a.x_min < b.x_min);
+    }
 };
 
 } // end namespace ed
@@ -4,6 +4,7 @@
 #include "ed/types.h"
 #include "ed/mask.h"
 #include "ed/rgbd_data.h"
+#include "ed/measurement_store.h"
 
 namespace ed
 {
@@ -19,15 +20,25 @@ public:
 
     Measurement(const RGBDData& rgbd_data, const PointCloudMaskPtr& mask, unsigned int seq = 0);
 
-    const geo::Pose3D& sensorPose() const { return rgbd_data_.sensor_pose; }
-    rgbd::ImageConstPtr image() const { return rgbd_data_.image; }
+    const geo::Pose3D& sensorPose() const { return sensor_pose_; }
+
+    /// Sensor image. If the measurement store compressed or spilled the image, it is loaded again.
+    rgbd::ImageConstPtr image() const { return image_ ? image_->image() : rgbd::ImageConstPtr(); }
+
     PointCloudMaskConstPtr mask() const { return mask_; }
     const ImageMask& imageMask() const { return image_mask_; }
     double timestamp() const { return timestamp_; }
 
+    /// Bytes used in memory by the masks and, if it is not shared with other measurements, the image
+    std::size_t memoryUsage() const;
+
+    const StoredImagePtr& storedImage() const { return image_; }
+
 protected:
 
-    RGBDData rgbd_data_;
+    // The point cloud of the RGBD data is not kept: it is only needed to compute the image mask
+    StoredImagePtr image_;
+    geo::Pose3D sensor_pose_;
     PointCloudMaskPtr mask_;
     ImageMask image_mask_;
     double timestamp_;
@@ -0,0 +1,176 @@
+#ifndef ED_MEASUREMENT_STORE_H_
+#define ED_MEASUREMENT_STORE_H_
+
+#include <rgbd/types.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <list>
+#include <map>
+#include <string>
+
+namespace ed
+{
+
+class MeasurementStore;
+
+/**
+ * Sensor image of one or more measurements. The measurement store decides where the image lives: in
+ * memory, compressed in memory, or spilled to disk. image() always returns the full image, loading it if
+ * necessary. Compression is lossy for the color image (JPEG).
+ */
+class StoredImage
+{
+
+public:
+
+    ~StoredImage();
+
+    /// Returns the image, decompressing it or loading it from disk if necessary. Returns a null pointer if
+    /// that fails, in which case the entry stays compressed or spilled.
+    rgbd::ImageConstPtr image() const;
+
+    /// Number of bytes the image currently uses in memory
+    std::size_t memoryUsage() const;
+
+private:
+
+    friend class MeasurementStore;
+
+    enum State
+    {
+        IN_MEMORY,
+        COMPRESSED,
+        SPILLED
+    };
+
+    StoredImage(MeasurementStore* store, const rgbd::ImageConstPtr& image);
+
+    MeasurementStore* store_;
+
+    // Image this entry was created from, used to detect re-used addresses
+    const rgbd::Image* key_;
+    boost::weak_ptr<const rgbd::Image> source_;
+
+    // The members below are guarded by the mutex of the store
+
+    // Set while the store compresses, spills or loads the image without holding its mutex. The entry is then
+    // in none of the LRU lists, and only the thread that set the flag changes it.
+    bool busy_;
+
+    State state_;
+
+    rgbd::ImageConstPtr image_;
+
+    std::size_t raw_bytes_;
+
+    std::string compressed_;
+
+    std::size_t spill_offset_;
+    std::size_t spill_size_;
+
+    std::list<StoredImage*>::iterator lru_it_;
+
+};
+
+typedef boost::shared_ptr<StoredImage> StoredImagePtr;
+
+// ----------------------------------------------------------------------------------------------------
+
+/**
+ * Keeps the images of all measurements within a memory budget. When the budget is exceeded, the least
+ * recently used images are compressed, and if that is not enough, the least recently used compressed
+ * images are moved to a spill file on disk. An image that is used again is loaded back into memory.
+ */
+class MeasurementStore
+{
+
+public:
+
+    /// The store shared by all measurements
+    static MeasurementStore& instance();
+
+    /// Sets the memory budget for all images in bytes (0 means unlimited). If 'spill_directory' is empty,
+    /// images are compressed but never spilled.
+    bool configure(std::size_t max_bytes, const std::string& spill_directory = "");
+
+    /// Adds the image to the store. Measurements of the same image share the returned entry.
+    StoredImagePtr add(const rgbd::ImageConstPtr& image);
+
+    struct Statistics
+    {
+        Statistics() : num_in_memory(0), num_compressed(0), num_spilled(0), memory_bytes(0), spilled_bytes(0), num_loads(0) {}
+
+        unsigned int num_in_memory;
+        unsigned int num_compressed;
+        unsigned int num_spilled;
+        std::size_t memory_bytes;
+        std::size_t spilled_bytes;
+        unsigned long num_loads;    ///< Number of times a compressed or spilled image was needed again
+    };
+
+    Statistics statistics() const;
+
+private:
+
+    friend class StoredImage;
+
+    MeasurementStore();
+
+    ~MeasurementStore();
+
+    mutable boost::mutex mutex_;
+
+    // Notified when an entry is no longer busy
+    boost::condition_variable idle_cond_;
+
+    // True while a thread brings the store within budget
+    bool enforcing_;
+
+    std::size_t max_bytes_;
+
+    // Most recently used first
+    std::list<StoredImage*> in_memory_;
+    std::list<StoredImage*> compressed_;
+
+    // Used to share entries between measurements of the same image
+    std::map<const rgbd::Image*, boost::weak_ptr<StoredImage> > entries_;
+
+    std::size_t memory_bytes_;
+    std::size_t compressed_bytes_;
+    std::size_t spilled_bytes_;
+    unsigned int num_spilled_;
+    unsigned long num_loads_;
+
+    // Spill file. It is unlinked directly after creation, such that it disappears when ED stops.
+    int spill_fd_;
+    std::size_t spill_end_;
+    std::multimap<std::size_t, std::size_t> spill_free_;    // size -> offset
+
+    // All functions below expect the mutex to be locked. Those that take the lock release it while they
+    // compress, decompress, read or write an image, and mark the entry busy in the meantime.
+
+    void waitUntilIdle(const StoredImage& e, boost::mutex::scoped_lock& lock);
+
+    void enforceBudget(boost::mutex::scoped_lock& lock);
+
+    void compress(StoredImage& e, boost::mutex::scoped_lock& lock);
+
+    bool spill(StoredImage& e, boost::mutex::scoped_lock& lock);
+
+    rgbd::ImageConstPtr load(StoredImage& e, boost::mutex::scoped_lock& lock);
+
+    void setIdle(StoredImage& e);
+
+    void releaseSpill(StoredImage& e);
+
+    void remove(StoredImage& e);
+
+};
+
+} // end namespace ed
+
+#endif
@@ -2,11 +2,16 @@
 #define ED_MODEL_LOADER_H_
 
 #include "ed/uuid.h"
+#include "ed/types.h"
+#include "ed/models/shape_cache.h"
 
 #include <map>
+#include <set>
 #include <geolib/datatypes.h>
 #include <tue/config/data_pointer.h>
 
+#include <boost/shared_ptr.hpp>
+
 #include <tue/config/reader.h>
 
 namespace ed
@@ -28,29 +33,152 @@ public:
 
     bool create(const tue::config::DataConstPointer& data, UpdateRequest& req, std::stringstream& error);
 
+    /// Creates the entity (and its composition) described by 'data'. The shapes are loaded in parallel.
     bool create(const tue::config::DataConstPointer& data, const UUID& id_opt, const UUID& parent_id,
                 UpdateRequest& req, std::stringstream& error, const std::string& model_path = "",
                 const geo::Pose3D& pose_offset = geo::Pose3D::identity());
 
+    /// Creates the entities described by 'items' in one request, loading the shapes of all items in parallel.
+    /// Returns false if an item could not be created, but still creates the others. None of the entities of a
+    /// failing item are added, also if only one of its shapes could not be loaded.
+    bool create(const std::vector<tue::config::DataConstPointer>& items, UpdateRequest& req, std::stringstream& error);
+
     bool exists(const std::string& type) const;
 
+    /// Model and shape files that were read so far
+    void getLoadedFiles(std::vector<std::string>& files) const;
+
+    /// Number of threads used to load shapes (default: number of cores)
+    void setNumThreads(unsigned int num_threads) { num_threads_ = num_threads; }
+
+    /// Adds a directory that contains models (in addition to ED_MODEL_PATH)
+    void addModelPath(const std::string& path) { model_paths_.push_back(path); }
+
+    /// Stores imported and triangulated shapes in 'directory', such that they are not created again in the next
+    /// run (default: ED_SHAPE_CACHE, if set)
+    bool setShapeCacheDirectory(const std::string& directory) { return file_cache_.open(directory); }
+
+    const ShapeCache& shapeCache() const { return file_cache_; }
+
 private:
 
+    // Pose as read from data, such that an instance can set single keys of the pose of its model
+    struct PoseFields
+    {
+        PoseFields() : x(0), y(0), z(0), roll(0), pitch(0), yaw(0) {}
+
+        double x, y, z, roll, pitch, yaw;
+
+        geo::Pose3D pose() const
+        {
+            geo::Pose3D p(x, y, z);
+            p.R.setRPY(roll, pitch, yaw);
+            return p;
+        }
+    };
+
+    // Entity fields read from model or instance data. An instance starts from the fields of its model and
+    // overwrites the keys it sets, as if the instance data were added to the model data.
+    struct EntityFields
+    {
+        EntityFields() : has_pose(false), has_composition(false), has_state_update(false),
+            has_state_update_group(false), has_original_pose(false), has_flags(false) {}
+
+        bool has_pose;
+        PoseFields pose;
+
+        bool has_composition;
+        std::vector<tue::config::DataConstPointer> composition;
+
+        std::string shape_model_path;
+        tue::config::DataConstPointer shape_data;
+
+        bool has_state_update;
+        ROIConstPtr roi;
+        MoveRestrictionsConstPtr move_restrictions;
+        StateDefinitionConstPtr state_definition;
+
+        bool has_state_update_group;
+        std::string state_update_group;
+
+        bool has_original_pose;
+        PoseFields original_pose;
+
+        bool has_flags;
+        std::vector<std::string> flags;
+    };
+
+    // Model type compiled once, such that creating an instance does not read the model data again
+    struct ModelTemplate
+    {
+        // Data of the model and its super types, shared by all instances
+        tue::config::DataConstPointer data;
+
+        // Super types and the type itself
+        std::vector<std::string> types;
+
+        EntityFields fields;
+
+        // Shape of the model, set when the first instance is loaded
+        geo::ShapePtr shape;
+    };
+
+    typedef boost::shared_ptr<ModelTemplate> ModelTemplatePtr;
+
+    // Shape of an entity, loaded after the model tree is resolved
+    struct ShapeJob
+    {
+        UUID id;
+        std::string model_path;
+        tue::config::DataConstPointer data;
+
+        // Template of which the entity uses the shape, if any
+        ModelTemplatePtr model;
+    };
+
     typedef std::pair<tue::config::DataConstPointer, std::vector<std::string> > ModelData;
 
     // Model name to model data
     std::map<std::string, ModelData> model_cache_;
 
+    // Model name to compiled model
+    std::map<std::string, ModelTemplatePtr> templates_;
+
     // Shape filename to shape
     std::map<std::string, geo::ShapePtr> shape_cache_;
 
+    // Persistent cache of imported and triangulated shapes
+    ShapeCache file_cache_;
+
     std::vector<std::string> model_paths_;
 
+    unsigned int num_threads_;
+
+    // Model files that were read
+    std::set<std::string> model_files_;
+
     tue::config::DataConstPointer loadModelData(const std::string& type, std::vector<std::string>& types, std::stringstream& error);
 
+    /// Returns the compiled model of 'type', or null if it cannot be loaded
+    ModelTemplatePtr loadModelTemplate(const std::string& type, std::stringstream& error);
+
+    /// Reads the entity fields of model or instance data into 'fields', overwriting only the fields that the
+    /// data sets. 'name' is used in messages.
+    void readFields(tue::config::Reader& r, const std::string& name, const std::string& model_path, EntityFields& fields);
+
     std::string getModelPath(const std::string& type) const;
 
-    void readPose(geo::Pose3D& pose, tue::config::Reader& r);
+    /// Reads the pose keys that are set. x, y and z are required if 'required' is true.
+    void readPose(PoseFields& pose, tue::config::Reader& r, bool required);
+
+    /// Phase one: resolves the model tree into 'req', and collects the shapes that must be loaded
+    bool createEntity(const tue::config::DataConstPointer& data, const UUID& id_opt, const UUID& parent_id,
+                      UpdateRequest& req, std::stringstream& error, const std::string& model_path,
+                      const geo::Pose3D& pose_offset, std::vector<ShapeJob>& shape_jobs);
+
+    /// Phase two: loads the shapes on a worker pool (each file once). 'shapes' gets the shape of each job, or null if
+    /// it could not be loaded. Returns false if a shape could not be loaded.
+    bool loadShapes(const std::vector<ShapeJob>& shape_jobs, std::vector<geo::ShapePtr>& shapes, std::stringstream& error);
 
 };
 
@@ -0,0 +1,71 @@
+#ifndef ED_MODELS_SHAPE_CACHE_H_
+#define ED_MODELS_SHAPE_CACHE_H_
+
+#include <geolib/datatypes.h>
+
+#include <boost/thread/mutex.hpp>
+
+#include <string>
+
+namespace ed
+{
+
+namespace models
+{
+
+/**
+ * Persistent cache of shapes that are expensive to create (imported meshes and triangulated heightmaps).
+ * Every shape is stored as a binary file in the cache directory, keyed by the source file and the loader
+ * parameters. An entry is only used if the size and modification time of the source file did not change.
+ * The levels of detail of LODShapes are stored with them. Entries are memory mapped when read. Thread-safe.
+ */
+class ShapeCache
+{
+
+public:
+
+    ShapeCache();
+
+    /// Uses 'directory' (created if needed) for the cache files
+    bool open(const std::string& directory);
+
+    bool isOpen() const { return !directory_.empty(); }
+
+    const std::string& directory() const { return directory_; }
+
+    /// Returns the shape created from 'filename' with loader parameters 'params', or null if it is not cached
+    geo::ShapePtr get(const std::string& filename, const std::string& params);
+
+    /// Stores the shape created from 'filename' with loader parameters 'params'
+    void put(const std::string& filename, const std::string& params, const geo::Shape& shape);
+
+    struct Statistics
+    {
+        Statistics() : hits(0), misses(0), writes(0) {}
+
+        unsigned int hits;
+        unsigned int misses;
+        unsigned int writes;
+    };
+
+    Statistics statistics() const;
+
+private:
+
+    std::string directory_;
+
+    mutable boost::mutex mutex_;
+
+    Statistics stats_;
+
+    unsigned int num_temp_files_;
+
+    std::string entryFilename(const std::string& filename, const std::string& params) const;
+
+};
+
+} // end namespace models
+
+} // end namespace ed
+
+#endif
@@ -7,19 +7,38 @@
 #include <tue/config/configuration.h>
 
 #include "ed/init_data.h"
+#include "ed/dirty_entity.h"
 
 namespace ed {
 
 struct WorldModel;
 struct UpdateRequest;
+struct CompactionMap;
 
 struct PluginInput
 {
     PluginInput(const WorldModel& world_, const std::vector<UpdateRequestConstPtr>& deltas_)
-        : world(world_), deltas(deltas_) {}
+        : world(world_), deltas(deltas_), dirty(noDirtyEntities()) {}
+
+    PluginInput(const WorldModel& world_, const std::vector<UpdateRequestConstPtr>& deltas_,
+                const std::vector<DirtyEntity>& dirty_)
+        : world(world_), deltas(deltas_), dirty(dirty_) {}
 
     const WorldModel& world;
     const std::vector<UpdateRequestConstPtr>& deltas;
+
+    /// The entities that changed since the previous process(), each once, sorted by id. At the first process()
+    /// of a plugin all entities of the world, with all components. An entity that was removed and added again
+    /// has both REMOVED and the components that were set; whether it exists is in the world.
+    const std::vector<DirtyEntity>& dirty;
+
+private:
+
+    static const std::vector<DirtyEntity>& noDirtyEntities()
+    {
+        static const std::vector<DirtyEntity> empty;
+        return empty;
+    }
 };
 
 class Plugin
@@ -40,6 +59,10 @@ public:
     virtual void initialize(InitData& init) {}
     virtual void process(const PluginInput& data, UpdateRequest& req) {}
 
+    /// Called (before process) when the world was compacted. Plugins that keep entity or relation indices
+    /// must replace them by the ones in 'map'.
+    virtual void remapIndices(const CompactionMap& map) {}
+
     const std::string& name() const { return name_; }
 
 private:
@@ -17,6 +17,7 @@ namespace ed
 {
 
 struct InitData;
+struct CompactionMap;
 
 class PluginContainer
 {
@@ -69,6 +70,14 @@ public:
     {
         boost::lock_guard<boost::mutex> lg(mutex_world_);
         world_deltas_.push_back(delta);
+        markDirty(*delta);
+    }
+
+    /// Adds a compaction of the world, which is passed to the plugin with the next world it gets
+    void addCompaction(const boost::shared_ptr<const CompactionMap>& map)
+    {
+        boost::lock_guard<boost::mutex> lg(mutex_world_);
+        compactions_.push_back(map);
     }
 
     bool isRunning() const { return is_running_; }
@@ -120,6 +129,17 @@ protected:
     // buffer of delta's since last process call
     std::vector<UpdateRequestConstPtr> world_deltas_;
 
+    // compactions of the world since last process call
+    std::vector<boost::shared_ptr<const CompactionMap> > compactions_;
+
+    // changed components per entity since last process call
+    std::map<UUID, unsigned int> dirty_;
+
+    // the entities of the world that is processed, at the first process call
+    bool all_dirty_;
+
+    void markDirty(const UpdateRequest& delta);
+
 };
 
 }
@@ -20,6 +20,8 @@ public:
 
     void insert(const Time& t, const geo::Pose3D& tf) { cache_.insert(t, tf); }
 
+    const TimeCache<geo::Pose3D>& cache() const { return cache_; }
+
 private:
 
     // Transforms, ordered in time
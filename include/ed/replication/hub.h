@@ -0,0 +1,146 @@
+#ifndef ED_REPLICATION_HUB_H_
+#define ED_REPLICATION_HUB_H_
+
+#include "ed/types.h"
+
+#include <geolib/datatypes.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ed
+{
+
+namespace replication
+{
+
+typedef boost::shared_ptr<const std::string> EncodedPtr;
+
+/// Property name with which a sync client asks for the response of the hub: queries that only have this
+/// property are answered by Hub::query(). Other queries get the entities with their index and the requested
+/// properties, as before.
+const char* const SYNC_QUERY = "__sync__";
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Pre-encoded state of one entity as it was after a certain revision
+struct EntityRecord
+{
+    EntityRecord() : removed(false) {}
+
+    std::string id;
+
+    bool removed;
+
+    /// JSON object with all entity fields except the mesh
+    EncodedPtr body;
+
+    /// JSON object containing the mesh. Null if the shape did not change in this revision
+    EncodedPtr shape;
+
+    /// Content hash of the mesh (only set if 'shape' is set)
+    std::string shape_hash;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+/// All entity records belonging to one revision (delta) or to a range of revisions (snapshot)
+struct Segment
+{
+    Segment() : revision(0) {}
+
+    unsigned long revision;
+
+    std::vector<EntityRecord> records;
+};
+
+typedef boost::shared_ptr<const Segment> SegmentConstPtr;
+
+// ----------------------------------------------------------------------------------------------------
+
+/**
+ * Keeps the last K encoded revision deltas plus a periodically compacted snapshot, such that
+ * any number of sync clients can be served by concatenating pre-encoded segments. Every revision
+ * is encoded exactly once, regardless of the number of clients.
+ *
+ * Meshes are content addressed: a response contains each mesh at most once, and meshes that were
+ * already published before the revision of the client are only referenced by their hash. Clients
+ * that do not know a referenced mesh can query the entity by id to obtain it.
+ */
+class Hub
+{
+
+public:
+
+    Hub(unsigned int max_deltas = 100, unsigned int snapshot_interval = 50);
+
+    ~Hub();
+
+    void configure(unsigned int max_deltas, unsigned int snapshot_interval);
+
+    /// Replaces all revisions by a snapshot of 'world', such that the hub can start with any world. Clients that
+    /// are behind get the full state.
+    void reset(const WorldModel& world);
+
+    /// Encodes the entities touched by 'req'. Must be called after 'world' has been updated with 'req'.
+    void addRevision(const WorldModel& world, const UpdateRequest& req);
+
+    /// Writes the JSON query response that brings a client at 'since_revision' up to date
+    void query(unsigned long since_revision, std::string& response, unsigned long& new_revision) const;
+
+    unsigned long revision() const { return revision_; }
+
+    unsigned long snapshotRevision() const { return snapshot_->revision; }
+
+    std::size_t numDeltas() const { return deltas_.size(); }
+
+private:
+
+    unsigned int max_deltas_;
+
+    unsigned int snapshot_interval_;
+
+    unsigned long revision_;
+
+    std::deque<SegmentConstPtr> deltas_;
+
+    SegmentConstPtr snapshot_;
+
+    void compact();
+
+    /// Encodes entity 'id' of 'world'. Its mesh is only encoded if it changed in the last revision, unless
+    /// 'with_shape' is true.
+    void encode(const WorldModel& world, const UUID& id, EntityRecord& rec, bool with_shape = false);
+
+    void pruneShapes();
+
+
+    // Content addressing of meshes
+
+    struct HashedShape
+    {
+        boost::weak_ptr<const geo::Shape> shape;
+        std::string hash;
+    };
+
+    // Shapes are usually shared between entities, so cache the hashes by pointer
+    std::map<const geo::Shape*, HashedShape> shape_hashes_;
+
+    // Encoded mesh per hash, shared by all records with the same mesh
+    std::map<std::string, boost::weak_ptr<const std::string> > encoded_meshes_;
+
+    // Revision in which the mesh with a certain hash was first published
+    std::map<std::string, unsigned long> mesh_revisions_;
+
+};
+
+} // end namespace replication
+
+} // end namespace ed
+
+#endif
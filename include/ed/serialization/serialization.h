@@ -6,6 +6,8 @@
 
 #include <geolib/datatypes.h>
 
+#include <vector>
+
 namespace tue {
 namespace config {
 class Reader;
@@ -21,6 +23,8 @@ class Entity;
 class UpdateRequest;
 class ConvexHull;
 class ImageMask;
+class ShapeStore;
+class UUID;
 
 namespace io
 {
@@ -42,6 +46,10 @@ namespace ed
 
 bool deserialize(io::Reader &r, UpdateRequest& req);
 
+/// Shares meshes with equal content via 'shape_store'. Entities of which the mesh is referenced by a hash
+/// that is not in the store are added to 'unresolved_shapes', such that their meshes can be requested.
+bool deserialize(io::Reader &r, UpdateRequest& req, ShapeStore& shape_store, std::vector<UUID>& unresolved_shapes);
+
 
 void serialize(const geo::Pose3D& pose, ed::io::Writer& w);
 
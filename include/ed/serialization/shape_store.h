@@ -0,0 +1,45 @@
+#ifndef ED_SERIALIZATION_SHAPE_STORE_H_
+#define ED_SERIALIZATION_SHAPE_STORE_H_
+
+#include <geolib/datatypes.h>
+
+#include <map>
+#include <string>
+
+namespace ed
+{
+
+/// Content hash of the vertices and triangles of a shape (16 hexadecimal characters)
+std::string shapeHash(const geo::Shape& s);
+
+// ----------------------------------------------------------------------------------------------------
+
+/**
+ * Receiver-side store of deserialized shapes, keyed by content hash. Entities whose meshes have
+ * the same content share one shape in memory, and meshes can be referenced by hash only.
+ */
+class ShapeStore
+{
+
+public:
+
+    /// Returns the stored shape with the given hash. If there is none, 'shape' is stored and returned.
+    geo::ShapeConstPtr add(const std::string& hash, const geo::ShapeConstPtr& shape);
+
+    /// Returns the stored shape with the given hash, or a null pointer if it is unknown
+    geo::ShapeConstPtr get(const std::string& hash) const;
+
+    /// Removes all shapes that are not used outside the store
+    void prune();
+
+    std::size_t size() const { return shapes_.size(); }
+
+private:
+
+    std::map<std::string, geo::ShapeConstPtr> shapes_;
+
+};
+
+} // end namespace ed
+
+#endif
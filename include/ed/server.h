@@ -12,6 +12,15 @@
 
 #include <ed/models/model_loader.h>
 
+#include "ed/replication/hub.h"
+#include "ed/evictor.h"
+#include "ed/world_history.h"
+
+#include "ed/io/filesystem/snapshot.h"
+#include "ed/io/filesystem/journal.h"
+#include "ed/io/filesystem/recorder.h"
+#include "ed/io/filesystem/measurement_archive.h"
+
 #include "ed/property_key_db.h"
 
 #include "tue/config/configuration.h"
@@ -40,7 +49,18 @@ public:
 
     void update(const std::string& update_str, std::string& error);
 
-    void storeEntityMeasurements(const std::string& path) const;
+    /// Appends the last measurement of every entity to 'path'/measurements.archive (written in the background)
+    void storeEntityMeasurements(const std::string& path);
+
+    /// Writes a binary snapshot of the current world model
+    bool saveSnapshot(const std::string& filename) const;
+
+    /// Replaces the current world model by the snapshot
+    bool loadSnapshot(const std::string& filename);
+
+    /// Should be called when ED stops (saves the world snapshot if configured, closes the journal, recording and
+    /// measurement archive)
+    void shutdown();
 
     WorldModelConstPtr world_model() const { return world_model_; }
 
@@ -48,10 +68,22 @@ public:
 
     PluginContainerPtr loadPlugin(const std::string& plugin_name, tue::Configuration config);
 
+    /// Adds a plugin container that was set up without loading a plugin library (used in tests)
+    void addPluginContainer(const PluginContainerPtr& container);
+
     void stepPlugins();
 
     void publishStatistics() const;
 
+    /// Starts encoding the revisions of the world for sync clients, if it did not yet. Done when 'replication' is
+    /// configured, or else on the first sync query.
+    void enableReplication();
+
+    const replication::Hub& replicationHub() const { return replication_hub_; }
+
+    /// Past states of the world model (empty unless configured)
+    const WorldHistory& history() const { return history_; }
+
     const PropertyKeyDBEntry* getPropertyKeyDBEntry(const std::string& name) const
     {
         return property_key_db_.getPropertyKeyDBEntry(name);
@@ -69,9 +101,43 @@ private:
 
     void initializeWorld();
 
+    /// Passes an applied update request to the replication hub, the journal and the recorder
+    void recordRevision(const WorldModel& world, const UpdateRequest& req);
+
+    /// Opens the journal and restores the world from it
+    void recoverJournal(const std::string& directory);
+
     //! Model loading
     models::ModelLoader model_loader_;
 
+    //! Encoded revisions for sync clients (only kept once there is a sync client or replication is configured)
+    replication::Hub replication_hub_;
+    bool replication_enabled_;
+
+    //! World snapshot
+    std::string snapshot_file_;
+    bool save_snapshot_on_shutdown_;
+    SnapshotHeader snapshot_header_;
+
+    //! Crash recovery
+    Journal journal_;
+    unsigned int journal_checkpoint_interval_;
+
+    //! Compact the world when at least this many (and more than half of the) entity slots are empty (0: never)
+    unsigned int compaction_min_free_slots_;
+
+    //! Removes entities whose time-to-live expired
+    Evictor evictor_;
+
+    //! Past states of the world model, for time-travel queries
+    WorldHistory history_;
+
+    //! Recording of the update stream
+    Recorder recorder_;
+
+    //! Stored entity measurements
+    MeasurementArchiveWriter measurement_archive_;
+
     //! Sensor data
     std::map<std::string, SensorModulePtr> sensors_;
     tf::TransformListener tf_listener_;
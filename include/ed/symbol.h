@@ -0,0 +1,74 @@
+#ifndef ED_SYMBOL_H_
+#define ED_SYMBOL_H_
+
+#include <boost/cstdint.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace ed
+{
+
+/// Id of an interned string (such as an entity type or flag). Ids are process-wide, dense and never reused.
+typedef unsigned int SymbolId;
+
+/// Id that no symbol has
+static const SymbolId INVALID_SYMBOL = std::numeric_limits<SymbolId>::max();
+
+/// Returns the id of 'name', which is added to the process-wide symbol table if needed. Thread-safe; only
+/// locks if the symbol is new.
+SymbolId internSymbol(const std::string& name);
+
+/// Sets 'id' to the id of 'name' if it was interned before, without adding it. Thread-safe and lock-free.
+bool findSymbol(const std::string& name, SymbolId& id);
+
+/// Returns the name of symbol 'id'. Thread-safe and lock-free.
+const std::string& symbolName(SymbolId id);
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Set of symbols. The first 64 symbols of the process are stored as bits, others in a sorted vector.
+class SymbolSet
+{
+
+public:
+
+    SymbolSet() : bits_(0) {}
+
+    bool contains(SymbolId id) const
+    {
+        if (id < 64)
+            return (bits_ >> id) & 1;
+        return std::binary_search(overflow_.begin(), overflow_.end(), id);
+    }
+
+    void insert(SymbolId id);
+
+    void erase(SymbolId id);
+
+    bool empty() const { return bits_ == 0 && overflow_.empty(); }
+
+    /// Ids of the symbols, in increasing order
+    void ids(std::vector<SymbolId>& ids) const;
+
+    /// Names of the symbols
+    std::set<std::string> names() const;
+
+    bool operator==(const SymbolSet& other) const { return bits_ == other.bits_ && overflow_ == other.overflow_; }
+
+    bool operator!=(const SymbolSet& other) const { return !(*this == other); }
+
+private:
+
+    boost::uint64_t bits_;
+
+    std::vector<SymbolId> overflow_;
+
+};
+
+} // end namespace ed
+
+#endif
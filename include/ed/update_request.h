@@ -95,7 +95,8 @@ public:
     void removeConvexHullNew(const UUID& id, const std::string& source)
     {
         // For now, signal that the convex hull must be removed by setting an empty chull
-        ed::MeasurementConvexHull& m = convex_hulls_new[id][source];
+        convex_hulls_new[id][source] = ed::MeasurementConvexHull();
+        flagUpdated(id);
     }
 
 
@@ -122,7 +123,7 @@ public:
 
     std::map<UUID, double> last_update_timestamps;
 
-    void setLastUpdateTimestamp(const UUID& id, double t) { last_update_timestamps[id] = t; }
+    void setLastUpdateTimestamp(const UUID& id, double t) { last_update_timestamps[id] = t; flagUpdated(id); }
 
 
     // POSES
@@ -196,6 +197,10 @@ public:
 
     void setFlag(const UUID& id, const std::string& flag) { added_flags[id] = flag; flagUpdated(id); }
 
+    std::map<ed::UUID, std::set<std::string> > flag_sets_added;
+
+    void addFlag(const UUID& id, const std::string& flag) { flag_sets_added[id].insert(flag); flagUpdated(id); }
+
     std::map<ed::UUID, std::string> removed_flags;
 
     void removeFlag(const UUID& id, const std::string& flag) { removed_flags[id] = flag; flagUpdated(id); }
@@ -208,6 +213,9 @@ public:
 
     bool empty() const { return updated_entities.empty(); }
 
+    /// Adds the contents of 'req', as if its setters were called on this request after the current ones
+    void add(const UpdateRequest& req);
+
 
     // Is true if the update was created for synchronization only (used by ed_cloud)
 
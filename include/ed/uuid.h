@@ -2,39 +2,79 @@
 #define ED_UUID_H_
 
 #include "ed/types.h"
+
+#include <boost/cstdint.hpp>
+
+#include <ostream>
 #include <string>
 
 namespace ed
 {
 
+/**
+ * Entity id. Generated ids are 128 random bits, stored inline, and are written as 32 lowercase hex
+ * characters. Any other string (such as a human-readable id from a YAML file) is kept in a process-wide
+ * table of interned names, and the id only stores the address of its name. Comparing, ordering and hashing
+ * ids never touches strings, and str() reads the name without locking.
+ *
+ * Interned names are never freed. Ids that come from clients and are only used to look up entities should
+ * therefore be converted with find(), which does not intern.
+ */
 class UUID
 {
 
 public:
 
-    UUID() : idx(INVALID_IDX) {}
-    UUID(const char* s) : id_(s), idx(INVALID_IDX) {}
-    UUID(const std::string& s) : id_(s), idx(INVALID_IDX) {}
+    UUID() : hi_(0), lo_(0), named_(true), idx(INVALID_IDX) {}
+    UUID(const char* s) : idx(INVALID_IDX) { fromString(s); }
+    UUID(const std::string& s) : idx(INVALID_IDX) { fromString(s); }
+
+    /// Returns a new random id. Uses a generator per thread, so does not lock.
+    static UUID generate();
+
+    /// Sets 'id' to the id of 's' without interning it. Returns false if 's' is a name that was never
+    /// interned, in which case no entity has this id. Thread-safe.
+    static bool find(const std::string& s, UUID& id);
+
+    inline bool operator<(const UUID& rhs) const
+    {
+        if (hi_ != rhs.hi_)
+            return hi_ < rhs.hi_;
+        if (lo_ != rhs.lo_)
+            return lo_ < rhs.lo_;
+        return named_ < rhs.named_;
+    }
+
+    inline bool operator==(const UUID& rhs) const { return lo_ == rhs.lo_ && hi_ == rhs.hi_ && named_ == rhs.named_; }
+
+    inline bool operator!=(const UUID& rhs) const { return !(*this == rhs); }
 
-    inline bool operator<(const UUID& rhs) const { return id_ < rhs.id_; }
+    /// Whether this is the empty id
+    inline bool empty() const { return named_ && lo_ == 0; }
 
-    inline bool operator==(const UUID& rhs) const { return id_ == rhs.id_; }
+    /// Whether this id is an interned name instead of a generated id
+    inline bool isName() const { return named_; }
 
-    inline bool operator!=(const UUID& rhs) const { return id_ != rhs.id_; }
+    inline boost::uint64_t high() const { return hi_; }
 
-    inline const char* c_str() const { return id_.c_str(); }
+    inline boost::uint64_t low() const { return lo_; }
 
-    inline const std::string& str() const { return id_; }
+    std::string str() const;
 
     friend std::ostream& operator<< (std::ostream& out, const UUID& d)
     {
-        out << d.id_;
+        out << d.str();
         return out;
     }
 
 private:
 
-    std::string id_;
+    void fromString(const std::string& s);
+
+    // For names, hi_ is 0 and lo_ is the address of the name in the name table, or 0 for the empty string
+    boost::uint64_t hi_;
+    boost::uint64_t lo_;
+    bool named_;
 
 public:
 
@@ -42,6 +82,13 @@ public:
 
 };
 
+inline std::size_t hash_value(const UUID& id)
+{
+    // Generated ids are random, but the low bits of the address of a name are always zero
+    boost::uint64_t h = (id.low() ^ (id.high() * 0x9e3779b97f4a7c15ull) ^ id.isName()) * 0xbf58476d1ce4e5b9ull;
+    return static_cast<std::size_t>(h ^ (h >> 32));
+}
+
 } // end namespace ed
 
 #endif
@@ -0,0 +1,131 @@
+#ifndef ED_WORLD_HISTORY_H_
+#define ED_WORLD_HISTORY_H_
+
+#include "ed/types.h"
+#include "ed/uuid.h"
+
+#include <boost/unordered_map.hpp>
+
+#include <deque>
+#include <vector>
+
+namespace ed
+{
+
+/**
+ * Past states of the world model, for queries such as "where was this entity at time t" or "which entities
+ * were there 30 seconds ago". Entities are immutable and shared between world models, so the history keeps,
+ * per entity, pointers to the versions it had. An entity that did not change costs nothing, and each added
+ * world only costs its changes, which are found with WorldModel::diff().
+ *
+ * Revisions older than the window are dropped, oldest first, and so are revisions beyond the memory budget.
+ * The memory estimate covers the bookkeeping and the replaced entity versions, but not their measurements,
+ * shapes and data, which are shared with newer versions.
+ */
+class WorldHistory
+{
+
+public:
+
+    /// Point in the history. If at_revision is set, at_time is not used.
+    struct Query
+    {
+        Query() : at_time(0), at_revision(0) {}
+
+        /// Time, in the clock passed to add()
+        double at_time;
+
+        /// Revision of the world model (0: use at_time)
+        unsigned long at_revision;
+    };
+
+    WorldHistory();
+
+    ~WorldHistory();
+
+    /// Keeps the revisions of the last 'window' seconds (0 disables the history), using at most about
+    /// 'max_memory' bytes (0: no limit)
+    void configure(double window, std::size_t max_memory);
+
+    bool enabled() const { return window_ > 0; }
+
+    void clear();
+
+    /// Adds 'world' as the state since 'time'. 'world' must be a later copy of the world that was added
+    /// before, and 'time' may not decrease. Revisions of the world between two calls are not kept.
+    void add(const WorldModelConstPtr& world, double time);
+
+    /// Sets 'revision' and 'time' to the revision that was the current one at 'q'. Returns false if 'q' is
+    /// before the oldest kept revision.
+    bool resolve(const Query& q, unsigned long& revision, double& time) const;
+
+    /// Sets 'e' to entity 'id' as it was at 'q', or to null if it did not exist then. Returns false if 'q' is
+    /// before the oldest kept revision. Takes O(log k) for an entity with k versions.
+    bool entity(const UUID& id, const Query& q, EntityConstPtr& e) const;
+
+    /// Sets 'entities' to all entities as they were at 'q', in no particular order. Returns false if 'q' is
+    /// before the oldest kept revision. The relations of the entities refer to the world of that time.
+    bool entities(const Query& q, std::vector<EntityConstPtr>& entities) const;
+
+    std::size_t numRevisions() const { return revisions_.size(); }
+
+    /// Time of the oldest kept revision (0 if the history is empty)
+    double oldestTime() const { return revisions_.empty() ? 0 : revisions_.front().time; }
+
+    /// Estimate of the memory used by the history, in bytes
+    std::size_t memoryUsage() const { return memory_usage_; }
+
+private:
+
+    struct Version
+    {
+        Version(unsigned long revision_, const EntityConstPtr& e_) : revision(revision_), e(e_) {}
+
+        unsigned long revision;
+
+        /// Null if the entity was removed
+        EntityConstPtr e;
+    };
+
+    struct Revision
+    {
+        unsigned long revision;
+        double time;
+
+        /// Entities that got a new version in this revision
+        std::vector<UUID> changed;
+    };
+
+    double window_;
+
+    std::size_t max_memory_;
+
+    std::size_t memory_usage_;
+
+    // The world that was added last
+    WorldModelConstPtr world_;
+
+    std::deque<Revision> revisions_;
+
+    // Versions of each entity, ordered by revision. The first one may be older than the oldest revision: it is
+    // the version of the entity at that revision.
+    boost::unordered_map<UUID, std::vector<Version> > versions_;
+
+    void addVersion(const UUID& id, unsigned long revision, const EntityConstPtr& e, Revision& rev);
+
+    void dropOldestRevision();
+
+    /// Returns the version of 'versions' at 'revision', or null
+    static EntityConstPtr versionAt(const std::vector<Version>& versions, unsigned long revision);
+
+    static bool revisionBefore(unsigned long revision, const Revision& rev) { return revision < rev.revision; }
+
+    static bool timeBefore(double time, const Revision& rev) { return time < rev.time; }
+
+    static bool versionBefore(unsigned long revision, const Version& v) { return revision < v.revision; }
+
+};
+
+} // end namespace ed
+
+#endif
@@ -3,9 +3,16 @@
 
 #include "ed/types.h"
 #include "ed/time.h"
+#include "ed/symbol.h"
+#include "ed/uuid.h"
+#include "ed/dirty_entity.h"
+#include "ed/copy_on_write.h"
 
 #include <geolib/datatypes.h>
 
+#include <boost/unordered_map.hpp>
+#include <boost/shared_ptr.hpp>
+
 #include <queue>
 
 namespace ed
@@ -16,6 +23,63 @@ class PropertyKeyDBEntry;
 
 // ----------------------------------------------------------------------------------------------------
 
+/// Axis-aligned bounding box of the convex hull of an entity, in world coordinates. Empty if the entity has no
+/// convex hull.
+struct EntityBox
+{
+    EntityBox() : min(1, 1, 1), max(0, 0, 0) {}
+
+    bool empty() const { return min.x > max.x; }
+
+    geo::Vec3 min, max;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Handle to an entity or relation slot. The generation of a slot increases when its entity (or relation) is
+/// removed or moved, such that a handle never refers to an entity that later takes the same slot.
+struct Handle
+{
+    Handle() : idx(INVALID_IDX), generation(0) {}
+
+    Handle(Idx idx_, unsigned int generation_) : idx(idx_), generation(generation_) {}
+
+    Idx idx;
+    unsigned int generation;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Result of WorldModel::compact(): the new index of every old entity and relation index (INVALID_IDX for
+/// empty slots). Indices keep their order.
+struct CompactionMap
+{
+    std::vector<Idx> entities;
+    std::vector<Idx> relations;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Result of WorldModel::diff(). The ids of added and changed entities have their index in the newer world set.
+struct WorldDiff
+{
+    /// Entities that are in the newer world, but not in the older one, in order of index
+    std::vector<UUID> added;
+
+    /// Entities that are in the older world, but not in the newer one
+    std::vector<UUID> removed;
+
+    /// Entities that are in both worlds, but changed, in order of index. Changes that are not in the pose,
+    /// shape, convex hull, data, types or flags (such as measurements, relations or properties) are OTHER.
+    std::vector<DirtyEntity> changed;
+
+    bool empty() const { return added.empty() && removed.empty() && changed.empty(); }
+
+    void clear() { added.clear(); removed.clear(); changed.clear(); }
+};
+
+// ----------------------------------------------------------------------------------------------------
+
 class WorldModel
 {
 
@@ -82,8 +146,45 @@ public:
 
     size_t numEntities() const { return entity_map_.size(); }
 
+    /// Handle to the entity in slot 'idx'
+    Handle entityHandle(Idx idx) const { return Handle(idx, entity_generations_[idx]); }
+
+    /// Returns the entity of 'h', or null if that entity was removed or moved since the handle was taken
+    EntityConstPtr getEntity(const Handle& h) const
+    {
+        if (h.idx < entities_.size() && entity_generations_[h.idx] == h.generation)
+            return entities_[h.idx];
+        return EntityConstPtr();
+    }
+
+    /// Handle to the relation in slot 'r_idx'
+    Handle relationHandle(Idx r_idx) const { return Handle(r_idx, relation_generations_[r_idx]); }
+
+    /// Returns the relation of 'h', or null if that relation was removed or moved since the handle was taken
+    RelationConstPtr getRelation(const Handle& h) const
+    {
+        if (h.idx < relations_.size() && relation_generations_[h.idx] == h.generation)
+            return relations_[h.idx];
+        return RelationConstPtr();
+    }
+
+    /// Number of entity slots that are empty, and will be reused or removed by compact()
+    size_t numFreeEntitySlots() const { return entity_empty_spots_.size(); }
+
+    /// Moves all entities and relations to the front of their arrays, such that there are no empty slots, and
+    /// sets 'map' to how indices changed. Entities that moved get a new revision. Everything that keeps
+    /// indices into this world (including plugins) must apply 'map'.
+    void compact(CompactionMap& map);
+
     void update(const UpdateRequest& req);
 
+    /// Sets 'diff' to the entities that were added, removed or changed since 'older', which must be an earlier
+    /// copy of this world (or of a world this world was copied from). Unchanged entities are shared by both
+    /// worlds and their slots have a revision of at most the revision of 'older', so blocks of slots without
+    /// changes are skipped, and the time depends on the number of changes rather than on the size of the world.
+    /// Entities that only moved to another slot (see compact()) are not reported.
+    void diff(const WorldModel& older, WorldDiff& diff) const;
+
     void setRelation(Idx parent, Idx child, const RelationConstPtr& r);
 
     bool findEntityIdx(const UUID& id, Idx& idx) const;
@@ -102,13 +203,60 @@ public:
 
     const std::vector<unsigned long>& entity_shape_revisions() const { return entity_shape_revisions_; }
 
+    // Dense tables, indexed like entities(), such that all entities can be scanned without touching them.
+    // Slots without an entity have alive 0, has_pose 0 and an empty box. The tables are shared in chunks between
+    // copies of the world, such that a copy only copies the chunks of the entities it changes.
+
+    const ChunkedArray<geo::Pose3D>& entity_poses() const { return entity_poses_; }
+
+    const ChunkedArray<unsigned char>& entity_has_pose() const { return entity_has_pose_; }
+
+    const ChunkedArray<EntityBox>& entity_boxes() const { return entity_boxes_; }
+
+    const ChunkedArray<unsigned char>& entity_alive() const { return entity_alive_; }
+
+    /// Indices of all entities, in increasing order
+    const std::vector<Idx>& live_entities() const { return *live_entities_; }
+
     const PropertyKeyDBEntry* getPropertyInfo(const std::string& name) const;
 
+    /// Indices (into entities()) of the entities that have type 'type', in increasing order. The indexes are
+    /// updated with the world model. Use intersect() to combine them.
+    const std::vector<Idx>& entitiesWithType(SymbolId type) const { return lookupIndex(type_index_, type); }
+
+    const std::vector<Idx>& entitiesWithType(const std::string& type) const;
+
+    /// Indices of the entities that have flag 'flag', in increasing order
+    const std::vector<Idx>& entitiesWithFlag(SymbolId flag) const { return lookupIndex(flag_index_, flag); }
+
+    const std::vector<Idx>& entitiesWithFlag(const std::string& flag) const;
+
+    /// Indices of the entities that have a shape, in increasing order
+    const std::vector<Idx>& entitiesWithShape() const { return *shape_index_; }
+
+    /// Indices of the entities that have a convex hull, in increasing order
+    const std::vector<Idx>& entitiesWithConvexHull() const { return *convex_hull_index_; }
+
+    /// Sets 'idxs' to the indices of the entities whose id is a name (not a generated id) that starts with
+    /// 'prefix', in order of id. Takes O(log n + k).
+    void entitiesWithPrefix(const std::string& prefix, std::vector<Idx>& idxs) const;
+
+    /// Sets 'result' to the indices that are in both 'a' and 'b'
+    static void intersect(const std::vector<Idx>& a, const std::vector<Idx>& b, std::vector<Idx>& result);
+
 private:
 
     unsigned long revision_;
 
-    std::map<UUID, Idx> entity_map_;
+    typedef boost::unordered_map<UUID, Idx> EntityMap;
+
+    EntityMap entity_map_;
+
+    typedef std::map<std::string, Idx> NameIndex;
+
+    // Entities with a name id, sorted by name, for prefix queries. Shared between copies of the world, and only
+    // copied by a copy that changes it (see nameIndex()).
+    boost::shared_ptr<NameIndex> name_index_;
 
     std::vector<EntityConstPtr> entities_;
 
@@ -116,18 +264,76 @@ private:
 
     std::vector<unsigned long> entity_shape_revisions_;
 
+    // Highest entity revision of each block of 64 slots, such that diff() can skip blocks that did not change
+    std::vector<unsigned long> entity_block_revisions_;
+
+    // Per slot; never shrinks, such that handles to slots beyond the end stay invalid
+    std::vector<unsigned int> entity_generations_;
+
+    ChunkedArray<geo::Pose3D> entity_poses_;
+
+    ChunkedArray<unsigned char> entity_has_pose_;
+
+    ChunkedArray<EntityBox> entity_boxes_;
+
+    ChunkedArray<unsigned char> entity_alive_;
+
+    // Shared like the indexes below
+    boost::shared_ptr<std::vector<Idx> > live_entities_;
+
     std::queue<Idx> entity_empty_spots_;
 
     std::vector<RelationConstPtr> relations_;
 
+    std::vector<unsigned int> relation_generations_;
+
+    std::queue<Idx> relation_empty_spots_;
+
     const PropertyKeyDB* property_info_db_;
 
+    // Sorted lists of entity indices. They are shared between copies of the world, and only copied by a copy that
+    // changes them (see writable()).
+
+    typedef boost::shared_ptr<std::vector<Idx> > IndexPtr;
+
+    std::map<SymbolId, IndexPtr> type_index_;
+
+    std::map<SymbolId, IndexPtr> flag_index_;
+
+    IndexPtr shape_index_;
+
+    IndexPtr convex_hull_index_;
+
+    static const std::vector<Idx>& lookupIndex(const std::map<SymbolId, IndexPtr>& index, SymbolId id);
+
+    /// Moves entity 'idx' in the indexes from what 'old_e' has to what 'new_e' has (both may be null)
+    void updateIndexes(Idx idx, const EntityConstPtr& old_e, const EntityConstPtr& new_e);
+
+    /// Sets the dense tables of entity 'idx' to 'e' (null if removed)
+    void updateTables(Idx idx, const EntityConstPtr& e);
+
     Idx addRelation(const RelationConstPtr& r);
 
+    /// Removes the relations of entity 'idx' from the entities on their other side, and frees their slots
+    void removeRelations(Idx idx);
+
+    void setRelation(Idx parent, Idx child, const RelationConstPtr& r, std::map<UUID, EntityPtr>& new_entities);
+
+    /// Returns the name index for changing it, after copying it if it is shared with another world
+    NameIndex& nameIndex();
+
     EntityPtr getOrAddEntity(const UUID& id, std::map<UUID, EntityPtr>& new_entities);
 
     Idx addNewEntity(const EntityConstPtr& e);
 
+    /// Sets the revision of slot 'idx' to the current revision
+    void setEntityRevision(Idx idx);
+
+    /// Adds the difference between 'e_old', the entity in slot 'idx' of 'older', and 'e_new', the entity in
+    /// slot 'idx' of this world, to 'diff' (both may be null)
+    void diffSlot(const WorldModel& older, Idx idx, const EntityConstPtr& e_old, const EntityConstPtr& e_new,
+                  WorldDiff& diff) const;
+
 
 };
 
@@ -76,11 +76,18 @@ bool BuilderPlugin::srvSetEntity(ed_msgs::SetEntity::Request& req, ed_msgs::SetE
     }
     else if (req.action == ed_msgs::SetEntity::Request::DELETE)
     {
-        update_req_->removeEntity(req.id);
+        // An id that was never interned is not in the world
+        ed::UUID id;
+        if (ed::UUID::find(req.id, id))
+            update_req_->removeEntity(id);
     }
     else if (req.action == ed_msgs::SetEntity::Request::UPDATE_POSE)
     {
-        ed::EntityConstPtr e = world_model_->getEntity(req.id);
+        ed::UUID id;
+        ed::EntityConstPtr e;
+        if (ed::UUID::find(req.id, id))
+            e = world_model_->getEntity(id);
+
         if (e)
         {
             geo::Pose3D new_pose;
@@ -3,6 +3,8 @@
 #include <ed/entity.h>
 #include <ed/measurement.h>
 #include <ed/world_model.h>
+#include <ed/instanced_shape.h>
+#include <ed/lod_shape.h>
 
 #include <rgbd/Image.h>
 #include <rgbd/View.h>
@@ -99,7 +101,7 @@ int hash(const char *str, int max_val)
 
 cv::Scalar idToColor(const ed::UUID& id)
 {
-    int i = hash(id.c_str(), 7);
+    int i = hash(id.str().c_str(), 7);
     return cv::Scalar(BLUES[i], GREENS[i], REDS[i]);
 }
 
@@ -300,6 +302,9 @@ void GUIPlugin::publishMapImage()
 
     cv::Mat z_buffer(map_image_.rows, map_image_.cols, CV_32FC1, 0.0);
 
+    // Details smaller than half a pixel (at the ground plane) are not visible
+    double lod_tolerance = 0.5 * projector_pose_.t.z / projector_.getFocalLengthX();
+
     for(ed::WorldModel::const_iterator it_entity = world_model_->begin(); it_entity != world_model_->end(); ++it_entity)
     {
         const ed::EntityConstPtr& e = *it_entity;
@@ -309,9 +314,13 @@ void GUIPlugin::publishMapImage()
             cv::Scalar color = idToColor(e->id());
             cv::Vec3b color_vec(0.5 * color[0], 0.5 * color[1], 0.5 * color[2]);
 
-            geo::Pose3D pose = projector_pose_.inverse() * e->pose();
+            // Render the shared mesh of instanced shapes with the instance transform
+            geo::Pose3D shape_transform;
+            const geo::Mesh& mesh = ed::levelOfDetail(*e->shape(), lod_tolerance, shape_transform);
+
+            geo::Pose3D pose = projector_pose_.inverse() * e->pose() * shape_transform;
             geo::RenderOptions opt;
-            opt.setMesh(e->shape()->getMesh(), pose);
+            opt.setMesh(mesh, pose);
 
             ColorRenderResult res(map_image_, z_buffer, color_vec, projector_pose_.t.z - 3, projector_pose_.t.z + 1);
 
@@ -390,7 +399,12 @@ void GUIPlugin::publishMapImage()
             last_measurement = e->lastMeasurement();
     }
 
+    // Null if the measurement store could not load the image
+    rgbd::ImageConstPtr last_image;
     if (last_measurement)
+        last_image = last_measurement->image();
+
+    if (last_image)
     {
         const geo::Pose3D& sensor_pose = last_measurement->sensorPose();
 
@@ -400,7 +414,7 @@ void GUIPlugin::publishMapImage()
 
         cv::circle(map_image_, p_2d, 10, cv::Scalar(255, 255, 255));
 
-        rgbd::View view(*last_measurement->image(), 100); // width doesnt matter; we'll go back to world coordinates anyway
+        rgbd::View view(*last_image, 100); // width doesnt matter; we'll go back to world coordinates anyway
         geo::Vector3 p1 = view.getRasterizer().project2Dto3D(0, 0) * 3;
         geo::Vector3 p2 = view.getRasterizer().project2Dto3D(view.getWidth() - 1, 0) * 3;
         geo::Vector3 p3 = view.getRasterizer().project2Dto3D(0, view.getHeight() - 1) * 3;
@@ -460,9 +474,15 @@ bool GUIPlugin::srvGetMeasurements(ed_msgs::GetMeasurements::Request& req, ed_ms
         return true;
 
     ed::MeasurementConstPtr m = e->bestMeasurement();
+
+    // Holds the image while it is used, and is null if the measurement store could not load it
+    rgbd::ImageConstPtr image;
     if (m)
+        image = m->image();
+
+    if (image)
     {
-        const cv::Mat& rgb_image = m->image()->getRGBImage();
+        const cv::Mat& rgb_image = image->getRGBImage();
         const ed::ImageMask& image_mask = m->imageMask();
 
         cv::Mat rgb_image_masked(rgb_image.rows, rgb_image.cols, CV_8UC3, cv::Scalar(0, 0, 0));
@@ -490,7 +510,15 @@ bool GUIPlugin::srvGetMeasurements(ed_msgs::GetMeasurements::Request& req, ed_ms
 
 bool GUIPlugin::srvSetLabel(ed_msgs::SetLabel::Request& req, ed_msgs::SetLabel::Response& res)
 {
-    ed::UUID id = req.id;
+    // The id is looked up without interning it: if it was never interned, no entity has it
+    ed::UUID id;
+    if (!ed::UUID::find(req.id, id))
+    {
+        res.msg = "GUIServer: srvSetLabel: Id does not exist: " + req.id;
+        std::cout << res.msg << std::endl;
+        return true;
+    }
+
     if (id.empty())
         id = selected_id_;
 
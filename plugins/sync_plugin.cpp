@@ -6,6 +6,7 @@
 #include "ed/update_request.h"
 #include "ed/world_model.h"
 #include "ed/serialization/serialization.h"
+#include "ed/replication/hub.h"
 #include <ed/io/json_reader.h>
 
 // ----------------------------------------------------------------------------------------------------
@@ -35,8 +36,12 @@ void SyncPlugin::initialize(ed::InitData& init)
 
 void SyncPlugin::process(const ed::PluginInput& data, ed::UpdateRequest& req)
 {
+    // Forget meshes that are no longer used by any entity
+    shape_store_.prune();
+
     ed_msgs::Query query;
     query.request.since_revision = rev_number_;
+    query.request.properties.push_back(ed::replication::SYNC_QUERY);
 
     if (!sync_client_.call(query))
     {
@@ -54,7 +59,8 @@ void SyncPlugin::process(const ed::PluginInput& data, ed::UpdateRequest& req)
 
 //    std::cout << "Response size: " << query.response.human_readable.size() << std::endl;
 
-    ed::deserialize(r, req);
+    std::vector<ed::UUID> unresolved_shapes;
+    ed::deserialize(r, req, shape_store_, unresolved_shapes);
 
     if (!r.ok())
     {
@@ -65,8 +71,65 @@ void SyncPlugin::process(const ed::PluginInput& data, ed::UpdateRequest& req)
     }
     else
     {
+        // The server sent its complete state, so everything we synced earlier and is not in there was removed
+        int full_state = 0;
+        if (r.readValue("full_state", full_state) && full_state)
+        {
+            for(std::set<ed::UUID>::const_iterator it = synced_ids_.begin(); it != synced_ids_.end(); ++it)
+            {
+                if (req.updated_entities.find(*it) == req.updated_entities.end())
+                    req.removeEntity(*it);
+            }
+        }
+
+        for(std::set<ed::UUID>::const_iterator it = req.updated_entities.begin(); it != req.updated_entities.end(); ++it)
+            synced_ids_.insert(*it);
+
+        for(std::set<ed::UUID>::const_iterator it = req.removed_entities.begin(); it != req.removed_entities.end(); ++it)
+            synced_ids_.erase(*it);
+
         rev_number_ = query.response.new_revision;
+
+        if (!unresolved_shapes.empty())
+            requestShapes(unresolved_shapes, req);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void SyncPlugin::requestShapes(const std::vector<ed::UUID>& ids, ed::UpdateRequest& req)
+{
+    // Explicitly querying entities always results in full meshes
+    ed_msgs::Query query;
+    for(std::vector<ed::UUID>::const_iterator it = ids.begin(); it != ids.end(); ++it)
+        query.request.ids.push_back(it->str());
+
+    if (!sync_client_.call(query))
+    {
+        ROS_ERROR_STREAM("[ED SyncPlugin] Failed to call service '" << sync_client_.getService() << "'");
+        return;
     }
+
+    ed::io::JSONReader r(query.response.human_readable.c_str());
+    if (!r.ok())
+    {
+        ROS_ERROR_STREAM("[ED SyncPlugin] Could not parse query response received from '" << sync_client_.getService() << "': " << query.response);
+        return;
+    }
+
+    std::vector<ed::UUID> unresolved_shapes;
+    ed::UpdateRequest shape_req;
+    ed::deserialize(r, shape_req, shape_store_, unresolved_shapes);
+
+    if (!r.ok())
+    {
+        ROS_ERROR_STREAM("[ED SyncPlugin] Invalid query response from '" << sync_client_.getService() << "': " << r.error());
+        return;
+    }
+
+    // Only take the meshes: the rest of the entity state may be newer than our revision
+    for(std::map<ed::UUID, geo::ShapeConstPtr>::const_iterator it = shape_req.shapes.begin(); it != shape_req.shapes.end(); ++it)
+        req.setShape(it->first, it->second);
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -2,9 +2,14 @@
 #define ED_HELLO_WORLD_PLUGIN_H_
 
 #include <ed/plugin.h>
+#include <ed/uuid.h>
+#include <ed/serialization/shape_store.h>
 
 #include <ros/service_client.h>
 
+#include <set>
+#include <vector>
+
 class SyncPlugin : public ed::Plugin
 {
 
@@ -20,8 +25,16 @@ public:
 
 private:
 
+    void requestShapes(const std::vector<ed::UUID>& ids, ed::UpdateRequest& req);
+
     uint64_t rev_number_;
 
+    // Ids of all entities that were received from the server
+    std::set<ed::UUID> synced_ids_;
+
+    // Received meshes, such that entities with the same mesh share it and the server can send references
+    ed::ShapeStore shape_store_;
+
     ros::ServiceClient sync_client_;
 
 };
@@ -40,35 +40,47 @@ void TFPublisherPlugin::initialize()
 
 // ----------------------------------------------------------------------------------------------------
 
-void TFPublisherPlugin::process(const ed::WorldModel& world, ed::UpdateRequest& req)
+void TFPublisherPlugin::process(const ed::PluginInput& data, ed::UpdateRequest& req)
 {
-    for(ed::WorldModel::const_iterator it = world.begin(); it != world.end(); ++it)
+    for(std::vector<ed::DirtyEntity>::const_iterator it = data.dirty.begin(); it != data.dirty.end(); ++it)
     {
-        const ed::EntityConstPtr& e = *it;
+        if (!it->changed(ed::DirtyEntity::POSE) && !it->changed(ed::DirtyEntity::REMOVED))
+            continue;
 
-        if (!e->has_pose())
+        ed::EntityConstPtr e = data.world.getEntity(it->id);
+        if (!e || !e->has_pose())
+        {
+            transforms_.erase(it->id);
             continue;
+        }
 
         std::string id = e->id().str();
         if (!id.empty() && id[0] == '/')
             id = id.substr(1);
 
         // If exclude is set, do not add entities whose id starts with exclude
-        if (!exclude_.empty() && id.size() >= exclude_.size() && id.substr(0, exclude_.size()) == exclude_)
+        if (!exclude_.empty() && id.compare(0, exclude_.size(), exclude_) == 0)
             continue;
 
-        geo::Pose3D pose_MAP;
-
-        pose_MAP = e->pose();
-
-        tf::StampedTransform t;
-        geo::convert(pose_MAP, t);
+        tf::StampedTransform& t = transforms_[it->id];
+        geo::convert(e->pose(), t);
         t.frame_id_ = root_frame_id_;
         t.child_frame_id_ = e->id().str();
-        t.stamp_ = ros::Time::now();
+    }
 
-        tf_broadcaster_->sendTransform(t);
+    // All transforms are sent every cycle, such that listeners keep receiving them
+    ros::Time now = ros::Time::now();
+
+    std::vector<tf::StampedTransform> transforms;
+    transforms.reserve(transforms_.size());
+    for(std::map<ed::UUID, tf::StampedTransform>::iterator it = transforms_.begin(); it != transforms_.end(); ++it)
+    {
+        it->second.stamp_ = now;
+        transforms.push_back(it->second);
     }
+
+    if (!transforms.empty())
+        tf_broadcaster_->sendTransform(transforms);
 }
 
 ED_REGISTER_PLUGIN(TFPublisherPlugin)
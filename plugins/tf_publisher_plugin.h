@@ -3,8 +3,12 @@
 
 #include <ed/plugin.h>
 
+#include <ed/uuid.h>
+
 #include <tf/transform_broadcaster.h>
 
+#include <map>
+
 class TFPublisherPlugin : public ed::Plugin
 {
 
@@ -18,7 +22,7 @@ public:
 
     void initialize();
 
-    void process(const ed::WorldModel& world, ed::UpdateRequest& req);
+    void process(const ed::PluginInput& data, ed::UpdateRequest& req);
 
 private:
 
@@ -29,6 +33,9 @@ private:
 
     tf::TransformBroadcaster* tf_broadcaster_;
 
+    // Transforms of the entities with a pose, which are only updated for entities that changed
+    std::map<ed::UUID, tf::StampedTransform> transforms_;
+
 };
 
 #endif
@@ -9,6 +9,7 @@
 #include <geolib/ros/msg_conversions.h>
 #include <tue/config/yaml_emitter.h>
 #include <ed/serialization/serialization.h>
+#include <ed/serialization/shape_store.h>
 
 #include <ed_msgs/Query.h>
 #include "ed/io/json_writer.h"
@@ -60,8 +61,8 @@ void entityToMsg(const ed::Entity& e, ed_msgs::EntityInfo& msg)
     msg.id = e.id().str();
     msg.type = e.type();
 
-    for(std::set<std::string>::const_iterator it = e.types().begin(); it != e.types().end(); ++it)
-        msg.types.push_back(*it);
+    std::set<std::string> types = e.typeNames();
+    msg.types.assign(types.begin(), types.end());
 
     msg.existence_probability = e.existenceProbability();
 //    msg.creation_time = ros::Time(e.creationTime());
@@ -99,8 +100,8 @@ void entityToMsg(const ed::Entity& e, ed_msgs::EntityInfo& msg)
     }
 
     // Flags
-    for(std::set<std::string>::const_iterator it = e.flags().begin(); it != e.flags().end(); ++it)
-        msg.flags.push_back(*it);
+    std::set<std::string> flags = e.flagNames();
+    msg.flags.assign(flags.begin(), flags.end());
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -140,9 +141,16 @@ bool srvUpdate(ed_msgs::UpdateSrv::Request& req, ed_msgs::UpdateSrv::Response& r
             if (r.readValue("action", action))
             {
                 if (action == "remove")
-                    update_req.removeEntity(id);
+                {
+                    // An id that was never interned is not in the world, so there is nothing to remove
+                    ed::UUID remove_id;
+                    if (ed::UUID::find(id, remove_id))
+                        update_req.removeEntity(remove_id);
+                }
                 else
+                {
                     res.response += "Unknown action '" + action + "'.\n";
+                }
             }
 
             std::string type;
@@ -244,8 +252,26 @@ bool srvQuery(ed_msgs::Query::Request& req, ed_msgs::Query::Response& res)
     tue::Timer timer;
     timer.start();
 
-    // Set of queried ids
-    std::set<std::string> ids(req.ids.begin(), req.ids.end());
+    // Sync clients are served from the pre-encoded revisions of the replication hub. Their responses have records
+    // of removed entities and no entity indices, so the hub is only used for clients that ask for it.
+    if (req.ids.empty() && req.properties.size() == 1 && req.properties[0] == ed::replication::SYNC_QUERY)
+    {
+        ed_wm->enableReplication();
+
+        unsigned long new_revision;
+        ed_wm->replicationHub().query(req.since_revision, res.human_readable, new_revision);
+        res.new_revision = new_revision;
+        return true;
+    }
+
+    // Set of queried ids. Ids are looked up without interning them: an unknown id can not match an entity.
+    std::set<ed::UUID> ids;
+    for(std::vector<std::string>::const_iterator it = req.ids.begin(); it != req.ids.end(); ++it)
+    {
+        ed::UUID id;
+        if (ed::UUID::find(*it, id))
+            ids.insert(id);
+    }
 
     // convert property names to indexes
     std::vector<ed::Idx> property_idxs;
@@ -261,6 +287,10 @@ bool srvQuery(ed_msgs::Query::Request& req, ed_msgs::Query::Response& res)
 
     std::vector<std::string> removed_entities;
 
+    // Hashes of the meshes that were written, and the hashes of the shapes seen so far
+    std::set<std::string> written_meshes;
+    std::map<const geo::Shape*, std::string> shape_hashes;
+
     std::stringstream out;
     ed::io::JSONWriter w(out);
 
@@ -275,7 +305,7 @@ bool srvQuery(ed_msgs::Query::Request& req, ed_msgs::Query::Response& res)
         if (!e)
             continue;
 
-        if (!ids.empty() && ids.find(e->id().str()) == ids.end())
+        if (!req.ids.empty() && ids.find(e->id()) == ids.end())
             continue;
 
         if (e)
@@ -311,12 +341,31 @@ bool srvQuery(ed_msgs::Query::Request& req, ed_msgs::Query::Response& res)
                 w.endGroup();
             }
 
-            // Mesh
+            // Mesh (only the first entity in this response with a certain mesh contains the full mesh)
             if (e->shape() && ed_wm->world_model()->entity_shape_revisions()[i] > req.since_revision)
             {
-                w.writeGroup("mesh");
-                ed::serialize(*e->shape(), w);
-                w.endGroup();
+                std::map<const geo::Shape*, std::string>::const_iterator it_hash = shape_hashes.find(e->shape().get());
+                if (it_hash != shape_hashes.end())
+                {
+                    w.writeValue("mesh_ref", it_hash->second);
+                }
+                else
+                {
+                    std::string hash = ed::shapeHash(*e->shape());
+                    shape_hashes[e->shape().get()] = hash;
+
+                    if (!written_meshes.insert(hash).second)
+                    {
+                        w.writeValue("mesh_ref", hash);
+                    }
+                    else
+                    {
+                        w.writeGroup("mesh");
+                        ed::serialize(*e->shape(), w);
+                        w.writeValue("hash", hash);
+                        w.endGroup();
+                    }
+                }
             }
 
             // Data
@@ -401,18 +450,113 @@ bool srvQuery(ed_msgs::Query::Request& req, ed_msgs::Query::Response& res)
 
 // ----------------------------------------------------------------------------------------------------
 
+// Time-travel query: {"at_time": t} or {"at_revision": r}, optionally with "id". Answers with the entities as
+// they were at that point of the history (see ed::WorldHistory), as JSON.
+bool srvHistoryQuery(ed_msgs::UpdateSrv::Request& req, ed_msgs::UpdateSrv::Response& res)
+{
+    ed::io::JSONReader r(req.request.c_str());
+    if (!r.ok())
+    {
+        res.response = r.error();
+        return true;
+    }
+
+    ed::WorldHistory::Query q;
+    int at_revision;
+    if (r.readValue("at_revision", at_revision))
+        q.at_revision = at_revision;
+    else if (!r.readValue("at_time", q.at_time))
+    {
+        res.response = "Specify 'at_time' or 'at_revision'.";
+        return true;
+    }
+
+    std::string id;
+    r.readValue("id", id);
+
+    const ed::WorldHistory& history = ed_wm->history();
+
+    unsigned long revision;
+    double time;
+    std::vector<ed::EntityConstPtr> entities;
+    if (!history.resolve(q, revision, time))
+    {
+        res.response = "Not in the history (enable it with the 'history' configuration).";
+        return true;
+    }
+
+    ed::UUID uuid;
+    if (id.empty())
+    {
+        history.entities(q, entities);
+    }
+    else if (ed::UUID::find(id, uuid))
+    {
+        ed::EntityConstPtr e;
+        history.entity(uuid, q, e);
+        if (e)
+            entities.push_back(e);
+    }
+
+    std::stringstream out;
+    ed::io::JSONWriter w(out);
+
+    w.writeValue("revision", (int)revision);
+    w.writeValue("time", time);
+
+    w.writeArray("entities");
+    for(std::vector<ed::EntityConstPtr>::const_iterator it = entities.begin(); it != entities.end(); ++it)
+    {
+        const ed::Entity& e = **it;
+
+        w.addArrayItem();
+        w.writeValue("id", e.id().str());
+        w.writeValue("type", e.type());
+        w.writeValue("existence_prob", e.existenceProbability());
+
+        w.writeGroup("timestamp");
+        ed::serializeTimestamp(e.lastUpdateTimestamp(), w);
+        w.endGroup();
+
+        if (e.has_pose())
+        {
+            w.writeGroup("pose");
+            ed::serialize(e.pose(), w);
+            w.endGroup();
+        }
+
+        w.endArrayItem();
+    }
+    w.endArray();
+
+    w.finish();
+
+    res.response = out.str();
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
 bool srvSimpleQuery(ed_msgs::SimpleQuery::Request& req, ed_msgs::SimpleQuery::Response& res)
 {
     double radius = req.radius;
     geo::Vector3 center_point;
     geo::convert(req.center_point, center_point);
 
+    // Look up the type and id once. If they were never interned, no entity has them.
+    ed::SymbolId type_symbol;
+    bool type_known = ed::findSymbol(req.type, type_symbol);
+
+    ed::UUID id;
+    if (!req.id.empty() && !ed::UUID::find(req.id, id))
+        return true;
+
     for(ed::WorldModel::const_iterator it = ed_wm->world_model()->begin(); it != ed_wm->world_model()->end(); ++it)
     {
 //        std::cout << it->first << std::endl;
 
         const ed::EntityConstPtr& e = *it;
-        if (!req.id.empty() && e->id() != ed::UUID(req.id))
+        if (!req.id.empty() && e->id() != id)
             continue;
 
         if (!e->has_pose())
@@ -427,7 +571,7 @@ bool srvSimpleQuery(ed_msgs::SimpleQuery::Request& req, ed_msgs::SimpleQuery::Re
             }
             else
             {
-                if (!e->hasType(req.type))
+                if (!type_known || !e->hasType(type_symbol))
                     continue;
             }
         }
@@ -661,6 +805,7 @@ int main(int argc, char** argv)
     ros::ServiceServer srv_query = nh_private2.advertiseService("query", srvQuery);
     ros::ServiceServer srv_update = nh_private2.advertiseService("update", srvUpdate);
     ros::ServiceServer srv_configure = nh_private2.advertiseService("configure", srvConfigure);
+    ros::ServiceServer srv_history_query = nh_private2.advertiseService("history_query", srvHistoryQuery);
 
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -701,5 +846,9 @@ int main(int argc, char** argv)
         r.sleep();
     }
 
+    errc.change("ED server", "shutdown");
+
+    ed_wm->shutdown();
+
     return 0;
 }
@@ -2,6 +2,8 @@
 
 #include "ed/helpers/depth_data_processing.h"
 #include "ed/measurement.h"
+#include "ed/instanced_shape.h"
+#include "ed/lod_shape.h"
 
 #include <geolib/Shape.h>
 #include <geolib/Mesh.h>
@@ -35,7 +37,8 @@ Entity::Entity(const UUID& id, const TYPE& type, const unsigned int& measurement
     has_original_pose_(false),
     originalPose_(geo::Pose3D::identity()),
     has_move_restrictions_(false),
-    moveRestrictions_(ed::MoveRestrictionsConstPtr())
+    moveRestrictions_(ed::MoveRestrictionsConstPtr()),
+    data_revision_(0)
 {
 }
 
@@ -95,18 +98,23 @@ void Entity::updateConvexHull()
 
 void Entity::updateConvexHullFromShape()
 {
-    const std::vector<geo::Vector3>& vertices = shape_->getMesh().getPoints();
+    // Use the shared mesh of instanced shapes, instead of creating their transformed mesh. A centimeter
+    // is precise enough for the convex hull, so use a coarse level of detail if the shape has one.
+    geo::Pose3D shape_transform;
+    const std::vector<geo::Vector3>& vertices = levelOfDetail(*shape_, 0.01, shape_transform).getPoints();
 
     if (vertices.empty())
         return;
 
+    geo::Pose3D vertex_pose = pose_ * shape_transform;
+
     float z_min = 1e9;
     float z_max = -1e9;
 
     std::vector<geo::Vec2f> points(vertices.size());
     for(unsigned int i = 0; i < vertices.size(); ++i)
     {
-        geo::Vector3 p_MAP = pose_ * vertices[i];
+        geo::Vector3 p_MAP = vertex_pose * vertices[i];
         z_min = std::min<float>(z_min, p_MAP.z - pose_.t.z);
         z_max = std::max<float>(z_max, p_MAP.z - pose_.t.z);
 
@@ -175,6 +183,35 @@ void Entity::measurements(std::vector<MeasurementConstPtr>& measurements, unsign
 
 // ----------------------------------------------------------------------------------------------------
 
+std::size_t Entity::measurementMemoryUsage() const
+{
+    std::vector<MeasurementConstPtr> msrs(measurements_.begin(), measurements_.end());
+    if (best_measurement_)
+        msrs.push_back(best_measurement_);
+
+    std::size_t bytes = 0;
+    std::set<const Measurement*> seen;
+    std::set<const StoredImage*> images;
+    for(std::vector<MeasurementConstPtr>::const_iterator it = msrs.begin(); it != msrs.end(); ++it)
+    {
+        if (!seen.insert(it->get()).second)
+            continue;
+
+        const Measurement& m = **it;
+        bytes += m.imageMask().runs().size() * sizeof(ImageMask::Run);
+        if (m.mask())
+            bytes += m.mask()->size() * sizeof(int);
+
+        const StoredImagePtr& image = m.storedImage();
+        if (image && images.insert(image.get()).second)
+            bytes += image->memoryUsage();
+    }
+
+    return bytes;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
 MeasurementConstPtr Entity::lastMeasurement() const
 {
     if (measurements_.empty())
@@ -185,18 +222,24 @@ MeasurementConstPtr Entity::lastMeasurement() const
 
 // ----------------------------------------------------------------------------------------------------
 
-UUID Entity::generateID() {
-    static const char alphanum[] =
-        "0123456789"
-        "abcdef";
+void Entity::remapRelations(const std::vector<Idx>& entity_map, const std::vector<Idx>& relation_map)
+{
+    std::map<Idx, Idx> relations_from;
+    for(std::map<Idx, Idx>::const_iterator it = relations_from_.begin(); it != relations_from_.end(); ++it)
+        relations_from[entity_map[it->first]] = relation_map[it->second];
+    relations_from_.swap(relations_from);
+
+    std::map<Idx, Idx> relations_to;
+    for(std::map<Idx, Idx>::const_iterator it = relations_to_.begin(); it != relations_to_.end(); ++it)
+        relations_to[entity_map[it->first]] = relation_map[it->second];
+    relations_to_.swap(relations_to);
+}
 
-    std::string s;
-    for (int i = 0; i < 32; ++i) {
-        int n = rand() / (RAND_MAX / (sizeof(alphanum) - 1) + 1);
-        s += alphanum[n];
-    }
+// ----------------------------------------------------------------------------------------------------
 
-    return UUID(s);
+UUID Entity::generateID()
+{
+    return UUID::generate();
 }
 
 }
@@ -0,0 +1,157 @@
+#include "ed/evictor.h"
+
+#include "ed/entity.h"
+#include "ed/update_request.h"
+#include "ed/world_model.h"
+
+namespace ed
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+Evictor::Evictor()
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+Evictor::~Evictor()
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Evictor::addTypePolicy(const std::string& type, double ttl)
+{
+    Policy p;
+    p.name = type;
+    p.symbol = internSymbol(type);
+    p.ttl = ttl;
+    policies_.push_back(p);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Evictor::addFlagPolicy(const std::string& flag, double ttl)
+{
+    Policy p;
+    p.name = flag;
+    p.is_flag = true;
+    p.symbol = internSymbol(flag);
+    p.ttl = ttl;
+    policies_.push_back(p);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Evictor::clear()
+{
+    policies_.clear();
+    queue_ = std::priority_queue<Item, std::vector<Item>, std::greater<Item> >();
+    scheduled_.clear();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Evictor::schedule(const WorldModel& world)
+{
+    if (policies_.empty())
+        return;
+
+    for(WorldModel::const_iterator it = world.begin(); it != world.end(); ++it)
+        schedule(**it);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Evictor::update(const WorldModel& world, const UpdateRequest& req)
+{
+    if (policies_.empty())
+        return;
+
+    for(std::set<UUID>::const_iterator it = req.updated_entities.begin(); it != req.updated_entities.end(); ++it)
+    {
+        EntityConstPtr e = world.getEntity(*it);
+        if (e)
+            schedule(*e);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Evictor::evict(const WorldModel& world, double time, UpdateRequest& req)
+{
+    while (!queue_.empty() && queue_.top().expiry <= time)
+    {
+        Item item = queue_.top();
+        queue_.pop();
+
+        boost::unordered_map<UUID, double>::iterator it = scheduled_.find(item.id);
+        if (it == scheduled_.end() || it->second != item.expiry)
+            continue; // Outdated
+
+        scheduled_.erase(it);
+
+        EntityConstPtr e = world.getEntity(item.id);
+        if (!e)
+            continue;
+
+        int i_policy = findPolicy(*e);
+        if (i_policy < 0 || e->lastUpdateTimestamp() <= 0)
+            continue;
+
+        // The entity may have been updated since it was queued
+        double expiry = e->lastUpdateTimestamp() + policies_[i_policy].ttl;
+        if (expiry > time)
+        {
+            queue_.push(Item(expiry, e->id()));
+            scheduled_[e->id()] = expiry;
+            continue;
+        }
+
+        req.removeEntity(e->id());
+        ++policies_[i_policy].num_evicted;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int Evictor::findPolicy(const Entity& e) const
+{
+    int i_best = -1;
+    for(unsigned int i = 0; i < policies_.size(); ++i)
+    {
+        const Policy& p = policies_[i];
+        if (i_best >= 0 && policies_[i_best].ttl <= p.ttl)
+            continue;
+
+        if (p.is_flag ? e.hasFlag(p.symbol) : e.hasType(p.symbol))
+            i_best = i;
+    }
+
+    return i_best;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Evictor::schedule(const Entity& e)
+{
+    if (e.lastUpdateTimestamp() <= 0)
+        return;
+
+    int i_policy = findPolicy(e);
+    if (i_policy < 0)
+        return;
+
+    double expiry = e.lastUpdateTimestamp() + policies_[i_policy].ttl;
+
+    // An entity that is already queued for an earlier time is checked again at that time
+    boost::unordered_map<UUID, double>::iterator it = scheduled_.find(e.id());
+    if (it != scheduled_.end() && it->second <= expiry)
+        return;
+
+    queue_.push(Item(expiry, e.id()));
+    scheduled_[e.id()] = expiry;
+}
+
+} // end namespace ed
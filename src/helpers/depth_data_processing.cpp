@@ -298,10 +298,23 @@ pcl::PointCloud<pcl::PointXYZ>::Ptr getPclFromDepthImageMask(rgbd::ImageConstPtr
 void getDepthImageFromMask(const rgbd::View& view, const ImageMask& mask, cv::Mat& masked_depth_image)
 {
     masked_depth_image = cv::Mat(view.getHeight(), view.getWidth(), CV_32FC1, 0.0);
-    for(ImageMask::const_iterator it = mask.begin(view.getWidth()); it != mask.end(); ++it)
+
+    if (mask.width() <= 0)
+        return;
+
+    // Copy span by span. Every mask pixel covers a square of 'factor' x 'factor' view pixels.
+    int factor = view.getWidth() / mask.width();
+    const std::vector<ImageMask::Run>& runs = mask.runs();
+    for(std::vector<ImageMask::Run>::const_iterator it = runs.begin(); it != runs.end(); ++it)
     {
-        cv::Point2i pt = it();
-        masked_depth_image.at<float>(pt) = view.getDepth(pt.x,pt.y);
+        int x_min = it->x_min * factor;
+        int x_max = (it->x_max + 1) * factor;
+        for(int y = it->y * factor; y < (it->y + 1) * factor; ++y)
+        {
+            float* row = masked_depth_image.ptr<float>(y);
+            for(int x = x_min; x < x_max; ++x)
+                row[x] = view.getDepth(x, y);
+        }
     }
 }
 
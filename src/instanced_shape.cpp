@@ -0,0 +1,127 @@
+#include "ed/instanced_shape.h"
+
+#include <geolib/Box.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace ed
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+InstancedShape::InstancedShape(const geo::ShapeConstPtr& base, const geo::Pose3D& transform) :
+    base_(base), transform_(transform), has_mesh_(false)
+{
+    const InstancedShape* instance = dynamic_cast<const InstancedShape*>(base.get());
+    if (instance)
+    {
+        base_ = instance->base_;
+        transform_ = transform * instance->transform_;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::Shape* InstancedShape::clone() const
+{
+    return new InstancedShape(base_, transform_);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+const geo::Mesh& InstancedShape::getMesh() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (!has_mesh_)
+    {
+        const_cast<geo::Mesh&>(mesh_) = base_->getMesh().getTransformed(transform_);
+        has_mesh_ = true;
+    }
+
+    return mesh_;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void InstancedShape::setMesh(const geo::Mesh& mesh)
+{
+    // The instance gets its own mesh
+    geo::ShapePtr base(new geo::Shape);
+    base->setMesh(mesh);
+
+    boost::mutex::scoped_lock lock(mutex_);
+    base_ = base;
+    transform_ = geo::Pose3D::identity();
+    mesh_ = geo::Mesh();
+    has_mesh_ = false;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double InstancedShape::getMaxRadius() const
+{
+    double max_radius_sq = 0;
+
+    const std::vector<geo::Vector3>& points = base_->getMesh().getPoints();
+    for(std::vector<geo::Vector3>::const_iterator it = points.begin(); it != points.end(); ++it)
+        max_radius_sq = std::max<double>(max_radius_sq, (transform_ * *it).length2());
+
+    return std::sqrt(max_radius_sq);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::Box InstancedShape::getBoundingBox() const
+{
+    const std::vector<geo::Vector3>& points = base_->getMesh().getPoints();
+    if (points.empty())
+        return geo::Box(geo::Vector3(0, 0, 0), geo::Vector3(0, 0, 0));
+
+    geo::Vector3 min = transform_ * points[0];
+    geo::Vector3 max = min;
+    for(std::vector<geo::Vector3>::const_iterator it = points.begin() + 1; it != points.end(); ++it)
+    {
+        geo::Vector3 p = transform_ * *it;
+        min.x = std::min(min.x, p.x); max.x = std::max(max.x, p.x);
+        min.y = std::min(min.y, p.y); max.y = std::max(max.y, p.y);
+        min.z = std::min(min.z, p.z); max.z = std::max(max.z, p.z);
+    }
+
+    return geo::Box(min, max);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool InstancedShape::contains(const geo::Vector3& p) const
+{
+    return base_->contains(transform_.inverse() * p);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+const geo::Mesh& sharedMesh(const geo::Shape& shape, geo::Pose3D& transform)
+{
+    const InstancedShape* instance = dynamic_cast<const InstancedShape*>(&shape);
+    if (instance)
+    {
+        transform = instance->transform();
+        return instance->base()->getMesh();
+    }
+
+    transform = geo::Pose3D::identity();
+    return shape.getMesh();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool isIdentity(const geo::Pose3D& pose)
+{
+    return pose.t.x == 0 && pose.t.y == 0 && pose.t.z == 0
+            && pose.R.xx == 1 && pose.R.xy == 0 && pose.R.xz == 0
+            && pose.R.yx == 0 && pose.R.yy == 1 && pose.R.yz == 0
+            && pose.R.zx == 0 && pose.R.zy == 0 && pose.R.zz == 1;
+}
+
+} // end namespace ed
@@ -0,0 +1,743 @@
+#include "binary_io.h"
+
+#include "ed/update_request.h"
+#include "ed/property.h"
+#include "ed/property_key_db.h"
+#include "ed/ROI.h"
+#include "ed/stateDefinition.h"
+#include "ed/moveRestrictions.h"
+#include "ed/relations/transform_cache.h"
+#include "ed/instanced_shape.h"
+#include "ed/io/json_writer.h"
+#include "ed/io/json_reader.h"
+#include "ed/logging.h"
+
+#include <tue/config/configuration.h>
+#include <tue/config/loaders/yaml.h>
+#include <tue/config/yaml_emitter.h>
+
+#include <geolib/Shape.h>
+#include <geolib/Mesh.h>
+
+#include <sstream>
+
+namespace ed
+{
+
+namespace binary
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const ConvexHull& ch)
+{
+    a << (int)ch.points.size();
+    for(std::vector<geo::Vec2f>::const_iterator it = ch.points.begin(); it != ch.points.end(); ++it)
+        a << it->x << it->y;
+    a << ch.z_min << ch.z_max;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, ConvexHull& ch)
+{
+    int num_points;
+    if (!r.readCount(num_points, 2 * sizeof(float)))
+        return false;
+
+    ch.points.resize(num_points);
+    for(int i = 0; i < num_points; ++i)
+    {
+        r.read(ch.points[i].x);
+        r.read(ch.points[i].y);
+    }
+
+    r.read(ch.z_min);
+    r.read(ch.z_max);
+    return r.ok();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const ROI& roi)
+{
+    a << roi.min << roi.max << (int)roi.include;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, ROIConstPtr& roi)
+{
+    float min, max;
+    int include;
+    if (!r.read(min) || !r.read(max) || !r.read(include))
+        return false;
+
+    roi.reset(new ROI(min, max, include));
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const StateDefinition& sd)
+{
+    a << (int)sd.angle << (int)sd.position << sd.angleDifferenceClose << sd.angleDifferenceOpen
+      << sd.positionDifferenceClose << sd.positionDifferenceOpen;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, StateDefinitionConstPtr& sd)
+{
+    int angle, position;
+    float angle_close, angle_open, position_close, position_open;
+    if (!r.read(angle) || !r.read(position) || !r.read(angle_close) || !r.read(angle_open)
+            || !r.read(position_close) || !r.read(position_open))
+        return false;
+
+    sd.reset(new StateDefinition(angle, position, angle_close, angle_open, position_close, position_open));
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const MoveRestrictions& mr)
+{
+    a << (int)mr.canRotate << (int)mr.canMove << (float)mr.moveDirection.x << (float)mr.moveDirection.y;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, MoveRestrictionsConstPtr& mr)
+{
+    int can_rotate, can_move;
+    float x, y;
+    if (!r.read(can_rotate) || !r.read(can_move) || !r.read(x) || !r.read(y))
+        return false;
+
+    mr.reset(new MoveRestrictions(can_rotate, can_move, x, y));
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const TransformCache& tc)
+{
+    const TimeCache<geo::Pose3D>& cache = tc.cache();
+    a << (int)cache.size();
+    for(TimeCache<geo::Pose3D>::const_iterator it = cache.begin(); it != cache.end(); ++it)
+    {
+        a << it->first.seconds();
+        write(a, it->second);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, RelationConstPtr& relation)
+{
+    int num_transforms;
+    if (!r.readCount(num_transforms, sizeof(double)))
+        return false;
+
+    boost::shared_ptr<TransformCache> tc(new TransformCache);
+    for(int i = 0; i < num_transforms; ++i)
+    {
+        double t;
+        geo::Pose3D pose;
+        if (!r.read(t) || !read(r, pose))
+            return false;
+        tc->insert(Time(t), pose);
+    }
+
+    relation = tc;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const tue::config::DataConstPointer& data)
+{
+    std::string data_str;
+    if (!data.empty())
+    {
+        tue::config::YAMLEmitter emitter;
+        std::stringstream out;
+        emitter.emit(data, out);
+        data_str = out.str();
+    }
+    a << data_str;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, tue::config::DataPointer& data)
+{
+    std::string data_str;
+    if (!r.read(data_str))
+        return false;
+
+    if (!data_str.empty())
+    {
+        tue::Configuration cfg;
+        if (tue::config::loadFromYAMLString(data_str, cfg))
+            data = cfg.data();
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const Property& prop)
+{
+    std::stringstream out;
+    io::JSONWriter w(out);
+    prop.entry->info->serialize(prop.value, w);
+    w.finish();
+
+    a << prop.entry->name << out.str();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, const PropertyKeyDB& property_key_db, const PropertyKeyDBEntry*& entry, Variant& value,
+          std::string& name)
+{
+    std::string value_str;
+    if (!r.read(name) || !r.read(value_str))
+        return false;
+
+    entry = property_key_db.getPropertyKeyDBEntry(name);
+    if (!entry || !entry->info->serializable())
+    {
+        entry = 0;
+        return true;
+    }
+
+    io::JSONReader jr(value_str.c_str());
+    if (!jr.ok() || !entry->info->deserialize(jr, value))
+        entry = 0;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const std::vector<const geo::Shape*>& shapes)
+{
+    std::map<const geo::Mesh*, int> mesh_idxs;
+    std::vector<const geo::Mesh*> meshes;
+    std::vector<int> shape_mesh_idxs(shapes.size());
+    std::vector<geo::Pose3D> transforms(shapes.size());
+    for(unsigned int i = 0; i < shapes.size(); ++i)
+    {
+        const geo::Mesh* mesh = &sharedMesh(*shapes[i], transforms[i]);
+        std::pair<std::map<const geo::Mesh*, int>::iterator, bool> ins = mesh_idxs.insert(std::make_pair(mesh, (int)meshes.size()));
+        if (ins.second)
+            meshes.push_back(mesh);
+        shape_mesh_idxs[i] = ins.first->second;
+    }
+
+    a << (int)meshes.size();
+    for(std::vector<const geo::Mesh*>::const_iterator it = meshes.begin(); it != meshes.end(); ++it)
+        write(a, **it);
+
+    a << (int)shapes.size();
+    for(unsigned int i = 0; i < shapes.size(); ++i)
+    {
+        int instanced = isIdentity(transforms[i]) ? 0 : 1;
+        a << shape_mesh_idxs[i] << instanced;
+        if (instanced)
+            write(a, transforms[i]);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, std::vector<geo::ShapeConstPtr>& shapes)
+{
+    int num_meshes;
+    if (!r.readCount(num_meshes, 2 * sizeof(int)))
+        return false;
+
+    std::vector<geo::ShapeConstPtr> meshes(num_meshes);
+    for(int i = 0; i < num_meshes; ++i)
+    {
+        geo::Mesh mesh;
+        if (!read(r, mesh))
+            return false;
+
+        geo::ShapePtr shape(new geo::Shape);
+        shape->setMesh(mesh);
+        meshes[i] = shape;
+    }
+
+    int num_shapes;
+    if (!r.readCount(num_shapes, 2 * sizeof(int)))
+        return false;
+
+    shapes.resize(num_shapes);
+    for(int i = 0; i < num_shapes; ++i)
+    {
+        int mesh_idx, instanced;
+        if (!r.read(mesh_idx) || mesh_idx < 0 || mesh_idx >= num_meshes || !r.read(instanced))
+            return false;
+
+        if (instanced)
+        {
+            geo::Pose3D transform;
+            if (!read(r, transform))
+                return false;
+            shapes[i].reset(new InstancedShape(meshes[mesh_idx], transform));
+        }
+        else
+        {
+            shapes[i] = meshes[mesh_idx];
+        }
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const UpdateRequest& req)
+{
+    // Types
+    a << (int)req.types.size();
+    for(std::map<UUID, std::string>::const_iterator it = req.types.begin(); it != req.types.end(); ++it)
+        a << it->first.str() << it->second;
+
+    a << (int)req.type_sets_added.size();
+    for(std::map<UUID, std::set<std::string> >::const_iterator it = req.type_sets_added.begin(); it != req.type_sets_added.end(); ++it)
+    {
+        a << it->first.str();
+        write(a, it->second);
+    }
+
+    a << (int)req.type_sets_removed.size();
+    for(std::map<UUID, std::set<std::string> >::const_iterator it = req.type_sets_removed.begin(); it != req.type_sets_removed.end(); ++it)
+    {
+        a << it->first.str();
+        write(a, it->second);
+    }
+
+    // Existence probabilities and timestamps
+    a << (int)req.existence_probabilities.size();
+    for(std::map<UUID, double>::const_iterator it = req.existence_probabilities.begin(); it != req.existence_probabilities.end(); ++it)
+        a << it->first.str() << it->second;
+
+    a << (int)req.last_update_timestamps.size();
+    for(std::map<UUID, double>::const_iterator it = req.last_update_timestamps.begin(); it != req.last_update_timestamps.end(); ++it)
+        a << it->first.str() << it->second;
+
+    // Poses
+    a << (int)req.poses.size();
+    for(std::map<UUID, geo::Pose3D>::const_iterator it = req.poses.begin(); it != req.poses.end(); ++it)
+    {
+        a << it->first.str();
+        write(a, it->second);
+    }
+
+    a << (int)req.originalPoses.size();
+    for(std::map<UUID, geo::Pose3D>::const_iterator it = req.originalPoses.begin(); it != req.originalPoses.end(); ++it)
+    {
+        a << it->first.str();
+        write(a, it->second);
+    }
+
+    // Shapes (each shape once, even if it is set on multiple entities)
+    std::map<const geo::Shape*, int> shape_idxs;
+    std::vector<const geo::Shape*> shapes;
+    for(std::map<UUID, geo::ShapeConstPtr>::const_iterator it = req.shapes.begin(); it != req.shapes.end(); ++it)
+    {
+        if (it->second && shape_idxs.insert(std::make_pair(it->second.get(), (int)shapes.size())).second)
+            shapes.push_back(it->second.get());
+    }
+
+    write(a, shapes);
+
+    a << (int)req.shapes.size();
+    for(std::map<UUID, geo::ShapeConstPtr>::const_iterator it = req.shapes.begin(); it != req.shapes.end(); ++it)
+        a << it->first.str() << (it->second ? shape_idxs[it->second.get()] : -1);
+
+    // Convex hulls per source
+    a << (int)req.convex_hulls_new.size();
+    for(std::map<UUID, std::map<std::string, MeasurementConvexHull> >::const_iterator it = req.convex_hulls_new.begin();
+        it != req.convex_hulls_new.end(); ++it)
+    {
+        a << it->first.str() << (int)it->second.size();
+        for(std::map<std::string, MeasurementConvexHull>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2)
+        {
+            a << it2->first;
+            write(a, it2->second.convex_hull);
+            write(a, it2->second.pose);
+            a << it2->second.timestamp;
+        }
+    }
+
+    // ROIs, state definitions, move restrictions and state update groups
+    std::vector<std::pair<std::string, const ROI*> > rois;
+    for(std::map<UUID, ROIConstPtr>::const_iterator it = req.rois.begin(); it != req.rois.end(); ++it)
+        if (it->second)
+            rois.push_back(std::make_pair(it->first.str(), it->second.get()));
+
+    a << (int)rois.size();
+    for(std::vector<std::pair<std::string, const ROI*> >::const_iterator it = rois.begin(); it != rois.end(); ++it)
+    {
+        a << it->first;
+        write(a, *it->second);
+    }
+
+    std::vector<std::pair<std::string, const StateDefinition*> > state_definitions;
+    for(std::map<UUID, StateDefinitionConstPtr>::const_iterator it = req.stateDefinitions.begin(); it != req.stateDefinitions.end(); ++it)
+        if (it->second)
+            state_definitions.push_back(std::make_pair(it->first.str(), it->second.get()));
+
+    a << (int)state_definitions.size();
+    for(std::vector<std::pair<std::string, const StateDefinition*> >::const_iterator it = state_definitions.begin();
+        it != state_definitions.end(); ++it)
+    {
+        a << it->first;
+        write(a, *it->second);
+    }
+
+    std::vector<std::pair<std::string, const MoveRestrictions*> > move_restrictions;
+    for(std::map<UUID, MoveRestrictionsConstPtr>::const_iterator it = req.moveRestrictions.begin(); it != req.moveRestrictions.end(); ++it)
+        if (it->second)
+            move_restrictions.push_back(std::make_pair(it->first.str(), it->second.get()));
+
+    a << (int)move_restrictions.size();
+    for(std::vector<std::pair<std::string, const MoveRestrictions*> >::const_iterator it = move_restrictions.begin();
+        it != move_restrictions.end(); ++it)
+    {
+        a << it->first;
+        write(a, *it->second);
+    }
+
+    a << (int)req.stateUpdateGroups.size();
+    for(std::map<UUID, std::string>::const_iterator it = req.stateUpdateGroups.begin(); it != req.stateUpdateGroups.end(); ++it)
+        a << it->first.str() << it->second;
+
+    // Relations (only transform caches can be stored)
+    std::vector<std::pair<std::pair<std::string, std::string>, const TransformCache*> > relations;
+    for(std::map<UUID, std::map<UUID, RelationConstPtr> >::const_iterator it = req.relations.begin(); it != req.relations.end(); ++it)
+    {
+        for(std::map<UUID, RelationConstPtr>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2)
+        {
+            const TransformCache* tc = dynamic_cast<const TransformCache*>(it2->second.get());
+            if (tc)
+                relations.push_back(std::make_pair(std::make_pair(it->first.str(), it2->first.str()), tc));
+        }
+    }
+
+    a << (int)relations.size();
+    for(std::vector<std::pair<std::pair<std::string, std::string>, const TransformCache*> >::const_iterator it = relations.begin();
+        it != relations.end(); ++it)
+    {
+        a << it->first.first << it->first.second;
+        write(a, *it->second);
+    }
+
+    // Data
+    a << (int)req.datas.size();
+    for(std::map<UUID, tue::config::DataConstPointer>::const_iterator it = req.datas.begin(); it != req.datas.end(); ++it)
+    {
+        a << it->first.str();
+        write(a, it->second);
+    }
+
+    // Serializable properties
+    a << (int)req.properties.size();
+    for(std::map<UUID, std::map<Idx, Property> >::const_iterator it = req.properties.begin(); it != req.properties.end(); ++it)
+    {
+        std::vector<const Property*> properties;
+        for(std::map<Idx, Property>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2)
+        {
+            if (it2->second.entry && it2->second.entry->info->serializable())
+                properties.push_back(&it2->second);
+        }
+
+        a << it->first.str() << (int)properties.size();
+        for(std::vector<const Property*>::const_iterator it2 = properties.begin(); it2 != properties.end(); ++it2)
+            write(a, **it2);
+    }
+
+    // Removed entities
+    a << (int)req.removed_entities.size();
+    for(std::set<UUID>::const_iterator it = req.removed_entities.begin(); it != req.removed_entities.end(); ++it)
+        a << it->str();
+
+    // Flags
+    a << (int)req.added_flags.size();
+    for(std::map<UUID, std::string>::const_iterator it = req.added_flags.begin(); it != req.added_flags.end(); ++it)
+        a << it->first.str() << it->second;
+
+    a << (int)req.flag_sets_added.size();
+    for(std::map<UUID, std::set<std::string> >::const_iterator it = req.flag_sets_added.begin(); it != req.flag_sets_added.end(); ++it)
+    {
+        a << it->first.str();
+        write(a, it->second);
+    }
+
+    a << (int)req.removed_flags.size();
+    for(std::map<UUID, std::string>::const_iterator it = req.removed_flags.begin(); it != req.removed_flags.end(); ++it)
+        a << it->first.str() << it->second;
+
+    a << (int)req.is_sync_update;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, const PropertyKeyDB& property_key_db, UpdateRequest& req)
+{
+    int n;
+    std::string id, value;
+
+    // Types
+    if (!r.readCount(n, 2))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        if (!r.read(id) || !r.read(value))
+            return false;
+        req.setType(id, value);
+    }
+
+    if (!r.readCount(n, 1 + sizeof(int)))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        std::set<std::string> types;
+        if (!r.read(id) || !read(r, types))
+            return false;
+        for(std::set<std::string>::const_iterator it = types.begin(); it != types.end(); ++it)
+            req.addType(id, *it);
+    }
+
+    if (!r.readCount(n, 1 + sizeof(int)))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        std::set<std::string> types;
+        if (!r.read(id) || !read(r, types))
+            return false;
+        for(std::set<std::string>::const_iterator it = types.begin(); it != types.end(); ++it)
+            req.removeType(id, *it);
+    }
+
+    // Existence probabilities and timestamps
+    if (!r.readCount(n, 1 + sizeof(double)))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        double p;
+        if (!r.read(id) || !r.read(p))
+            return false;
+        req.setExistenceProbability(id, p);
+    }
+
+    if (!r.readCount(n, 1 + sizeof(double)))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        double t;
+        if (!r.read(id) || !r.read(t))
+            return false;
+        req.setLastUpdateTimestamp(id, t);
+    }
+
+    // Poses
+    if (!r.readCount(n, 1 + 7 * sizeof(double)))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        geo::Pose3D pose;
+        if (!r.read(id) || !read(r, pose))
+            return false;
+        req.setPose(id, pose);
+    }
+
+    if (!r.readCount(n, 1 + 7 * sizeof(double)))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        geo::Pose3D pose;
+        if (!r.read(id) || !read(r, pose))
+            return false;
+        req.setOriginalPose(id, pose);
+    }
+
+    // Shapes
+    std::vector<geo::ShapeConstPtr> shapes;
+    if (!read(r, shapes))
+        return false;
+
+    if (!r.readCount(n, 1 + sizeof(int)))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        int shape_idx;
+        if (!r.read(id) || !r.read(shape_idx) || shape_idx >= (int)shapes.size())
+            return false;
+        req.setShape(id, shape_idx >= 0 ? shapes[shape_idx] : geo::ShapeConstPtr());
+    }
+
+    // Convex hulls per source
+    if (!r.readCount(n, 1 + sizeof(int)))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        int num_sources;
+        if (!r.read(id) || !r.readCount(num_sources, 1))
+            return false;
+
+        for(int j = 0; j < num_sources; ++j)
+        {
+            std::string source;
+            MeasurementConvexHull m;
+            if (!r.read(source) || !read(r, m.convex_hull) || !read(r, m.pose) || !r.read(m.timestamp))
+                return false;
+            req.setConvexHullNew(id, m.convex_hull, m.pose, m.timestamp, source);
+        }
+    }
+
+    // ROIs, state definitions, move restrictions and state update groups
+    if (!r.readCount(n, 1))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        ROIConstPtr roi;
+        if (!r.read(id) || !read(r, roi))
+            return false;
+        req.setROI(id, roi);
+    }
+
+    if (!r.readCount(n, 1))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        StateDefinitionConstPtr sd;
+        if (!r.read(id) || !read(r, sd))
+            return false;
+        req.setStateDefinition(id, sd);
+    }
+
+    if (!r.readCount(n, 1))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        MoveRestrictionsConstPtr mr;
+        if (!r.read(id) || !read(r, mr))
+            return false;
+        req.setMoveRestrictions(id, mr);
+    }
+
+    if (!r.readCount(n, 2))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        if (!r.read(id) || !r.read(value))
+            return false;
+        req.setStateUpdateGroup(id, value);
+    }
+
+    // Relations
+    if (!r.readCount(n, 2 + sizeof(int)))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        std::string child_id;
+        RelationConstPtr tc;
+        if (!r.read(id) || !r.read(child_id) || !read(r, tc))
+            return false;
+        req.setRelation(id, child_id, tc);
+    }
+
+    // Data
+    if (!r.readCount(n, 2))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        tue::config::DataPointer data;
+        if (!r.read(id) || !read(r, data))
+            return false;
+        req.addData(id, data);
+    }
+
+    // Properties
+    if (!r.readCount(n, 1 + sizeof(int)))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        int num_properties;
+        if (!r.read(id) || !r.readCount(num_properties, 2))
+            return false;
+
+        for(int j = 0; j < num_properties; ++j)
+        {
+            std::string name;
+            const PropertyKeyDBEntry* entry;
+            Variant v;
+            if (!read(r, property_key_db, entry, v, name))
+                return false;
+
+            if (entry)
+                req.setProperty(id, entry, v);
+            else
+                log::warning() << "Skipping unknown property '" << name << "' of entity '" << id << "'" << std::endl;
+        }
+    }
+
+    // Removed entities
+    if (!r.readCount(n, 1))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        if (!r.read(id))
+            return false;
+        req.removeEntity(id);
+    }
+
+    // Flags
+    if (!r.readCount(n, 2))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        if (!r.read(id) || !r.read(value))
+            return false;
+        req.setFlag(id, value);
+    }
+
+    if (!r.readCount(n, 1 + sizeof(int)))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        std::set<std::string> flags;
+        if (!r.read(id) || !read(r, flags))
+            return false;
+        for(std::set<std::string>::const_iterator it = flags.begin(); it != flags.end(); ++it)
+            req.addFlag(id, *it);
+    }
+
+    if (!r.readCount(n, 2))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        if (!r.read(id) || !r.read(value))
+            return false;
+        req.removeFlag(id, value);
+    }
+
+    int is_sync_update;
+    if (!r.read(is_sync_update))
+        return false;
+    req.setSyncUpdate(is_sync_update);
+
+    return r.ok();
+}
+
+} // end namespace binary
+
+} // end namespace ed
@@ -0,0 +1,172 @@
+#ifndef ED_IO_FILESYSTEM_BINARY_IO_H_
+#define ED_IO_FILESYSTEM_BINARY_IO_H_
+
+// Helpers for the binary snapshot, journal and shape cache files: values are written with an OArchive and
+// read back directly from a memory mapped file.
+
+#include "ed/types.h"
+#include "ed/variant.h"
+#include "ed/serialization/archive.h"
+#include "ed/convex_hull.h"
+
+#include <tue/config/data_pointer.h>
+
+#include <geolib/datatypes.h>
+
+#include <cstring>
+#include <set>
+#include <string>
+
+namespace ed
+{
+
+struct Property;
+class TransformCache;
+struct PropertyKeyDBEntry;
+class PropertyKeyDB;
+
+namespace binary
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Read-only memory mapping of a complete file
+class MappedFile
+{
+
+public:
+
+    MappedFile() : data_(0), size_(0) {}
+
+    ~MappedFile();
+
+    bool open(const std::string& filename);
+
+    const char* data() const { return data_; }
+
+    std::size_t size() const { return size_; }
+
+private:
+
+    const char* data_;
+
+    std::size_t size_;
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Reads the values written by an OArchive directly from memory
+class BufferReader
+{
+
+public:
+
+    BufferReader(const char* data, std::size_t size) : p_(data), end_(data + size), ok_(true) {}
+
+    template<typename T>
+    bool read(T& v)
+    {
+        if (!ok_ || static_cast<std::size_t>(end_ - p_) < sizeof(T))
+            return fail();
+
+        memcpy(&v, p_, sizeof(T));
+        p_ += sizeof(T);
+        return true;
+    }
+
+    bool read(std::string& s)
+    {
+        if (!ok_)
+            return false;
+
+        const char* z = static_cast<const char*>(memchr(p_, '\0', end_ - p_));
+        if (!z)
+            return fail();
+
+        s.assign(p_, z);
+        p_ = z + 1;
+        return true;
+    }
+
+    /// Reads an element count. Fails if the remaining data cannot contain that many elements.
+    bool readCount(int& n, std::size_t min_element_size)
+    {
+        if (!read(n))
+            return false;
+
+        if (n < 0 || static_cast<std::size_t>(n) * min_element_size > static_cast<std::size_t>(end_ - p_))
+            return fail();
+
+        return true;
+    }
+
+    bool ok() const { return ok_; }
+
+    /// Start of the data that was not read yet
+    const char* position() const { return p_; }
+
+private:
+
+    const char* p_;
+
+    const char* end_;
+
+    bool ok_;
+
+    bool fail() { ok_ = false; return false; }
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const geo::Pose3D& pose);
+bool read(BufferReader& r, geo::Pose3D& pose);
+
+void write(OArchive& a, const std::set<std::string>& strings);
+bool read(BufferReader& r, std::set<std::string>& strings);
+
+void write(OArchive& a, const geo::Mesh& mesh);
+bool read(BufferReader& r, geo::Mesh& mesh);
+
+void write(OArchive& a, const ConvexHull& ch);
+bool read(BufferReader& r, ConvexHull& ch);
+
+void write(OArchive& a, const ROI& roi);
+bool read(BufferReader& r, ROIConstPtr& roi);
+
+void write(OArchive& a, const StateDefinition& sd);
+bool read(BufferReader& r, StateDefinitionConstPtr& sd);
+
+void write(OArchive& a, const MoveRestrictions& mr);
+bool read(BufferReader& r, MoveRestrictionsConstPtr& mr);
+
+/// Transform cache relation: all time stamped poses
+void write(OArchive& a, const TransformCache& tc);
+bool read(BufferReader& r, RelationConstPtr& tc);
+
+/// Entity data is stored as a YAML string (empty if there is no data)
+void write(OArchive& a, const tue::config::DataConstPointer& data);
+bool read(BufferReader& r, tue::config::DataPointer& data);
+
+/// Properties are stored by name with a JSON value. Only serializable properties can be written.
+void write(OArchive& a, const Property& prop);
+
+/// Reads a property. 'entry' is null if the property is unknown in 'property_key_db' or not serializable.
+bool read(BufferReader& r, const PropertyKeyDB& property_key_db, const PropertyKeyDBEntry*& entry, Variant& value,
+          std::string& name);
+
+/// Shapes, storing each mesh once, also if it is shared by multiple (instanced) shapes. Instanced shapes are
+/// read as instances of the same mesh.
+void write(OArchive& a, const std::vector<const geo::Shape*>& shapes);
+bool read(BufferReader& r, std::vector<geo::ShapeConstPtr>& shapes);
+
+/// Update request without its measurements. Only transform cache relations and serializable properties are written.
+void write(OArchive& a, const UpdateRequest& req);
+bool read(BufferReader& r, const PropertyKeyDB& property_key_db, UpdateRequest& req);
+
+} // end namespace binary
+
+} // end namespace ed
+
+#endif
@@ -0,0 +1,154 @@
+#include "binary_io.h"
+
+#include <geolib/Shape.h>
+#include <geolib/Mesh.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The primitives in this file are part of ed_core, such that the model loader can use them (shape cache)
+
+namespace ed
+{
+
+namespace binary
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+MappedFile::~MappedFile()
+{
+    if (data_)
+        munmap(const_cast<char*>(data_), size_);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool MappedFile::open(const std::string& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (p == MAP_FAILED)
+        return false;
+
+    data_ = static_cast<const char*>(p);
+    size_ = st.st_size;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const geo::Pose3D& pose)
+{
+    geo::Quaternion q = pose.getQuaternion();
+    a << (double)pose.t.x << (double)pose.t.y << (double)pose.t.z
+      << (double)q.x << (double)q.y << (double)q.z << (double)q.w;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, geo::Pose3D& pose)
+{
+    double x, y, z;
+    geo::Quaternion q;
+    double qx, qy, qz, qw;
+    if (!r.read(x) || !r.read(y) || !r.read(z) || !r.read(qx) || !r.read(qy) || !r.read(qz) || !r.read(qw))
+        return false;
+
+    pose.t = geo::Vector3(x, y, z);
+    q.x = qx; q.y = qy; q.z = qz; q.w = qw;
+    pose.R.setRotation(q);
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const std::set<std::string>& strings)
+{
+    a << (int)strings.size();
+    for(std::set<std::string>::const_iterator it = strings.begin(); it != strings.end(); ++it)
+        a << *it;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, std::set<std::string>& strings)
+{
+    int n;
+    if (!r.readCount(n, 1))
+        return false;
+
+    for(int i = 0; i < n; ++i)
+    {
+        std::string s;
+        if (!r.read(s))
+            return false;
+        strings.insert(s);
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void write(OArchive& a, const geo::Mesh& mesh)
+{
+    const std::vector<geo::Vector3>& vertices = mesh.getPoints();
+    a << (int)vertices.size();
+    for(std::vector<geo::Vector3>::const_iterator it = vertices.begin(); it != vertices.end(); ++it)
+        a << (double)it->x << (double)it->y << (double)it->z;
+
+    const std::vector<geo::TriangleI>& triangles = mesh.getTriangleIs();
+    a << (int)triangles.size();
+    for(std::vector<geo::TriangleI>::const_iterator it = triangles.begin(); it != triangles.end(); ++it)
+        a << it->i1_ << it->i2_ << it->i3_;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool read(BufferReader& r, geo::Mesh& mesh)
+{
+    int num_vertices;
+    if (!r.readCount(num_vertices, 3 * sizeof(double)))
+        return false;
+
+    for(int i = 0; i < num_vertices; ++i)
+    {
+        double x, y, z;
+        r.read(x); r.read(y); r.read(z);
+        mesh.addPoint(geo::Vector3(x, y, z));
+    }
+
+    int num_triangles;
+    if (!r.readCount(num_triangles, 3 * sizeof(int)))
+        return false;
+
+    for(int i = 0; i < num_triangles; ++i)
+    {
+        int i1, i2, i3;
+        r.read(i1); r.read(i2); r.read(i3);
+        if (i1 < 0 || i2 < 0 || i3 < 0 || i1 >= num_vertices || i2 >= num_vertices || i3 >= num_vertices)
+            return false;
+        mesh.addTriangle(i1, i2, i3);
+    }
+
+    return r.ok();
+}
+
+} // end namespace binary
+
+} // end namespace ed
@@ -0,0 +1,502 @@
+#include "ed/io/filesystem/journal.h"
+#include "ed/io/filesystem/snapshot.h"
+#include "binary_io.h"
+
+#include "ed/world_model.h"
+#include "ed/update_request.h"
+#include "ed/logging.h"
+
+#include <boost/crc.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ed
+{
+
+namespace
+{
+
+using binary::BufferReader;
+using binary::MappedFile;
+using binary::read;
+using binary::write;
+
+// Increase if the record format changes
+const int JOURNAL_VERSION = 2;
+
+// Every record starts with: payload size, CRC-32 of sequence number and payload, sequence number
+struct RecordHeader
+{
+    uint32_t size;
+    uint32_t crc;
+    uint64_t sequence;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+uint32_t recordCRC(uint64_t sequence, const char* payload, std::size_t size)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(&sequence, sizeof(sequence));
+    crc.process_bytes(payload, size);
+    return crc.checksum();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+std::string segmentFilename(const std::string& directory, unsigned long first_sequence)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "/journal-%020lu.log", first_sequence);
+    return directory + buf;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+std::string checkpointFilename(const std::string& directory, unsigned long sequence)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "/checkpoint-%020lu.snapshot", sequence);
+    return directory + buf;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool parseFilename(const std::string& filename, const std::string& prefix, const std::string& suffix, unsigned long& n)
+{
+    if (filename.size() <= prefix.size() + suffix.size() || filename.compare(0, prefix.size(), prefix) != 0
+            || filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) != 0)
+        return false;
+
+    std::string number = filename.substr(prefix.size(), filename.size() - prefix.size() - suffix.size());
+    if (number.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+
+    n = strtoul(number.c_str(), 0, 10);
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Lists the sequence numbers of the checkpoints and journal segments in the directory (sorted)
+void listFiles(const std::string& directory, std::vector<unsigned long>& checkpoints, std::vector<unsigned long>& segments)
+{
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+        return;
+
+    while(struct dirent* entry = readdir(dir))
+    {
+        unsigned long n;
+        if (parseFilename(entry->d_name, "checkpoint-", ".snapshot", n))
+            checkpoints.push_back(n);
+        else if (parseFilename(entry->d_name, "journal-", ".log", n))
+            segments.push_back(n);
+    }
+
+    closedir(dir);
+
+    std::sort(checkpoints.begin(), checkpoints.end());
+    std::sort(segments.begin(), segments.end());
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Makes renames and deletes in the directory durable
+void syncDirectory(const std::string& directory)
+{
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    fsync(fd);
+    ::close(fd);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Renames a checkpoint or segment that can not be recovered, such that it is kept but no longer used
+void moveAside(const std::string& directory, const std::string& filename)
+{
+    std::string target = filename + ".unrecovered";
+    struct stat st;
+    for(int i = 1; stat(target.c_str(), &st) == 0; ++i)
+    {
+        std::stringstream s;
+        s << filename << ".unrecovered." << i;
+        target = s.str();
+    }
+
+    if (rename(filename.c_str(), target.c_str()) != 0)
+    {
+        log::error() << "Journal: could not move '" << filename << "' aside: " << strerror(errno) << std::endl;
+        return;
+    }
+
+    log::error() << "Journal: moved '" << filename << "' to '" << target << "'" << std::endl;
+    syncDirectory(directory);
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+Journal::Journal() : sequence_(0), checkpoint_sequence_(0), request_stop_(false), fd_(-1)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    close();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool Journal::open(const std::string& directory, const PropertyKeyDB& property_key_db,
+                   UpdateRequestPtr& checkpoint, std::vector<UpdateRequestPtr>& records)
+{
+    close();
+
+    directory_ = directory;
+    if (mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        log::error() << "Could not create journal directory '" << directory_ << "': " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned long> checkpoints, segments;
+    listFiles(directory_, checkpoints, segments);
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Load the newest checkpoint that can be read. Checkpoints that can not be read (corrupt, or written
+    // with another snapshot version) are moved aside, not deleted.
+
+    checkpoint.reset();
+    checkpoint_sequence_ = 0;
+    for(std::vector<unsigned long>::const_reverse_iterator it = checkpoints.rbegin(); it != checkpoints.rend(); ++it)
+    {
+        SnapshotHeader header;
+        UpdateRequestPtr req(new UpdateRequest);
+        if (readSnapshot(checkpointFilename(directory_, *it), property_key_db, header, *req))
+        {
+            checkpoint = req;
+            checkpoint_sequence_ = *it;
+            break;
+        }
+
+        log::error() << "Journal: could not read checkpoint " << *it << std::endl;
+        moveAside(directory_, checkpointFilename(directory_, *it));
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Replay the records after the checkpoint
+
+    sequence_ = checkpoint_sequence_;
+
+    for(std::size_t i = 0; i < segments.size(); ++i)
+    {
+        std::string filename = segmentFilename(directory_, segments[i]);
+
+        // Skip segments that only contain records which are part of the checkpoint
+        if (i + 1 < segments.size() && segments[i + 1] <= checkpoint_sequence_ + 1)
+            continue;
+
+        MappedFile file;
+        if (!file.open(filename))
+            continue;
+
+        // Set if the record at 'offset' is incomplete, i.e. it reaches the end of the file
+        bool torn = false;
+
+        std::size_t offset = 0;
+        while(offset < file.size())
+        {
+            RecordHeader header;
+            if (file.size() - offset < sizeof(header))
+            {
+                torn = true;
+                break;
+            }
+
+            memcpy(&header, file.data() + offset, sizeof(header));
+            const char* payload = file.data() + offset + sizeof(header);
+            std::size_t available = file.size() - offset - sizeof(header);
+
+            if (available < header.size || header.crc != recordCRC(header.sequence, payload, header.size))
+            {
+                torn = (available <= header.size);
+                break;
+            }
+
+            if (header.sequence > checkpoint_sequence_)
+            {
+                if (header.sequence != sequence_ + 1)
+                    break;
+
+                UpdateRequestPtr req(new UpdateRequest);
+                BufferReader r(payload, header.size);
+                int version;
+                if (!r.read(version) || version != JOURNAL_VERSION || !read(r, property_key_db, *req))
+                    break;
+
+                records.push_back(req);
+                sequence_ = header.sequence;
+            }
+
+            offset += sizeof(header) + header.size;
+        }
+
+        if (offset == file.size())
+            continue;
+
+        if (torn && i + 1 == segments.size())
+        {
+            // A crash while writing leaves a torn record at the end of the journal. Cut it off, such that
+            // new records are not appended after it.
+            log::warning() << "Journal: discarding " << (file.size() - offset) << " bytes at the end of '"
+                           << filename << "'" << std::endl;
+            if (truncate(filename.c_str(), offset) != 0)
+                log::error() << "Journal: could not truncate '" << filename << "'" << std::endl;
+        }
+        else
+        {
+            // A corrupt record, a gap in the sequence or a record of another version: the records from here on
+            // can not be applied. They are kept, but moved out of the way of the new records.
+            log::error() << "Journal: could not replay record " << (sequence_ + 1) << " from '" << filename
+                         << "', stopping recovery" << std::endl;
+            for(std::size_t j = i; j < segments.size(); ++j)
+                moveAside(directory_, segmentFilename(directory_, segments[j]));
+        }
+
+        break;
+    }
+
+    if (checkpoint || !records.empty())
+        log::info() << "Journal: recovered checkpoint " << checkpoint_sequence_ << " and " << records.size()
+                    << " records" << std::endl;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Start appending
+
+    if (!openSegment(sequence_ + 1))
+        return false;
+
+    request_stop_ = false;
+    thread_.reset(new boost::thread(boost::bind(&Journal::run, this)));
+    pthread_setname_np(thread_->native_handle(), "journal");
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Journal::close()
+{
+    if (thread_)
+    {
+        {
+            boost::lock_guard<boost::mutex> lg(mutex_);
+            request_stop_ = true;
+        }
+        cond_.notify_one();
+
+        thread_->join();
+        thread_.reset();
+    }
+
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Journal::append(const UpdateRequest& req)
+{
+    if (!thread_ || req.empty())
+        return;
+
+    // Reserve space for the header and serialize the request after it
+    std::stringstream s;
+    s.write(std::string(sizeof(RecordHeader), '\0').c_str(), sizeof(RecordHeader));
+
+    OArchive a(s, JOURNAL_VERSION);
+    write(a, req);
+
+    Task task;
+    task.record = s.str();
+    task.sequence = ++sequence_;
+
+    RecordHeader header;
+    header.size = task.record.size() - sizeof(header);
+    header.sequence = task.sequence;
+    header.crc = recordCRC(header.sequence, task.record.c_str() + sizeof(header), header.size);
+    task.record.replace(0, sizeof(header), reinterpret_cast<const char*>(&header), sizeof(header));
+
+    {
+        boost::lock_guard<boost::mutex> lg(mutex_);
+        pending_.push_back(task);
+    }
+    cond_.notify_one();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Journal::checkpoint(const WorldModelConstPtr& world)
+{
+    if (!thread_)
+        return;
+
+    Task task;
+    task.world = world;
+    task.sequence = sequence_;
+    checkpoint_sequence_ = sequence_;
+
+    {
+        boost::lock_guard<boost::mutex> lg(mutex_);
+        pending_.push_back(task);
+    }
+    cond_.notify_one();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Journal::run()
+{
+    std::vector<Task> tasks;
+    std::string batch;
+
+    while(true)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while(pending_.empty() && !request_stop_)
+                cond_.wait(lock);
+
+            if (pending_.empty())
+                break;
+
+            tasks.swap(pending_);
+        }
+
+        // Group commit: all records that came in since the last flush are written and synced at once
+        batch.clear();
+        for(std::vector<Task>::const_iterator it = tasks.begin(); it != tasks.end(); ++it)
+        {
+            if (it->world)
+            {
+                flush(batch);
+                batch.clear();
+                writeCheckpoint(*it->world, it->sequence);
+            }
+            else
+            {
+                batch += it->record;
+            }
+        }
+
+        flush(batch);
+        tasks.clear();
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool Journal::openSegment(unsigned long first_sequence)
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+
+    std::string filename = segmentFilename(directory_, first_sequence);
+    fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0)
+    {
+        log::error() << "Could not open journal segment '" << filename << "': " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    syncDirectory(directory_);
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool Journal::flush(const std::string& data)
+{
+    if (data.empty() || fd_ < 0)
+        return true;
+
+    std::size_t written = 0;
+    while(written < data.size())
+    {
+        ssize_t n = ::write(fd_, data.c_str() + written, data.size() - written);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            log::error() << "Could not write to journal: " << strerror(errno) << std::endl;
+            return false;
+        }
+        written += n;
+    }
+
+    if (fdatasync(fd_) != 0)
+    {
+        log::error() << "Could not sync journal: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Journal::writeCheckpoint(const WorldModel& world, unsigned long sequence)
+{
+    // Records after the checkpoint go to a new segment, such that the old ones can be deleted
+    if (!openSegment(sequence + 1))
+        return;
+
+    std::string filename = checkpointFilename(directory_, sequence);
+    if (!writeSnapshot(filename, world, SnapshotHeader()))
+        return;
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0 || fsync(fd) != 0)
+    {
+        log::error() << "Could not sync journal checkpoint '" << filename << "'" << std::endl;
+        if (fd >= 0)
+            ::close(fd);
+        return;
+    }
+    ::close(fd);
+    syncDirectory(directory_);
+
+    // The checkpoint is durable: everything before it is no longer needed
+    std::vector<unsigned long> checkpoints, segments;
+    listFiles(directory_, checkpoints, segments);
+
+    for(std::vector<unsigned long>::const_iterator it = checkpoints.begin(); it != checkpoints.end(); ++it)
+        if (*it < sequence)
+            remove(checkpointFilename(directory_, *it).c_str());
+
+    for(std::vector<unsigned long>::const_iterator it = segments.begin(); it != segments.end(); ++it)
+        if (*it <= sequence)
+            remove(segmentFilename(directory_, *it).c_str());
+}
+
+} // end namespace ed
@@ -0,0 +1,552 @@
+#include "ed/io/filesystem/measurement_archive.h"
+#include "binary_io.h"
+
+#include "ed/measurement.h"
+#include "ed/uuid.h"
+#include "ed/serialization/serialization.h"
+#include "ed/logging.h"
+
+#include <rgbd/Image.h>
+#include <rgbd/serialization.h>
+
+#include <tue/serialization/input_archive.h>
+#include <tue/serialization/output_archive.h>
+
+#include <cstring>
+#include <sstream>
+#include <streambuf>
+
+#include <unistd.h>
+
+namespace ed
+{
+
+namespace
+{
+
+using binary::BufferReader;
+using binary::MappedFile;
+
+const char ARCHIVE_MAGIC[] = "EDMSRA";
+const char INDEX_MAGIC[8] = { 'E', 'D', 'M', 'S', 'R', 'I', 'D', 'X' };
+
+// Increase if the format changes
+const int ARCHIVE_VERSION = 1;
+
+// Every record starts with its type and the size of its payload
+enum RecordType
+{
+    RECORD_IMAGE = 1,
+    RECORD_MEASUREMENT = 2
+};
+
+struct RecordHeader
+{
+    uint32_t type;
+    uint32_t size;
+};
+
+// Last bytes of a closed archive. Locates the index, which lists the measurement records.
+struct Footer
+{
+    uint64_t index_offset;
+    uint64_t num_entries;
+    char magic[8];
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Read-only stream buffer on top of memory, such that tue archives can read from the mapped file
+class MemoryBuffer : public std::streambuf
+{
+
+public:
+
+    MemoryBuffer(const char* data, std::size_t size)
+    {
+        char* p = const_cast<char*>(data);
+        setg(p, p, p + size);
+    }
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+template<typename T>
+void append(std::string& buffer, const T& v)
+{
+    buffer.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void appendRecord(std::string& buffer, RecordType type, const std::string& payload)
+{
+    RecordHeader header;
+    header.type = type;
+    header.size = payload.size();
+    append(buffer, header);
+    buffer += payload;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+std::size_t headerSize()
+{
+    return sizeof(ARCHIVE_MAGIC) + sizeof(ARCHIVE_VERSION);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// Reads the index of the archive. Returns the offset at which new records can be appended.
+bool readIndex(const MappedFile& file, std::vector<MeasurementArchiveWriter::IndexEntry>& index, std::size_t& end)
+{
+    BufferReader r_header(file.data(), file.size());
+    std::string magic;
+    int version;
+    if (!r_header.read(magic) || magic != ARCHIVE_MAGIC || !r_header.read(version) || version != ARCHIVE_VERSION)
+        return false;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Closed archive: read the index footer
+
+    Footer footer;
+    if (file.size() >= headerSize() + sizeof(footer))
+    {
+        memcpy(&footer, file.data() + file.size() - sizeof(footer), sizeof(footer));
+        if (memcmp(footer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 && footer.index_offset >= headerSize()
+                && footer.index_offset <= file.size() - sizeof(footer))
+        {
+            BufferReader r(file.data() + footer.index_offset, file.size() - sizeof(footer) - footer.index_offset);
+            for(uint64_t i = 0; i < footer.num_entries; ++i)
+            {
+                MeasurementArchiveWriter::IndexEntry entry;
+                if (!r.read(entry.id) || !r.read(entry.timestamp) || !r.read(entry.offset))
+                    return false;
+                index.push_back(entry);
+            }
+
+            end = footer.index_offset;
+            return true;
+        }
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // No index (the writer did not close the archive): scan the records
+
+    std::size_t offset = headerSize();
+    while(file.size() - offset >= sizeof(RecordHeader))
+    {
+        RecordHeader header;
+        memcpy(&header, file.data() + offset, sizeof(header));
+        if (file.size() - offset - sizeof(header) < header.size)
+            break;
+
+        if (header.type == RECORD_MEASUREMENT)
+        {
+            MeasurementArchiveWriter::IndexEntry entry;
+            BufferReader r(file.data() + offset + sizeof(header), header.size);
+            if (!r.read(entry.id) || !r.read(entry.timestamp))
+                break;
+            entry.offset = offset;
+            index.push_back(entry);
+        }
+
+        offset += sizeof(header) + header.size;
+    }
+
+    if (offset < file.size())
+        log::warning() << "Measurement archive: ignoring " << (file.size() - offset) << " bytes of incomplete records" << std::endl;
+
+    end = offset;
+    return true;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+//
+//                                               WRITER
+//
+// ----------------------------------------------------------------------------------------------------
+
+MeasurementArchiveWriter::MeasurementArchiveWriter() : request_stop_(false), offset_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+MeasurementArchiveWriter::~MeasurementArchiveWriter()
+{
+    close();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool MeasurementArchiveWriter::open(const std::string& filename)
+{
+    close();
+
+    index_.clear();
+    image_offsets_.clear();
+
+    // Keep the measurements of an existing archive: the new records overwrite its index
+    std::size_t end = 0;
+    {
+        MappedFile file;
+        if (file.open(filename) && !readIndex(file, index_, end))
+        {
+            log::error() << "'" << filename << "' is not a measurement archive" << std::endl;
+            return false;
+        }
+    }
+
+    if (end > 0)
+    {
+        if (truncate(filename.c_str(), end) != 0)
+        {
+            log::error() << "Could not open measurement archive '" << filename << "'" << std::endl;
+            return false;
+        }
+
+        out_.open(filename.c_str(), std::ofstream::binary | std::ofstream::app);
+        offset_ = end;
+    }
+    else
+    {
+        out_.open(filename.c_str(), std::ofstream::binary | std::ofstream::trunc);
+        out_.write(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+        out_.write(reinterpret_cast<const char*>(&ARCHIVE_VERSION), sizeof(ARCHIVE_VERSION));
+        offset_ = headerSize();
+    }
+
+    if (!out_.is_open() || out_.fail())
+    {
+        log::error() << "Could not open measurement archive '" << filename << "'" << std::endl;
+        out_.close();
+        return false;
+    }
+
+    filename_ = filename;
+    request_stop_ = false;
+    thread_.reset(new boost::thread(boost::bind(&MeasurementArchiveWriter::run, this)));
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementArchiveWriter::close()
+{
+    if (!thread_)
+        return;
+
+    {
+        boost::lock_guard<boost::mutex> lg(mutex_);
+        request_stop_ = true;
+    }
+    cond_.notify_one();
+
+    thread_->join();
+    thread_.reset();
+
+    // Index footer
+    std::string buffer;
+    for(std::vector<IndexEntry>::const_iterator it = index_.begin(); it != index_.end(); ++it)
+    {
+        buffer.append(it->id.c_str(), it->id.size() + 1);
+        append(buffer, it->timestamp);
+        append(buffer, it->offset);
+    }
+
+    Footer footer;
+    footer.index_offset = offset_;
+    footer.num_entries = index_.size();
+    memcpy(footer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    append(buffer, footer);
+
+    out_.write(buffer.c_str(), buffer.size());
+    out_.close();
+
+    if (out_.fail())
+        log::error() << "Could not write index of measurement archive '" << filename_ << "'" << std::endl;
+
+    image_offsets_.clear();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementArchiveWriter::add(const UUID& id, const MeasurementConstPtr& msr)
+{
+    if (!thread_ || !msr || !msr->image())
+        return;
+
+    {
+        boost::lock_guard<boost::mutex> lg(mutex_);
+        pending_.push_back(std::make_pair(id.str(), msr));
+    }
+    cond_.notify_one();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementArchiveWriter::run()
+{
+    std::vector<std::pair<std::string, MeasurementConstPtr> > measurements;
+    std::string buffer;
+
+    while(true)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while(pending_.empty() && !request_stop_)
+                cond_.wait(lock);
+
+            if (pending_.empty())
+                break;
+
+            measurements.swap(pending_);
+        }
+
+        // Serialize everything that came in, and append it with one write
+        buffer.clear();
+        for(std::vector<std::pair<std::string, MeasurementConstPtr> >::const_iterator it = measurements.begin();
+            it != measurements.end(); ++it)
+            write(it->first, *it->second, buffer);
+
+        measurements.clear();
+
+        out_.write(buffer.c_str(), buffer.size());
+        out_.flush();
+        offset_ += buffer.size();
+
+        // Forget images that are no longer used anywhere
+        std::map<const rgbd::Image*, std::pair<boost::weak_ptr<const rgbd::Image>, unsigned long long> >::iterator it
+                = image_offsets_.begin();
+        while(it != image_offsets_.end())
+        {
+            if (it->second.first.expired())
+                image_offsets_.erase(it++);
+            else
+                ++it;
+        }
+
+        if (out_.fail())
+        {
+            log::error() << "Could not write to measurement archive '" << filename_ << "'" << std::endl;
+            break;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementArchiveWriter::write(const std::string& id, const Measurement& msr, std::string& buffer)
+{
+    const rgbd::ImageConstPtr& image = msr.image();
+    if (!image)
+    {
+        log::error() << "Could not archive measurement of '" << id << "': image could not be loaded" << std::endl;
+        return;
+    }
+
+    // Image (only if it was not written before)
+    unsigned long long image_offset;
+    std::map<const rgbd::Image*, std::pair<boost::weak_ptr<const rgbd::Image>, unsigned long long> >::iterator it_image
+            = image_offsets_.find(image.get());
+
+    if (it_image != image_offsets_.end() && it_image->second.first.lock() == image)
+    {
+        image_offset = it_image->second.second;
+    }
+    else
+    {
+        std::stringstream s;
+        tue::serialization::OutputArchive a(s);
+        rgbd::serialize(*image, a);
+
+        image_offset = offset_ + buffer.size();
+        appendRecord(buffer, RECORD_IMAGE, s.str());
+
+        image_offsets_[image.get()] = std::make_pair(boost::weak_ptr<const rgbd::Image>(image), image_offset);
+    }
+
+    // Measurement: id and timestamp first, such that an archive without index can be scanned
+    std::string payload;
+    payload.append(id.c_str(), id.size() + 1);
+
+    double timestamp = msr.timestamp();
+    append(payload, timestamp);
+    append(payload, image_offset);
+
+    {
+        std::stringstream s;
+        OArchive a_pose(s, ARCHIVE_VERSION);
+        binary::write(a_pose, msr.sensorPose());
+
+        tue::serialization::OutputArchive a_mask(s);
+        serialize(msr.imageMask(), a_mask);
+
+        payload += s.str();
+    }
+
+    IndexEntry entry;
+    entry.id = id;
+    entry.timestamp = timestamp;
+    entry.offset = offset_ + buffer.size();
+    index_.push_back(entry);
+
+    appendRecord(buffer, RECORD_MEASUREMENT, payload);
+}
+
+// ----------------------------------------------------------------------------------------------------
+//
+//                                               READER
+//
+// ----------------------------------------------------------------------------------------------------
+
+MeasurementArchiveReader::MeasurementArchiveReader()
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+MeasurementArchiveReader::~MeasurementArchiveReader()
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool MeasurementArchiveReader::open(const std::string& filename)
+{
+    index_.clear();
+
+    file_.reset(new MappedFile);
+    if (!file_->open(filename))
+    {
+        log::error() << "Could not open measurement archive '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    std::vector<MeasurementArchiveWriter::IndexEntry> index;
+    std::size_t end;
+    if (!readIndex(*file_, index, end))
+    {
+        log::error() << "'" << filename << "' is not a valid measurement archive" << std::endl;
+        return false;
+    }
+
+    for(std::vector<MeasurementArchiveWriter::IndexEntry>::const_iterator it = index.begin(); it != index.end(); ++it)
+        index_[it->id][it->timestamp] = it->offset;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementArchiveReader::getEntityIds(std::vector<std::string>& ids) const
+{
+    for(std::map<std::string, std::map<double, unsigned long long> >::const_iterator it = index_.begin(); it != index_.end(); ++it)
+        ids.push_back(it->first);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementArchiveReader::getTimestamps(const std::string& id, std::vector<double>& timestamps) const
+{
+    std::map<std::string, std::map<double, unsigned long long> >::const_iterator it = index_.find(id);
+    if (it == index_.end())
+        return;
+
+    for(std::map<double, unsigned long long>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2)
+        timestamps.push_back(it2->first);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool MeasurementArchiveReader::read(const std::string& id, double timestamp, Measurement& msr) const
+{
+    std::map<std::string, std::map<double, unsigned long long> >::const_iterator it = index_.find(id);
+    if (it == index_.end())
+        return false;
+
+    // Latest measurement at or before the timestamp
+    std::map<double, unsigned long long>::const_iterator it2 = it->second.upper_bound(timestamp);
+    if (it2 == it->second.begin())
+        return false;
+    --it2;
+
+    return readRecord(it2->second, msr);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool MeasurementArchiveReader::read(const std::string& id, Measurement& msr) const
+{
+    std::map<std::string, std::map<double, unsigned long long> >::const_iterator it = index_.find(id);
+    if (it == index_.end() || it->second.empty())
+        return false;
+
+    return readRecord(it->second.rbegin()->second, msr);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool MeasurementArchiveReader::readRecord(unsigned long long offset, Measurement& msr) const
+{
+    RecordHeader header;
+    if (offset > file_->size() || file_->size() - offset < sizeof(header))
+        return false;
+
+    memcpy(&header, file_->data() + offset, sizeof(header));
+    if (header.type != RECORD_MEASUREMENT || file_->size() - offset - sizeof(header) < header.size)
+        return false;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Measurement record
+
+    const char* payload = file_->data() + offset + sizeof(header);
+    BufferReader r(payload, header.size);
+
+    std::string id;
+    double timestamp;
+    unsigned long long image_offset;
+    int version;
+    geo::Pose3D sensor_pose;
+    if (!r.read(id) || !r.read(timestamp) || !r.read(image_offset) || !r.read(version) || version != ARCHIVE_VERSION
+            || !binary::read(r, sensor_pose))
+        return false;
+
+    // The mask follows the pose
+    MemoryBuffer mask_buffer(r.position(), payload + header.size - r.position());
+    std::istream mask_stream(&mask_buffer);
+    tue::serialization::InputArchive a_mask(mask_stream);
+
+    ImageMask mask;
+    if (!deserialize(a_mask, mask))
+        return false;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Image record
+
+    RecordHeader image_header;
+    if (image_offset > file_->size() || file_->size() - image_offset < sizeof(image_header))
+        return false;
+
+    memcpy(&image_header, file_->data() + image_offset, sizeof(image_header));
+    if (image_header.type != RECORD_IMAGE || file_->size() - image_offset - sizeof(image_header) < image_header.size)
+        return false;
+
+    MemoryBuffer image_buffer(file_->data() + image_offset + sizeof(image_header), image_header.size);
+    std::istream image_stream(&image_buffer);
+    tue::serialization::InputArchive a_image(image_stream);
+
+    rgbd::ImagePtr image(new rgbd::Image);
+    if (!rgbd::deserialize(a_image, *image))
+        return false;
+
+    msr = Measurement(image, mask, sensor_pose);
+    return true;
+}
+
+} // end namespace ed
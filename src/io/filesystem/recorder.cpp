@@ -0,0 +1,183 @@
+#include "ed/io/filesystem/recorder.h"
+#include "ed/io/filesystem/snapshot.h"
+#include "binary_io.h"
+
+#include "ed/update_request.h"
+#include "ed/logging.h"
+
+#include <cerrno>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <sys/time.h>
+
+namespace ed
+{
+
+namespace
+{
+
+using binary::BufferReader;
+using binary::MappedFile;
+
+const char RECORDING_MAGIC[] = "EDREC";
+
+// Increase if the format changes
+const int RECORDING_VERSION = 2;
+
+// ----------------------------------------------------------------------------------------------------
+
+double wallTime()
+{
+    timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+Recorder::Recorder() : num_records_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+Recorder::~Recorder()
+{
+    close();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool Recorder::open(const std::string& directory, const WorldModel& world)
+{
+    close();
+
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        log::error() << "Could not create recording directory '" << directory << "'" << std::endl;
+        return false;
+    }
+
+    SnapshotHeader header;
+    header.source = "recording";
+    if (!writeSnapshot(directory + "/world.snapshot", world, header))
+        return false;
+
+    std::string filename = directory + "/requests.rec";
+    out_.open(filename.c_str(), std::ofstream::binary | std::ofstream::trunc);
+    if (!out_.is_open())
+    {
+        log::error() << "Could not open recording '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    out_.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    OArchive a(out_, RECORDING_VERSION);
+
+    num_records_ = 0;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Recorder::close()
+{
+    if (out_.is_open())
+        out_.close();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Recorder::record(const UpdateRequest& req)
+{
+    if (!out_.is_open() || req.empty())
+        return;
+
+    double timestamp = wallTime();
+
+    std::stringstream s;
+    OArchive a_req(s, RECORDING_VERSION);
+    binary::write(a_req, req);
+    std::string payload = s.str();
+
+    // Buffered: the recording should affect the timing of the server as little as possible
+    out_.write((const char*)&timestamp, sizeof(timestamp));
+    int size = payload.size();
+    out_.write((const char*)&size, sizeof(size));
+    out_.write(payload.c_str(), payload.size());
+
+    ++num_records_;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+RecordingReader::RecordingReader() : offset_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+RecordingReader::~RecordingReader()
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool RecordingReader::open(const std::string& directory, const PropertyKeyDB& property_key_db, UpdateRequest& world)
+{
+    SnapshotHeader header;
+    if (!readSnapshot(directory + "/world.snapshot", property_key_db, header, world))
+        return false;
+
+    std::string filename = directory + "/requests.rec";
+    file_.reset(new MappedFile);
+    if (!file_->open(filename))
+    {
+        log::error() << "Could not open recording '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    BufferReader r(file_->data(), file_->size());
+    std::string magic;
+    int version;
+    if (!r.read(magic) || magic != RECORDING_MAGIC || !r.read(version) || version != RECORDING_VERSION)
+    {
+        log::error() << "'" << filename << "' is not a recording of this version" << std::endl;
+        return false;
+    }
+
+    offset_ = sizeof(RECORDING_MAGIC) + sizeof(version);
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool RecordingReader::next(const PropertyKeyDB& property_key_db, double& timestamp, UpdateRequest& req)
+{
+    if (!file_ || !file_->data())
+        return false;
+
+    int size;
+    BufferReader r_header(file_->data() + offset_, file_->size() - offset_);
+    if (!r_header.read(timestamp) || !r_header.read(size) || size < 0
+            || file_->size() - offset_ - sizeof(timestamp) - sizeof(size) < static_cast<std::size_t>(size))
+        return false;
+
+    const char* payload = file_->data() + offset_ + sizeof(timestamp) + sizeof(size);
+    offset_ += sizeof(timestamp) + sizeof(size) + size;
+
+    BufferReader r(payload, size);
+    int version;
+    if (!r.read(version) || version != RECORDING_VERSION || !binary::read(r, property_key_db, req))
+    {
+        log::error() << "Invalid request in recording" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+} // end namespace ed
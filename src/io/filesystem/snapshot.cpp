@@ -0,0 +1,484 @@
+#include "ed/io/filesystem/snapshot.h"
+#include "binary_io.h"
+
+#include "ed/world_model.h"
+#include "ed/update_request.h"
+#include "ed/entity.h"
+#include "ed/property_key_db.h"
+#include "ed/relations/transform_cache.h"
+#include "ed/logging.h"
+
+#include <geolib/Shape.h>
+#include <geolib/Mesh.h>
+
+#include <fstream>
+#include <cstdio>
+
+#include <sys/stat.h>
+
+namespace ed
+{
+
+namespace
+{
+
+using binary::BufferReader;
+using binary::MappedFile;
+using binary::read;
+using binary::write;
+
+const char SNAPSHOT_MAGIC[] = "EDSNAP";
+
+// Increase if the format changes. Snapshots of other versions are not loaded.
+const int SNAPSHOT_VERSION = 2;
+
+// ----------------------------------------------------------------------------------------------------
+
+void writeEntity(OArchive& a, const Entity& e, const std::map<const geo::Shape*, int>& shape_idxs)
+{
+    a << e.id().str() << e.type();
+    write(a, e.typeNames());
+    write(a, e.flagNames());
+    a << e.existenceProbability() << e.lastUpdateTimestamp();
+
+    a << (int)e.has_pose();
+    if (e.has_pose())
+        write(a, e.pose());
+
+    a << (int)e.has_original_pose();
+    if (e.has_original_pose())
+        write(a, e.originalPose());
+
+    a << e.stateUpdateGroup();
+
+    const ROIConstPtr& roi = e.ROI();
+    a << (int)(e.has_roi() && roi);
+    if (e.has_roi() && roi)
+        write(a, *roi);
+
+    const StateDefinitionConstPtr& sd = e.stateDefinition();
+    a << (int)(e.has_state_definition() && sd);
+    if (e.has_state_definition() && sd)
+        write(a, *sd);
+
+    const MoveRestrictionsConstPtr& mr = e.moveRestrictions();
+    a << (int)(e.has_move_restrictions() && mr);
+    if (e.has_move_restrictions() && mr)
+        write(a, *mr);
+
+    // Convex hulls per source
+    const std::map<std::string, MeasurementConvexHull>& chull_map = e.convexHullMap();
+    a << (int)chull_map.size();
+    for(std::map<std::string, MeasurementConvexHull>::const_iterator it = chull_map.begin(); it != chull_map.end(); ++it)
+    {
+        const MeasurementConvexHull& m = it->second;
+        a << it->first;
+        write(a, m.convex_hull);
+        write(a, m.pose);
+        a << m.timestamp;
+    }
+
+    // Shape (index of mesh block)
+    int shape_idx = -1;
+    if (e.shape())
+    {
+        std::map<const geo::Shape*, int>::const_iterator it = shape_idxs.find(e.shape().get());
+        if (it != shape_idxs.end())
+            shape_idx = it->second;
+    }
+    a << shape_idx;
+
+    write(a, e.data());
+
+    // Serializable properties
+    std::vector<const Property*> properties;
+    for(std::map<Idx, Property>::const_iterator it = e.properties().begin(); it != e.properties().end(); ++it)
+    {
+        if (it->second.entry && it->second.entry->info->serializable())
+            properties.push_back(&it->second);
+    }
+
+    a << (int)properties.size();
+    for(std::vector<const Property*>::const_iterator it = properties.begin(); it != properties.end(); ++it)
+        write(a, **it);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool readEntity(BufferReader& r, const std::vector<geo::ShapeConstPtr>& shapes, const PropertyKeyDB& property_key_db,
+                UpdateRequest& req)
+{
+    std::string id_str, type;
+    if (!r.read(id_str) || !r.read(type))
+        return false;
+
+    UUID id(id_str);
+
+    if (!type.empty())
+        req.setType(id, type);
+
+    std::set<std::string> types, flags;
+    if (!read(r, types) || !read(r, flags))
+        return false;
+
+    for(std::set<std::string>::const_iterator it = types.begin(); it != types.end(); ++it)
+        req.addType(id, *it);
+
+    for(std::set<std::string>::const_iterator it = flags.begin(); it != flags.end(); ++it)
+        req.addFlag(id, *it);
+
+    double existence_prob, timestamp;
+    r.read(existence_prob);
+    r.read(timestamp);
+    req.setExistenceProbability(id, existence_prob);
+    req.setLastUpdateTimestamp(id, timestamp);
+
+    int has_pose;
+    r.read(has_pose);
+    if (has_pose)
+    {
+        geo::Pose3D pose;
+        if (!read(r, pose))
+            return false;
+        req.setPose(id, pose);
+    }
+
+    int has_original_pose;
+    r.read(has_original_pose);
+    if (has_original_pose)
+    {
+        geo::Pose3D pose;
+        if (!read(r, pose))
+            return false;
+        req.setOriginalPose(id, pose);
+    }
+
+    std::string state_update_group;
+    if (!r.read(state_update_group))
+        return false;
+    if (!state_update_group.empty())
+        req.setStateUpdateGroup(id, state_update_group);
+
+    int has_roi;
+    r.read(has_roi);
+    if (has_roi)
+    {
+        ROIConstPtr roi;
+        if (!read(r, roi))
+            return false;
+        req.setROI(id, roi);
+    }
+
+    int has_state_definition;
+    r.read(has_state_definition);
+    if (has_state_definition)
+    {
+        StateDefinitionConstPtr sd;
+        if (!read(r, sd))
+            return false;
+        req.setStateDefinition(id, sd);
+    }
+
+    int has_move_restrictions;
+    r.read(has_move_restrictions);
+    if (has_move_restrictions)
+    {
+        MoveRestrictionsConstPtr mr;
+        if (!read(r, mr))
+            return false;
+        req.setMoveRestrictions(id, mr);
+    }
+
+    int num_chulls;
+    if (!r.readCount(num_chulls, 1))
+        return false;
+    for(int i = 0; i < num_chulls; ++i)
+    {
+        std::string source;
+        MeasurementConvexHull m;
+        if (!r.read(source) || !read(r, m.convex_hull) || !read(r, m.pose) || !r.read(m.timestamp))
+            return false;
+        req.setConvexHullNew(id, m.convex_hull, m.pose, m.timestamp, source);
+    }
+
+    int shape_idx;
+    r.read(shape_idx);
+    if (shape_idx >= (int)shapes.size())
+        return false;
+    if (shape_idx >= 0)
+        req.setShape(id, shapes[shape_idx]);
+
+    tue::config::DataPointer data;
+    if (!read(r, data))
+        return false;
+    if (!data.empty())
+        req.addData(id, data);
+
+    int num_properties;
+    if (!r.readCount(num_properties, 2))
+        return false;
+    for(int i = 0; i < num_properties; ++i)
+    {
+        std::string name;
+        const PropertyKeyDBEntry* entry;
+        Variant value;
+        if (!read(r, property_key_db, entry, value, name))
+            return false;
+
+        if (entry)
+            req.setProperty(id, entry, value);
+        else
+            log::warning() << "Snapshot: skipping unknown property '" << name << "' of entity '" << id << "'" << std::endl;
+    }
+
+    // Make sure an entity without any other information is still created
+    if (req.updated_entities.find(id) == req.updated_entities.end())
+        req.setType(id, type);
+
+    return r.ok();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool readHeader(BufferReader& r, SnapshotHeader& header)
+{
+    std::string magic;
+    int version;
+    if (!r.read(magic) || magic != SNAPSHOT_MAGIC || !r.read(version))
+        return false;
+
+    if (version != SNAPSHOT_VERSION)
+    {
+        log::warning() << "Snapshot has version " << version << ", expected version " << SNAPSHOT_VERSION << std::endl;
+        return false;
+    }
+
+    if (!r.read(header.source))
+        return false;
+
+    int num_dependencies;
+    if (!r.readCount(num_dependencies, 1 + sizeof(double)))
+        return false;
+
+    header.dependencies.clear();
+    for(int i = 0; i < num_dependencies; ++i)
+    {
+        std::string filename;
+        double mtime;
+        if (!r.read(filename) || !r.read(mtime))
+            return false;
+        header.dependencies[filename] = mtime;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool modificationTime(const std::string& filename, double& mtime)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return false;
+
+    mtime = st.st_mtime;
+    return true;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+bool SnapshotHeader::addDependency(const std::string& filename)
+{
+    double mtime;
+    if (!modificationTime(filename, mtime))
+        return false;
+
+    dependencies[filename] = mtime;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool SnapshotHeader::upToDate() const
+{
+    for(std::map<std::string, double>::const_iterator it = dependencies.begin(); it != dependencies.end(); ++it)
+    {
+        double mtime;
+        if (!modificationTime(it->first, mtime) || mtime != it->second)
+            return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool writeSnapshot(const std::string& filename, const WorldModel& world, const SnapshotHeader& header)
+{
+    // Write to a temporary file first, such that an existing snapshot stays intact if writing fails
+    std::string tmp_filename = filename + ".tmp";
+
+    std::ofstream f_out;
+    f_out.open(tmp_filename.c_str(), std::ofstream::binary);
+
+    if (!f_out.is_open())
+    {
+        log::error() << "Could not save snapshot to '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    f_out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    OArchive a(f_out, SNAPSHOT_VERSION);
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Header
+
+    a << header.source;
+    a << (int)header.dependencies.size();
+    for(std::map<std::string, double>::const_iterator it = header.dependencies.begin(); it != header.dependencies.end(); ++it)
+        a << it->first << it->second;
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Mesh blocks (each shape once, even if it is used by multiple entities, and each mesh once, even if it is
+    // shared by multiple instanced shapes)
+
+    std::map<const geo::Shape*, int> shape_idxs;
+    std::vector<const geo::Shape*> shapes;
+    for(WorldModel::const_iterator it = world.begin(); it != world.end(); ++it)
+    {
+        const EntityConstPtr& e = *it;
+        if (e->shape() && shape_idxs.insert(std::make_pair(e->shape().get(), (int)shapes.size())).second)
+            shapes.push_back(e->shape().get());
+    }
+
+    write(a, shapes);
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Entities
+
+    a << (int)world.numEntities();
+    for(WorldModel::const_iterator it = world.begin(); it != world.end(); ++it)
+        writeEntity(a, **it, shape_idxs);
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Relations (only transform caches can be stored)
+
+    const std::vector<EntityConstPtr>& entities = world.entities();
+
+    std::vector<std::pair<Idx, Idx> > relation_pairs;
+    for(Idx i = 0; i < entities.size(); ++i)
+    {
+        const EntityConstPtr& e = entities[i];
+        if (!e)
+            continue;
+
+        const std::map<Idx, Idx>& relations_to = e->relationsTo();
+        for(std::map<Idx, Idx>::const_iterator it = relations_to.begin(); it != relations_to.end(); ++it)
+        {
+            if (it->first < entities.size() && entities[it->first]
+                    && dynamic_cast<const TransformCache*>(world.relations()[it->second].get()))
+                relation_pairs.push_back(std::make_pair(i, it->first));
+        }
+    }
+
+    a << (int)relation_pairs.size();
+    for(std::vector<std::pair<Idx, Idx> >::const_iterator it = relation_pairs.begin(); it != relation_pairs.end(); ++it)
+    {
+        const EntityConstPtr& parent = entities[it->first];
+        const EntityConstPtr& child = entities[it->second];
+        const TransformCache* tc = static_cast<const TransformCache*>(world.relations()[parent->relationTo(it->second)].get());
+
+        a << parent->id().str() << child->id().str();
+        write(a, *tc);
+    }
+
+    f_out.close();
+
+    if (f_out.fail() || rename(tmp_filename.c_str(), filename.c_str()) != 0)
+    {
+        log::error() << "Could not save snapshot to '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool readSnapshotHeader(const std::string& filename, SnapshotHeader& header)
+{
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+
+    BufferReader r(file.data(), file.size());
+    return readHeader(r, header);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool readSnapshot(const std::string& filename, const PropertyKeyDB& property_key_db, SnapshotHeader& header, UpdateRequest& req)
+{
+    MappedFile file;
+    if (!file.open(filename))
+    {
+        log::error() << "Could not open snapshot '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    BufferReader r(file.data(), file.size());
+    if (!readHeader(r, header))
+    {
+        log::error() << "Invalid snapshot header in '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    // Mesh blocks
+    std::vector<geo::ShapeConstPtr> shapes;
+    if (!read(r, shapes))
+    {
+        log::error() << "Invalid shapes in snapshot '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    // Entities
+    int num_entities;
+    if (!r.readCount(num_entities, 1))
+        return false;
+
+    for(int i = 0; i < num_entities; ++i)
+    {
+        if (!readEntity(r, shapes, property_key_db, req))
+        {
+            log::error() << "Invalid entity in snapshot '" << filename << "'" << std::endl;
+            return false;
+        }
+    }
+
+    // Relations
+    int num_relations;
+    if (!r.readCount(num_relations, 2))
+        return false;
+
+    for(int i = 0; i < num_relations; ++i)
+    {
+        std::string parent_id, child_id;
+        RelationConstPtr tc;
+        if (!r.read(parent_id) || !r.read(child_id) || !read(r, tc))
+            return false;
+
+        req.setRelation(parent_id, child_id, tc);
+    }
+
+    if (!r.ok())
+    {
+        log::error() << "Snapshot '" << filename << "' is truncated" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+} // end namespace ed
@@ -20,6 +20,13 @@ namespace ed
 
 bool write(const std::string& filename, const Measurement& msr)
 {
+    rgbd::ImageConstPtr image = msr.image();
+    if (!image)
+    {
+        ed::log::error() << "Could not save measurement to '" << filename << "': image could not be loaded" << std::endl;
+        return false;
+    }
+
     // save image
     {
         std::string filename_image = filename + ".rgbd";
@@ -28,7 +35,7 @@ bool write(const std::string& filename, const Measurement& msr)
         if (f_out.is_open())
         {
             tue::serialization::OutputArchive a_out(f_out);
-            rgbd::serialize(*msr.image(), a_out);
+            rgbd::serialize(*image, a_out);
         }
         else
         {
@@ -0,0 +1,67 @@
+#include "ed/lod_shape.h"
+#include "ed/instanced_shape.h"
+
+#include <geolib/Box.h>
+
+namespace ed
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+LODShape::LODShape()
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::Shape* LODShape::clone() const
+{
+    return new LODShape(*this);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void LODShape::addLevel(double error, const geo::Mesh& mesh)
+{
+    errors_.push_back(error);
+    meshes_.push_back(mesh);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+const geo::Mesh& LODShape::getMesh(double tolerance) const
+{
+    for(unsigned int i = errors_.size(); i > 0; --i)
+    {
+        if (errors_[i - 1] <= tolerance)
+            return meshes_[i - 1];
+    }
+
+    return mesh_;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+const geo::Mesh& levelOfDetail(const geo::Shape& shape, double tolerance, geo::Pose3D& transform)
+{
+    const geo::Shape* base = &shape;
+
+    const InstancedShape* instance = dynamic_cast<const InstancedShape*>(&shape);
+    if (instance)
+    {
+        transform = instance->transform();
+        base = instance->base().get();
+    }
+    else
+    {
+        transform = geo::Pose3D::identity();
+    }
+
+    const LODShape* lod_shape = dynamic_cast<const LODShape*>(base);
+    if (lod_shape)
+        return lod_shape->getMesh(tolerance);
+
+    return base->getMesh();
+}
+
+} // end namespace ed
@@ -4,6 +4,8 @@
 
 #include "ed/helpers/depth_data_processing.h"
 
+#include <algorithm>
+
 namespace ed
 {
 
@@ -16,29 +18,51 @@ Measurement::Measurement() : timestamp_(0)
 // ----------------------------------------------------------------------------------------------------
 
 Measurement::Measurement(rgbd::ImageConstPtr image, const ImageMask& image_mask, const geo::Pose3D& sensor_pose) :
+    image_(MeasurementStore::instance().add(image)),
+    sensor_pose_(sensor_pose),
     image_mask_(image_mask),
     timestamp_(image->getTimestamp())
 {
-    rgbd_data_.image = image;
-    rgbd_data_.sensor_pose = sensor_pose;
 }
 
 // ----------------------------------------------------------------------------------------------------
 
 Measurement::Measurement(const RGBDData& rgbd_data, const PointCloudMaskPtr& mask, unsigned int seq) :
-    rgbd_data_(rgbd_data),
+    image_(MeasurementStore::instance().add(rgbd_data.image)),
+    sensor_pose_(rgbd_data.sensor_pose),
     mask_(mask),
     timestamp_(rgbd_data.image->getTimestamp())
 {
     // Calculate image mask
     image_mask_.setSize(rgbd_data.image->getDepthImage().cols, rgbd_data.image->getDepthImage().rows);
+
+    std::vector<int> pixel_idxs_sorted;
     for(PointCloudMask::const_iterator it = mask_->begin(); it != mask_->end(); ++it)
     {
-        const std::vector<int>& pixel_idxs = rgbd_data_.point_cloud_to_pixels_mapping[*it];
-        for(std::vector<int>::const_iterator it2 = pixel_idxs.begin(); it2 != pixel_idxs.end(); ++it2)
-            image_mask_.addPoint(*it2);
+        const std::vector<int>& pixel_idxs = rgbd_data.point_cloud_to_pixels_mapping[*it];
+        pixel_idxs_sorted.insert(pixel_idxs_sorted.end(), pixel_idxs.begin(), pixel_idxs.end());
     }
 
+    // Adding the pixels in scan order lets the mask append to its runs instead of inserting
+    std::sort(pixel_idxs_sorted.begin(), pixel_idxs_sorted.end());
+    for(std::vector<int>::const_iterator it = pixel_idxs_sorted.begin(); it != pixel_idxs_sorted.end(); ++it)
+        image_mask_.addPoint(*it);
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+std::size_t Measurement::memoryUsage() const
+{
+    std::size_t bytes = image_mask_.runs().size() * sizeof(ImageMask::Run);
+    if (mask_)
+        bytes += mask_->size() * sizeof(int);
+
+    // Count the image only if this measurement is its only user
+    if (image_ && image_.unique())
+        bytes += image_->memoryUsage();
+
+    return bytes;
 }
 
 }
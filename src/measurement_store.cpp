@@ -0,0 +1,467 @@
+#include "ed/measurement_store.h"
+#include "ed/logging.h"
+
+#include <rgbd/Image.h>
+#include <rgbd/serialization.h>
+
+#include <tue/serialization/input_archive.h>
+#include <tue/serialization/output_archive.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ed
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+StoredImage::StoredImage(MeasurementStore* store, const rgbd::ImageConstPtr& image) :
+    store_(store), key_(image.get()), source_(image), busy_(false), state_(IN_MEMORY), image_(image), raw_bytes_(0),
+    spill_offset_(0), spill_size_(0)
+{
+    const cv::Mat& depth = image->getDepthImage();
+    const cv::Mat& rgb = image->getRGBImage();
+    raw_bytes_ = depth.total() * depth.elemSize() + rgb.total() * rgb.elemSize();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+StoredImage::~StoredImage()
+{
+    boost::mutex::scoped_lock lock(store_->mutex_);
+
+    // The store may still be compressing or spilling this entry as a victim of the budget
+    store_->waitUntilIdle(*this, lock);
+    store_->remove(*this);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+rgbd::ImageConstPtr StoredImage::image() const
+{
+    boost::mutex::scoped_lock lock(store_->mutex_);
+
+    // Where the image lives is not part of the logical state of the entry
+    StoredImage& e = const_cast<StoredImage&>(*this);
+
+    store_->waitUntilIdle(e, lock);
+
+    if (state_ == IN_MEMORY)
+    {
+        // Mark as most recently used
+        store_->in_memory_.splice(store_->in_memory_.begin(), store_->in_memory_, e.lru_it_);
+        return image_;
+    }
+
+    return store_->load(e, lock);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+std::size_t StoredImage::memoryUsage() const
+{
+    boost::mutex::scoped_lock lock(store_->mutex_);
+
+    if (state_ == IN_MEMORY)
+        return raw_bytes_;
+    else if (state_ == COMPRESSED)
+        return compressed_.size();
+    else
+        return 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+MeasurementStore& MeasurementStore::instance()
+{
+    // Never destroyed: measurements may still be released during static destruction
+    static MeasurementStore* store = new MeasurementStore;
+    return *store;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+MeasurementStore::MeasurementStore() : enforcing_(false), max_bytes_(0), memory_bytes_(0), compressed_bytes_(0), spilled_bytes_(0),
+    num_spilled_(0), num_loads_(0), spill_fd_(-1), spill_end_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+MeasurementStore::~MeasurementStore()
+{
+    if (spill_fd_ >= 0)
+        ::close(spill_fd_);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool MeasurementStore::configure(std::size_t max_bytes, const std::string& spill_directory)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+
+    max_bytes_ = max_bytes;
+
+    bool ok = true;
+    if (!spill_directory.empty() && spill_fd_ < 0)
+    {
+        std::stringstream filename;
+        filename << spill_directory << "/ed-measurements-" << getpid() << ".spill";
+
+        if (mkdir(spill_directory.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            log::error() << "Could not create measurement spill directory '" << spill_directory << "'" << std::endl;
+            ok = false;
+        }
+        else if ((spill_fd_ = ::open(filename.str().c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0)
+        {
+            log::error() << "Could not create measurement spill file '" << filename.str() << "'" << std::endl;
+            ok = false;
+        }
+        else
+        {
+            unlink(filename.str().c_str());
+        }
+    }
+
+    enforceBudget(lock);
+
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+StoredImagePtr MeasurementStore::add(const rgbd::ImageConstPtr& image)
+{
+    if (!image)
+        return StoredImagePtr();
+
+    // Declared before the lock: if this holds the last reference, the entry must be destroyed unlocked
+    StoredImagePtr existing;
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    boost::weak_ptr<StoredImage>& entry = entries_[image.get()];
+
+    existing = entry.lock();
+    if (existing && existing->source_.lock() == image)
+        return existing;
+
+    StoredImagePtr e(new StoredImage(this, image));
+    entry = e;
+
+    in_memory_.push_front(e.get());
+    e->lru_it_ = in_memory_.begin();
+    memory_bytes_ += e->raw_bytes_;
+
+    enforceBudget(lock);
+
+    return e;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+MeasurementStore::Statistics MeasurementStore::statistics() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+
+    Statistics stats;
+    stats.num_in_memory = in_memory_.size();
+    stats.num_compressed = compressed_.size();
+    stats.num_spilled = num_spilled_;
+    stats.memory_bytes = memory_bytes_;
+    stats.spilled_bytes = spilled_bytes_;
+    stats.num_loads = num_loads_;
+    return stats;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementStore::waitUntilIdle(const StoredImage& e, boost::mutex::scoped_lock& lock)
+{
+    while (e.busy_)
+        idle_cond_.wait(lock);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementStore::setIdle(StoredImage& e)
+{
+    e.busy_ = false;
+    idle_cond_.notify_all();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementStore::enforceBudget(boost::mutex::scoped_lock& lock)
+{
+    // One thread at a time picks victims. Others can continue: the thread that enforces the budget checks it
+    // again after every image, also if it grew in the meantime.
+    if (max_bytes_ == 0 || enforcing_)
+        return;
+
+    enforcing_ = true;
+
+    // Compress the least recently used images, but keep at most half of the budget compressed: beyond
+    // that, the least recently used compressed images are spilled. The latest image is never compressed.
+    while (memory_bytes_ > max_bytes_)
+    {
+        if (spill_fd_ >= 0 && !compressed_.empty() && (compressed_bytes_ > max_bytes_ / 2 || in_memory_.size() <= 1))
+        {
+            if (!spill(*compressed_.back(), lock))
+                break;
+        }
+        else if (in_memory_.size() > 1)
+        {
+            compress(*in_memory_.back(), lock);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    enforcing_ = false;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementStore::compress(StoredImage& e, boost::mutex::scoped_lock& lock)
+{
+    in_memory_.erase(e.lru_it_);
+    e.busy_ = true;
+
+    rgbd::ImageConstPtr image = e.image_;
+
+    lock.unlock();
+
+    std::stringstream s;
+    tue::serialization::OutputArchive a(s);
+    rgbd::serialize(*image, a, rgbd::RGB_STORAGE_JPG, rgbd::DEPTH_STORAGE_PNG);
+    std::string compressed = s.str();
+    image.reset();
+
+    lock.lock();
+
+    e.compressed_.swap(compressed);
+    e.image_.reset();
+    e.state_ = StoredImage::COMPRESSED;
+
+    compressed_.push_front(&e);
+    e.lru_it_ = compressed_.begin();
+
+    memory_bytes_ = memory_bytes_ - e.raw_bytes_ + e.compressed_.size();
+    compressed_bytes_ += e.compressed_.size();
+
+    setIdle(e);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool MeasurementStore::spill(StoredImage& e, boost::mutex::scoped_lock& lock)
+{
+    std::size_t size = e.compressed_.size();
+
+    // Re-use the smallest free range that fits
+    std::size_t offset;
+    std::multimap<std::size_t, std::size_t>::iterator it_free = spill_free_.lower_bound(size);
+    if (it_free != spill_free_.end())
+    {
+        offset = it_free->second;
+        if (it_free->first > size)
+            spill_free_.insert(std::make_pair(it_free->first - size, offset + size));
+        spill_free_.erase(it_free);
+    }
+    else
+    {
+        offset = spill_end_;
+        spill_end_ += size;
+    }
+
+    // Counted as spilled already, such that the file is not truncated while it is written
+    e.spill_offset_ = offset;
+    e.spill_size_ = size;
+    spilled_bytes_ += size;
+    ++num_spilled_;
+
+    compressed_.erase(e.lru_it_);
+    e.busy_ = true;
+
+    int fd = spill_fd_;
+
+    lock.unlock();
+
+    int error = 0;
+    std::size_t written = 0;
+    while (written < size)
+    {
+        ssize_t n = pwrite(fd, e.compressed_.data() + written, size - written, offset + written);
+        if (n <= 0)
+        {
+            error = errno;
+            break;
+        }
+        written += n;
+    }
+
+    lock.lock();
+
+    if (written < size)
+    {
+        log::error() << "Could not write to measurement spill file: " << strerror(error) << std::endl;
+
+        // Keep it compressed in memory
+        releaseSpill(e);
+        compressed_.push_back(&e);
+        e.lru_it_ = --compressed_.end();
+        setIdle(e);
+        return false;
+    }
+
+    memory_bytes_ -= size;
+    compressed_bytes_ -= size;
+
+    std::string().swap(e.compressed_);
+    e.state_ = StoredImage::SPILLED;
+
+    setIdle(e);
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+rgbd::ImageConstPtr MeasurementStore::load(StoredImage& e, boost::mutex::scoped_lock& lock)
+{
+    if (e.state_ == StoredImage::COMPRESSED)
+        compressed_.erase(e.lru_it_);
+    e.busy_ = true;
+
+    int fd = spill_fd_;
+
+    lock.unlock();
+
+    bool ok = true;
+    std::string data;
+    if (e.state_ == StoredImage::SPILLED)
+    {
+        data.resize(e.spill_size_);
+        std::size_t n_read = 0;
+        while (n_read < data.size())
+        {
+            ssize_t n = pread(fd, &data[n_read], data.size() - n_read, e.spill_offset_ + n_read);
+            if (n <= 0)
+            {
+                log::error() << "Could not read from measurement spill file" << std::endl;
+                ok = false;
+                break;
+            }
+            n_read += n;
+        }
+    }
+
+    rgbd::ImagePtr image(new rgbd::Image);
+    if (ok)
+    {
+        std::stringstream s(e.state_ == StoredImage::SPILLED ? data : e.compressed_);
+        tue::serialization::InputArchive a(s);
+        if (!rgbd::deserialize(a, *image))
+        {
+            log::error() << "Could not decompress measurement image" << std::endl;
+            ok = false;
+        }
+    }
+
+    lock.lock();
+
+    if (!ok)
+    {
+        if (e.state_ == StoredImage::COMPRESSED)
+        {
+            compressed_.push_front(&e);
+            e.lru_it_ = compressed_.begin();
+        }
+        setIdle(e);
+        return rgbd::ImageConstPtr();
+    }
+
+    if (e.state_ == StoredImage::SPILLED)
+    {
+        releaseSpill(e);
+    }
+    else
+    {
+        memory_bytes_ -= e.compressed_.size();
+        compressed_bytes_ -= e.compressed_.size();
+        std::string().swap(e.compressed_);
+    }
+
+    e.image_ = image;
+    e.state_ = StoredImage::IN_MEMORY;
+    in_memory_.push_front(&e);
+    e.lru_it_ = in_memory_.begin();
+    memory_bytes_ += e.raw_bytes_;
+
+    ++num_loads_;
+
+    setIdle(e);
+
+    enforceBudget(lock);
+
+    return image;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementStore::releaseSpill(StoredImage& e)
+{
+    spilled_bytes_ -= e.spill_size_;
+    --num_spilled_;
+
+    if (num_spilled_ == 0)
+    {
+        // Nothing left on disk: start over instead of keeping a fragmented file
+        spill_free_.clear();
+        spill_end_ = 0;
+        if (ftruncate(spill_fd_, 0) != 0)
+            log::warning() << "Could not truncate measurement spill file" << std::endl;
+    }
+    else
+    {
+        spill_free_.insert(std::make_pair(e.spill_size_, e.spill_offset_));
+    }
+
+    e.spill_size_ = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeasurementStore::remove(StoredImage& e)
+{
+    if (e.state_ == StoredImage::IN_MEMORY)
+    {
+        in_memory_.erase(e.lru_it_);
+        memory_bytes_ -= e.raw_bytes_;
+    }
+    else if (e.state_ == StoredImage::COMPRESSED)
+    {
+        compressed_.erase(e.lru_it_);
+        memory_bytes_ -= e.compressed_.size();
+        compressed_bytes_ -= e.compressed_.size();
+    }
+    else
+    {
+        releaseSpill(e);
+    }
+
+    // The entry may already have been replaced by one for a new image at the same address
+    std::map<const rgbd::Image*, boost::weak_ptr<StoredImage> >::iterator it = entries_.find(e.key_);
+    if (it != entries_.end() && it->second.expired())
+        entries_.erase(it);
+}
+
+} // end namespace ed
@@ -0,0 +1,415 @@
+#include "mesh_decimation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace ed
+{
+
+namespace models
+{
+
+namespace
+{
+
+bool lessXYZ(const geo::Vector3& p1, const geo::Vector3& p2)
+{
+    if (p1.x != p2.x)
+        return p1.x < p2.x;
+    if (p1.y != p2.y)
+        return p1.y < p2.y;
+    return p1.z < p2.z;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+struct PointIndexLess
+{
+    PointIndexLess(const std::vector<geo::Vector3>& points_) : points(points_) {}
+
+    bool operator()(int i1, int i2) const { return lessXYZ(points[i1], points[i2]); }
+
+    const std::vector<geo::Vector3>& points;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Edge (lowest vertex first) and a triangle it belongs to
+struct Edge
+{
+    Edge(int v1_, int v2_, int triangle_) : v1(std::min(v1_, v2_)), v2(std::max(v1_, v2_)), triangle(triangle_) {}
+
+    bool operator<(const Edge& other) const { return v1 < other.v1 || (v1 == other.v1 && v2 < other.v2); }
+
+    bool sameAs(const Edge& other) const { return v1 == other.v1 && v2 == other.v2; }
+
+    int v1, v2;
+    int triangle;
+};
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeshDecimator::Quadric::addPlane(const geo::Vector3& n, double d)
+{
+    a[0] += n.x * n.x; a[1] += n.x * n.y; a[2] += n.x * n.z; a[3] += n.x * d;
+    a[4] += n.y * n.y; a[5] += n.y * n.z; a[6] += n.y * d;
+    a[7] += n.z * n.z; a[8] += n.z * d;
+    a[9] += d * d;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double MeshDecimator::Quadric::error(const geo::Vector3& p) const
+{
+    return p.x * (a[0] * p.x + 2 * (a[1] * p.y + a[2] * p.z + a[3]))
+         + p.y * (a[4] * p.y + 2 * (a[5] * p.z + a[6]))
+         + p.z * (a[7] * p.z + 2 * a[8])
+         + a[9];
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool MeshDecimator::Quadric::minimum(geo::Vector3& p) const
+{
+    // Solve A p = -b (Cramer's rule)
+    double c0 = a[4] * a[7] - a[5] * a[5];
+    double c1 = a[2] * a[5] - a[1] * a[7];
+    double c2 = a[1] * a[5] - a[2] * a[4];
+
+    double det = a[0] * c0 + a[1] * c1 + a[2] * c2;
+    if (std::abs(det) < 1e-9)
+        return false;
+
+    double c4 = a[0] * a[7] - a[2] * a[2];
+    double c5 = a[1] * a[2] - a[0] * a[5];
+    double c8 = a[0] * a[4] - a[1] * a[1];
+
+    p.x = -(c0 * a[3] + c1 * a[6] + c2 * a[8]) / det;
+    p.y = -(c1 * a[3] + c4 * a[6] + c5 * a[8]) / det;
+    p.z = -(c2 * a[3] + c5 * a[6] + c8 * a[8]) / det;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+MeshDecimator::MeshDecimator(const geo::Mesh& mesh) : num_triangles_(0)
+{
+    const std::vector<geo::Vector3>& points = mesh.getPoints();
+
+    // Weld coincident vertices
+    std::vector<int> order(points.size());
+    for(unsigned int i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), PointIndexLess(points));
+
+    std::vector<int> welded(points.size());
+    for(unsigned int i = 0; i < order.size(); ++i)
+    {
+        if (i == 0 || lessXYZ(points[order[i - 1]], points[order[i]]))
+        {
+            vertices_.push_back(Vertex());
+            vertices_.back().p = points[order[i]];
+            vertices_.back().version = 0;
+        }
+
+        welded[order[i]] = vertices_.size() - 1;
+    }
+
+    // Triangles and the quadrics of their planes
+    const std::vector<geo::TriangleI>& triangles = mesh.getTriangleIs();
+    triangles_.reserve(triangles.size());
+
+    std::vector<geo::Vector3> normals;
+    normals.reserve(triangles.size());
+
+    for(std::vector<geo::TriangleI>::const_iterator it = triangles.begin(); it != triangles.end(); ++it)
+    {
+        Triangle t;
+        t.v[0] = welded[it->i1_];
+        t.v[1] = welded[it->i2_];
+        t.v[2] = welded[it->i3_];
+        t.removed = false;
+
+        const geo::Vector3& p0 = vertices_[t.v[0]].p;
+        geo::Vector3 n = (vertices_[t.v[1]].p - p0).cross(vertices_[t.v[2]].p - p0);
+        double length = n.length();
+        if (t.v[0] == t.v[1] || t.v[1] == t.v[2] || t.v[2] == t.v[0] || length == 0)
+            continue;
+
+        n = n / length;
+        double d = -n.dot(p0);
+
+        for(unsigned int j = 0; j < 3; ++j)
+        {
+            vertices_[t.v[j]].q.addPlane(n, d);
+            vertices_[t.v[j]].triangles.push_back(triangles_.size());
+        }
+
+        triangles_.push_back(t);
+        normals.push_back(n);
+    }
+
+    num_triangles_ = triangles_.size();
+
+    std::vector<Edge> edges;
+    edges.reserve(3 * triangles_.size());
+    for(unsigned int i = 0; i < triangles_.size(); ++i)
+    {
+        const Triangle& t = triangles_[i];
+        for(unsigned int j = 0; j < 3; ++j)
+            edges.push_back(Edge(t.v[j], t.v[(j + 1) % 3], i));
+    }
+    std::sort(edges.begin(), edges.end());
+
+    for(unsigned int i = 0; i < edges.size(); )
+    {
+        unsigned int j = i + 1;
+        while(j < edges.size() && edges[j].sameAs(edges[i]))
+            ++j;
+
+        const Edge& e = edges[i];
+
+        // Keep open borders in place with a plane through the edge, perpendicular to its triangle
+        if (j == i + 1)
+        {
+            const geo::Vector3& p1 = vertices_[e.v1].p;
+            geo::Vector3 n = (vertices_[e.v2].p - p1).cross(normals[e.triangle]);
+            double length = n.length();
+            if (length > 0)
+            {
+                n = n / length;
+                double d = -n.dot(p1);
+                vertices_[e.v1].q.addPlane(n, d);
+                vertices_[e.v2].q.addPlane(n, d);
+            }
+        }
+
+        i = j;
+    }
+
+    // Edges can only be queued when all quadrics are complete
+    for(unsigned int i = 0; i < edges.size(); ++i)
+    {
+        if (i == 0 || !edges[i].sameAs(edges[i - 1]))
+            addCollapse(edges[i].v1, edges[i].v2);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeshDecimator::addCollapse(int v1, int v2)
+{
+    const Vertex& vertex1 = vertices_[v1];
+    const Vertex& vertex2 = vertices_[v2];
+
+    Quadric q = vertex1.q;
+    q.add(vertex2.q);
+
+    Collapse c;
+    c.v1 = v1;
+    c.v2 = v2;
+    c.version1 = vertex1.version;
+    c.version2 = vertex2.version;
+
+    // Use the point of minimal error, unless it is ill-conditioned and lies far from the edge
+    geo::Vector3 mid = (vertex1.p + vertex2.p) * 0.5;
+    if (q.minimum(c.p) && (c.p - mid).length2() <= (vertex2.p - vertex1.p).length2())
+    {
+        c.error = q.error(c.p);
+    }
+    else
+    {
+        c.p = mid;
+        c.error = q.error(mid);
+
+        const geo::Vector3* ends[] = { &vertex1.p, &vertex2.p };
+        for(unsigned int i = 0; i < 2; ++i)
+        {
+            double error = q.error(*ends[i]);
+            if (error < c.error)
+            {
+                c.p = *ends[i];
+                c.error = error;
+            }
+        }
+    }
+
+    c.error = std::max(c.error, 0.0);
+    collapses_.push(c);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeshDecimator::decimate(double max_error)
+{
+    double max_error_sq = max_error * max_error;
+
+    while(!collapses_.empty() && collapses_.top().error <= max_error_sq)
+    {
+        Collapse c = collapses_.top();
+        collapses_.pop();
+
+        // Skip collapses of which a vertex changed after they were queued. The changed vertex queued new ones.
+        if (vertices_[c.v1].version == c.version1 && vertices_[c.v2].version == c.version2)
+            collapse(c);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool MeshDecimator::flips(int v, int other, const geo::Vector3& p) const
+{
+    const std::vector<int>& triangles = vertices_[v].triangles;
+    for(std::vector<int>::const_iterator it = triangles.begin(); it != triangles.end(); ++it)
+    {
+        const Triangle& t = triangles_[*it];
+        if (t.removed || t.v[0] == other || t.v[1] == other || t.v[2] == other)
+            continue;
+
+        geo::Vector3 p_old[3], p_new[3];
+        for(unsigned int j = 0; j < 3; ++j)
+        {
+            p_old[j] = vertices_[t.v[j]].p;
+            p_new[j] = (t.v[j] == v) ? p : p_old[j];
+        }
+
+        geo::Vector3 n_old = (p_old[1] - p_old[0]).cross(p_old[2] - p_old[0]);
+        geo::Vector3 n_new = (p_new[1] - p_new[0]).cross(p_new[2] - p_new[0]);
+        if (n_old.dot(n_new) <= 0)
+            return true;
+    }
+
+    return false;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool MeshDecimator::collapse(const Collapse& c)
+{
+    Vertex& vertex1 = vertices_[c.v1];
+    Vertex& vertex2 = vertices_[c.v2];
+
+    // Only collapse if the vertices have no common neighbors besides those of the triangles on the edge,
+    // which keeps the mesh manifold
+    std::vector<int> neighbors1, neighbors2;
+    unsigned int num_shared = 0;
+
+    for(std::vector<int>::const_iterator it = vertex1.triangles.begin(); it != vertex1.triangles.end(); ++it)
+    {
+        const Triangle& t = triangles_[*it];
+        if (t.removed)
+            continue;
+
+        if (t.v[0] == c.v2 || t.v[1] == c.v2 || t.v[2] == c.v2)
+            ++num_shared;
+
+        for(unsigned int j = 0; j < 3; ++j)
+            if (t.v[j] != c.v1 && t.v[j] != c.v2)
+                neighbors1.push_back(t.v[j]);
+    }
+
+    for(std::vector<int>::const_iterator it = vertex2.triangles.begin(); it != vertex2.triangles.end(); ++it)
+    {
+        const Triangle& t = triangles_[*it];
+        if (t.removed)
+            continue;
+
+        for(unsigned int j = 0; j < 3; ++j)
+            if (t.v[j] != c.v1 && t.v[j] != c.v2)
+                neighbors2.push_back(t.v[j]);
+    }
+
+    std::sort(neighbors1.begin(), neighbors1.end());
+    neighbors1.erase(std::unique(neighbors1.begin(), neighbors1.end()), neighbors1.end());
+    std::sort(neighbors2.begin(), neighbors2.end());
+    neighbors2.erase(std::unique(neighbors2.begin(), neighbors2.end()), neighbors2.end());
+
+    std::vector<int> common;
+    std::set_intersection(neighbors1.begin(), neighbors1.end(), neighbors2.begin(), neighbors2.end(),
+                          std::back_inserter(common));
+
+    if (num_shared == 0 || common.size() != num_shared || flips(c.v1, c.v2, c.p) || flips(c.v2, c.v1, c.p))
+        return false;
+
+    // Remove the triangles on the edge and move the others of v2 to v1
+    std::vector<int> triangles;
+    for(std::vector<int>::const_iterator it = vertex1.triangles.begin(); it != vertex1.triangles.end(); ++it)
+    {
+        Triangle& t = triangles_[*it];
+        if (t.removed)
+            continue;
+
+        if (t.v[0] == c.v2 || t.v[1] == c.v2 || t.v[2] == c.v2)
+        {
+            t.removed = true;
+            --num_triangles_;
+        }
+        else
+        {
+            triangles.push_back(*it);
+        }
+    }
+
+    for(std::vector<int>::const_iterator it = vertex2.triangles.begin(); it != vertex2.triangles.end(); ++it)
+    {
+        Triangle& t = triangles_[*it];
+        if (t.removed)
+            continue;
+
+        for(unsigned int j = 0; j < 3; ++j)
+            if (t.v[j] == c.v2)
+                t.v[j] = c.v1;
+
+        triangles.push_back(*it);
+    }
+
+    vertex1.triangles.swap(triangles);
+    vertex1.p = c.p;
+    vertex1.q.add(vertex2.q);
+    ++vertex1.version;
+
+    vertex2.triangles.clear();
+    vertex2.version = -1;
+
+    // Requeue the edges of the moved vertex
+    std::vector<int> neighbors;
+    std::set_union(neighbors1.begin(), neighbors1.end(), neighbors2.begin(), neighbors2.end(),
+                   std::back_inserter(neighbors));
+
+    for(std::vector<int>::const_iterator it = neighbors.begin(); it != neighbors.end(); ++it)
+        addCollapse(c.v1, *it);
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void MeshDecimator::getMesh(geo::Mesh& mesh) const
+{
+    std::vector<int> indices(vertices_.size(), -1);
+
+    for(std::vector<Triangle>::const_iterator it = triangles_.begin(); it != triangles_.end(); ++it)
+    {
+        const Triangle& t = *it;
+        if (t.removed)
+            continue;
+
+        int i[3];
+        for(unsigned int j = 0; j < 3; ++j)
+        {
+            int& index = indices[t.v[j]];
+            if (index < 0)
+                index = mesh.addPoint(vertices_[t.v[j]].p);
+            i[j] = index;
+        }
+
+        mesh.addTriangle(i[0], i[1], i[2]);
+    }
+}
+
+} // end namespace models
+
+} // end namespace ed
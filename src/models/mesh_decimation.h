@@ -0,0 +1,100 @@
+#ifndef ED_MODELS_MESH_DECIMATION_H_
+#define ED_MODELS_MESH_DECIMATION_H_
+
+#include <geolib/datatypes.h>
+#include <geolib/Mesh.h>
+
+#include <queue>
+#include <vector>
+
+namespace ed
+{
+
+namespace models
+{
+
+/**
+ * Quadric error mesh decimation (Garland and Heckbert, 1997). Coincident vertices are welded first, such that
+ * meshes with separate vertices per triangle (as imported) can be decimated. Edges are collapsed in order of
+ * increasing error, so decimate() can be called with increasing tolerances to create successively coarser
+ * levels of detail. Collapses that would flip a triangle or make the mesh non-manifold are skipped.
+ */
+class MeshDecimator
+{
+
+public:
+
+    MeshDecimator(const geo::Mesh& mesh);
+
+    /// Collapses edges as long as the error stays within 'max_error' (m). The error of a vertex is the root of
+    /// the summed squared distances to the planes of the original triangles (and open borders) it replaces.
+    void decimate(double max_error);
+
+    unsigned int numTriangles() const { return num_triangles_; }
+
+    void getMesh(geo::Mesh& mesh) const;
+
+private:
+
+    /// Symmetric 4x4 matrix, summing the squared distances to a set of planes
+    struct Quadric
+    {
+        Quadric() { for(unsigned int i = 0; i < 10; ++i) a[i] = 0; }
+
+        void addPlane(const geo::Vector3& n, double d);
+
+        void add(const Quadric& q) { for(unsigned int i = 0; i < 10; ++i) a[i] += q.a[i]; }
+
+        double error(const geo::Vector3& p) const;
+
+        /// Point of minimal error, false if it is not unique
+        bool minimum(geo::Vector3& p) const;
+
+        double a[10];
+    };
+
+    struct Vertex
+    {
+        geo::Vector3 p;
+        Quadric q;
+        std::vector<int> triangles;
+        int version;
+    };
+
+    struct Triangle
+    {
+        int v[3];
+        bool removed;
+    };
+
+    struct Collapse
+    {
+        double error;
+        int v1, v2;
+        int version1, version2;
+        geo::Vector3 p;
+
+        bool operator<(const Collapse& other) const { return error > other.error; }
+    };
+
+    std::vector<Vertex> vertices_;
+
+    std::vector<Triangle> triangles_;
+
+    unsigned int num_triangles_;
+
+    std::priority_queue<Collapse> collapses_;
+
+    void addCollapse(int v1, int v2);
+
+    bool collapse(const Collapse& c);
+
+    bool flips(int v, int other, const geo::Vector3& p) const;
+
+};
+
+} // end namespace models
+
+} // end namespace ed
+
+#endif
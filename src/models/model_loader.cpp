@@ -14,6 +14,10 @@
 #include <tue/config/writer.h>
 #include <tue/config/configuration.h>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 
@@ -23,9 +27,95 @@ namespace ed
 namespace models
 {
 
+namespace
+{
+
+// Loads a shape file, or a shape that is not loaded from a file (if filename is empty)
+struct ShapeTask
+{
+    std::string filename;
+    std::string model_path;
+    tue::config::DataConstPointer data;
+
+    geo::ShapePtr shape;
+    std::string error;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+class ShapeTaskQueue
+{
+
+public:
+
+    ShapeTaskQueue(std::vector<ShapeTask>& tasks, ShapeCache* file_cache) : tasks_(tasks), file_cache_(file_cache), next_(0) {}
+
+    void run()
+    {
+        while(true)
+        {
+            unsigned int i;
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                if (next_ >= tasks_.size())
+                    return;
+                i = next_++;
+            }
+
+            ShapeTask& task = tasks_[i];
+
+            std::stringstream error;
+            if (!task.filename.empty())
+            {
+                task.shape = loadShapeFile(task.filename, tue::config::Reader(task.data), error, file_cache_);
+            }
+            else
+            {
+                std::map<std::string, geo::ShapePtr> no_shape_cache;
+                task.shape = loadShape(task.model_path, tue::config::Reader(task.data), no_shape_cache, error, file_cache_);
+            }
+
+            task.error = error.str();
+        }
+    }
+
+private:
+
+    std::vector<ShapeTask>& tasks_;
+
+    ShapeCache* file_cache_;
+
+    boost::mutex mutex_;
+
+    unsigned int next_;
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+bool hasGroup(tue::config::Reader& r, const std::string& name)
+{
+    if (!r.readGroup(name))
+        return false;
+    r.endGroup();
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool hasArray(tue::config::Reader& r, const std::string& name)
+{
+    if (!r.readArray(name))
+        return false;
+    r.endArray();
+    return true;
+}
+
+} // end anonymous namespace
+
 // ----------------------------------------------------------------------------------------------------
 
-ModelLoader::ModelLoader()
+ModelLoader::ModelLoader() : num_threads_(boost::thread::hardware_concurrency())
 {
     const char * mpath = ::getenv("ED_MODEL_PATH");
     if (mpath)
@@ -35,6 +125,10 @@ ModelLoader::ModelLoader()
         while (std::getline(ss, item, ':'))
             model_paths_.push_back(item);
     }
+
+    const char* shape_cache_dir = ::getenv("ED_SHAPE_CACHE");
+    if (shape_cache_dir && shape_cache_dir[0] != '\0')
+        file_cache_.open(shape_cache_dir);
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -92,6 +186,8 @@ tue::config::DataConstPointer ModelLoader::loadModelData(const std::string& type
         return data;
     }
 
+    model_files_.insert(model_cfg_path.string());
+
     std::string super_type;
     if (model_cfg.value("type", super_type, tue::OPTIONAL))
     {
@@ -137,6 +233,17 @@ bool ModelLoader::exists(const std::string& type) const
 
 // ----------------------------------------------------------------------------------------------------
 
+void ModelLoader::getLoadedFiles(std::vector<std::string>& files) const
+{
+    files.insert(files.end(), model_files_.begin(), model_files_.end());
+
+    // The shape cache is indexed by filename
+    for(std::map<std::string, geo::ShapePtr>::const_iterator it = shape_cache_.begin(); it != shape_cache_.end(); ++it)
+        files.push_back(it->first);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
 bool ModelLoader::create(const UUID& id, const std::string& type, UpdateRequest& req, std::stringstream& error)
 {
     std::vector<std::string> types;
@@ -171,93 +278,129 @@ bool ModelLoader::create(const tue::config::DataConstPointer& data, const UUID&
                          UpdateRequest& req, std::stringstream& error, const std::string& model_path,
                          const geo::Pose3D& pose_offset)
 {
-    tue::config::Reader r(data);
+    std::vector<ShapeJob> shape_jobs;
+    if (!createEntity(data, id_opt, parent_id, req, error, model_path, pose_offset, shape_jobs))
+        return false;
 
-    // Get Id
-    UUID id;
-    std::string id_str;
-    if (r.value("id", id_str, tue::config::OPTIONAL))
+    std::vector<geo::ShapePtr> shapes;
+    if (!loadShapes(shape_jobs, shapes, error))
+        return false;
+
+    for(unsigned int i = 0; i < shape_jobs.size(); ++i)
+        req.setShape(shape_jobs[i].id, shapes[i]);
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool ModelLoader::create(const std::vector<tue::config::DataConstPointer>& items, UpdateRequest& req,
+                         std::stringstream& error)
+{
+    // Each item is created in its own request, such that a failing item does not leave part of its entity tree
+    std::vector<UpdateRequest> item_reqs(items.size());
+    std::vector<bool> items_ok(items.size(), true);
+
+    std::vector<ShapeJob> shape_jobs;
+    std::vector<std::size_t> shape_job_items;
+    for(std::size_t i = 0; i < items.size(); ++i)
     {
-        if (parent_id.str().empty() || parent_id.str()[0] == '_')
-            id = id_str;
-        else
-            id = parent_id.str() + "/" + id_str;
+        // Only the shapes of items that were created completely are loaded
+        std::size_t num_shape_jobs = shape_jobs.size();
+        if (!createEntity(items[i], "", "", item_reqs[i], error, "", geo::Pose3D::identity(), shape_jobs))
+        {
+            shape_jobs.resize(num_shape_jobs);
+            items_ok[i] = false;
+        }
+
+        shape_job_items.resize(shape_jobs.size(), i);
     }
-    else if (!id_opt.str().empty())
+
+    std::vector<geo::ShapePtr> shapes;
+    loadShapes(shape_jobs, shapes, error);
+
+    for(std::size_t i = 0; i < shape_jobs.size(); ++i)
     {
-        id = id_opt;
+        if (shapes[i])
+            item_reqs[shape_job_items[i]].setShape(shape_jobs[i].id, shapes[i]);
+        else
+            items_ok[shape_job_items[i]] = false;
     }
-    else
+
+    bool ok = true;
+    for(std::size_t i = 0; i < items.size(); ++i)
     {
-        id = ed::Entity::generateID();
+        if (items_ok[i])
+            req.add(item_reqs[i]);
+        else
+            ok = false;
     }
 
-    // Get type. If it exists, first construct an entity based on the given type.
-    std::string type;
-    if (r.value("type", type, tue::config::OPTIONAL))
-    {
-        std::vector<std::string> types;
-        tue::config::DataConstPointer super_data = loadModelData(type, types, error);
+    return ok;
+}
 
-        if (super_data.empty())
-            return false;
+// ----------------------------------------------------------------------------------------------------
 
-        tue::config::DataPointer data_combined;
-        data_combined.add(super_data);
-        data_combined.add(data);
+ModelLoader::ModelTemplatePtr ModelLoader::loadModelTemplate(const std::string& type, std::stringstream& error)
+{
+    std::map<std::string, ModelTemplatePtr>::const_iterator it = templates_.find(type);
+    if (it != templates_.end())
+        return it->second;
 
-        r = tue::config::Reader(data_combined);
+    std::vector<std::string> types;
+    tue::config::DataConstPointer data = loadModelData(type, types, error);
+    if (data.empty())
+        return ModelTemplatePtr();
 
-        types.push_back(type);
-        for(std::vector<std::string>::const_iterator it = types.begin(); it != types.end(); ++it)
-            req.addType(id, *it);
-    }
+    ModelTemplatePtr model(new ModelTemplate);
+    model->data = data;
+    model->types = types;
+    model->types.push_back(type);
 
-    // Set type
-    req.setType(id, type);
+    tue::config::Reader r(data);
+    readFields(r, type, "", model->fields);
 
-    geo::Pose3D pose = geo::Pose3D::identity();
+    templates_[type] = model;
+    return model;
+}
 
-    // Get pose
+// ----------------------------------------------------------------------------------------------------
+
+void ModelLoader::readFields(tue::config::Reader& r, const std::string& name, const std::string& model_path,
+                             EntityFields& fields)
+{
+    // Get pose. Keys that are not set keep the value of the model.
     if (r.readGroup("pose"))
     {
-        readPose(pose, r);
+        readPose(fields.pose, r, !fields.has_pose);
+        fields.has_pose = true;
         r.endGroup();
     }
 
-    pose = pose_offset * pose;
-
-    req.setPose(id, pose);
-
     // Check the composition
     if (r.readArray("composition"))
     {
+        fields.has_composition = true;
         while (r.nextArrayItem())
-        {
-            if (!create(r.data(), "", id, req, error, "", pose))
-                return false;
-        }
+            fields.composition.push_back(r.data());
 
         r.endArray();
     }
 
-    // Set shape
+    // Get shape
     if (r.readGroup("shape"))
     {
-        std::string shape_model_path = model_path;
-        r.value("__model_path__", shape_model_path);
-
-        geo::ShapePtr shape = loadShape(shape_model_path, r, shape_cache_, error);
-        if (shape)
-            req.setShape(id, shape);
-        else
-            return false;
+        fields.shape_model_path = model_path;
+        r.value("__model_path__", fields.shape_model_path);
+        fields.shape_data = r.data();
 
         r.endGroup();
     }
 
     if (r.readGroup("state_update"))
     {
+        fields.has_state_update = true;
+
         // Read ROI values to filter z values while calling /ed/kinect/state-update
         if (r.readGroup("ROI"))
         {
@@ -269,9 +412,8 @@ bool ModelLoader::create(const tue::config::DataConstPointer& data, const UUID&
             r.value("z_max", max);
             r.value("mode", mode ,tue::config::OPTIONAL);
 
-            ed::ROIConstPtr roiPtr = ed::ROIConstPtr(new ed::ROI(min, max, mode == "include" ? true : false));
-            req.setROI(id, roiPtr);
-            std::cout << id << " ROI min:" << min << " max:" << max << " mode:" << mode << std::endl;
+            fields.roi = ed::ROIConstPtr(new ed::ROI(min, max, mode == "include" ? true : false));
+            std::cout << name << " ROI min:" << min << " max:" << max << " mode:" << mode << std::endl;
             r.endGroup();
         }
         // Read movement freedoms/restrictions to align to main group object while calling /ed/kinect/state-update
@@ -304,24 +446,22 @@ bool ModelLoader::create(const tue::config::DataConstPointer& data, const UUID&
                 {
                   if(canMove == true)
                   {
-                    ROS_WARN("inside the definition of: %s , translation is allowed but translation_restriction set to fixed position, possible error inside Yaml" ,id.c_str());
+                    ROS_WARN("inside the definition of: %s , translation is allowed but translation_restriction set to fixed position, possible error inside Yaml" ,name.c_str());
                     canMove = false;
                   }
                 }
                 else
                 {
                   if(canMove == false)
-                    ROS_WARN("inside the definition of: %s , translation is forbidden but translation_restriction set direction Vector, possible error inside Yaml" ,id.c_str());
+                    ROS_WARN("inside the definition of: %s , translation is forbidden but translation_restriction set direction Vector, possible error inside Yaml" ,name.c_str());
 
                 }
                 r.endGroup();
             }
 
 
-            ed::MoveRestrictionsConstPtr moveRestrictionsPtr =
-                ed::MoveRestrictionsConstPtr(new ed::MoveRestrictions(canRotate, canMove, x, y));
-            req.setMoveRestrictions(id, moveRestrictionsPtr);
-            std::cout << id << " freedoms x:" << x << " y:" << y  << " rotate:" << canRotate << " move:" << canMove << std::endl;
+            fields.move_restrictions = ed::MoveRestrictionsConstPtr(new ed::MoveRestrictions(canRotate, canMove, x, y));
+            std::cout << name << " freedoms x:" << x << " y:" << y  << " rotate:" << canRotate << " move:" << canMove << std::endl;
             r.endGroup();
         }
 
@@ -339,73 +479,305 @@ bool ModelLoader::create(const tue::config::DataConstPointer& data, const UUID&
             bool angle = mode == "angle" ? true : false;
             bool position = !angle;
 
-            ed::StateDefinitionConstPtr stateDefinitionPtr =
-                ed::StateDefinitionConstPtr(new ed::StateDefinition(angle, position, close, open, close, open));
-            req.setStateDefinition(id, stateDefinitionPtr);
+            fields.state_definition = ed::StateDefinitionConstPtr(new ed::StateDefinition(angle, position, close, open, close, open));
 
-            std::cout << id << " state_definitions close:" << close << " open:" << open << " mode:" << mode << std::endl;
+            std::cout << name << " state_definitions close:" << close << " open:" << open << " mode:" << mode << std::endl;
             r.endGroup();
         }
         r.endGroup();
     }
 
-
-    std::string stateUpdateGroup;
     // if state-update-group, store the group and prepare the entity for /ed/kinect/state-update which also needs the original position
-    if (r.value("state-update-group", stateUpdateGroup, tue::config::OPTIONAL))
+    if (r.value("state-update-group", fields.state_update_group, tue::config::OPTIONAL))
+        fields.has_state_update_group = true;
+
+    if (r.readGroup("original-pose"))
     {
-        req.setStateUpdateGroup(id, stateUpdateGroup);
-        // if original-pose inside YAML given read it, otherwise use pose value
-        geo::Pose3D origPose;
-        if (r.readGroup("original-pose"))
-        {
-            origPose = geo::Pose3D::identity();
-            readPose(origPose, r);
-            // move orig pose with the world
-            origPose = pose_offset * origPose;
-            r.endGroup();
-        }
-        else
-        {
-            origPose = geo::Pose3D(pose.R, pose.t);
-        }
-        req.setOriginalPose(id, origPose);
+        readPose(fields.original_pose, r, !fields.has_original_pose);
+        fields.has_original_pose = true;
+        r.endGroup();
     }
 
     if (r.readArray("flags"))
     {
+        fields.has_flags = true;
         while (r.nextArrayItem())
         {
             std::string flag;
             if (r.value("flag", flag))
-                req.setFlag(id, flag);
+                fields.flags.push_back(flag);
         }
         r.endArray();
     }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool ModelLoader::createEntity(const tue::config::DataConstPointer& data, const UUID& id_opt, const UUID& parent_id,
+                               UpdateRequest& req, std::stringstream& error, const std::string& model_path,
+                               const geo::Pose3D& pose_offset, std::vector<ShapeJob>& shape_jobs)
+{
+    tue::config::Reader r(data);
+
+    // Get Id
+    UUID id;
+    std::string id_str;
+    if (r.value("id", id_str, tue::config::OPTIONAL))
+    {
+        if (parent_id.str().empty() || parent_id.str()[0] == '_')
+            id = id_str;
+        else
+            id = parent_id.str() + "/" + id_str;
+    }
+    else if (!id_opt.str().empty())
+    {
+        id = id_opt;
+    }
+    else
+    {
+        id = ed::Entity::generateID();
+    }
+
+    // Get type. If it exists, the instance starts from the fields of the compiled model and overwrites the keys
+    // it sets.
+    EntityFields fields;
+    std::string type;
+    ModelTemplatePtr model;
+    if (r.value("type", type, tue::config::OPTIONAL))
+    {
+        model = loadModelTemplate(type, error);
+        if (!model)
+            return false;
+
+        for(std::vector<std::string>::const_iterator it = model->types.begin(); it != model->types.end(); ++it)
+            req.addType(id, *it);
+
+        // Groups and arrays that both the instance and its model have are merged by the data itself. Instances
+        // rarely have them, so then the merged data is read, as for an entity without model.
+        const EntityFields& model_fields = model->fields;
+        bool has_shape = hasGroup(r, "shape");
+        if ((model_fields.has_composition && hasArray(r, "composition"))
+                || (model_fields.has_flags && hasArray(r, "flags"))
+                || (model_fields.has_state_update && hasGroup(r, "state_update"))
+                || (!model_fields.shape_data.empty() && has_shape))
+        {
+            tue::config::DataPointer data_combined;
+            data_combined.add(model->data);
+            data_combined.add(data);
+
+            tue::config::Reader r_combined(data_combined);
+            readFields(r_combined, id.str(), model_path, fields);
+        }
+        else
+        {
+            fields = model_fields;
+            readFields(r, id.str(), model_path, fields);
+        }
+
+        // Without a shape of its own, the instance shares the shape of its model
+        if (!has_shape)
+            fields.shape_data = tue::config::DataConstPointer();
+    }
+    else
+    {
+        readFields(r, id.str(), model_path, fields);
+    }
 
-    // Add additional data
-    req.addData(id, r.data());
+    // Set type
+    req.setType(id, type);
+
+    geo::Pose3D pose = pose_offset * (fields.has_pose ? fields.pose.pose() : geo::Pose3D::identity());
+    req.setPose(id, pose);
+
+    for(std::vector<tue::config::DataConstPointer>::const_iterator it = fields.composition.begin(); it != fields.composition.end(); ++it)
+    {
+        if (!createEntity(*it, "", id, req, error, "", pose, shape_jobs))
+            return false;
+    }
+
+    // Set shape. Instances that use the shape of their model share it, such that it is only loaded once.
+    if (!fields.shape_data.empty())
+    {
+        shape_jobs.push_back(ShapeJob());
+        ShapeJob& job = shape_jobs.back();
+        job.id = id;
+        job.model_path = fields.shape_model_path;
+        job.data = fields.shape_data;
+    }
+    else if (model && model->shape)
+    {
+        req.setShape(id, model->shape);
+    }
+    else if (model && !model->fields.shape_data.empty())
+    {
+        shape_jobs.push_back(ShapeJob());
+        ShapeJob& job = shape_jobs.back();
+        job.id = id;
+        job.model_path = model->fields.shape_model_path;
+        job.data = model->fields.shape_data;
+        job.model = model;
+    }
+
+    if (fields.roi)
+        req.setROI(id, fields.roi);
+
+    if (fields.move_restrictions)
+        req.setMoveRestrictions(id, fields.move_restrictions);
+
+    if (fields.state_definition)
+        req.setStateDefinition(id, fields.state_definition);
+
+    if (fields.has_state_update_group)
+    {
+        req.setStateUpdateGroup(id, fields.state_update_group);
+
+        // if original-pose given, move it with the world, otherwise use pose value
+        req.setOriginalPose(id, fields.has_original_pose ? pose_offset * fields.original_pose.pose() : pose);
+    }
+
+    for(std::vector<std::string>::const_iterator it = fields.flags.begin(); it != fields.flags.end(); ++it)
+        req.setFlag(id, *it);
+
+    // Add additional data. Instances get the data of their model, with their own data on top.
+    if (model)
+    {
+        tue::config::DataPointer data_combined;
+        data_combined.add(model->data);
+        data_combined.add(data);
+        req.addData(id, data_combined);
+    }
+    else
+    {
+        req.addData(id, data);
+    }
 
     return true;
 }
 
+// ----------------------------------------------------------------------------------------------------
+
+bool ModelLoader::loadShapes(const std::vector<ShapeJob>& shape_jobs, std::vector<geo::ShapePtr>& shapes,
+                             std::stringstream& error)
+{
+    // Files that are not yet cached, each loaded once, and shapes that are not loaded from a file
+    std::vector<ShapeTask> tasks;
+    std::vector<int> job_tasks(shape_jobs.size(), -1);
+    std::map<std::string, int> file_tasks;
+    std::set<const ModelTemplate*> models;
+
+    for(unsigned int i = 0; i < shape_jobs.size(); ++i)
+    {
+        const ShapeJob& job = shape_jobs[i];
+
+        // Instances of the same model share its shape, which is loaded for the first
+        if (job.model && !models.insert(job.model.get()).second)
+            continue;
+
+        std::string filename;
+        if (getShapeFile(job.model_path, tue::config::Reader(job.data), filename))
+        {
+            if (shape_cache_.find(filename) != shape_cache_.end())
+                continue;
+
+            std::map<std::string, int>::const_iterator it = file_tasks.find(filename);
+            if (it != file_tasks.end())
+            {
+                job_tasks[i] = it->second;
+                continue;
+            }
+
+            file_tasks[filename] = tasks.size();
+            tasks.push_back(ShapeTask());
+            tasks.back().filename = filename;
+        }
+        else
+        {
+            tasks.push_back(ShapeTask());
+            tasks.back().model_path = job.model_path;
+        }
+
+        job_tasks[i] = tasks.size() - 1;
+        tasks.back().data = job.data;
+    }
+
+    // The calling thread is one of the workers
+    ShapeCache* file_cache = file_cache_.isOpen() ? &file_cache_ : 0;
+    ShapeTaskQueue queue(tasks, file_cache);
+    unsigned int num_workers = std::min<unsigned int>(std::max(num_threads_, 1u), tasks.size());
+
+    boost::thread_group workers;
+    for(unsigned int i = 1; i < num_workers; ++i)
+        workers.create_thread(boost::bind(&ShapeTaskQueue::run, &queue));
+
+    queue.run();
+    workers.join_all();
+
+    for(std::map<std::string, int>::const_iterator it = file_tasks.begin(); it != file_tasks.end(); ++it)
+    {
+        const ShapeTask& task = tasks[it->second];
+        if (task.shape)
+            shape_cache_[task.filename] = task.shape;
+    }
+
+    // Collect the shapes in the order of the model tree. Files are taken from the cache, which applies the shape
+    // pose in the same way as for a sequential load.
+    bool ok = true;
+    shapes.assign(shape_jobs.size(), geo::ShapePtr());
+    for(unsigned int i = 0; i < shape_jobs.size(); ++i)
+    {
+        const ShapeJob& job = shape_jobs[i];
+
+        geo::ShapePtr& shape = shapes[i];
+        if (job.model && job.model->shape)
+        {
+            shape = job.model->shape;
+        }
+        else if (job_tasks[i] >= 0 && tasks[job_tasks[i]].filename.empty())
+        {
+            const ShapeTask& task = tasks[job_tasks[i]];
+            error << task.error;
+            shape = task.shape;
+        }
+        else if (job_tasks[i] >= 0 && !tasks[job_tasks[i]].shape)
+        {
+            // Report the error of a failed file only once
+            ShapeTask& task = tasks[job_tasks[i]];
+            error << task.error;
+            task.error.clear();
+        }
+        else
+        {
+            shape = loadShape(job.model_path, tue::config::Reader(job.data), shape_cache_, error, file_cache);
+        }
+
+        if (!shape)
+        {
+            ok = false;
+            continue;
+        }
+
+        if (job.model)
+            job.model->shape = shape;
+    }
+
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
 
-void ModelLoader::readPose(geo::Pose3D& pose, tue::config::Reader& r)
+void ModelLoader::readPose(PoseFields& pose, tue::config::Reader& r, bool required)
 {
-    r.value("x", pose.t.x);
-    r.value("y", pose.t.y);
-    r.value("z", pose.t.z);
-
-    double roll = 0, pitch = 0, yaw = 0;
-    r.value("X", roll,  tue::config::OPTIONAL);
-    r.value("Y", pitch, tue::config::OPTIONAL);
-    r.value("Z", yaw,   tue::config::OPTIONAL);
-    r.value("roll",  roll,  tue::config::OPTIONAL);
-    r.value("pitch", pitch, tue::config::OPTIONAL);
-    r.value("yaw",   yaw,   tue::config::OPTIONAL);
-
-    // Set rotation
-    pose.R.setRPY(roll, pitch, yaw);
+    tue::config::RequiredOrOptional xyz = required ? tue::config::REQUIRED : tue::config::OPTIONAL;
+    r.value("x", pose.x, xyz);
+    r.value("y", pose.y, xyz);
+    r.value("z", pose.z, xyz);
+
+    r.value("X", pose.roll,  tue::config::OPTIONAL);
+    r.value("Y", pose.pitch, tue::config::OPTIONAL);
+    r.value("Z", pose.yaw,   tue::config::OPTIONAL);
+    r.value("roll",  pose.roll,  tue::config::OPTIONAL);
+    r.value("pitch", pose.pitch, tue::config::OPTIONAL);
+    r.value("yaw",   pose.yaw,   tue::config::OPTIONAL);
 }
 
 } // end namespace models
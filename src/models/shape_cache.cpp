@@ -0,0 +1,231 @@
+#include "ed/models/shape_cache.h"
+
+#include "ed/serialization/archive.h"
+#include "ed/logging.h"
+#include "ed/lod_shape.h"
+#include "../io/filesystem/binary_io.h"
+
+#include <geolib/Shape.h>
+#include <geolib/Mesh.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ed
+{
+
+namespace models
+{
+
+namespace
+{
+
+// Increase if the format changes
+const int SHAPE_CACHE_VERSION = 2;
+
+// ----------------------------------------------------------------------------------------------------
+
+// Size and modification time of the source file, as stored in the cache entry
+bool sourceStamp(const std::string& filename, double& size, double& mtime)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return false;
+
+    size = st.st_size;
+    mtime = st.st_mtim.tv_sec + st.st_mtim.tv_nsec * 1e-9;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool makeDirectories(const std::string& directory)
+{
+    for(std::size_t i = 1; i <= directory.size(); ++i)
+    {
+        if (i < directory.size() && directory[i] != '/')
+            continue;
+
+        std::string dir = directory.substr(0, i);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+    }
+
+    return true;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+ShapeCache::ShapeCache() : num_temp_files_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool ShapeCache::open(const std::string& directory)
+{
+    if (!makeDirectories(directory))
+    {
+        log::error() << "Could not create shape cache directory '" << directory << "'" << std::endl;
+        return false;
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    directory_ = directory;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+std::string ShapeCache::entryFilename(const std::string& filename, const std::string& params) const
+{
+    // FNV-1a of the key. Collisions are detected when reading, because the entry contains the full key.
+    unsigned long long h = 14695981039346656037ULL;
+    std::string key = filename + '\0' + params;
+    for(std::string::const_iterator it = key.begin(); it != key.end(); ++it)
+    {
+        h ^= (unsigned char)*it;
+        h *= 1099511628211ULL;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.shape", h);
+    return directory_ + "/" + name;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::ShapePtr ShapeCache::get(const std::string& filename, const std::string& params)
+{
+    if (!isOpen())
+        return geo::ShapePtr();
+
+    geo::ShapePtr shape;
+
+    double size, mtime;
+    binary::MappedFile file;
+    if (sourceStamp(filename, size, mtime) && file.open(entryFilename(filename, params)))
+    {
+        binary::BufferReader r(file.data(), file.size());
+
+        int version;
+        std::string entry_filename, entry_params;
+        double entry_size, entry_mtime;
+        geo::Mesh mesh;
+        int num_levels;
+
+        if (r.read(version) && version == SHAPE_CACHE_VERSION
+                && r.read(entry_filename) && entry_filename == filename
+                && r.read(entry_params) && entry_params == params
+                && r.read(entry_size) && entry_size == size
+                && r.read(entry_mtime) && entry_mtime == mtime
+                && binary::read(r, mesh)
+                && r.readCount(num_levels, sizeof(double)))
+        {
+            if (num_levels == 0)
+            {
+                shape.reset(new geo::Shape);
+                shape->setMesh(mesh);
+            }
+            else
+            {
+                boost::shared_ptr<LODShape> lod_shape(new LODShape);
+                lod_shape->setMesh(mesh);
+
+                bool ok = true;
+                for(int i = 0; ok && i < num_levels; ++i)
+                {
+                    double error;
+                    geo::Mesh level;
+                    ok = r.read(error) && binary::read(r, level);
+                    lod_shape->addLevel(error, level);
+                }
+
+                if (ok)
+                    shape = lod_shape;
+            }
+        }
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (shape)
+        ++stats_.hits;
+    else
+        ++stats_.misses;
+
+    return shape;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void ShapeCache::put(const std::string& filename, const std::string& params, const geo::Shape& shape)
+{
+    if (!isOpen())
+        return;
+
+    double size, mtime;
+    if (!sourceStamp(filename, size, mtime))
+        return;
+
+    std::stringstream tmp_filename;
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        tmp_filename << directory_ << "/.tmp-" << getpid() << "-" << num_temp_files_++;
+    }
+
+    // Written to a temporary file first, such that a reader never sees a partial entry
+    {
+        std::ofstream out(tmp_filename.str().c_str(), std::ofstream::binary | std::ofstream::trunc);
+        if (!out.is_open())
+            return;
+
+        OArchive a(out, SHAPE_CACHE_VERSION);
+        a << filename << params << size << mtime;
+        binary::write(a, shape.getMesh());
+
+        // Levels of detail
+        const LODShape* lod_shape = dynamic_cast<const LODShape*>(&shape);
+        int num_levels = lod_shape ? lod_shape->numLevels() : 0;
+        a << num_levels;
+        for(int i = 0; i < num_levels; ++i)
+        {
+            a << lod_shape->levelError(i);
+            binary::write(a, lod_shape->levelMesh(i));
+        }
+
+        if (!out.good())
+        {
+            out.close();
+            unlink(tmp_filename.str().c_str());
+            return;
+        }
+    }
+
+    if (rename(tmp_filename.str().c_str(), entryFilename(filename, params).c_str()) != 0)
+    {
+        unlink(tmp_filename.str().c_str());
+        return;
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    ++stats_.writes;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+ShapeCache::Statistics ShapeCache::statistics() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return stats_;
+}
+
+} // end namespace models
+
+} // end namespace ed
@@ -1,6 +1,10 @@
 #include "shape_loader.h"
 
 #include "xml_shape_parser.h"
+#include "mesh_decimation.h"
+
+#include "ed/instanced_shape.h"
+#include "ed/lod_shape.h"
 
 #include <tue/filesystem/path.h>
 
@@ -10,6 +14,13 @@
 #include <geolib/CompositeShape.h>
 #include <geolib/Importer.h>
 
+#include <boost/thread/once.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+
 // Heightmap generation
 #include "polypartition/polypartition.h"
 #include <opencv2/imgproc/imgproc.hpp>
@@ -83,7 +94,393 @@ void findContours(const cv::Mat& image, const geo::Vec2i& p_start, int d_start,
 
 // ----------------------------------------------------------------------------------------------------
 
-geo::ShapePtr getHeightMapShape(const std::string& image_filename, const geo::Vec3& pos, double blockheight, double resolution, std::stringstream& error)
+namespace
+{
+
+// Twice the signed area of triangle (p1, p2, p3)
+template<typename P>
+double cross(const P& p1, const P& p2, const P& p3)
+{
+    return ((double)p2.x - p1.x) * ((double)p3.y - p1.y) - ((double)p2.y - p1.y) * ((double)p3.x - p1.x);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Douglas-Peucker on the contour points first..last (indices wrap around). Marks the points that deviate
+// more than 'tolerance' from the simplified contour as 'keep'.
+void simplifyRange(const std::vector<geo::Vec2i>& points, unsigned int first, unsigned int last, double tolerance,
+                   std::vector<bool>& keep)
+{
+    unsigned int n = points.size();
+
+    std::vector<std::pair<unsigned int, unsigned int> > ranges;
+    ranges.push_back(std::make_pair(first, last));
+
+    while(!ranges.empty())
+    {
+        unsigned int i1 = ranges.back().first;
+        unsigned int i2 = ranges.back().second;
+        ranges.pop_back();
+
+        const geo::Vec2i& p1 = points[i1 % n];
+        const geo::Vec2i& p2 = points[i2 % n];
+        double length_sq = (double)(p2.x - p1.x) * (p2.x - p1.x) + (double)(p2.y - p1.y) * (p2.y - p1.y);
+
+        double max_dist_sq = 0;
+        unsigned int i_max = i1;
+        for(unsigned int i = i1 + 1; i < i2; ++i)
+        {
+            const geo::Vec2i& p = points[i % n];
+
+            double dist_sq;
+            if (length_sq > 0)
+            {
+                double c = cross(p1, p2, p);
+                dist_sq = c * c / length_sq;
+            }
+            else
+                dist_sq = (double)(p.x - p1.x) * (p.x - p1.x) + (double)(p.y - p1.y) * (p.y - p1.y);
+
+            if (dist_sq > max_dist_sq)
+            {
+                max_dist_sq = dist_sq;
+                i_max = i;
+            }
+        }
+
+        if (i_max != i1 && max_dist_sq > tolerance * tolerance)
+        {
+            keep[i_max % n] = true;
+            ranges.push_back(std::make_pair(i1, i_max));
+            ranges.push_back(std::make_pair(i_max, i2));
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Simplifies a closed contour. Points on a straight line between their neighbours are always removed,
+// other points only if they are within 'tolerance' (in pixels) of the simplified contour.
+void simplifyContour(const std::vector<geo::Vec2i>& points, double tolerance, std::vector<geo::Vec2i>& simplified)
+{
+    simplified.clear();
+
+    unsigned int n = points.size();
+
+    // Split the contour at the first point and the point farthest from it
+    unsigned int i_far = 0;
+    double max_dist_sq = 0;
+    for(unsigned int i = 1; i < n; ++i)
+    {
+        double dx = points[i].x - points[0].x;
+        double dy = points[i].y - points[0].y;
+        if (dx * dx + dy * dy > max_dist_sq)
+        {
+            max_dist_sq = dx * dx + dy * dy;
+            i_far = i;
+        }
+    }
+
+    if (i_far == 0)
+        return;
+
+    std::vector<bool> keep(n, false);
+    keep[0] = keep[i_far] = true;
+    simplifyRange(points, 0, i_far, tolerance, keep);
+    simplifyRange(points, i_far, n, tolerance, keep);
+
+    // Remove the points on a straight line between their neighbours, which also removes duplicate points
+    // and zero-width spikes left by the simplification
+    for(unsigned int i = 0; i < n; ++i)
+    {
+        if (!keep[i])
+            continue;
+
+        simplified.push_back(points[i]);
+        while(simplified.size() > 2 && cross(simplified[simplified.size() - 3], simplified[simplified.size() - 2], simplified.back()) == 0)
+            simplified.erase(simplified.end() - 2);
+    }
+
+    // Same for the points where the contour wraps around
+    bool changed = true;
+    while(changed && simplified.size() > 2)
+    {
+        changed = false;
+        if (cross(simplified[simplified.size() - 2], simplified.back(), simplified.front()) == 0)
+        {
+            simplified.pop_back();
+            changed = true;
+        }
+        else if (cross(simplified.back(), simplified.front(), simplified[1]) == 0)
+        {
+            simplified.erase(simplified.begin());
+            changed = true;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Converts the contours (outer contour first, then the holes) to polygons. Where the contours visit a pixel
+// corner more than once (pixels touching diagonally), each visit is moved slightly into the corner it turns
+// around, such that the polygons are simple. Returns twice the area, and whether all polygon points differ.
+double toPolygons(const std::vector<std::vector<geo::Vec2i> >& contours, std::list<TPPLPoly>& polys, bool& simple)
+{
+    std::map<std::pair<int, int>, int> num_visits;
+    for(unsigned int i = 0; i < contours.size(); ++i)
+    {
+        for(unsigned int j = 0; j < contours[i].size(); ++j)
+            ++num_visits[std::make_pair(contours[i][j].x, contours[i][j].y)];
+    }
+
+    double area = 0;
+    for(unsigned int i = 0; i < contours.size(); ++i)
+    {
+        const std::vector<geo::Vec2i>& contour = contours[i];
+        unsigned int n = contour.size();
+
+        polys.push_back(TPPLPoly());
+        TPPLPoly& poly = polys.back();
+        poly.Init(n);
+
+        for(unsigned int j = 0; j < n; ++j)
+        {
+            const geo::Vec2i& p = contour[j];
+            poly[j].x = p.x;
+            poly[j].y = p.y;
+
+            if (num_visits[std::make_pair(p.x, p.y)] > 1)
+            {
+                const geo::Vec2i& p_prev = contour[(j + n - 1) % n];
+                const geo::Vec2i& p_next = contour[(j + 1) % n];
+                double l_in = std::sqrt((double)(p.x - p_prev.x) * (p.x - p_prev.x) + (double)(p.y - p_prev.y) * (p.y - p_prev.y));
+                double l_out = std::sqrt((double)(p_next.x - p.x) * (p_next.x - p.x) + (double)(p_next.y - p.y) * (p_next.y - p.y));
+                poly[j].x += 1e-4 * ((p_next.x - p.x) / l_out - (p.x - p_prev.x) / l_in);
+                poly[j].y += 1e-4 * ((p_next.y - p.y) / l_out - (p.y - p_prev.y) / l_in);
+            }
+        }
+
+        poly.SetHole(i > 0);
+        poly.SetOrientation(i == 0 ? TPPL_CCW : TPPL_CW);
+
+        for(unsigned int j = 1; j + 1 < n; ++j)
+            area += cross(poly[0], poly[j], poly[j + 1]);
+    }
+
+    // Contours that overlap (which the contour tracing produces for some diagonal structures) can not be separated
+    std::set<std::pair<double, double> > unique_points;
+    simple = true;
+    for(std::list<TPPLPoly>::iterator it = polys.begin(); it != polys.end() && simple; ++it)
+    {
+        for(long j = 0; j < it->GetNumPoints() && simple; ++j)
+            simple = unique_points.insert(std::make_pair((*it)[j].x, (*it)[j].y)).second;
+    }
+
+    return area;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Triangulates a polygon (contours[0]) with holes (the other contours). Monotone partitioning is O(n log n),
+// ear clipping O(n^2), but monotone partitioning is less robust for degenerate polygons, so its result is checked.
+bool triangulate(const std::vector<std::vector<geo::Vec2i> >& contours, bool monotone, std::list<TPPLPoly>& triangles)
+{
+    std::list<TPPLPoly> polys;
+    bool simple;
+    double area = toPolygons(contours, polys, simple);
+
+    triangles.clear();
+
+    TPPLPartition pp;
+    if (!monotone)
+        return pp.Triangulate_EC(&polys, &triangles);
+
+    // Monotone partitioning does not handle polygons that are not simple (and may even crash on them)
+    if (!simple || !pp.Triangulate_MONO(&polys, &triangles))
+        return false;
+
+    // The triangles must cover the polygon. Errors are multiples of half a pixel, the moved corners
+    // only cause much smaller differences.
+    double triangle_area = 0;
+    for(std::list<TPPLPoly>::iterator it = triangles.begin(); it != triangles.end(); ++it)
+    {
+        TPPLPoly& t = *it;
+        if (t.GetNumPoints() != 3)
+            return false;
+        triangle_area += std::abs(cross(t[0], t[1], t[2]));
+    }
+
+    return std::abs(triangle_area - area) < 0.5;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Vertices of the heightmap mesh: all bottom vertices are shared, top vertices are shared between
+// contours with the same height
+struct HeightMapVertices
+{
+    HeightMapVertices(const cv::Mat& image, const geo::Vec3& pos_, double resolution_) :
+        pos(pos_), resolution(resolution_), rows(image.rows),
+        bottom_index(image.rows, image.cols, CV_32SC1, cv::Scalar(-1)),
+        top_index(image.rows, image.cols, CV_32SC1, cv::Scalar(-1)),
+        top_value(image.rows, image.cols, CV_32SC1, cv::Scalar(-1)) {}
+
+    int bottom(geo::Mesh& mesh, const geo::Vec2i& p)
+    {
+        int& i = bottom_index.at<int>(p.y, p.x);
+        if (i < 0)
+            i = mesh.addPoint(toWorld(p, pos.z));
+        return i;
+    }
+
+    int top(geo::Mesh& mesh, const geo::Vec2i& p, int v, double z)
+    {
+        int& i = top_index.at<int>(p.y, p.x);
+        int& i_v = top_value.at<int>(p.y, p.x);
+        if (i < 0 || i_v != v)
+        {
+            i = mesh.addPoint(toWorld(p, z));
+            i_v = v;
+        }
+        return i;
+    }
+
+    geo::Vector3 toWorld(const geo::Vec2i& p, double z) const
+    {
+        return geo::Vector3(p.x * resolution + pos.x, (rows - p.y - 2) * resolution + pos.y, z);
+    }
+
+    geo::Vec3 pos;
+    double resolution;
+    int rows;
+    cv::Mat bottom_index, top_index, top_value;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+// Adds the side and top triangles of the region with value 'v', bounded by 'contours' (outer contour
+// first, then the holes)
+bool addHeightMapRegion(const std::vector<std::vector<geo::Vec2i> >& contours, unsigned char v, double max_z,
+                        double tolerance, HeightMapVertices& vertices, geo::Mesh& mesh)
+{
+    // Prefer the simplified contours; fall back to the original ones and ear clipping
+    std::vector<std::vector<geo::Vec2i> > simplified;
+    for(unsigned int i = 0; i < contours.size(); ++i)
+    {
+        std::vector<geo::Vec2i> contour;
+        simplifyContour(contours[i], tolerance, contour);
+
+        if (contour.size() > 2)
+            simplified.push_back(contour);
+        else if (i == 0)
+            break;
+    }
+
+    const std::vector<std::vector<geo::Vec2i> >* used = &simplified;
+    std::list<TPPLPoly> triangles;
+
+    if (simplified.empty() || !triangulate(simplified, true, triangles))
+    {
+        used = &contours;
+        if (!triangulate(contours, true, triangles) && !triangulate(contours, false, triangles))
+            return false;
+    }
+
+    // Side triangles
+    for(unsigned int i = 0; i < used->size(); ++i)
+    {
+        const std::vector<geo::Vec2i>& contour = (*used)[i];
+        for(unsigned int j = 0; j < contour.size(); ++j)
+        {
+            const geo::Vec2i& p1 = contour[j];
+            const geo::Vec2i& p2 = contour[(j + 1) % contour.size()];
+
+            int b1 = vertices.bottom(mesh, p1);
+            int b2 = vertices.bottom(mesh, p2);
+            int t1 = vertices.top(mesh, p1, v, max_z);
+            int t2 = vertices.top(mesh, p2, v, max_z);
+
+            mesh.addTriangle(b1, t1, b2);
+            mesh.addTriangle(t1, t2, b2);
+        }
+    }
+
+    // Top triangles, counter-clockwise in world coordinates (the image y-axis points down)
+    for(std::list<TPPLPoly>::iterator it = triangles.begin(); it != triangles.end(); ++it)
+    {
+        TPPLPoly& t = *it;
+
+        // Undo the offsets of toPolygons
+        geo::Vec2i p[3];
+        for(unsigned int i = 0; i < 3; ++i)
+            p[i] = geo::Vec2i((int)std::floor(t[i].x + 0.5), (int)std::floor(t[i].y + 0.5));
+
+        double c = cross(p[0], p[1], p[2]);
+        if (c == 0)
+            continue;
+
+        int i1 = vertices.top(mesh, p[0], v, max_z);
+        int i2 = vertices.top(mesh, p[1], v, max_z);
+        int i3 = vertices.top(mesh, p[2], v, max_z);
+
+        if (c < 0)
+            mesh.addTriangle(i1, i2, i3);
+        else
+            mesh.addTriangle(i1, i3, i2);
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Maximum errors (m) of the levels of detail of imported meshes and heightmaps
+const double LOD_ERRORS[] = { 0.01, 0.03, 0.1 };
+
+// Smaller meshes are cheap enough for every consumer
+const unsigned int LOD_MIN_TRIANGLES = 256;
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::ShapePtr createLevelsOfDetail(const geo::ShapePtr& shape)
+{
+    const geo::Mesh& mesh = shape->getMesh();
+
+    unsigned int num_triangles = mesh.getTriangleIs().size();
+    if (num_triangles < LOD_MIN_TRIANGLES)
+        return shape;
+
+    boost::shared_ptr<LODShape> lod_shape(new LODShape);
+    lod_shape->setMesh(mesh);
+
+    MeshDecimator decimator(mesh);
+    for(unsigned int i = 0; i < sizeof(LOD_ERRORS) / sizeof(LOD_ERRORS[0]); ++i)
+    {
+        decimator.decimate(LOD_ERRORS[i]);
+
+        // Only keep levels that are considerably coarser than the previous one
+        if (decimator.numTriangles() > 3 * num_triangles / 4)
+            continue;
+
+        geo::Mesh level;
+        decimator.getMesh(level);
+        lod_shape->addLevel(LOD_ERRORS[i], level);
+
+        num_triangles = decimator.numTriangles();
+    }
+
+    if (lod_shape->numLevels() == 0)
+        return shape;
+
+    return lod_shape;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::ShapePtr getHeightMapShape(const std::string& image_filename, const geo::Vec3& pos, double blockheight, double resolution,
+                                double tolerance, std::stringstream& error)
 {
     cv::Mat image_orig = cv::imread(image_filename, CV_LOAD_IMAGE_GRAYSCALE);   // Read the file
 
@@ -97,10 +494,15 @@ geo::ShapePtr getHeightMapShape(const std::string& image_filename, const geo::Ve
     cv::Mat image(image_orig.rows + 2, image_orig.cols + 2, CV_8UC1, cv::Scalar(255));
     image_orig.copyTo(image(cv::Rect(cv::Point(1, 1), cv::Size(image_orig.cols, image_orig.rows))));
 
-    cv::Mat vertex_index_map(image.rows, image.cols, CV_32SC1, -1);
     cv::Mat contour_map(image.rows, image.cols, CV_8UC1, cv::Scalar(0));
 
-    boost::shared_ptr<geo::CompositeShape> shape(new geo::CompositeShape);
+    // Contour points are pixel corners, so the tolerance is converted to pixels
+    double tolerance_px = resolution > 0 ? tolerance / resolution : 0;
+
+    HeightMapVertices vertices(image, pos, resolution);
+    geo::Mesh mesh;
+
+    geo::ShapePtr shape(new geo::Shape);
 
     for(int y = 0; y < image.rows; ++y)
     {
@@ -113,42 +515,12 @@ geo::ShapePtr getHeightMapShape(const std::string& image_filename, const geo::Ve
                 std::vector<geo::Vec2i> points, line_starts;
                 findContours(image, geo::Vec2i(x, y), 0, points, line_starts, contour_map);
 
-                unsigned int num_points = points.size();
-
-                if (num_points > 2)
+                if (points.size() > 2)
                 {
-                    geo::Mesh mesh;
-
-                    double min_z = pos.z;
                     double max_z = pos.z + (double)(255 - v) / 255 * blockheight;
 
-                    std::list<TPPLPoly> testpolys;
-
-                    TPPLPoly poly;
-                    poly.Init(num_points);
-
-                    for(unsigned int i = 0; i < num_points; ++i)
-                    {
-                        poly[i].x = points[i].x;
-                        poly[i].y = points[i].y;
-
-                        // Convert to world coordinates
-                        double wx = points[i].x * resolution + pos.x;
-                        double wy = (image.rows - points[i].y - 2) * resolution + pos.y;
-
-                        vertex_index_map.at<int>(points[i].y, points[i].x) = mesh.addPoint(geo::Vector3(wx, wy, min_z));
-                        mesh.addPoint(geo::Vector3(wx, wy, max_z));
-                    }
-
-                    testpolys.push_back(poly);
-
-                    // Calculate side triangles
-                    for(unsigned int i = 0; i < num_points; ++i)
-                    {
-                        int j = (i + 1) % num_points;
-                        mesh.addTriangle(i * 2, i * 2 + 1, j * 2);
-                        mesh.addTriangle(i * 2 + 1, j * 2 + 1, j * 2);
-                    }
+                    std::vector<std::vector<geo::Vec2i> > contours;
+                    contours.push_back(points);
 
                     for(unsigned int i = 0; i < line_starts.size(); ++i)
                     {
@@ -165,72 +537,24 @@ geo::ShapePtr getHeightMapShape(const std::string& image_filename, const geo::Ve
                             findContours(image, geo::Vec2i(x2 - 1, y2 + 1), 1, hole_points, line_starts, contour_map);
 
                             if (hole_points.size() > 2)
-                            {
-                                TPPLPoly poly_hole;
-                                poly_hole.Init(hole_points.size());
-                                poly_hole.SetHole(true);
-
-                                for(unsigned int j = 0; j < hole_points.size(); ++j)
-                                {
-                                    poly_hole[j].x = hole_points[j].x;
-                                    poly_hole[j].y = hole_points[j].y;
-
-                                    // Convert to world coordinates
-                                    double wx = hole_points[j].x * resolution + pos.x;
-                                    double wy = (image.rows - hole_points[j].y - 2) * resolution + pos.y;
-
-                                    vertex_index_map.at<int>(hole_points[j].y, hole_points[j].x) = mesh.addPoint(geo::Vector3(wx, wy, min_z));
-                                    mesh.addPoint(geo::Vector3(wx, wy, max_z));
-                                }
-                                testpolys.push_back(poly_hole);
-
-                                // Calculate side triangles
-                                for(unsigned int j = 0; j < hole_points.size(); ++j)
-                                {
-                                    const geo::Vec2i& hp1 = hole_points[j];
-                                    const geo::Vec2i& hp2 = hole_points[(j + 1) % hole_points.size()];
-
-                                    int i1 = vertex_index_map.at<int>(hp1.y, hp1.x);
-                                    int i2 = vertex_index_map.at<int>(hp2.y, hp2.x);
-
-                                    mesh.addTriangle(i1, i1 + 1, i2);
-                                    mesh.addTriangle(i2, i1 + 1, i2 + 1);
-                                }
-                            }
+                                contours.push_back(hole_points);
                         }
                     }
 
-                    TPPLPartition pp;
-                    std::list<TPPLPoly> result;
-
-                    if (!pp.Triangulate_EC(&testpolys, &result))
+                    if (!addHeightMapRegion(contours, v, max_z, tolerance_px, vertices, mesh))
                     {
                         error << "[ED::MODELS::LOADSHAPE] Error while creating heightmap: could not triangulate polygon." << std::endl;
+                        shape->setMesh(mesh);
                         return shape;
                     }
 
-                    for(std::list<TPPLPoly>::iterator it = result.begin(); it != result.end(); ++it)
-                    {
-                        TPPLPoly& cp = *it;
-
-                        int i1 = vertex_index_map.at<int>(cp[0].y, cp[0].x) + 1;
-                        int i2 = vertex_index_map.at<int>(cp[1].y, cp[1].x) + 1;
-                        int i3 = vertex_index_map.at<int>(cp[2].y, cp[2].x) + 1;
-
-                        mesh.addTriangle(i1, i3, i2);
-                    }
-
-                    geo::Shape sub_shape;
-                    sub_shape.setMesh(mesh);
-
-                    shape->addShape(sub_shape, geo::Pose3D::identity());
-
                     cv::floodFill(image, cv::Point(x, y), 255);
                 }
             }
         }
     }
 
+    shape->setMesh(mesh);
     return shape;
 }
 
@@ -250,7 +574,11 @@ geo::ShapePtr getHeightMapShape(const tue::filesystem::Path& path, tue::config::
         return geo::ShapePtr();
     }
 
-    return getHeightMapShape(path.string(), geo::Vec3(origin_x, origin_y, origin_z), blockheight, resolution, error);
+    // Maximum deviation (in meters) of the simplified contours from the pixel contours
+    double simplify = 0;
+    cfg.value("simplify", simplify, tue::config::OPTIONAL);
+
+    return getHeightMapShape(path.string(), geo::Vec3(origin_x, origin_y, origin_z), blockheight, resolution, simplify, error);
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -388,8 +716,112 @@ void readPose(tue::config::Reader& cfg, geo::Pose3D& pose)
 
 // ----------------------------------------------------------------------------------------------------
 
+bool getShapeFile(const std::string& model_path, tue::config::Reader cfg, std::string& filename)
+{
+    std::string path;
+    if (!cfg.value("path", path, tue::config::OPTIONAL) || path.empty())
+        return false;
+
+    if (model_path.empty() || path[0] == '/')
+        filename = path;
+    else
+        filename = model_path + "/" + path;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void registerShapeDeserializer()
+{
+    geo::serialization::registerDeserializer<geo::Shape>();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::ShapePtr loadShapeFile(const std::string& filename, tue::config::Reader cfg, std::stringstream& error,
+                            ShapeCache* file_cache)
+{
+    geo::ShapePtr shape;
+
+    tue::filesystem::Path shape_path(filename);
+    if (!shape_path.exists())
+    {
+        error << "[ED::MODELS::LOADSHAPE] Error while loading shape at " << shape_path.string() << " ; file does not exist" << std::endl;
+        return shape;
+    }
+
+    std::string xt = shape_path.extension();
+
+    // Geolib files are already binary meshes: only cache shapes that are imported or triangulated
+    bool use_file_cache = (file_cache && xt != ".geo");
+
+    std::string params;
+    if (use_file_cache)
+    {
+        // Heightmap parameters (see getHeightMapShape). Other file types have no parameters.
+        if (xt == ".pgm")
+        {
+            std::stringstream s;
+            s.precision(17);
+            const char* names[] = { "origin_x", "origin_y", "origin_z", "resolution", "blockheight", "simplify" };
+            for(unsigned int i = 0; i < 6; ++i)
+            {
+                double v = 0;
+                cfg.value(names[i], v, tue::config::OPTIONAL);
+                s << names[i] << "=" << v << ";";
+            }
+            params = s.str();
+        }
+
+        shape = file_cache->get(filename, params);
+        if (shape)
+            return shape;
+    }
+
+    if (xt == ".pgm")
+    {
+        shape = getHeightMapShape(shape_path, cfg, error);
+    }
+    else if (xt == ".geo")
+    {
+        // The deserializer registry is global, so register only once (shapes may be loaded in parallel)
+        static boost::once_flag register_flag = BOOST_ONCE_INIT;
+        boost::call_once(registerShapeDeserializer, register_flag);
+
+        shape = geo::serialization::fromFile(shape_path.string());
+    }
+    else if (xt == ".3ds" || xt == ".stl" || xt == ".dae")
+    {
+        shape = geo::Importer::readMeshFile(shape_path.string());
+    }
+    else if (xt == ".xml")
+    {
+        std::string error;
+        shape = parseXMLShape(shape_path.string(), error);
+    }
+
+    if (!shape)
+    {
+        error << "[ED::MODELS::LOADSHAPE] Error while loading shape at " << shape_path.string() << std::endl;
+        return shape;
+    }
+
+    // Geolib and XML files can describe primitives and composite shapes, which are kept as they are
+    if (xt != ".geo" && xt != ".xml")
+        shape = createLevelsOfDetail(shape);
+
+    if (use_file_cache)
+        file_cache->put(filename, params, *shape);
+
+    return shape;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
 geo::ShapePtr loadShape(const std::string& model_path, tue::config::Reader cfg,
-                        std::map<std::string, geo::ShapePtr>& shape_cache, std::stringstream& error)
+                        std::map<std::string, geo::ShapePtr>& shape_cache, std::stringstream& error,
+                        ShapeCache* file_cache)
 {
     geo::ShapePtr shape;
     geo::Pose3D pose = geo::Pose3D::identity();
@@ -403,49 +835,21 @@ geo::ShapePtr loadShape(const std::string& model_path, tue::config::Reader cfg,
             return shape;
         }
 
-        tue::filesystem::Path shape_path;
-
-        if (model_path.empty() || path[0] == '/')
-            shape_path = path;
-        else
-            shape_path = model_path + "/" + path;
+        std::string filename;
+        getShapeFile(model_path, cfg, filename);
 
-        // Check cache first
-        std::map<std::string, geo::ShapePtr>::const_iterator it = shape_cache.find(shape_path.string());
+        // Check cache first. The cached shape is shared by all instances, whatever their pose.
+        std::map<std::string, geo::ShapePtr>::const_iterator it = shape_cache.find(filename);
         if (it != shape_cache.end())
-            return it->second;
-
-        if (shape_path.exists())
         {
-            std::string xt = shape_path.extension();
-            if (xt == ".pgm")
-            {
-                shape = getHeightMapShape(shape_path, cfg, error);
-            }
-            else if (xt == ".geo")
-            {
-                geo::serialization::registerDeserializer<geo::Shape>();
-                shape = geo::serialization::fromFile(shape_path.string());
-            }
-            else if (xt == ".3ds" || xt == ".stl" || xt == ".dae")
-            {
-                shape = geo::Importer::readMeshFile(shape_path.string());
-            }
-            else if (xt == ".xml")
-            {
-                std::string error;
-                shape = parseXMLShape(shape_path.string(), error);
-            }
-
-            if (!shape)
-                error << "[ED::MODELS::LOADSHAPE] Error while loading shape at " << shape_path.string() << std::endl;
-            else
-                // Add to cache
-                shape_cache[shape_path.string()] = shape;
+            shape = it->second;
         }
         else
         {
-            error << "[ED::MODELS::LOADSHAPE] Error while loading shape at " << shape_path.string() << " ; file does not exist" << std::endl;
+            shape = loadShapeFile(filename, cfg, error, file_cache);
+            if (shape)
+                // Add to cache
+                shape_cache[filename] = shape;
         }
     }
     else if (cfg.readGroup("box"))
@@ -529,7 +933,7 @@ geo::ShapePtr loadShape(const std::string& model_path, tue::config::Reader cfg,
         while(cfg.nextArrayItem())
         {
             std::map<std::string, geo::ShapePtr> dummy_shape_cache;
-            geo::ShapePtr sub_shape = loadShape(model_path, cfg, dummy_shape_cache, error);
+            geo::ShapePtr sub_shape = loadShape(model_path, cfg, dummy_shape_cache, error, file_cache);
             composite->addShape(*sub_shape, geo::Pose3D::identity());
         }
         cfg.endArray();
@@ -545,13 +949,32 @@ geo::ShapePtr loadShape(const std::string& model_path, tue::config::Reader cfg,
                 && cfg.value("resolution", resolution)
                 && cfg.value("height", height))
         {
+            double simplify = 0;
+            cfg.value("simplify", simplify, tue::config::OPTIONAL);
+
             std::string image_filename_full = image_filename;
 //            if (image_filename[0] == '/')
 //                image_filename_full = image_filename;
 //            else
 //                image_filename_full = model_path + "/" + image_filename;
 
-            shape = getHeightMapShape(image_filename_full, geo::Vec3(0, 0, 0), height, resolution, error);
+            std::stringstream params;
+            params.precision(17);
+            params << "heightmap;height=" << height << ";resolution=" << resolution << ";simplify=" << simplify << ";";
+
+            if (file_cache)
+                shape = file_cache->get(image_filename_full, params.str());
+
+            if (!shape)
+            {
+                shape = getHeightMapShape(image_filename_full, geo::Vec3(0, 0, 0), height, resolution, simplify, error);
+                if (shape)
+                {
+                    shape = createLevelsOfDetail(shape);
+                    if (file_cache)
+                        file_cache->put(image_filename_full, params.str(), *shape);
+                }
+            }
 
             if (cfg.readGroup("pose"))
             {
@@ -575,13 +998,9 @@ geo::ShapePtr loadShape(const std::string& model_path, tue::config::Reader cfg,
         cfg.endGroup();
     }
 
-    if (shape)
-    {
-        // Transform shape according to pose
-        geo::ShapePtr shape_tr(new geo::Shape);
-        shape_tr->setMesh(shape->getMesh().getTransformed(pose));
-        shape = shape_tr;
-    }
+    // Place the shape according to pose, sharing its mesh
+    if (shape && !isIdentity(pose))
+        shape.reset(new InstancedShape(shape, pose));
 
     return shape;
 }
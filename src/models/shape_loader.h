@@ -4,14 +4,27 @@
 #include <geolib/datatypes.h>
 #include <tue/config/reader.h>
 
+#include "ed/models/shape_cache.h"
+
 namespace ed
 {
 
 namespace models
 {
 
+/// Loads the shape described by 'cfg'. Imported meshes and heightmaps are taken from, or added to, the
+/// persistent 'file_cache' if given.
 geo::ShapePtr loadShape(const std::string& model_path, tue::config::Reader cfg,
-                        std::map<std::string, geo::ShapePtr>& shape_cache, std::stringstream& error);
+                        std::map<std::string, geo::ShapePtr>& shape_cache, std::stringstream& error,
+                        ShapeCache* file_cache = 0);
+
+/// Gets the file of a shape that is loaded from a file ('path'). Returns false for other shapes.
+bool getShapeFile(const std::string& model_path, tue::config::Reader cfg, std::string& filename);
+
+/// Loads a shape file (mesh, heightmap image, geolib or xml shape). The file shape cache of loadShape is keyed
+/// by the same filename. Thread-safe.
+geo::ShapePtr loadShapeFile(const std::string& filename, tue::config::Reader cfg, std::stringstream& error,
+                            ShapeCache* file_cache = 0);
 
 void createPolygon(geo::Shape& shape, const std::vector<geo::Vec2>& points, double height, bool create_bottom = true);
 
@@ -1,6 +1,8 @@
 #include "ed/plugin_container.h"
 
 #include "ed/plugin.h"
+#include "ed/world_model.h"
+#include "ed/entity.h"
 
 // TODO: get rid of ros rate
 #include <ros/rate.h>
@@ -14,7 +16,7 @@ namespace ed
 
 PluginContainer::PluginContainer()
     : class_loader_(0), request_stop_(false), is_running_(false), cycle_duration_(0.1), loop_frequency_(10), step_finished_(true), t_last_update_(0),
-      total_process_time_sec_(0)
+      total_process_time_sec_(0), all_dirty_(true)
 {
     timer_.start();
 }
@@ -159,6 +161,9 @@ bool PluginContainer::step()
     }
 
     std::vector<UpdateRequestConstPtr> world_deltas;
+    std::vector<boost::shared_ptr<const CompactionMap> > compactions;
+    std::map<UUID, unsigned int> dirty_map;
+    bool new_world = false;
 
     // Check if there is a new world. If so replace the current one with the new one
     {
@@ -167,15 +172,38 @@ bool PluginContainer::step()
         {
             world_current_ = world_new_;
             world_deltas = world_deltas_;
+            compactions.swap(compactions_);
+            dirty_map.swap(dirty_);
+            new_world = true;
 
             world_deltas_.clear();
             world_new_.reset();
         }
     }
 
+    std::vector<DirtyEntity> dirty;
+    if (new_world && all_dirty_)
+    {
+        // The plugin did not see the world before, so everything in it is new
+        for(WorldModel::const_iterator it = world_current_->begin(); it != world_current_->end(); ++it)
+            dirty_map[(*it)->id()] |= DirtyEntity::ALL;
+        all_dirty_ = false;
+    }
+
+    dirty.reserve(dirty_map.size());
+    for(std::map<UUID, unsigned int>::const_iterator it = dirty_map.begin(); it != dirty_map.end(); ++it)
+        dirty.push_back(DirtyEntity(it->first, it->second));
+
+    // Indices the plugin keeps must refer to the new world before it processes it
+    for(std::vector<boost::shared_ptr<const CompactionMap> >::const_iterator it = compactions.begin(); it != compactions.end(); ++it)
+    {
+        ed::ErrorContext errc("Plugin:", name().c_str());
+        plugin_->remapIndices(**it);
+    }
+
     if (world_current_)
     {
-        PluginInput data(*world_current_, world_deltas);
+        PluginInput data(*world_current_, world_deltas, dirty);
 
         UpdateRequestPtr update_request(new UpdateRequest);
 
@@ -204,6 +232,54 @@ bool PluginContainer::step()
 
 // --------------------------------------------------------------------------------
 
+namespace
+{
+
+template<typename T>
+void markComponent(std::map<UUID, unsigned int>& dirty, const std::map<UUID, T>& changes, unsigned int components)
+{
+    for(typename std::map<UUID, T>::const_iterator it = changes.begin(); it != changes.end(); ++it)
+        dirty[it->first] |= components;
+}
+
+} // end anonymous namespace
+
+// --------------------------------------------------------------------------------
+
+void PluginContainer::markDirty(const UpdateRequest& delta)
+{
+    std::map<UUID, unsigned int> changes;
+
+    // The convex hull of an entity with a shape follows its pose, and the pose of an entity with measured
+    // convex hulls follows those
+    markComponent(changes, delta.poses, DirtyEntity::POSE | DirtyEntity::CONVEX_HULL);
+    markComponent(changes, delta.shapes, DirtyEntity::SHAPE | DirtyEntity::CONVEX_HULL);
+    markComponent(changes, delta.convex_hulls_new, DirtyEntity::CONVEX_HULL | DirtyEntity::POSE);
+    markComponent(changes, delta.datas, DirtyEntity::DATA);
+    markComponent(changes, delta.types, DirtyEntity::TYPE);
+    markComponent(changes, delta.type_sets_added, DirtyEntity::TYPE);
+    markComponent(changes, delta.type_sets_removed, DirtyEntity::TYPE);
+    markComponent(changes, delta.added_flags, DirtyEntity::FLAGS);
+    markComponent(changes, delta.flag_sets_added, DirtyEntity::FLAGS);
+    markComponent(changes, delta.removed_flags, DirtyEntity::FLAGS);
+
+    for(std::set<UUID>::const_iterator it = delta.removed_entities.begin(); it != delta.removed_entities.end(); ++it)
+        changes[*it] |= DirtyEntity::REMOVED;
+
+    // Entities of which only something else changed
+    for(std::set<UUID>::const_iterator it = delta.updated_entities.begin(); it != delta.updated_entities.end(); ++it)
+    {
+        unsigned int& components = changes[*it];
+        if (components == 0)
+            components = DirtyEntity::OTHER;
+    }
+
+    for(std::map<UUID, unsigned int>::const_iterator it = changes.begin(); it != changes.end(); ++it)
+        dirty_[it->first] |= it->second;
+}
+
+// --------------------------------------------------------------------------------
+
 void PluginContainer::requestStop()
 {
     request_stop_ = true;
@@ -0,0 +1,469 @@
+#include "ed/replication/hub.h"
+
+#include "ed/world_model.h"
+#include "ed/update_request.h"
+#include "ed/entity.h"
+#include "ed/property_key_db.h"
+#include "ed/serialization/serialization.h"
+#include "ed/serialization/shape_store.h"
+#include "ed/io/json_writer.h"
+
+#include <tue/config/yaml_emitter.h>
+
+#include <geolib/Shape.h>
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <set>
+
+namespace ed
+{
+
+namespace replication
+{
+
+namespace
+{
+
+// ----------------------------------------------------------------------------------------------------
+
+struct MergedEntity
+{
+    MergedEntity() : record(0), shape_record(0), closed(false) {}
+
+    // Newest record of the entity
+    const EntityRecord* record;
+
+    // Newest record containing a mesh of the entity that is still valid
+    const EntityRecord* shape_record;
+
+    // True if no older records should be taken into account
+    bool closed;
+};
+
+typedef std::map<std::string, MergedEntity> MergeMap;
+
+// ----------------------------------------------------------------------------------------------------
+
+// Segments must be merged from newest to oldest
+void merge(const Segment& s, MergeMap& merged)
+{
+    for(std::vector<EntityRecord>::const_iterator it = s.records.begin(); it != s.records.end(); ++it)
+    {
+        const EntityRecord& rec = *it;
+        MergedEntity& m = merged[rec.id];
+
+        if (m.closed)
+            continue;
+
+        if (!m.record)
+            m.record = &rec;
+
+        // Everything before a removal belongs to an earlier incarnation of this entity
+        if (rec.removed)
+        {
+            m.closed = true;
+            continue;
+        }
+
+        if (!m.shape_record && rec.shape)
+            m.shape_record = &rec;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void writeEntity(const std::string& id, const MergedEntity& m, bool mesh_as_ref, std::string& out)
+{
+    if (m.record->removed)
+    {
+        out += "{\"id\":\"" + id + "\",\"removed\":1}";
+        return;
+    }
+
+    const std::string& body = *m.record->body;
+
+    if (!m.shape_record)
+    {
+        out += body;
+        return;
+    }
+
+    // Join both objects: strip the closing brace of the body and the opening brace of the shape
+    out.append(body, 0, body.size() - 1);
+    out += ",";
+
+    if (mesh_as_ref)
+        out += "\"mesh_ref\":\"" + m.shape_record->shape_hash + "\"}";
+    else
+        out.append(*m.shape_record->shape, 1, std::string::npos);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Meshes that were published in or before 'known_revision' are only referenced
+void writeResponse(const MergeMap& merged, bool full_state, unsigned long known_revision,
+                   const std::map<std::string, unsigned long>& mesh_revisions, std::string& response)
+{
+    std::size_t size = 0;
+    for(MergeMap::const_iterator it = merged.begin(); it != merged.end(); ++it)
+    {
+        const MergedEntity& m = it->second;
+        if (m.record->body)
+            size += m.record->body->size() + 1;
+        if (m.shape_record)
+            size += m.shape_record->shape->size();
+    }
+
+    // Hashes of the meshes written so far
+    std::set<std::string> written_meshes;
+
+    response.clear();
+    response.reserve(size + 64);
+
+    response += "{\"entities\":[";
+
+    bool first = true;
+    for(MergeMap::const_iterator it = merged.begin(); it != merged.end(); ++it)
+    {
+        const MergedEntity& m = it->second;
+
+        // A client that receives the full state simply does not hear about removed entities
+        if (full_state && m.record->removed)
+            continue;
+
+        if (!first)
+            response += ",";
+        first = false;
+
+        bool mesh_as_ref = false;
+        if (m.shape_record && !m.record->removed)
+        {
+            const std::string& hash = m.shape_record->shape_hash;
+            std::map<std::string, unsigned long>::const_iterator it_rev = mesh_revisions.find(hash);
+
+            mesh_as_ref = !written_meshes.insert(hash).second
+                    || (it_rev != mesh_revisions.end() && it_rev->second <= known_revision);
+        }
+
+        writeEntity(it->first, m, mesh_as_ref, response);
+    }
+
+    response += "]";
+
+    if (full_state)
+        response += ",\"full_state\":1";
+
+    response += "}";
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void writeBody(const Entity& e, io::Writer& w)
+{
+    w.writeValue("id", e.id().str());
+    w.writeValue("type", e.type());
+    w.writeValue("existence_prob", e.existenceProbability());
+
+    w.writeGroup("timestamp");
+    serializeTimestamp(e.lastUpdateTimestamp(), w);
+    w.endGroup();
+
+    if (!e.convexHull().points.empty())
+    {
+        w.writeGroup("convex_hull");
+        serialize(e.convexHull(), w);
+        w.endGroup();
+    }
+
+    if (e.has_pose())
+    {
+        w.writeGroup("pose");
+        serialize(e.pose(), w);
+        w.endGroup();
+    }
+
+    if (!e.data().empty())
+    {
+        tue::config::YAMLEmitter emitter;
+        std::stringstream out;
+        emitter.emit(e.data(), out);
+
+        std::string data_str = out.str();
+
+        std::replace(data_str.begin(), data_str.end(), '"', '|');
+        std::replace(data_str.begin(), data_str.end(), '\n', '^');
+
+        w.writeValue("data", data_str);
+    }
+
+    w.writeArray("properties");
+
+    const std::map<Idx, Property>& properties = e.properties();
+    for(std::map<Idx, Property>::const_iterator it = properties.begin(); it != properties.end(); ++it)
+    {
+        const Property& prop = it->second;
+        if (prop.entry->info->serializable())
+        {
+            w.addArrayItem();
+            w.writeValue("name", prop.entry->name);
+            prop.entry->info->serialize(prop.value, w);
+            w.endArrayItem();
+        }
+    }
+
+    w.endArray();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+void Hub::encode(const WorldModel& world, const UUID& id, EntityRecord& rec, bool with_shape)
+{
+    rec.id = id.str();
+
+    Idx idx;
+    if (!world.findEntityIdx(id, idx) || !world.entities()[idx])
+    {
+        rec.removed = true;
+        return;
+    }
+
+    const Entity& e = *world.entities()[idx];
+
+    {
+        std::stringstream out;
+        io::JSONWriter w(out);
+        writeBody(e, w);
+        w.finish();
+        rec.body = boost::make_shared<std::string>(out.str());
+    }
+
+    // Only encode the mesh if it changed in this revision
+    if (!e.shape() || (!with_shape && world.entity_shape_revisions()[idx] != world.revision()))
+        return;
+
+    HashedShape& hashed = shape_hashes_[e.shape().get()];
+    if (hashed.shape.lock() != e.shape())
+    {
+        hashed.shape = e.shape();
+        hashed.hash = shapeHash(*e.shape());
+    }
+
+    rec.shape_hash = hashed.hash;
+
+    boost::weak_ptr<const std::string>& encoded_mesh = encoded_meshes_[rec.shape_hash];
+    rec.shape = encoded_mesh.lock();
+
+    if (!rec.shape)
+    {
+        std::stringstream out;
+        io::JSONWriter w(out);
+        w.writeGroup("mesh");
+        serialize(*e.shape(), w);
+        w.writeValue("hash", rec.shape_hash);
+        w.endGroup();
+        w.finish();
+        rec.shape = boost::make_shared<std::string>(out.str());
+        encoded_mesh = rec.shape;
+    }
+
+    // Remember when the mesh was first published
+    mesh_revisions_.insert(std::make_pair(rec.shape_hash, world.revision()));
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+Hub::Hub(unsigned int max_deltas, unsigned int snapshot_interval) : revision_(0), snapshot_(new Segment)
+{
+    configure(max_deltas, snapshot_interval);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+Hub::~Hub()
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Hub::configure(unsigned int max_deltas, unsigned int snapshot_interval)
+{
+    max_deltas_ = std::max<unsigned int>(max_deltas, 1);
+
+    // All deltas after the snapshot must still be available, so compact at least every max_deltas revisions
+    snapshot_interval_ = std::max<unsigned int>(std::min(snapshot_interval, max_deltas_), 1);
+
+    // Make sure no delta after the snapshot is dropped
+    if (revision_ > snapshot_->revision)
+        compact();
+
+    while (deltas_.size() > max_deltas_)
+        deltas_.pop_front();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Hub::reset(const WorldModel& world)
+{
+    boost::shared_ptr<Segment> snapshot(new Segment);
+    snapshot->revision = world.revision();
+    snapshot->records.resize(world.numEntities());
+
+    std::vector<EntityRecord>::iterator it_rec = snapshot->records.begin();
+    for(WorldModel::const_iterator it = world.begin(); it != world.end(); ++it, ++it_rec)
+        encode(world, (*it)->id(), *it_rec, true);
+
+    revision_ = world.revision();
+    deltas_.clear();
+    snapshot_ = snapshot;
+
+    pruneShapes();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Hub::addRevision(const WorldModel& world, const UpdateRequest& req)
+{
+    // Empty requests do not result in a new revision
+    if (world.revision() == revision_)
+        return;
+
+    boost::shared_ptr<Segment> delta(new Segment);
+    delta->revision = world.revision();
+    delta->records.resize(req.updated_entities.size());
+
+    std::vector<EntityRecord>::iterator it_rec = delta->records.begin();
+    for(std::set<UUID>::const_iterator it = req.updated_entities.begin(); it != req.updated_entities.end(); ++it, ++it_rec)
+        encode(world, *it, *it_rec);
+
+    revision_ = world.revision();
+    deltas_.push_back(delta);
+
+    bool compacted = false;
+    if (revision_ - snapshot_->revision >= snapshot_interval_)
+    {
+        compact();
+        compacted = true;
+    }
+
+    while (deltas_.size() > max_deltas_)
+        deltas_.pop_front();
+
+    if (compacted)
+        pruneShapes();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Hub::compact()
+{
+    MergeMap merged;
+    for(std::deque<SegmentConstPtr>::const_reverse_iterator it = deltas_.rbegin(); it != deltas_.rend(); ++it)
+    {
+        if ((*it)->revision <= snapshot_->revision)
+            break;
+        merge(**it, merged);
+    }
+    merge(*snapshot_, merged);
+
+    // The encoded strings are shared, so compaction only copies pointers
+    boost::shared_ptr<Segment> snapshot(new Segment);
+    snapshot->revision = revision_;
+    snapshot->records.reserve(merged.size());
+
+    for(MergeMap::const_iterator it = merged.begin(); it != merged.end(); ++it)
+    {
+        const MergedEntity& m = it->second;
+        if (m.record->removed)
+            continue;
+
+        snapshot->records.push_back(*m.record);
+
+        EntityRecord& rec = snapshot->records.back();
+        rec.shape = m.shape_record ? m.shape_record->shape : EncodedPtr();
+        rec.shape_hash = m.shape_record ? m.shape_record->shape_hash : std::string();
+    }
+
+    snapshot_ = snapshot;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Hub::pruneShapes()
+{
+    for(std::map<const geo::Shape*, HashedShape>::iterator it = shape_hashes_.begin(); it != shape_hashes_.end();)
+    {
+        if (it->second.shape.expired())
+            shape_hashes_.erase(it++);
+        else
+            ++it;
+    }
+
+    for(std::map<std::string, boost::weak_ptr<const std::string> >::iterator it = encoded_meshes_.begin(); it != encoded_meshes_.end();)
+    {
+        if (it->second.expired())
+            encoded_meshes_.erase(it++);
+        else
+            ++it;
+    }
+
+    // Meshes that are no longer retained are published again if they show up later
+    for(std::map<std::string, unsigned long>::iterator it = mesh_revisions_.begin(); it != mesh_revisions_.end();)
+    {
+        if (encoded_meshes_.find(it->first) == encoded_meshes_.end())
+            mesh_revisions_.erase(it++);
+        else
+            ++it;
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Hub::query(unsigned long since_revision, std::string& response, unsigned long& new_revision) const
+{
+    new_revision = revision_;
+
+    MergeMap merged;
+
+    if (since_revision >= revision_)
+    {
+        writeResponse(merged, false, since_revision, mesh_revisions_, response);
+        return;
+    }
+
+    if (!deltas_.empty() && since_revision + 1 >= deltas_.front()->revision)
+    {
+        // The client is recent enough: only send what changed since its revision
+        for(std::deque<SegmentConstPtr>::const_reverse_iterator it = deltas_.rbegin(); it != deltas_.rend(); ++it)
+        {
+            if ((*it)->revision <= since_revision)
+                break;
+            merge(**it, merged);
+        }
+
+        writeResponse(merged, false, since_revision, mesh_revisions_, response);
+    }
+    else
+    {
+        // The client is too far behind: send the snapshot plus everything after it
+        for(std::deque<SegmentConstPtr>::const_reverse_iterator it = deltas_.rbegin(); it != deltas_.rend(); ++it)
+        {
+            if ((*it)->revision <= snapshot_->revision)
+                break;
+            merge(**it, merged);
+        }
+        merge(*snapshot_, merged);
+
+        // The client may have missed any mesh, so send all of them
+        writeResponse(merged, true, 0, mesh_revisions_, response);
+    }
+}
+
+} // end namespace replication
+
+} // end namespace ed
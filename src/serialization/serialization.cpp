@@ -1,10 +1,12 @@
 #include "ed/serialization/serialization.h"
+#include "ed/serialization/shape_store.h"
 #include "ed/mask.h"
 
 #include "ed/world_model.h"
 #include "ed/update_request.h"
 #include "ed/entity.h"
 #include "ed/convex_hull_calc.h"
+#include "ed/instanced_shape.h"
 
 #include <tue/config/reader.h>
 #include <tue/config/writer.h>
@@ -35,6 +37,16 @@ namespace ed
 // ----------------------------------------------------------------------------------------------------
 
 bool deserialize(io::Reader &r, UpdateRequest& req)
+{
+    // Meshes can still be shared and referenced within this one message
+    ShapeStore shape_store;
+    std::vector<UUID> unresolved_shapes;
+    return deserialize(r, req, shape_store, unresolved_shapes);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool deserialize(io::Reader &r, UpdateRequest& req, ShapeStore& shape_store, std::vector<UUID>& unresolved_shapes)
 {
     if (r.readArray("entities"))
     {
@@ -47,6 +59,13 @@ bool deserialize(io::Reader &r, UpdateRequest& req)
                 return false;
             }
 
+            int removed = 0;
+            if (r.readValue("removed", removed) && removed)
+            {
+                req.removeEntity(id);
+                continue;
+            }
+
             std::string type;
             if (r.readValue("type", type))
             {
@@ -89,9 +108,27 @@ bool deserialize(io::Reader &r, UpdateRequest& req)
             {
                 geo::ShapePtr shape(new geo::Shape);
                 ed::deserialize(r, *shape);
-                req.setShape(id, shape);
+
+                // Use the hash of the sender, since the vertices may have lost precision on the way
+                std::string hash;
+                if (!r.readValue("hash", hash))
+                    hash = shapeHash(*shape);
+
+                req.setShape(id, shape_store.add(hash, shape));
                 r.endGroup();
             }
+            else
+            {
+                std::string hash;
+                if (r.readValue("mesh_ref", hash))
+                {
+                    geo::ShapeConstPtr shape = shape_store.get(hash);
+                    if (shape)
+                        req.setShape(id, shape);
+                    else
+                        unresolved_shapes.push_back(id);
+                }
+            }
 
             std::string data_str;
             if (r.readValue("data", data_str))
@@ -304,18 +341,24 @@ bool deserialize(ed::io::Reader& r, ConvexHull& ch)
 
 void serialize(const geo::Shape& s, ed::io::Writer& w)
 {
+    // Instanced shapes are written with their transform applied, without creating their transformed mesh
+    geo::Pose3D transform;
+    const geo::Mesh& mesh = sharedMesh(s, transform);
+    bool transformed = !isIdentity(transform);
+
     w.writeArray("vertices");
-    const std::vector<geo::Vector3>& vertices = s.getMesh().getPoints();
+    const std::vector<geo::Vector3>& vertices = mesh.getPoints();
     for(std::vector<geo::Vector3>::const_iterator it = vertices.begin(); it != vertices.end(); ++it)
     {
+        geo::Vector3 p = transformed ? transform * *it : *it;
         w.addArrayItem();
-        w.writeValue("x", it->x); w.writeValue("y", it->y); w.writeValue("z", it->z);
+        w.writeValue("x", p.x); w.writeValue("y", p.y); w.writeValue("z", p.z);
         w.endArrayItem();
     }
     w.endArray();
 
     w.writeArray("triangles");
-    const std::vector<geo::TriangleI>& triangles = s.getMesh().getTriangleIs();
+    const std::vector<geo::TriangleI>& triangles = mesh.getTriangleIs();
     for(unsigned int i = 0; i < triangles.size(); ++i)
     {
         w.addArrayItem();
@@ -442,24 +485,22 @@ bool deserializeTimestamp(ed::io::Reader& r, double& time)
 
 void serialize(const ImageMask& mask, tue::serialization::OutputArchive& m)
 {
-    const static int MASK_SERIALIZATION_VERSION = 0;
+    // Version 0 stored every pixel index; version 1 stores the runs
+    const static int MASK_SERIALIZATION_VERSION = 1;
 
     m << MASK_SERIALIZATION_VERSION;
 
     m << mask.width();
     m << mask.height();
 
-    // Determine size
-    int size = 0;
-    for(ImageMask::const_iterator it = mask.begin(); it != mask.end(); ++it)
-        ++size;
-
-    m << size;
+    const std::vector<ImageMask::Run>& runs = mask.runs();
+    m << (int)runs.size();
 
-    for(ImageMask::const_iterator it = mask.begin(); it != mask.end(); ++it)
+    for(std::vector<ImageMask::Run>::const_iterator it = runs.begin(); it != runs.end(); ++it)
     {
-        cv::Point2i pt = it();
-        m << pt.y * mask.width() + pt.x;
+        m << it->y;
+        m << it->x_min;
+        m << it->length();
     }
 }
 
@@ -478,12 +519,27 @@ bool deserialize(tue::serialization::InputArchive& m, ImageMask& mask)
     int size;
     m >> size;
 
-    for(int i = 0; i < size; ++i)
+    if (version == 0)
     {
-        int idx;
-        m >> idx;
+        for(int i = 0; i < size; ++i)
+        {
+            int idx;
+            m >> idx;
 
-        mask.addPoint(idx % width, idx / width);
+            mask.addPoint(idx % width, idx / width);
+        }
+    }
+    else
+    {
+        for(int i = 0; i < size; ++i)
+        {
+            int y, x_min, length;
+            m >> y;
+            m >> x_min;
+            m >> length;
+
+            mask.addRun(y, x_min, x_min + length - 1);
+        }
     }
 
     return true;
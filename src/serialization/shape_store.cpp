@@ -0,0 +1,101 @@
+#include "ed/serialization/shape_store.h"
+#include "ed/instanced_shape.h"
+
+#include <geolib/Shape.h>
+
+#include <cstdio>
+
+namespace ed
+{
+
+namespace
+{
+
+// FNV-1a
+const unsigned long long HASH_OFFSET = 14695981039346656037ULL;
+const unsigned long long HASH_PRIME = 1099511628211ULL;
+
+inline void hashBytes(const void* data, std::size_t size, unsigned long long& h)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for(std::size_t i = 0; i < size; ++i)
+    {
+        h ^= bytes[i];
+        h *= HASH_PRIME;
+    }
+}
+
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+std::string shapeHash(const geo::Shape& s)
+{
+    unsigned long long h = HASH_OFFSET;
+
+    // Hash instanced shapes as their transformed mesh (as they are serialized), without creating it
+    geo::Pose3D transform;
+    const geo::Mesh& mesh = sharedMesh(s, transform);
+    bool transformed = !isIdentity(transform);
+
+    const std::vector<geo::Vector3>& vertices = mesh.getPoints();
+    for(std::vector<geo::Vector3>::const_iterator it = vertices.begin(); it != vertices.end(); ++it)
+    {
+        geo::Vector3 p = transformed ? transform * *it : *it;
+        hashBytes(&p.x, sizeof(p.x), h);
+        hashBytes(&p.y, sizeof(p.y), h);
+        hashBytes(&p.z, sizeof(p.z), h);
+    }
+
+    // Separate the vertices from the triangles, such that differently sized meshes do not collide
+    unsigned long long num_vertices = vertices.size();
+    hashBytes(&num_vertices, sizeof(num_vertices), h);
+
+    const std::vector<geo::TriangleI>& triangles = mesh.getTriangleIs();
+    for(std::vector<geo::TriangleI>::const_iterator it = triangles.begin(); it != triangles.end(); ++it)
+    {
+        hashBytes(&it->i1_, sizeof(it->i1_), h);
+        hashBytes(&it->i2_, sizeof(it->i2_), h);
+        hashBytes(&it->i3_, sizeof(it->i3_), h);
+    }
+
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", h);
+    return std::string(buf);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::ShapeConstPtr ShapeStore::add(const std::string& hash, const geo::ShapeConstPtr& shape)
+{
+    geo::ShapeConstPtr& stored = shapes_[hash];
+    if (!stored)
+        stored = shape;
+    return stored;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+geo::ShapeConstPtr ShapeStore::get(const std::string& hash) const
+{
+    std::map<std::string, geo::ShapeConstPtr>::const_iterator it = shapes_.find(hash);
+    if (it == shapes_.end())
+        return geo::ShapeConstPtr();
+    return it->second;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void ShapeStore::prune()
+{
+    std::map<std::string, geo::ShapeConstPtr>::iterator it = shapes_.begin();
+    while(it != shapes_.end())
+    {
+        if (it->second.unique())
+            shapes_.erase(it++);
+        else
+            ++it;
+    }
+}
+
+} // end namespace ed
@@ -6,8 +6,7 @@
 
 #include <geolib/Box.h>
 
-// Storing measurements to disk
-#include "ed/io/filesystem/write.h"
+#include <tue/profiling/timer.h>
 
 #include <tue/profiling/scoped_timer.h>
 
@@ -21,6 +20,8 @@
 
 #include <boost/make_shared.hpp>
 
+#include <algorithm>
+
 #include <std_msgs/String.h>
 
 #include "ed/serialization/serialization.h"
@@ -33,7 +34,9 @@ namespace ed
 
 // ----------------------------------------------------------------------------------------------------
 
-Server::Server() : world_model_(new WorldModel(&property_key_db_))
+Server::Server() : world_model_(new WorldModel(&property_key_db_)), replication_enabled_(false),
+    save_snapshot_on_shutdown_(false),
+    journal_checkpoint_interval_(1000), compaction_min_free_slots_(1000)
 {
 }
 
@@ -121,25 +124,172 @@ void Server::configure(tue::Configuration& config, bool reconfigure)
         config.endArray();
     }
 
-    if (config.value("world_name", world_name_, tue::OPTIONAL))
-        initializeWorld();
+    if (config.readGroup("replication"))
+    {
+        int max_deltas = 100;
+        int snapshot_interval = 50;
+        config.value("max_deltas", max_deltas, tue::OPTIONAL);
+        config.value("snapshot_interval", snapshot_interval, tue::OPTIONAL);
+        replication_hub_.configure(max_deltas, snapshot_interval);
+        enableReplication();
+        config.endGroup();
+    }
 
-    if (config.readArray("world"))
+    if (config.readGroup("shape_cache"))
     {
-        while (config.nextArrayItem())
+        // Imported meshes and triangulated heightmaps are stored here, such that the next start is faster
+        std::string directory;
+        config.value("directory", directory);
+        config.endGroup();
+
+        if (!directory.empty() && directory != model_loader_.shapeCache().directory()
+                && !model_loader_.setShapeCacheDirectory(directory))
+            config.addError("Could not open shape cache directory '" + directory + "'");
+    }
+
+    int save_snapshot = 0;
+    bool load_snapshot = false;
+    if (config.readGroup("snapshot"))
+    {
+        int load = 1;
+        int save_on_shutdown = 0;
+        config.value("file", snapshot_file_);
+        config.value("load", load, tue::OPTIONAL);
+        config.value("save", save_snapshot, tue::OPTIONAL);
+        config.value("save_on_shutdown", save_on_shutdown, tue::OPTIONAL);
+        config.endGroup();
+
+        // Only at startup: reconfiguring should not throw away what was learned at runtime
+        load_snapshot = load && !reconfigure;
+        save_snapshot_on_shutdown_ = save_on_shutdown;
+    }
+
+    std::string record_directory;
+    if (config.readGroup("recorder"))
+    {
+        config.value("directory", record_directory);
+        config.endGroup();
+    }
+
+    if (config.readGroup("measurement_store"))
+    {
+        // Memory budget for the images of all entity measurements. Beyond it, old images are compressed and
+        // spilled to disk.
+        int max_memory_mb = 0;
+        std::string spill_directory;
+        config.value("max_memory_mb", max_memory_mb);
+        config.value("spill_directory", spill_directory, tue::OPTIONAL);
+        config.endGroup();
+
+        if (max_memory_mb < 0)
+            config.addError("measurement_store: max_memory_mb must be non-negative");
+        else if (!MeasurementStore::instance().configure(static_cast<std::size_t>(max_memory_mb) * 1024 * 1024, spill_directory))
+            config.addError("measurement_store: could not create spill file in '" + spill_directory + "'");
+    }
+
+    std::string journal_directory;
+    if (config.readGroup("journal"))
+    {
+        int checkpoint_interval = journal_checkpoint_interval_;
+        config.value("directory", journal_directory);
+        config.value("checkpoint_interval", checkpoint_interval, tue::OPTIONAL);
+        config.endGroup();
+
+        journal_checkpoint_interval_ = checkpoint_interval;
+    }
+
+    int compaction_min_free_slots = compaction_min_free_slots_;
+    if (config.value("compaction_min_free_slots", compaction_min_free_slots, tue::OPTIONAL))
+    {
+        if (compaction_min_free_slots < 0)
+            config.addError("compaction_min_free_slots must be non-negative");
+        else
+            compaction_min_free_slots_ = compaction_min_free_slots;
+    }
+
+    bool eviction_configured = false;
+    if (config.readArray("eviction"))
+    {
+        evictor_.clear();
+        while(config.nextArrayItem())
         {
-            ed::UpdateRequestPtr req(new UpdateRequest);
-            std::stringstream error;
-            if (!model_loader_.create(config.data(), "", "", *req, error))
-            {
-                config.addError("Could not instantiate world object: " + error.str());
+            double ttl;
+            std::string type, flag;
+            if (!config.value("ttl", ttl))
                 continue;
+
+            if (ttl <= 0)
+                config.addError("eviction: ttl must be positive");
+            else if (config.value("type", type, tue::OPTIONAL))
+                evictor_.addTypePolicy(type, ttl);
+            else if (config.value("flag", flag, tue::OPTIONAL))
+                evictor_.addFlagPolicy(flag, ttl);
+            else
+                config.addError("eviction: specify a 'type' or 'flag'");
+        }
+        config.endArray();
+
+        eviction_configured = true;
+    }
+
+    if (config.readGroup("history"))
+    {
+        // Window (in seconds) of past world states that are kept, and a memory budget for them
+        double window = 0;
+        int max_memory_mb = 0;
+        config.value("window", window);
+        config.value("max_memory_mb", max_memory_mb, tue::OPTIONAL);
+        config.endGroup();
+
+        if (window < 0 || max_memory_mb < 0)
+            config.addError("history: window and max_memory_mb must be non-negative");
+        else
+            history_.configure(window, static_cast<std::size_t>(max_memory_mb) * 1024 * 1024);
+    }
+
+    if (config.value("world_name", world_name_, tue::OPTIONAL))
+    {
+        // Loading a snapshot of the same world is much faster than loading all models, but can only be
+        // done if none of the files the world was created from changed
+        bool loaded = false;
+        SnapshotHeader header;
+        if (load_snapshot && readSnapshotHeader(snapshot_file_, header)
+                && header.source == world_name_ && header.upToDate())
+            loaded = loadSnapshot(snapshot_file_);
+
+        if (!loaded)
+        {
+            snapshot_header_ = SnapshotHeader();
+            initializeWorld();
+
+            if (model_loader_.shapeCache().isOpen())
+            {
+                models::ShapeCache::Statistics stats = model_loader_.shapeCache().statistics();
+                ROS_INFO_STREAM("[ED] Shape cache: " << stats.hits << " hits, " << stats.misses << " misses");
             }
+        }
+    }
 
+    if (config.readArray("world"))
+    {
+        // All items are added with one update, such that the world model is copied once and plugins get one delta
+        std::vector<tue::config::DataConstPointer> items;
+        while (config.nextArrayItem())
+            items.push_back(config.data());
+        config.endArray();
+
+        ed::UpdateRequestPtr req(new UpdateRequest);
+        std::stringstream error;
+        if (!model_loader_.create(items, *req, error))
+            config.addError("Could not instantiate world object: " + error.str());
+
+        if (!req->empty())
+        {
             // Create world model copy (shallow)
             WorldModelPtr new_world_model = boost::make_shared<WorldModel>(*world_model_);
 
             new_world_model->update(*req);
+            recordRevision(*new_world_model, *req);
 
             // Temporarily for Javier
             for(std::map<std::string, PluginContainerPtr>::iterator it = plugin_containers_.begin(); it != plugin_containers_.end(); ++it)
@@ -152,6 +302,24 @@ void Server::configure(tue::Configuration& config, bool reconfigure)
             world_model_ = new_world_model;
         }
     }
+
+    // Only at startup: restore what was learned at runtime before the last crash or shutdown
+    if (!journal_directory.empty() && !reconfigure)
+        recoverJournal(journal_directory);
+
+    // Entities that were loaded from a snapshot or journal were not seen by the evictor
+    if (eviction_configured)
+        evictor_.schedule(*world_model_);
+
+    if (save_snapshot && !snapshot_file_.empty())
+        saveSnapshot(snapshot_file_);
+
+    // Record all requests applied from now on (for offline replay with ed_replay)
+    if (!record_directory.empty() && !reconfigure)
+    {
+        if (recorder_.open(record_directory, *world_model_))
+            ROS_INFO_STREAM("[ED] Recording update requests to '" << record_directory << "'");
+    }
 }
 
 // ----------------------------------------------------------------------------------------------------
@@ -183,21 +351,31 @@ void Server::reset(bool keep_all_shapes)
         ROS_ERROR_STREAM("[ED] Could not initialize world: " << error.str());
     }
 
+    // Robot entities are kept (TODO: robocup hack)
+    std::vector<Idx> robot_idxs, amigo_idxs;
+    world_model_->entitiesWithPrefix("sergio", robot_idxs);
+    world_model_->entitiesWithPrefix("amigo", amigo_idxs);
+    robot_idxs.insert(robot_idxs.end(), amigo_idxs.begin(), amigo_idxs.end());
+    std::sort(robot_idxs.begin(), robot_idxs.end());
+
     // Prepare deletion request
     UpdateRequestPtr req_delete(new UpdateRequest);
-    for(WorldModel::const_iterator it = world_model_->begin(); it != world_model_->end(); ++it)
+    const std::vector<EntityConstPtr>& entities = world_model_->entities();
+    for(Idx i = 0; i < entities.size(); ++i)
     {
         // Only remove entities that are NOT in the initial world model
-        const ed::EntityConstPtr& e = *it;
+        const ed::EntityConstPtr& e = entities[i];
+        if (!e)
+            continue;
 
-        if (e->id().str().substr(0, 6) == "sergio" || e->id().str().substr(0, 5) == "amigo") // TODO: robocup hack
+        if (std::binary_search(robot_idxs.begin(), robot_idxs.end(), i))
             continue;
 
         if (keep_all_shapes && e->shape())
             continue;
 
         if (req_init_world->updated_entities.find(e->id()) == req_init_world->updated_entities.end())
-            req_delete->removeEntity((*it)->id());
+            req_delete->removeEntity(e->id());
     }
 
     // Create world model copy
@@ -205,7 +383,10 @@ void Server::reset(bool keep_all_shapes)
 
     // Apply the deletion request
     new_world_model->update(*req_init_world);
+    recordRevision(*new_world_model, *req_init_world);
+
     new_world_model->update(*req_delete);
+    recordRevision(*new_world_model, *req_delete);
 
     // Swap to new world model
     world_model_ = new_world_model;
@@ -273,6 +454,13 @@ PluginContainerPtr Server::loadPlugin(const std::string& plugin_name, tue::Confi
 
 // ----------------------------------------------------------------------------------------------------
 
+void Server::addPluginContainer(const PluginContainerPtr& container)
+{
+    plugin_containers_[container->name()] = container;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
 void Server::stepPlugins()
 {
     ErrorContext errc("Server", "stepPlugins");
@@ -294,6 +482,7 @@ void Server::stepPlugins()
             }
 
             new_world_model->update(*c->updateRequest());
+            recordRevision(*new_world_model, *c->updateRequest());
             plugins_with_requests.push_back(c);
 
             // Temporarily for Javier
@@ -345,6 +534,34 @@ void Server::update()
 //        mergeEntities(new_world_model, 5.0, 0.5);
 //    }
 
+    // Remove the entities whose time-to-live expired, as an ordinary update
+    if (!evictor_.empty())
+    {
+        UpdateRequestPtr req(new UpdateRequest);
+        evictor_.evict(*new_world_model, ros::Time::now().toSec(), *req);
+
+        if (!req->empty())
+        {
+            new_world_model->update(*req);
+            recordRevision(*new_world_model, *req);
+
+            for(std::map<std::string, PluginContainerPtr>::iterator it = plugin_containers_.begin(); it != plugin_containers_.end(); ++it)
+                it->second->addDelta(req);
+        }
+    }
+
+    // Compact the world after heavy churn, such that its arrays stay dense. Plugins get the compaction
+    // together with the world.
+    std::size_t num_free = new_world_model->numFreeEntitySlots();
+    if (compaction_min_free_slots_ > 0 && num_free >= compaction_min_free_slots_ && num_free > new_world_model->numEntities())
+    {
+        boost::shared_ptr<CompactionMap> map(new CompactionMap);
+        new_world_model->compact(*map);
+
+        for(std::map<std::string, PluginContainerPtr>::iterator it = plugin_containers_.begin(); it != plugin_containers_.end(); ++it)
+            it->second->addCompaction(map);
+    }
+
     // Notify all plugins of the updated world model
     for(std::map<std::string, PluginContainerPtr>::iterator it = plugin_containers_.begin(); it != plugin_containers_.end(); ++it)
     {
@@ -355,6 +572,14 @@ void Server::update()
     // Set the new (updated) world
     world_model_ = new_world_model;
 
+    // The history keeps the state of each cycle (the revisions within a cycle are not kept)
+    if (history_.enabled())
+        history_.add(world_model_, ros::Time::now().toSec());
+
+    // Bound the part of the journal that has to be replayed after a crash
+    if (journal_.isOpen() && journal_.numRecordsSinceCheckpoint() >= journal_checkpoint_interval_)
+        journal_.checkpoint(world_model_);
+
     pub_profile_.publish();
 }
 
@@ -362,16 +587,21 @@ void Server::update()
 
 void Server::update(const ed::UpdateRequest& req)
 {
+    // Plugins keep the request until their next cycle
+    UpdateRequestPtr delta(new UpdateRequest(req));
+
     // Create world model copy (shallow)
     WorldModelPtr new_world_model = boost::make_shared<WorldModel>(*world_model_);
 
     // Update the world model
-    new_world_model->update(req);
+    new_world_model->update(*delta);
+    recordRevision(*new_world_model, *delta);
 
-    // Notify all plugins of the updated world model
+    // Notify all plugins of the changes and the updated world model
     for(std::map<std::string, PluginContainerPtr>::iterator it = plugin_containers_.begin(); it != plugin_containers_.end(); ++it)
     {
         PluginContainerPtr c = it->second;
+        c->addDelta(delta);
         c->setWorld(new_world_model);
     }
 
@@ -399,7 +629,7 @@ void Server::update(const std::string& update_str, std::string& error)
 
     // - - - - - - - - - Create update request from cfg - - - - - - - - -
 
-    UpdateRequest req;
+    UpdateRequestPtr req(new UpdateRequest);
 
     if (cfg.readArray("entities"))
     {
@@ -423,7 +653,7 @@ void Server::update(const std::string& update_str, std::string& error)
 
                 pose.R.setRPY(rx, ry, rz);
 
-                req.setPose(id, pose);
+                req->setPose(id, pose);
 
                 cfg.endGroup();
             }
@@ -445,12 +675,14 @@ void Server::update(const std::string& update_str, std::string& error)
     WorldModelPtr new_world_model = boost::make_shared<WorldModel>(*world_model_);
 
     // Update the world model
-    new_world_model->update(req);
+    new_world_model->update(*req);
+    recordRevision(*new_world_model, *req);
 
-    // Notify all plugins of the updated world model
+    // Notify all plugins of the changes and the updated world model
     for(std::map<std::string, PluginContainerPtr>::iterator it = plugin_containers_.begin(); it != plugin_containers_.end(); ++it)
     {
         PluginContainerPtr c = it->second;
+        c->addDelta(req);
         c->setWorld(new_world_model);
     }
 
@@ -475,6 +707,7 @@ void Server::initializeWorld()
     WorldModelPtr new_world_model = boost::make_shared<WorldModel>(*world_model_);
 
     new_world_model->update(*req);
+    recordRevision(*new_world_model, *req);
 
     // Temporarily for Javier
     for(std::map<std::string, PluginContainerPtr>::iterator it = plugin_containers_.begin(); it != plugin_containers_.end(); ++it)
@@ -489,20 +722,195 @@ void Server::initializeWorld()
 
 // ----------------------------------------------------------------------------------------------------
 
-void Server::storeEntityMeasurements(const std::string& path) const
+bool Server::saveSnapshot(const std::string& filename) const
+{
+    ErrorContext errc("Server", "saveSnapshot");
+
+    tue::Timer timer;
+    timer.start();
+
+    SnapshotHeader header;
+    header.source = world_name_;
+
+    // If the world was loaded from a snapshot, the files it was created from are still dependencies
+    header.dependencies = snapshot_header_.dependencies;
+
+    std::vector<std::string> files;
+    model_loader_.getLoadedFiles(files);
+    for(std::vector<std::string>::const_iterator it = files.begin(); it != files.end(); ++it)
+        header.addDependency(*it);
+
+    if (!writeSnapshot(filename, *world_model_, header))
+        return false;
+
+    ROS_INFO_STREAM("[ED] Saved snapshot of " << world_model_->numEntities() << " entities to '" << filename
+                    << "' (" << timer.getElapsedTimeInMilliSec() << " ms)");
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool Server::loadSnapshot(const std::string& filename)
 {
+    ErrorContext errc("Server", "loadSnapshot");
+
+    tue::Timer timer;
+    timer.start();
+
+    UpdateRequestPtr req(new UpdateRequest);
+    SnapshotHeader header;
+    if (!readSnapshot(filename, property_key_db_, header, *req))
+        return false;
+
+    // Remove all entities that are not in the snapshot
     for(WorldModel::const_iterator it = world_model_->begin(); it != world_model_->end(); ++it)
     {
         const EntityConstPtr& e = *it;
-        MeasurementConstPtr msr = e->lastMeasurement();
-        if (!msr)
-            continue;
+        if (req->updated_entities.find(e->id()) == req->updated_entities.end())
+            req->removeEntity(e->id());
+    }
+
+    // Create world model copy (shallow)
+    WorldModelPtr new_world_model = boost::make_shared<WorldModel>(*world_model_);
+
+    new_world_model->update(*req);
+    recordRevision(*new_world_model, *req);
+
+    for(std::map<std::string, PluginContainerPtr>::iterator it = plugin_containers_.begin(); it != plugin_containers_.end(); ++it)
+    {
+        PluginContainerPtr c = it->second;
+        c->addDelta(req);
+        c->setWorld(new_world_model);
+    }
+
+    world_model_ = new_world_model;
+    snapshot_header_ = header;
+
+    ROS_INFO_STREAM("[ED] Loaded snapshot of " << world_model_->numEntities() << " entities from '" << filename
+                    << "' (" << timer.getElapsedTimeInMilliSec() << " ms)");
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Server::shutdown()
+{
+    if (save_snapshot_on_shutdown_ && !snapshot_file_.empty())
+        saveSnapshot(snapshot_file_);
+
+    if (journal_.isOpen())
+    {
+        journal_.checkpoint(world_model_);
+        journal_.close();
+    }
+
+    recorder_.close();
+    measurement_archive_.close();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Server::recordRevision(const WorldModel& world, const UpdateRequest& req)
+{
+    if (replication_enabled_)
+        replication_hub_.addRevision(world, req);
+    journal_.append(req);
+    recorder_.record(req);
+    evictor_.update(world, req);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Server::enableReplication()
+{
+    if (replication_enabled_)
+        return;
+
+    // Encoding every revision costs time on each update, so it starts from the current world once it is needed
+    replication_hub_.reset(*world_model_);
+    replication_enabled_ = true;
+}
 
-        std::string filename = path + "/" + e->id().str();
-        if (!write(filename, *msr))
+// ----------------------------------------------------------------------------------------------------
+
+void Server::recoverJournal(const std::string& directory)
+{
+    ErrorContext errc("Server", "recoverJournal");
+
+    tue::Timer timer;
+    timer.start();
+
+    UpdateRequestPtr checkpoint;
+    std::vector<UpdateRequestPtr> records;
+    if (!journal_.open(directory, property_key_db_, checkpoint, records))
+    {
+        ROS_ERROR_STREAM("[ED] Could not open journal in '" << directory << "'");
+        return;
+    }
+
+    if (checkpoint)
+    {
+        // The checkpoint replaces the world: remove all entities that are not in it
+        for(WorldModel::const_iterator it = world_model_->begin(); it != world_model_->end(); ++it)
+        {
+            const EntityConstPtr& e = *it;
+            if (checkpoint->updated_entities.find(e->id()) == checkpoint->updated_entities.end())
+                checkpoint->removeEntity(e->id());
+        }
+
+        records.insert(records.begin(), checkpoint);
+    }
+
+    if (!records.empty())
+    {
+        // Create world model copy (shallow)
+        WorldModelPtr new_world_model = boost::make_shared<WorldModel>(*world_model_);
+
+        // The recovered requests are already in the journal, so they are only passed to the replication hub
+        for(std::vector<UpdateRequestPtr>::const_iterator it = records.begin(); it != records.end(); ++it)
         {
-            std::cout << "Saving measurement failed." << std::endl;
+            new_world_model->update(**it);
+            if (replication_enabled_)
+                replication_hub_.addRevision(*new_world_model, **it);
+
+            for(std::map<std::string, PluginContainerPtr>::iterator it2 = plugin_containers_.begin(); it2 != plugin_containers_.end(); ++it2)
+                it2->second->addDelta(*it);
         }
+
+        for(std::map<std::string, PluginContainerPtr>::iterator it = plugin_containers_.begin(); it != plugin_containers_.end(); ++it)
+            it->second->setWorld(new_world_model);
+
+        world_model_ = new_world_model;
+
+        ROS_INFO_STREAM("[ED] Recovered " << world_model_->numEntities() << " entities from journal '" << directory
+                        << "' (" << timer.getElapsedTimeInMilliSec() << " ms)");
+    }
+
+    // Start from a checkpoint of the current world, such that the recovered records are not replayed again
+    journal_.checkpoint(world_model_);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void Server::storeEntityMeasurements(const std::string& path)
+{
+    // The measurements are written to a single archive in the background, such that storing them does not
+    // stall the server
+    std::string filename = path + "/measurements.archive";
+    if (!measurement_archive_.isOpen() || measurement_archive_.filename() != filename)
+    {
+        if (!measurement_archive_.open(filename))
+            return;
+    }
+
+    for(WorldModel::const_iterator it = world_model_->begin(); it != world_model_->end(); ++it)
+    {
+        const EntityConstPtr& e = *it;
+        MeasurementConstPtr msr = e->lastMeasurement();
+        if (msr)
+            measurement_archive_.add(e->id(), msr);
     }
 }
 
@@ -602,6 +1010,32 @@ void Server::publishStatistics() const
         s << "    " << p->name() << ": " << cpu_perc << " % (" << p->loopFrequency() << " hz)" << std::endl;
     }
 
+    MeasurementStore::Statistics msr_stats = MeasurementStore::instance().statistics();
+    s << "[measurement images]" << std::endl;
+    s << "    in memory: " << msr_stats.num_in_memory << ", compressed: " << msr_stats.num_compressed
+      << ", spilled: " << msr_stats.num_spilled << std::endl;
+    s << "    memory: " << (msr_stats.memory_bytes / (1024.0 * 1024)) << " MB, spilled: "
+      << (msr_stats.spilled_bytes / (1024.0 * 1024)) << " MB, loads: " << msr_stats.num_loads << std::endl;
+
+    if (!evictor_.empty())
+    {
+        s << "[eviction]" << std::endl;
+        const std::vector<Evictor::Policy>& policies = evictor_.policies();
+        for(std::vector<Evictor::Policy>::const_iterator it = policies.begin(); it != policies.end(); ++it)
+        {
+            s << "    " << (it->is_flag ? "flag " : "type ") << it->name << " (" << it->ttl << " s): "
+              << it->num_evicted << " evicted" << std::endl;
+        }
+        s << "    scheduled: " << evictor_.numScheduled() << std::endl;
+    }
+
+    if (history_.enabled())
+    {
+        s << "[history]" << std::endl;
+        s << "    revisions: " << history_.numRevisions() << " (since " << (ros::Time::now().toSec() - history_.oldestTime())
+          << " s), memory: " << (history_.memoryUsage() / (1024.0 * 1024)) << " MB" << std::endl;
+    }
+
 
     std_msgs::String msg;
     msg.data = s.str();
@@ -0,0 +1,184 @@
+#include "ed/symbol.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/atomic.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace ed
+{
+
+namespace
+{
+
+struct Symbol
+{
+    Symbol(const std::string& name_, SymbolId id_, const Symbol* next_) : name(name_), id(id_), next(next_) {}
+
+    const std::string name;
+    const SymbolId id;
+
+    // Next symbol in the same bucket
+    const Symbol* const next;
+};
+
+// Symbols are only added and never change, so they can be read without the mutex. A new symbol is prepended to
+// its bucket with a release store, after which readers that find it see it completely. Symbols are not freed.
+// Names are found by id through chunks that are allocated once, such that the table never moves.
+struct SymbolTable
+{
+    static const unsigned int NUM_BUCKETS = 4096;
+    static const unsigned int CHUNK_SIZE = 1024;
+    static const unsigned int MAX_CHUNKS = 4096;
+
+    SymbolTable() : size(0)
+    {
+        for(unsigned int i = 0; i < NUM_BUCKETS; ++i)
+            buckets[i].store(0, boost::memory_order_relaxed);
+        std::fill(chunks, chunks + MAX_CHUNKS, static_cast<const Symbol**>(0));
+    }
+
+    boost::mutex mutex;
+
+    boost::atomic<const Symbol*> buckets[NUM_BUCKETS];
+
+    // Symbols by id. An id is only known after its symbol was published, so its chunk is filled in.
+    const Symbol** chunks[MAX_CHUNKS];
+
+    // Only changed with the mutex
+    SymbolId size;
+
+    const Symbol* find(const std::string& name, std::size_t hash) const
+    {
+        for(const Symbol* s = buckets[hash % NUM_BUCKETS].load(boost::memory_order_acquire); s; s = s->next)
+        {
+            if (s->name == name)
+                return s;
+        }
+        return 0;
+    }
+};
+
+SymbolTable& symbolTable()
+{
+    static SymbolTable table;
+    return table;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+SymbolId internSymbol(const std::string& name)
+{
+    SymbolTable& table = symbolTable();
+    std::size_t hash = boost::hash<std::string>()(name);
+
+    const Symbol* symbol = table.find(name, hash);
+    if (symbol)
+        return symbol->id;
+
+    boost::mutex::scoped_lock lock(table.mutex);
+
+    // Another thread may have added it in the meantime
+    symbol = table.find(name, hash);
+    if (symbol)
+        return symbol->id;
+
+    SymbolId id = table.size;
+    unsigned int chunk = id / SymbolTable::CHUNK_SIZE;
+    if (chunk >= SymbolTable::MAX_CHUNKS)
+        throw std::length_error("ed::internSymbol: symbol table is full");
+
+    if (!table.chunks[chunk])
+        table.chunks[chunk] = new const Symbol*[SymbolTable::CHUNK_SIZE];
+
+    boost::atomic<const Symbol*>& bucket = table.buckets[hash % SymbolTable::NUM_BUCKETS];
+    symbol = new Symbol(name, id, bucket.load(boost::memory_order_relaxed));
+    table.chunks[chunk][id % SymbolTable::CHUNK_SIZE] = symbol;
+    ++table.size;
+
+    bucket.store(symbol, boost::memory_order_release);
+    return id;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool findSymbol(const std::string& name, SymbolId& id)
+{
+    const Symbol* symbol = symbolTable().find(name, boost::hash<std::string>()(name));
+    if (!symbol)
+        return false;
+
+    id = symbol->id;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+const std::string& symbolName(SymbolId id)
+{
+    const SymbolTable& table = symbolTable();
+    return table.chunks[id / SymbolTable::CHUNK_SIZE][id % SymbolTable::CHUNK_SIZE]->name;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void SymbolSet::insert(SymbolId id)
+{
+    if (id < 64)
+    {
+        bits_ |= boost::uint64_t(1) << id;
+        return;
+    }
+
+    std::vector<SymbolId>::iterator it = std::lower_bound(overflow_.begin(), overflow_.end(), id);
+    if (it == overflow_.end() || *it != id)
+        overflow_.insert(it, id);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void SymbolSet::erase(SymbolId id)
+{
+    if (id < 64)
+    {
+        bits_ &= ~(boost::uint64_t(1) << id);
+        return;
+    }
+
+    std::vector<SymbolId>::iterator it = std::lower_bound(overflow_.begin(), overflow_.end(), id);
+    if (it != overflow_.end() && *it == id)
+        overflow_.erase(it);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void SymbolSet::ids(std::vector<SymbolId>& ids) const
+{
+    for(SymbolId id = 0; id < 64; ++id)
+    {
+        if ((bits_ >> id) & 1)
+            ids.push_back(id);
+    }
+
+    ids.insert(ids.end(), overflow_.begin(), overflow_.end());
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+std::set<std::string> SymbolSet::names() const
+{
+    std::vector<SymbolId> symbol_ids;
+    ids(symbol_ids);
+
+    std::set<std::string> names;
+    for(std::vector<SymbolId>::const_iterator it = symbol_ids.begin(); it != symbol_ids.end(); ++it)
+        names.insert(symbolName(*it));
+
+    return names;
+}
+
+} // end namespace ed
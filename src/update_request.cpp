@@ -5,6 +5,73 @@
 namespace ed
 {
 
+namespace
+{
+
+// Values of 'src' replace those of 'dst' with the same key
+template<typename K, typename V>
+void addMap(std::map<K, V>& dst, const std::map<K, V>& src)
+{
+    for(typename std::map<K, V>::const_iterator it = src.begin(); it != src.end(); ++it)
+        dst[it->first] = it->second;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Per entity, the sets of 'src' are added to those of 'dst'
+template<typename K, typename T>
+void addSets(std::map<K, std::set<T> >& dst, const std::map<K, std::set<T> >& src)
+{
+    for(typename std::map<K, std::set<T> >::const_iterator it = src.begin(); it != src.end(); ++it)
+        dst[it->first].insert(it->second.begin(), it->second.end());
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+void UpdateRequest::add(const UpdateRequest& req)
+{
+    for(std::map<UUID, std::vector<MeasurementConstPtr> >::const_iterator it = req.measurements.begin();
+        it != req.measurements.end(); ++it)
+        addMeasurements(it->first, it->second);
+
+    addMap(shapes, req.shapes);
+    addMap(rois, req.rois);
+    addMap(stateDefinitions, req.stateDefinitions);
+    addMap(moveRestrictions, req.moveRestrictions);
+    addMap(stateUpdateGroups, req.stateUpdateGroups);
+    addMap(originalPoses, req.originalPoses);
+
+    for(std::map<UUID, std::map<std::string, MeasurementConvexHull> >::const_iterator it = req.convex_hulls_new.begin();
+        it != req.convex_hulls_new.end(); ++it)
+        addMap(convex_hulls_new[it->first], it->second);
+
+    addMap(types, req.types);
+    addSets(type_sets_added, req.type_sets_added);
+    addSets(type_sets_removed, req.type_sets_removed);
+    addMap(existence_probabilities, req.existence_probabilities);
+    addMap(last_update_timestamps, req.last_update_timestamps);
+    addMap(poses, req.poses);
+
+    for(std::map<UUID, std::map<UUID, RelationConstPtr> >::const_iterator it = req.relations.begin(); it != req.relations.end(); ++it)
+        addMap(relations[it->first], it->second);
+
+    for(std::map<UUID, tue::config::DataConstPointer>::const_iterator it = req.datas.begin(); it != req.datas.end(); ++it)
+        addData(it->first, it->second);
+
+    for(std::map<UUID, std::map<Idx, Property> >::const_iterator it = req.properties.begin(); it != req.properties.end(); ++it)
+        addMap(properties[it->first], it->second);
+
+    removed_entities.insert(req.removed_entities.begin(), req.removed_entities.end());
+    addMap(added_flags, req.added_flags);
+    addSets(flag_sets_added, req.flag_sets_added);
+    addMap(removed_flags, req.removed_flags);
+
+    updated_entities.insert(req.updated_entities.begin(), req.updated_entities.end());
+    is_sync_update = is_sync_update || req.is_sync_update;
+}
+
 // ----------------------------------------------------------------------------------------------------
 
 //void UpdateRequest::setEntity(const EntityConstPtr& e)
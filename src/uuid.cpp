@@ -0,0 +1,234 @@
+#include "ed/uuid.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <deque>
+#include <fstream>
+#include <map>
+
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace ed
+{
+
+namespace
+{
+
+// Names are kept in a deque, such that their addresses stay valid when names are added. Ids store these
+// addresses, so reading a name does not need the mutex.
+struct NameTable
+{
+    boost::mutex mutex;
+    std::map<std::string, boost::uint64_t> ids;
+    std::deque<std::string> names;
+};
+
+NameTable& nameTable()
+{
+    static NameTable table;
+    return table;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+boost::uint64_t splitmix64(boost::uint64_t& x)
+{
+    boost::uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// xorshift128+, seeded per thread from /dev/urandom (or, if that is not available, the time, process
+// and thread)
+class IdGenerator
+{
+
+public:
+
+    IdGenerator()
+    {
+        boost::uint64_t seed[2] = { 0, 0 };
+
+        std::ifstream urandom("/dev/urandom", std::ios::binary);
+        if (!urandom.read(reinterpret_cast<char*>(seed), sizeof(seed)))
+        {
+            timeval tv;
+            gettimeofday(&tv, 0);
+            seed[0] = (boost::uint64_t(tv.tv_sec) << 20) ^ tv.tv_usec ^ (boost::uint64_t(getpid()) << 40);
+            seed[1] = reinterpret_cast<std::size_t>(this);
+        }
+
+        // Spread the seed, and make sure the state is never all zeros
+        boost::uint64_t x = seed[0] ^ splitmix64(seed[1]);
+        s_[0] = splitmix64(x);
+        s_[1] = splitmix64(x) | 1;
+    }
+
+    boost::uint64_t next()
+    {
+        boost::uint64_t s1 = s_[0];
+        const boost::uint64_t s0 = s_[1];
+        s_[0] = s0;
+        s1 ^= s1 << 23;
+        s_[1] = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+        return s_[1] + s0;
+    }
+
+private:
+
+    boost::uint64_t s_[2];
+
+};
+
+IdGenerator& threadGenerator()
+{
+    static boost::thread_specific_ptr<IdGenerator> generator;
+
+    IdGenerator* gen = generator.get();
+    if (!gen)
+    {
+        gen = new IdGenerator;
+        generator.reset(gen);
+    }
+
+    return *gen;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Parses exactly 32 lowercase hex characters (the form in which generated ids are written)
+bool parseHex(const std::string& s, boost::uint64_t& hi, boost::uint64_t& lo)
+{
+    if (s.size() != 32)
+        return false;
+
+    boost::uint64_t v[2] = { 0, 0 };
+    for(unsigned int i = 0; i < 32; ++i)
+    {
+        int h = hexValue(s[i]);
+        if (h < 0)
+            return false;
+        v[i / 16] = (v[i / 16] << 4) | h;
+    }
+
+    hi = v[0];
+    lo = v[1];
+    return true;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+UUID UUID::generate()
+{
+    IdGenerator& gen = threadGenerator();
+
+    UUID id;
+    id.hi_ = gen.next();
+    id.lo_ = gen.next();
+    id.named_ = false;
+    return id;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void UUID::fromString(const std::string& s)
+{
+    if (parseHex(s, hi_, lo_))
+    {
+        named_ = false;
+        return;
+    }
+
+    hi_ = 0;
+    named_ = true;
+
+    if (s.empty())
+    {
+        lo_ = 0;
+        return;
+    }
+
+    NameTable& table = nameTable();
+    boost::mutex::scoped_lock lock(table.mutex);
+
+    std::map<std::string, boost::uint64_t>::const_iterator it = table.ids.find(s);
+    if (it != table.ids.end())
+    {
+        lo_ = it->second;
+        return;
+    }
+
+    table.names.push_back(s);
+    lo_ = reinterpret_cast<std::size_t>(&table.names.back());
+    table.ids[s] = lo_;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool UUID::find(const std::string& s, UUID& id)
+{
+    id = UUID();
+
+    if (s.empty())
+        return true;
+
+    if (parseHex(s, id.hi_, id.lo_))
+    {
+        id.named_ = false;
+        return true;
+    }
+
+    NameTable& table = nameTable();
+    boost::mutex::scoped_lock lock(table.mutex);
+
+    std::map<std::string, boost::uint64_t>::const_iterator it = table.ids.find(s);
+    if (it == table.ids.end())
+        return false;
+
+    id.lo_ = it->second;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+std::string UUID::str() const
+{
+    if (named_)
+    {
+        if (lo_ == 0)
+            return std::string();
+
+        return *reinterpret_cast<const std::string*>(static_cast<std::size_t>(lo_));
+    }
+
+    static const char digits[] = "0123456789abcdef";
+
+    std::string s(32, '0');
+    for(unsigned int i = 0; i < 16; ++i)
+    {
+        s[15 - i] = digits[(hi_ >> (4 * i)) & 0xf];
+        s[31 - i] = digits[(lo_ >> (4 * i)) & 0xf];
+    }
+
+    return s;
+}
+
+} // end namespace ed
@@ -0,0 +1,228 @@
+#include "ed/world_history.h"
+
+#include "ed/entity.h"
+#include "ed/world_model.h"
+
+#include <algorithm>
+
+namespace ed
+{
+
+namespace
+{
+
+// Estimate of the memory of an entity that is not shared with other versions of it
+std::size_t entityMemory(const Entity& e)
+{
+    const ConvexHull& chull = e.convexHull();
+    std::size_t num_points = chull.points.size() + chull.edges.size() + chull.normals.size();
+
+    // Map nodes hold the key, the value and about 4 pointers
+    std::size_t num_nodes = e.relationsFrom().size() + e.relationsTo().size() + e.properties().size()
+            + e.convexHullMap().size();
+
+    return sizeof(Entity) + num_points * sizeof(geo::Vec2f) + num_nodes * (4 * sizeof(void*) + 2 * sizeof(Idx));
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------------------------------------
+
+WorldHistory::WorldHistory() : window_(0), max_memory_(0), memory_usage_(0)
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+WorldHistory::~WorldHistory()
+{
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldHistory::configure(double window, std::size_t max_memory)
+{
+    window_ = window;
+    max_memory_ = max_memory;
+
+    if (!enabled())
+        clear();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldHistory::clear()
+{
+    world_.reset();
+    revisions_.clear();
+    versions_.clear();
+    memory_usage_ = 0;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldHistory::add(const WorldModelConstPtr& world, double time)
+{
+    if (!enabled() || (world_ && world->revision() == world_->revision()))
+        return;
+
+    // The first world is compared with an empty one, such that all its entities are added
+    WorldDiff diff;
+    if (world_)
+        world->diff(*world_, diff);
+    else
+        world->diff(WorldModel(), diff);
+
+    revisions_.push_back(Revision());
+    Revision& rev = revisions_.back();
+    rev.revision = world->revision();
+    rev.time = time;
+
+    for(std::vector<UUID>::const_iterator it = diff.added.begin(); it != diff.added.end(); ++it)
+        addVersion(*it, rev.revision, world->entities()[it->idx], rev);
+
+    for(std::vector<DirtyEntity>::const_iterator it = diff.changed.begin(); it != diff.changed.end(); ++it)
+        addVersion(it->id, rev.revision, world->entities()[it->id.idx], rev);
+
+    for(std::vector<UUID>::const_iterator it = diff.removed.begin(); it != diff.removed.end(); ++it)
+        addVersion(*it, rev.revision, EntityConstPtr(), rev);
+
+    memory_usage_ += sizeof(Revision) + rev.changed.size() * (sizeof(UUID) + sizeof(Version));
+
+    world_ = world;
+
+    // The oldest revision is only needed as long as the next one is inside the window. The newest revision is
+    // always kept.
+    while(revisions_.size() > 1 && (revisions_[1].time <= time - window_
+                                    || (max_memory_ > 0 && memory_usage_ > max_memory_)))
+        dropOldestRevision();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool WorldHistory::resolve(const Query& q, unsigned long& revision, double& time) const
+{
+    std::deque<Revision>::const_iterator it;
+    if (q.at_revision > 0)
+        it = std::upper_bound(revisions_.begin(), revisions_.end(), q.at_revision, revisionBefore);
+    else
+        it = std::upper_bound(revisions_.begin(), revisions_.end(), q.at_time, timeBefore);
+
+    if (it == revisions_.begin())
+        return false;
+
+    --it;
+    revision = it->revision;
+    time = it->time;
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool WorldHistory::entity(const UUID& id, const Query& q, EntityConstPtr& e) const
+{
+    unsigned long revision;
+    double time;
+    if (!resolve(q, revision, time))
+        return false;
+
+    boost::unordered_map<UUID, std::vector<Version> >::const_iterator it = versions_.find(id);
+    e = (it != versions_.end()) ? versionAt(it->second, revision) : EntityConstPtr();
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool WorldHistory::entities(const Query& q, std::vector<EntityConstPtr>& entities) const
+{
+    entities.clear();
+
+    unsigned long revision;
+    double time;
+    if (!resolve(q, revision, time))
+        return false;
+
+    // The current state is the world itself
+    if (revision == revisions_.back().revision)
+    {
+        for(WorldModel::const_iterator it = world_->begin(); it != world_->end(); ++it)
+            entities.push_back(*it);
+        return true;
+    }
+
+    for(boost::unordered_map<UUID, std::vector<Version> >::const_iterator it = versions_.begin(); it != versions_.end(); ++it)
+    {
+        EntityConstPtr e = versionAt(it->second, revision);
+        if (e)
+            entities.push_back(e);
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldHistory::addVersion(const UUID& id, unsigned long revision, const EntityConstPtr& e, Revision& rev)
+{
+    std::vector<Version>& versions = versions_[id];
+
+    // The version that is replaced now counts as history
+    if (!versions.empty() && versions.back().e)
+        memory_usage_ += entityMemory(*versions.back().e);
+
+    versions.push_back(Version(revision, e));
+    rev.changed.push_back(id);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void WorldHistory::dropOldestRevision()
+{
+    const Revision& oldest = revisions_.front();
+
+    // The versions before the ones of the oldest revision can no longer be queried. The versions of the oldest
+    // revision are kept (they are still the current ones at the next revision), unless they are removals.
+    for(std::vector<UUID>::const_iterator it = oldest.changed.begin(); it != oldest.changed.end(); ++it)
+    {
+        boost::unordered_map<UUID, std::vector<Version> >::iterator it_versions = versions_.find(*it);
+        if (it_versions == versions_.end())
+            continue;
+
+        std::vector<Version>& versions = it_versions->second;
+
+        std::size_t n = 0;
+        while(n < versions.size() && versions[n].revision < oldest.revision)
+            ++n;
+
+        if (n < versions.size() && !versions[n].e)
+            ++n;
+
+        // All of them were replaced, so they were counted
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            if (versions[i].e)
+                memory_usage_ -= entityMemory(*versions[i].e);
+        }
+
+        versions.erase(versions.begin(), versions.begin() + n);
+        if (versions.empty())
+            versions_.erase(it_versions);
+    }
+
+    memory_usage_ -= sizeof(Revision) + oldest.changed.size() * (sizeof(UUID) + sizeof(Version));
+    revisions_.pop_front();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+EntityConstPtr WorldHistory::versionAt(const std::vector<Version>& versions, unsigned long revision)
+{
+    std::vector<Version>::const_iterator it = std::upper_bound(versions.begin(), versions.end(), revision,
+                                                               versionBefore);
+    if (it == versions.begin())
+        return EntityConstPtr();
+
+    return (it - 1)->e;
+}
+
+} // end namespace ed
@@ -7,6 +7,9 @@
 #include <tue/config/reader.h>
 #include <boost/make_shared.hpp>
 
+#include <algorithm>
+#include <iterator>
+
 #include "ed/property_key_db.h"
 
 #include "ed/types.h"
@@ -14,9 +17,182 @@
 namespace ed
 {
 
+namespace
+{
+
+void insertIdx(std::vector<Idx>& v, Idx idx)
+{
+    std::vector<Idx>::iterator it = std::lower_bound(v.begin(), v.end(), idx);
+    if (it == v.end() || *it != idx)
+        v.insert(it, idx);
+}
+
 // --------------------------------------------------------------------------------
 
-WorldModel::WorldModel(const PropertyKeyDB* prop_key_db) : revision_(0), property_info_db_(prop_key_db)
+void eraseIdx(std::vector<Idx>& v, Idx idx)
+{
+    std::vector<Idx>::iterator it = std::lower_bound(v.begin(), v.end(), idx);
+    if (it != v.end() && *it == idx)
+        v.erase(it);
+}
+
+// --------------------------------------------------------------------------------
+
+void updateIndex(boost::shared_ptr<std::vector<Idx> >& index, Idx idx, bool value)
+{
+    // Only copy a shared index if the entity is added to or removed from it
+    if (std::binary_search(index->begin(), index->end(), idx) == value)
+        return;
+
+    if (value)
+        insertIdx(writable(index), idx);
+    else
+        eraseIdx(writable(index), idx);
+}
+
+// --------------------------------------------------------------------------------
+
+void updateSymbolIndex(std::map<SymbolId, boost::shared_ptr<std::vector<Idx> > >& index, Idx idx,
+                       const SymbolSet* old_set, const SymbolSet* new_set)
+{
+    if (old_set && new_set && *old_set == *new_set)
+        return;
+
+    std::vector<SymbolId> old_ids, new_ids;
+    if (old_set)
+        old_set->ids(old_ids);
+    if (new_set)
+        new_set->ids(new_ids);
+
+    std::vector<SymbolId> removed;
+    std::set_difference(old_ids.begin(), old_ids.end(), new_ids.begin(), new_ids.end(), std::back_inserter(removed));
+
+    for(std::vector<SymbolId>::const_iterator it = removed.begin(); it != removed.end(); ++it)
+    {
+        std::map<SymbolId, boost::shared_ptr<std::vector<Idx> > >::iterator it_index = index.find(*it);
+        if (it_index == index.end())
+            continue;
+
+        updateIndex(it_index->second, idx, false);
+        if (it_index->second->empty())
+            index.erase(it_index);
+    }
+
+    // Symbols that did not change are already in their index, so they are not copied
+    for(std::vector<SymbolId>::const_iterator it = new_ids.begin(); it != new_ids.end(); ++it)
+    {
+        boost::shared_ptr<std::vector<Idx> >& index_symbol = index[*it];
+        if (!index_symbol)
+            index_symbol = boost::make_shared<std::vector<Idx> >();
+        updateIndex(index_symbol, idx, true);
+    }
+}
+
+// --------------------------------------------------------------------------------
+
+void remapIndex(std::vector<Idx>& index, const std::vector<Idx>& map)
+{
+    for(std::vector<Idx>::iterator it = index.begin(); it != index.end(); ++it)
+        *it = map[*it];
+}
+
+// --------------------------------------------------------------------------------
+
+bool relationsMove(const Entity& e, const CompactionMap& map)
+{
+    for(std::map<Idx, Idx>::const_iterator it = e.relationsFrom().begin(); it != e.relationsFrom().end(); ++it)
+    {
+        if (map.entities[it->first] != it->first || map.relations[it->second] != it->second)
+            return true;
+    }
+
+    for(std::map<Idx, Idx>::const_iterator it = e.relationsTo().begin(); it != e.relationsTo().end(); ++it)
+    {
+        if (map.entities[it->first] != it->first || map.relations[it->second] != it->second)
+            return true;
+    }
+
+    return false;
+}
+
+// --------------------------------------------------------------------------------
+
+// Number of slots per entry of entity_block_revisions_
+const Idx REVISION_BLOCK_SIZE = 64;
+
+// --------------------------------------------------------------------------------
+
+bool samePose(const geo::Pose3D& a, const geo::Pose3D& b)
+{
+    return a.t.x == b.t.x && a.t.y == b.t.y && a.t.z == b.t.z
+            && a.R.xx == b.R.xx && a.R.xy == b.R.xy && a.R.xz == b.R.xz
+            && a.R.yx == b.R.yx && a.R.yy == b.R.yy && a.R.yz == b.R.yz
+            && a.R.zx == b.R.zx && a.R.zy == b.R.zy && a.R.zz == b.R.zz;
+}
+
+// --------------------------------------------------------------------------------
+
+bool sameConvexHull(const ConvexHull& a, const ConvexHull& b)
+{
+    if (a.points.size() != b.points.size())
+        return false;
+
+    if (a.points.empty())
+        return true;
+
+    if (a.z_min != b.z_min || a.z_max != b.z_max)
+        return false;
+
+    for(unsigned int i = 0; i < a.points.size(); ++i)
+    {
+        if (a.points[i].x != b.points[i].x || a.points[i].y != b.points[i].y)
+            return false;
+    }
+
+    return true;
+}
+
+// --------------------------------------------------------------------------------
+
+// Returns the components (DirtyEntity::Component) in which 'a' and 'b' differ, or OTHER if they differ in
+// something else
+unsigned int changedComponents(const Entity& a, const Entity& b)
+{
+    unsigned int components = 0;
+
+    if (a.has_pose() != b.has_pose() || (a.has_pose() && !samePose(a.pose(), b.pose())))
+        components |= DirtyEntity::POSE;
+
+    if (a.shape() != b.shape() || a.shapeRevision() != b.shapeRevision())
+        components |= DirtyEntity::SHAPE;
+
+    // The convex hull is relative to the pose, so it also moves if the pose changed
+    if (!sameConvexHull(a.convexHull(), b.convexHull())
+            || ((components & DirtyEntity::POSE) && !b.convexHull().points.empty()))
+        components |= DirtyEntity::CONVEX_HULL;
+
+    if (a.dataRevision() != b.dataRevision())
+        components |= DirtyEntity::DATA;
+
+    if (a.type() != b.type() || !(a.typeSymbols() == b.typeSymbols()))
+        components |= DirtyEntity::TYPE;
+
+    if (!(a.flagSymbols() == b.flagSymbols()))
+        components |= DirtyEntity::FLAGS;
+
+    if (components == 0)
+        components = DirtyEntity::OTHER;
+
+    return components;
+}
+
+} // end anonymous namespace
+
+// --------------------------------------------------------------------------------
+
+WorldModel::WorldModel(const PropertyKeyDB* prop_key_db) : revision_(0),
+    live_entities_(boost::make_shared<std::vector<Idx> >()), property_info_db_(prop_key_db),
+    shape_index_(boost::make_shared<std::vector<Idx> >()), convex_hull_index_(boost::make_shared<std::vector<Idx> >())
 {
 }
 
@@ -32,6 +208,15 @@ void WorldModel::update(const UpdateRequest& req)
 
     std::map<UUID, EntityPtr> new_entities;
 
+    // Entities as they were before the update, to update the indexes afterwards
+    std::map<UUID, EntityConstPtr> old_entities;
+    for(std::set<UUID>::const_iterator it = req.updated_entities.begin(); it != req.updated_entities.end(); ++it)
+    {
+        Idx idx;
+        if (findEntityIdx(*it, idx))
+            old_entities[*it] = entities_[idx];
+    }
+
     // Update associated measurements
     for(std::map<UUID, std::vector<MeasurementConstPtr> >::const_iterator it = req.measurements.begin(); it != req.measurements.end(); ++it)
     {
@@ -163,7 +348,7 @@ void WorldModel::update(const UpdateRequest& req)
             {
                 Idx idx2;
                 if (findEntityIdx(it2->first, idx2))
-                    setRelation(idx1, idx2, it2->second);
+                    setRelation(idx1, idx2, it2->second, new_entities);
                 else
                     std::cout << "WorldModel::update (relation): unknown entity: '" << it2->first << "'." << std::endl;
             }
@@ -179,6 +364,14 @@ void WorldModel::update(const UpdateRequest& req)
         e->setFlag(it->second);
     }
 
+    for(std::map<UUID, std::set<std::string> >::const_iterator it = req.flag_sets_added.begin(); it != req.flag_sets_added.end(); ++it)
+    {
+        EntityPtr e = getOrAddEntity(it->first, new_entities);
+        const std::set<std::string>& flag_set = it->second;
+        for(std::set<std::string>::const_iterator it2 = flag_set.begin(); it2 != flag_set.end(); ++it2)
+            e->setFlag(*it2);
+    }
+
     for(std::map<UUID, std::string>::const_iterator it = req.removed_flags.begin(); it != req.removed_flags.end(); ++it)
     {
         EntityPtr e = getOrAddEntity(it->first, new_entities);
@@ -190,9 +383,15 @@ void WorldModel::update(const UpdateRequest& req)
     {
         EntityPtr e = getOrAddEntity(it->first, new_entities);
 
-        tue::config::DataPointer params;
-        params.add(e->data());
-        params.add(it->second);
+        // Entities without data share the data of the request
+        tue::config::DataConstPointer params = it->second;
+        if (!e->data().empty())
+        {
+            tue::config::DataPointer merged;
+            merged.add(e->data());
+            merged.add(it->second);
+            params = merged;
+        }
 
         tue::config::Reader r(params);
         std::string type;
@@ -200,6 +399,7 @@ void WorldModel::update(const UpdateRequest& req)
             e->setType(type);
 
         e->setData(params);
+        e->setDataRevision(revision_);
     }
 
     for(std::map<UUID, std::map<Idx, Property> >::const_iterator it = req.properties.begin(); it != req.properties.end(); ++it)
@@ -214,6 +414,18 @@ void WorldModel::update(const UpdateRequest& req)
         }
     }
 
+    // Update the indexes and tables. Every change of an entity flags it as updated (UpdateRequest::flagUpdated), so
+    // all entities that changed are in 'old_entities' if they existed.
+    for(std::map<UUID, EntityPtr>::const_iterator it = new_entities.begin(); it != new_entities.end(); ++it)
+    {
+        Idx idx;
+        findEntityIdx(it->first, idx);
+
+        std::map<UUID, EntityConstPtr>::const_iterator it_old = old_entities.find(it->first);
+        updateIndexes(idx, it_old != old_entities.end() ? it_old->second : EntityConstPtr(), it->second);
+        updateTables(idx, it->second);
+    }
+
     // Remove entities
     for(std::set<UUID>::const_iterator it = req.removed_entities.begin(); it != req.removed_entities.end(); ++it)
     {
@@ -223,6 +435,41 @@ void WorldModel::update(const UpdateRequest& req)
 
 // --------------------------------------------------------------------------------
 
+void WorldModel::diff(const WorldModel& older, WorldDiff& diff) const
+{
+    diff.clear();
+
+    // If 'older' has a higher revision, it is not an earlier copy of this world, and all slots are compared
+    unsigned long since = older.revision_ <= revision_ ? older.revision_ : 0;
+
+    for(Idx block = 0; block < entity_block_revisions_.size(); ++block)
+    {
+        if (entity_block_revisions_[block] <= since)
+            continue;
+
+        Idx end = std::min<Idx>((block + 1) * REVISION_BLOCK_SIZE, entity_revisions_.size());
+        for(Idx i = block * REVISION_BLOCK_SIZE; i < end; ++i)
+        {
+            if (entity_revisions_[i] <= since)
+                continue;
+
+            const EntityConstPtr& e_new = entities_[i];
+            EntityConstPtr e_old = i < older.entities_.size() ? older.entities_[i] : EntityConstPtr();
+            if (e_old != e_new)
+                diffSlot(older, i, e_old, e_new, diff);
+        }
+    }
+
+    // Slots that were removed by compaction
+    for(Idx i = entities_.size(); i < older.entities_.size(); ++i)
+    {
+        if (older.entities_[i])
+            diffSlot(older, i, older.entities_[i], EntityConstPtr(), diff);
+    }
+}
+
+// --------------------------------------------------------------------------------
+
 struct SearchNode
 {
     SearchNode() {}
@@ -318,8 +565,17 @@ bool WorldModel::calculateTransform(const UUID& source, const UUID& target, cons
 
 void WorldModel::setRelation(Idx parent, Idx child, const RelationConstPtr& r)
 {
-    const EntityConstPtr& p = entities_[parent];
-    const EntityConstPtr& c = entities_[child];
+    std::map<UUID, EntityPtr> new_entities;
+    setRelation(parent, child, r, new_entities);
+}
+
+// --------------------------------------------------------------------------------
+
+void WorldModel::setRelation(Idx parent, Idx child, const RelationConstPtr& r, std::map<UUID, EntityPtr>& new_entities)
+{
+    // Copies, since the entity pointers may be replaced below
+    EntityConstPtr p = entities_[parent];
+    EntityConstPtr c = entities_[child];
 
     if (!p || !c)
     {
@@ -332,14 +588,13 @@ void WorldModel::setRelation(Idx parent, Idx child, const RelationConstPtr& r)
     {
         r_idx = addRelation(r);
 
-        EntityPtr p_new(new Entity(*entities_[parent]));
-        EntityPtr c_new(new Entity(*entities_[child]));
+        // Entities that were already copied during this update are modified in place, such that an
+        // entity with many relations (e.g., the world root) is not copied for every relation
+        EntityPtr p_new = getOrAddEntity(p->id(), new_entities);
+        EntityPtr c_new = getOrAddEntity(c->id(), new_entities);
 
         p_new->setRelationTo(child, r_idx);
         c_new->setRelationFrom(parent, r_idx);
-
-        entities_[parent] = p_new;
-        entities_[child] = c_new;
     }
     else
     {
@@ -347,33 +602,96 @@ void WorldModel::setRelation(Idx parent, Idx child, const RelationConstPtr& r)
     }
 
     // Update entity revisions
-    for(std::size_t i = entity_revisions_.size(); i < std::max(parent, child) + 1; ++i)
-        entity_revisions_.push_back(0);
-    entity_revisions_[parent] = revision_;
-    entity_revisions_[child] = revision_;
+    setEntityRevision(parent);
+    setEntityRevision(child);
 }
 
 // --------------------------------------------------------------------------------
 
 Idx WorldModel::addRelation(const RelationConstPtr& r)
 {
-    Idx r_idx = relations_.size();
-    relations_.push_back(r);
+    Idx r_idx;
+    if (relation_empty_spots_.empty())
+    {
+        r_idx = relations_.size();
+        relations_.push_back(r);
+        if (relation_generations_.size() < relations_.size())
+            relation_generations_.push_back(0);
+    }
+    else
+    {
+        r_idx = relation_empty_spots_.front();
+        relation_empty_spots_.pop();
+        relations_[r_idx] = r;
+    }
+
     return r_idx;
 }
 
 // --------------------------------------------------------------------------------
 
+void WorldModel::removeRelations(Idx idx)
+{
+    const EntityConstPtr& e = entities_[idx];
+
+    std::vector<Idx> freed;
+
+    // The other sides are copied, since they may be shared with other worlds
+    for(std::map<Idx, Idx>::const_iterator it = e->relationsTo().begin(); it != e->relationsTo().end(); ++it)
+    {
+        Idx child = it->first;
+        if (child != idx && entities_[child])
+        {
+            EntityPtr c = boost::make_shared<Entity>(*entities_[child]);
+            c->removeRelationFrom(idx);
+            entities_[child] = c;
+            setEntityRevision(child);
+        }
+        freed.push_back(it->second);
+    }
+
+    for(std::map<Idx, Idx>::const_iterator it = e->relationsFrom().begin(); it != e->relationsFrom().end(); ++it)
+    {
+        Idx parent = it->first;
+        if (parent == idx)
+            continue; // Relation to itself, which was already freed
+
+        if (entities_[parent])
+        {
+            EntityPtr p = boost::make_shared<Entity>(*entities_[parent]);
+            p->removeRelationTo(idx);
+            entities_[parent] = p;
+            setEntityRevision(parent);
+        }
+        freed.push_back(it->second);
+    }
+
+    for(std::vector<Idx>::const_iterator it = freed.begin(); it != freed.end(); ++it)
+    {
+        relations_[*it].reset();
+        ++relation_generations_[*it];
+        relation_empty_spots_.push(*it);
+    }
+}
+
+// --------------------------------------------------------------------------------
+
 void WorldModel::setEntity(const UUID& id, const EntityConstPtr& e)
 {
-    std::map<UUID, Idx>::const_iterator it_idx = entity_map_.find(id);
+    EntityMap::const_iterator it_idx = entity_map_.find(id);
     if (it_idx == entity_map_.end())
     {
-        addNewEntity(e);
+        Idx idx = addNewEntity(e);
+        updateIndexes(idx, EntityConstPtr(), e);
+        updateTables(idx, e);
+        setEntityRevision(idx);
     }
     else
     {
+        updateIndexes(it_idx->second, entities_[it_idx->second], e);
+        updateTables(it_idx->second, e);
         entities_[it_idx->second] = e;
+        setEntityRevision(it_idx->second);
     }
 }
 
@@ -381,19 +699,32 @@ void WorldModel::setEntity(const UUID& id, const EntityConstPtr& e)
 
 void WorldModel::removeEntity(const UUID& id)
 {
-    std::map<UUID, Idx>::iterator it_idx = entity_map_.find(id);
+    EntityMap::iterator it_idx = entity_map_.find(id);
     if (it_idx != entity_map_.end())
     {
+        removeRelations(it_idx->second);
+        updateIndexes(it_idx->second, entities_[it_idx->second], EntityConstPtr());
+        updateTables(it_idx->second, EntityConstPtr());
         entities_[it_idx->second].reset();
-        entity_revisions_[it_idx->second] = revision_;
+        ++entity_generations_[it_idx->second];
+        setEntityRevision(it_idx->second);
         entity_shape_revisions_[it_idx->second] = 0;
         entity_empty_spots_.push(it_idx->second);
+        if (id.isName())
+            nameIndex().erase(id.str());
         entity_map_.erase(it_idx);
     }
 }
 
 // --------------------------------------------------------------------------------
 
+WorldModel::NameIndex& WorldModel::nameIndex()
+{
+    return writable(name_index_);
+}
+
+// --------------------------------------------------------------------------------
+
 EntityPtr WorldModel::getOrAddEntity(const UUID& id, std::map<UUID, EntityPtr>& new_entities)
 {
     // Check if the id is already in the new_entities map. If so, return it
@@ -424,9 +755,7 @@ EntityPtr WorldModel::getOrAddEntity(const UUID& id, std::map<UUID, EntityPtr>&
 
     new_entities[id] = e;
 
-    for(std::size_t i = entity_revisions_.size(); i < idx + 1; ++i)
-        entity_revisions_.push_back(0);
-    entity_revisions_[idx] = revision_;
+    setEntityRevision(idx);
 
     return e;
 }
@@ -435,13 +764,13 @@ EntityPtr WorldModel::getOrAddEntity(const UUID& id, std::map<UUID, EntityPtr>&
 
 bool WorldModel::findEntityIdx(const UUID& id, Idx& idx) const
 {
-    if (id.idx != INVALID_IDX && entities_[id.idx] && entities_[id.idx]->id() == id.str())
+    if (id.idx < entities_.size() && entities_[id.idx] && entities_[id.idx]->id() == id)
     {
         idx = id.idx;
         return true;
     }
 
-    std::map<UUID, Idx>::const_iterator it = entity_map_.find(id);
+    EntityMap::const_iterator it = entity_map_.find(id);
     if (it == entity_map_.end())
         return false;
 
@@ -460,7 +789,13 @@ Idx WorldModel::addNewEntity(const EntityConstPtr& e)
         idx = entities_.size();
         entity_map_[e->id()] = idx;
         entities_.push_back(e);
+        if (entity_generations_.size() < entities_.size())
+            entity_generations_.push_back(0);
         entity_shape_revisions_.push_back(0);
+        entity_poses_.push_back(geo::Pose3D::identity());
+        entity_has_pose_.push_back(0);
+        entity_boxes_.push_back(EntityBox());
+        entity_alive_.push_back(0);
     }
     else
     {
@@ -470,11 +805,188 @@ Idx WorldModel::addNewEntity(const EntityConstPtr& e)
         entities_[idx] = e;
     }
 
+    if (e->id().isName())
+        nameIndex()[e->id().str()] = idx;
+
     return idx;
 }
 
 // --------------------------------------------------------------------------------
 
+void WorldModel::setEntityRevision(Idx idx)
+{
+    if (entity_revisions_.size() <= idx)
+        entity_revisions_.resize(idx + 1, 0);
+    entity_revisions_[idx] = revision_;
+
+    Idx block = idx / REVISION_BLOCK_SIZE;
+    if (entity_block_revisions_.size() <= block)
+        entity_block_revisions_.resize(block + 1, 0);
+    entity_block_revisions_[block] = revision_;
+}
+
+// --------------------------------------------------------------------------------
+
+void WorldModel::diffSlot(const WorldModel& older, Idx idx, const EntityConstPtr& e_old, const EntityConstPtr& e_new,
+                          WorldDiff& diff) const
+{
+    // The entity that was in the slot was removed, unless it moved to another slot. The maps are used instead
+    // of findEntityIdx(), since that sets the index of ids that are shared with other worlds.
+    if (e_old && (!e_new || e_new->id() != e_old->id()) && entity_map_.find(e_old->id()) == entity_map_.end())
+        diff.removed.push_back(e_old->id());
+
+    if (!e_new)
+        return;
+
+    EntityConstPtr e_prev;
+    if (e_old && e_old->id() == e_new->id())
+    {
+        e_prev = e_old;
+    }
+    else
+    {
+        EntityMap::const_iterator it = older.entity_map_.find(e_new->id());
+        if (it != older.entity_map_.end())
+            e_prev = older.entities_[it->second];
+    }
+
+    UUID id = e_new->id();
+    id.idx = idx;
+
+    if (!e_prev)
+        diff.added.push_back(id);
+    else if (e_prev != e_new)
+        diff.changed.push_back(DirtyEntity(id, changedComponents(*e_prev, *e_new)));
+}
+
+// --------------------------------------------------------------------------------
+
+void WorldModel::compact(CompactionMap& map)
+{
+    map.entities.assign(entities_.size(), INVALID_IDX);
+    Idx num_entities = 0;
+    for(Idx i = 0; i < entities_.size(); ++i)
+    {
+        if (entities_[i])
+            map.entities[i] = num_entities++;
+    }
+
+    map.relations.assign(relations_.size(), INVALID_IDX);
+    Idx num_relations = 0;
+    for(Idx i = 0; i < relations_.size(); ++i)
+    {
+        if (relations_[i])
+            map.relations[i] = num_relations++;
+    }
+
+    if (num_entities == entities_.size() && num_relations == relations_.size())
+        return;
+
+    ++revision_;
+
+    // Slots that get another entity (or none) get a new generation, such that old handles to them are invalid
+    for(Idx i = 0; i < entities_.size(); ++i)
+    {
+        if (!entities_[i] || map.entities[i] != i)
+            ++entity_generations_[i];
+    }
+
+    for(Idx i = 0; i < relations_.size(); ++i)
+    {
+        if (!relations_[i] || map.relations[i] != i)
+            ++relation_generations_[i];
+    }
+
+    std::vector<EntityConstPtr> entities(num_entities);
+    std::vector<unsigned long> revisions(num_entities, 0);
+    std::vector<unsigned long> shape_revisions(num_entities, 0);
+    ChunkedArray<geo::Pose3D> poses;
+    ChunkedArray<unsigned char> has_pose;
+    ChunkedArray<EntityBox> boxes;
+    ChunkedArray<unsigned char> alive;
+
+    for(Idx i = 0; i < entities_.size(); ++i)
+    {
+        if (!entities_[i])
+            continue;
+
+        Idx j = map.entities[i];
+
+        // Entities are only copied if the indices in their relations change
+        EntityConstPtr e = entities_[i];
+        bool changed = (i != j);
+        if (relationsMove(*e, map))
+        {
+            EntityPtr e_new = boost::make_shared<Entity>(*e);
+            e_new->remapRelations(map.entities, map.relations);
+            e_new->setRevision(revision_);
+            e = e_new;
+            changed = true;
+        }
+
+        entities[j] = e;
+
+        unsigned long rev = i < entity_revisions_.size() ? entity_revisions_[i] : 0;
+        revisions[j] = changed ? revision_ : rev;
+        shape_revisions[j] = (i != j && entity_shape_revisions_[i] != 0) ? revision_ : entity_shape_revisions_[i];
+
+        // Slots keep their order, so the tables are filled in order
+        poses.push_back(entity_poses_[i]);
+        has_pose.push_back(entity_has_pose_[i]);
+        boxes.push_back(entity_boxes_[i]);
+        alive.push_back(1);
+    }
+
+    entities_.swap(entities);
+    entity_revisions_.swap(revisions);
+    entity_shape_revisions_.swap(shape_revisions);
+
+    entity_block_revisions_.assign((num_entities + REVISION_BLOCK_SIZE - 1) / REVISION_BLOCK_SIZE, 0);
+    for(Idx i = 0; i < num_entities; ++i)
+    {
+        unsigned long& block_rev = entity_block_revisions_[i / REVISION_BLOCK_SIZE];
+        block_rev = std::max(block_rev, entity_revisions_[i]);
+    }
+    entity_poses_.swap(poses);
+    entity_has_pose_.swap(has_pose);
+    entity_boxes_.swap(boxes);
+    entity_alive_.swap(alive);
+
+    std::vector<RelationConstPtr> relations(num_relations);
+    for(Idx i = 0; i < relations_.size(); ++i)
+    {
+        if (relations_[i])
+            relations[map.relations[i]] = relations_[i];
+    }
+    relations_.swap(relations);
+
+    entity_empty_spots_ = std::queue<Idx>();
+    relation_empty_spots_ = std::queue<Idx>();
+
+    // The map keeps the order of indices, so the indexes stay sorted
+    for(EntityMap::iterator it = entity_map_.begin(); it != entity_map_.end(); ++it)
+        it->second = map.entities[it->second];
+
+    if (name_index_)
+    {
+        NameIndex& name_index = nameIndex();
+        for(NameIndex::iterator it = name_index.begin(); it != name_index.end(); ++it)
+            it->second = map.entities[it->second];
+    }
+
+    for(std::map<SymbolId, IndexPtr>::iterator it = type_index_.begin(); it != type_index_.end(); ++it)
+        remapIndex(writable(it->second), map.entities);
+
+    for(std::map<SymbolId, IndexPtr>::iterator it = flag_index_.begin(); it != flag_index_.end(); ++it)
+        remapIndex(writable(it->second), map.entities);
+
+    remapIndex(writable(shape_index_), map.entities);
+    remapIndex(writable(convex_hull_index_), map.entities);
+    remapIndex(writable(live_entities_), map.entities);
+}
+
+// --------------------------------------------------------------------------------
+
 const PropertyKeyDBEntry* WorldModel::getPropertyInfo(const std::string& name) const
 {
     if (!property_info_db_)
@@ -483,4 +995,128 @@ const PropertyKeyDBEntry* WorldModel::getPropertyInfo(const std::string& name) c
     return property_info_db_->getPropertyKeyDBEntry(name);
 }
 
+// --------------------------------------------------------------------------------
+
+const std::vector<Idx>& WorldModel::lookupIndex(const std::map<SymbolId, IndexPtr>& index, SymbolId id)
+{
+    static const std::vector<Idx> empty;
+
+    std::map<SymbolId, IndexPtr>::const_iterator it = index.find(id);
+    if (it == index.end())
+        return empty;
+
+    return *it->second;
+}
+
+// --------------------------------------------------------------------------------
+
+const std::vector<Idx>& WorldModel::entitiesWithType(const std::string& type) const
+{
+    // Symbols that were never interned are not indexed
+    SymbolId id;
+    if (!findSymbol(type, id))
+        return lookupIndex(type_index_, INVALID_SYMBOL);
+
+    return entitiesWithType(id);
+}
+
+// --------------------------------------------------------------------------------
+
+const std::vector<Idx>& WorldModel::entitiesWithFlag(const std::string& flag) const
+{
+    // Symbols that were never interned are not indexed
+    SymbolId id;
+    if (!findSymbol(flag, id))
+        return lookupIndex(flag_index_, INVALID_SYMBOL);
+
+    return entitiesWithFlag(id);
+}
+
+// --------------------------------------------------------------------------------
+
+void WorldModel::entitiesWithPrefix(const std::string& prefix, std::vector<Idx>& idxs) const
+{
+    idxs.clear();
+    if (!name_index_)
+        return;
+
+    for(NameIndex::const_iterator it = name_index_->lower_bound(prefix);
+        it != name_index_->end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+        idxs.push_back(it->second);
+}
+
+// --------------------------------------------------------------------------------
+
+void WorldModel::intersect(const std::vector<Idx>& a, const std::vector<Idx>& b, std::vector<Idx>& result)
+{
+    result.clear();
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+}
+
+// --------------------------------------------------------------------------------
+
+void WorldModel::updateIndexes(Idx idx, const EntityConstPtr& old_e, const EntityConstPtr& new_e)
+{
+    updateSymbolIndex(type_index_, idx, old_e ? &old_e->typeSymbols() : 0, new_e ? &new_e->typeSymbols() : 0);
+    updateSymbolIndex(flag_index_, idx, old_e ? &old_e->flagSymbols() : 0, new_e ? &new_e->flagSymbols() : 0);
+
+    updateIndex(shape_index_, idx, new_e && new_e->shape());
+    updateIndex(convex_hull_index_, idx, new_e && !new_e->convexHull().points.empty());
+}
+
+// --------------------------------------------------------------------------------
+
+void WorldModel::updateTables(Idx idx, const EntityConstPtr& e)
+{
+    // Only copy the chunks of the tables that are shared with other worlds if a value changes
+    if (!e)
+    {
+        if (entity_alive_[idx])
+        {
+            entity_poses_.set(idx, geo::Pose3D::identity());
+            entity_has_pose_.set(idx, 0);
+            entity_boxes_.set(idx, EntityBox());
+            entity_alive_.set(idx, 0);
+            eraseIdx(writable(live_entities_), idx);
+        }
+        return;
+    }
+
+    geo::Pose3D pose = e->has_pose() ? e->pose() : geo::Pose3D::identity();
+    if (!samePose(entity_poses_[idx], pose))
+        entity_poses_.set(idx, pose);
+
+    if (entity_has_pose_[idx] != e->has_pose())
+        entity_has_pose_.set(idx, e->has_pose());
+
+    // The convex hull is relative to the position of the entity
+    EntityBox box;
+    const ConvexHull& chull = e->convexHull();
+    if (!chull.points.empty())
+    {
+        const geo::Vec3& t = pose.t;
+        box.min = geo::Vec3(t.x + chull.points[0].x, t.y + chull.points[0].y, t.z + chull.z_min);
+        box.max = geo::Vec3(box.min.x, box.min.y, t.z + chull.z_max);
+
+        for(std::vector<geo::Vec2f>::const_iterator it = chull.points.begin() + 1; it != chull.points.end(); ++it)
+        {
+            box.min.x = std::min<double>(box.min.x, t.x + it->x);
+            box.min.y = std::min<double>(box.min.y, t.y + it->y);
+            box.max.x = std::max<double>(box.max.x, t.x + it->x);
+            box.max.y = std::max<double>(box.max.y, t.y + it->y);
+        }
+    }
+
+    const EntityBox& old_box = entity_boxes_[idx];
+    if (old_box.min.x != box.min.x || old_box.min.y != box.min.y || old_box.min.z != box.min.z
+            || old_box.max.x != box.max.x || old_box.max.y != box.max.y || old_box.max.z != box.max.z)
+        entity_boxes_.set(idx, box);
+
+    if (!entity_alive_[idx])
+    {
+        entity_alive_.set(idx, 1);
+        insertIdx(writable(live_entities_), idx);
+    }
+}
+
 }
@@ -0,0 +1,124 @@
+// Checks that the evictor removes exactly the entities whose time-to-live expired, also when they are updated
+// after they were queued, and measures the time of eviction in a world with 100k entities.
+
+#include <ed/evictor.h>
+#include <ed/world_model.h>
+#include <ed/update_request.h>
+#include <ed/entity.h>
+
+// Profiling
+#include <tue/profiling/timer.h>
+
+#include <iostream>
+#include <sstream>
+
+// ----------------------------------------------------------------------------------------------------
+
+std::string entityId(unsigned int i)
+{
+    std::stringstream id;
+    id << "e" << i;
+    return id.str();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void apply(ed::WorldModel& wm, ed::Evictor& evictor, const ed::UpdateRequest& req)
+{
+    wm.update(req);
+    evictor.update(wm, req);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Evicts at 'time', and checks that exactly the entities for which 'expected' is true were removed. Sets
+// 't_evict' to the time eviction took (without removing the entities).
+bool checkEviction(ed::WorldModel& wm, ed::Evictor& evictor, double time, unsigned int N, bool (*expected)(unsigned int),
+                   double& t_evict)
+{
+    tue::Timer timer;
+    timer.start();
+
+    ed::UpdateRequest req;
+    evictor.evict(wm, time, req);
+
+    t_evict = timer.getElapsedTimeInMilliSec();
+
+    apply(wm, evictor, req);
+
+    for(unsigned int i = 0; i < N; ++i)
+    {
+        bool removed = !wm.getEntity(entityId(i));
+        if (removed != expected(i))
+        {
+            std::cout << "Entity " << i << (removed ? " was" : " was not") << " evicted at time " << time << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Persons (every 4th entity) live 10 s, unless they were seen again at t = 50. Other perceived entities live
+// 60 s, except perceived furniture without timestamp.
+bool evictedAt30(unsigned int i) { return i % 8 == 0; }
+bool evictedAt70(unsigned int i) { return i % 4 == 0 || (i % 2 == 0 && i % 10 != 0) || i % 10 == 5; }
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    unsigned int N = 100000;
+
+    ed::Evictor evictor;
+    evictor.addTypePolicy("person", 10);
+    evictor.addFlagPolicy("perceived", 60);
+
+    ed::WorldModel wm;
+
+    // Every 4th entity is a person, of the others every 5th is furniture. Every 2nd entity, and entities 5,
+    // 15, ... are perceived. Furniture has no timestamp, unless it is perceived.
+    ed::UpdateRequest req;
+    for(unsigned int i = 0; i < N; ++i)
+    {
+        std::string id = entityId(i);
+        req.setType(id, i % 4 == 0 ? "person" : (i % 5 == 0 ? "furniture" : "object"));
+        if (i % 2 == 0 || i % 10 == 5)
+            req.addFlag(id, "perceived");
+        if (i % 4 == 0 || i % 5 != 0 || i % 10 == 5)
+            req.setLastUpdateTimestamp(id, 1);
+    }
+    apply(wm, evictor, req);
+
+    // Half of the persons are seen again
+    ed::UpdateRequest req_seen;
+    for(unsigned int i = 4; i < N; i += 8)
+        req_seen.setLastUpdateTimestamp(entityId(i), 50);
+    apply(wm, evictor, req_seen);
+
+    // Nothing expired yet
+    ed::UpdateRequest req_none;
+    evictor.evict(wm, 5, req_none);
+    if (!req_none.empty())
+    {
+        std::cout << "Entities were evicted before they expired" << std::endl;
+        return 1;
+    }
+
+    double t_evict_30, t_evict_70;
+    if (!checkEviction(wm, evictor, 30, N, evictedAt30, t_evict_30))
+        return 1;
+
+    // Persons that were seen at t = 50 expire at t = 60, the other perceived entities at t = 61
+    if (!checkEviction(wm, evictor, 70, N, evictedAt70, t_evict_70))
+        return 1;
+
+    const std::vector<ed::Evictor::Policy>& policies = evictor.policies();
+    std::cout << N << " entities: evicted " << policies[0].num_evicted << " persons and " << policies[1].num_evicted
+              << " perceived entities (" << t_evict_30 << " ms and " << t_evict_70 << " ms)" << std::endl;
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
@@ -11,13 +11,17 @@
 // Config settings
 #include <tue/config/writer.h>
 
+#include <tue/profiling/timer.h>
+
+#include <cstdlib>
+
 // ----------------------------------------------------------------------------------------------------
 
 int main(int argc, char **argv)
 {
     if (argc <= 1)
     {
-        std::cout << "Please provide a heightmap image file (e.g., pgm)" << std::endl;
+        std::cout << "Please provide a heightmap image file (e.g., pgm) and optionally a simplification tolerance (meters, at a resolution of 1 m per pixel)" << std::endl;
         return 0;
     }
 
@@ -41,13 +45,19 @@ int main(int argc, char **argv)
     w.setValue("resolution", 1);
     w.setValue("blockheight", 0);
 
+    if (argc > 2)
+        w.setValue("simplify", atof(argv[2]));
+
     tue::config::Reader cfg(w.data()); // Wrap config in reader
 
     std::map<std::string, geo::ShapePtr> shape_cache; // necessary for call, not used
 
     // Call shape loader. This will generate a mesh from the file
     std::stringstream error;
+    tue::Timer timer;
+    timer.start();
     geo::ShapePtr shape = ed::models::loadShape("", cfg, shape_cache, error);
+    timer.stop();
 
     if (!shape)
     {
@@ -59,7 +69,8 @@ int main(int argc, char **argv)
     const std::vector<geo::TriangleI>& triangles = shape->getMesh().getTriangleIs();
     const std::vector<geo::Vector3>& vertices = shape->getMesh().getPoints();
 
-    // Display number of vertices and triangles
+    // Display meshing time and number of vertices and triangles
+    std::cout << "Meshing took " << timer.getElapsedTimeInMilliSec() << " ms" << std::endl;
     std::cout << vertices.size() << " vertices" << std::endl;
     std::cout << triangles.size() << " triangles" << std::endl;
 
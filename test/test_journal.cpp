@@ -0,0 +1,242 @@
+#include <ed/world_model.h>
+#include <ed/update_request.h>
+#include <ed/entity.h>
+#include <ed/property_key_db.h>
+#include <ed/io/filesystem/journal.h>
+
+#include <geolib/Shape.h>
+#include <geolib/Box.h>
+
+// Profiling
+#include <tue/profiling/timer.h>
+
+#include <boost/make_shared.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+ed::UpdateRequestPtr createRequest(unsigned int i)
+{
+    ed::UpdateRequestPtr req(new ed::UpdateRequest);
+
+    std::stringstream id;
+    id << "e" << (i % 100);
+
+    req->setType(id.str(), "object");
+    req->setPose(id.str(), geo::Pose3D(i, 2, 0, 0, 0, 0.1 * i));
+    req->addFlag(id.str(), "perceived");
+
+    if (i % 10 == 0)
+        req->setShape(id.str(), geo::ShapePtr(new geo::Box(geo::Vector3(-0.5, -0.5, 0), geo::Vector3(0.5, 0.5, i % 7))));
+
+    if (i % 25 == 24)
+        req->removeEntity(id.str());
+
+    return req;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool compare(const ed::WorldModel& wm1, const ed::WorldModel& wm2)
+{
+    if (wm1.numEntities() != wm2.numEntities())
+    {
+        std::cout << "Recovered world has " << wm2.numEntities() << " entities, expected " << wm1.numEntities() << std::endl;
+        return false;
+    }
+
+    for(ed::WorldModel::const_iterator it = wm1.begin(); it != wm1.end(); ++it)
+    {
+        const ed::EntityConstPtr& e1 = *it;
+        ed::EntityConstPtr e2 = wm2.getEntity(ed::UUID(e1->id().str()));
+
+        if (!e2 || e1->type() != e2->type() || e1->flagNames() != e2->flagNames() || e1->has_pose() != e2->has_pose()
+                || (e1->has_pose() && (e1->pose().t - e2->pose().t).length() > 1e-9)
+                || (e1->shape() ? true : false) != (e2->shape() ? true : false))
+        {
+            std::cout << "Entity '" << e1->id() << "' differs" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool recover(const std::string& dir, const ed::PropertyKeyDB& property_key_db, ed::WorldModel& wm, unsigned int& num_records)
+{
+    ed::Journal journal;
+    ed::UpdateRequestPtr checkpoint;
+    std::vector<ed::UpdateRequestPtr> records;
+    if (!journal.open(dir, property_key_db, checkpoint, records))
+        return false;
+
+    if (checkpoint)
+        wm.update(*checkpoint);
+
+    for(std::vector<ed::UpdateRequestPtr>::const_iterator it = records.begin(); it != records.end(); ++it)
+        wm.update(**it);
+
+    num_records = records.size();
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+std::string lastFile(const std::string& dir, const std::string& prefix)
+{
+    std::string last;
+    DIR* d = opendir(dir.c_str());
+    while(struct dirent* entry = readdir(d))
+    {
+        std::string name = entry->d_name;
+        if (name.compare(0, prefix.size(), prefix) == 0 && name > last)
+            last = name;
+    }
+    closedir(d);
+    return dir + "/" + last;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Total size of the files in 'dir' of which the name ends with 'suffix'
+off_t totalSize(const std::string& dir, const std::string& suffix)
+{
+    off_t size = 0;
+    DIR* d = opendir(dir.c_str());
+    while(struct dirent* entry = readdir(d))
+    {
+        std::string name = entry->d_name;
+        struct stat st;
+        if (name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0
+                && stat((dir + "/" + name).c_str(), &st) == 0)
+            size += st.st_size;
+    }
+    closedir(d);
+    return size;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    unsigned int N = 10000;
+    std::string dir = "/tmp/ed_test_journal";
+
+    if (system(("rm -rf " + dir).c_str()) != 0)
+        return 1;
+
+    ed::PropertyKeyDB property_key_db;
+    ed::WorldModelPtr wm(new ed::WorldModel);
+
+    {
+        ed::Journal journal;
+        ed::UpdateRequestPtr checkpoint;
+        std::vector<ed::UpdateRequestPtr> records;
+        if (!journal.open(dir, property_key_db, checkpoint, records) || checkpoint || !records.empty())
+            return 1;
+
+        tue::Timer timer;
+        timer.start();
+
+        for(unsigned int i = 0; i < N; ++i)
+        {
+            ed::UpdateRequestPtr req = createRequest(i);
+
+            ed::WorldModelPtr new_wm = boost::make_shared<ed::WorldModel>(*wm);
+            new_wm->update(*req);
+            journal.append(*req);
+            wm = new_wm;
+
+            if (i == N / 2)
+                journal.checkpoint(wm);
+        }
+
+        std::cout << "Appending " << N << " requests took " << timer.getElapsedTimeInMilliSec() << " ms" << std::endl;
+
+        // Destructor writes all pending records
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Recover from the checkpoint and the journal tail
+
+    tue::Timer timer;
+    timer.start();
+
+    ed::WorldModel wm_recovered;
+    unsigned int num_records;
+    if (!recover(dir, property_key_db, wm_recovered, num_records) || !compare(*wm, wm_recovered))
+        return 1;
+
+    std::cout << "Recovering took " << timer.getElapsedTimeInMilliSec() << " ms" << std::endl;
+
+    if (num_records != N - N / 2 - 1)
+    {
+        std::cout << "Replayed " << num_records << " records, expected " << (N - N / 2 - 1) << std::endl;
+        return 1;
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Crash while writing: a torn record at the end of the journal is discarded
+
+    {
+        ed::Journal journal;
+        ed::UpdateRequestPtr checkpoint;
+        std::vector<ed::UpdateRequestPtr> records;
+        if (!journal.open(dir, property_key_db, checkpoint, records))
+            return 1;
+
+        journal.append(*createRequest(N));
+        journal.append(*createRequest(N + 1));
+    }
+
+    std::string segment = lastFile(dir, "journal-");
+    struct stat st;
+    if (stat(segment.c_str(), &st) != 0 || truncate(segment.c_str(), st.st_size - 3) != 0)
+        return 1;
+
+    ed::WorldModel wm_torn;
+    if (!recover(dir, property_key_db, wm_torn, num_records))
+        return 1;
+
+    wm->update(*createRequest(N));
+    if (num_records != N - N / 2 || !compare(*wm, wm_torn))
+    {
+        std::cout << "Torn record was not handled correctly" << std::endl;
+        return 1;
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    // Unreadable checkpoint: the records after it can not be replayed, but nothing is deleted or truncated
+
+    off_t size_before = totalSize(dir, ".snapshot") + totalSize(dir, ".log");
+
+    FILE* f = fopen(lastFile(dir, "checkpoint-").c_str(), "r+");
+    if (!f || fwrite("garbage", 1, 7, f) != 7 || fclose(f) != 0)
+        return 1;
+
+    ed::WorldModel wm_corrupt;
+    if (!recover(dir, property_key_db, wm_corrupt, num_records))
+        return 1;
+
+    if (num_records != 0 || wm_corrupt.numEntities() != 0 || totalSize(dir, ".snapshot") != 0
+            || totalSize(dir, ".unrecovered") != size_before)
+    {
+        std::cout << "Unreadable checkpoint was not handled correctly" << std::endl;
+        return 1;
+    }
+
+    if (system(("rm -rf " + dir).c_str()) != 0)
+        return 1;
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
@@ -69,5 +69,56 @@ int main(int argc, char **argv) {
 
     }
 
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+    {
+        Timer timer;
+        timer.start();
+
+        int i = 0;
+        for(int n = 0; n < N; ++n)
+        {
+            const std::vector<ed::ImageMask::Run>& runs = m.runs();
+            for(std::vector<ed::ImageMask::Run>::const_iterator it = runs.begin(); it != runs.end(); ++it)
+            {
+                const cv::Vec3b* row = rgb_image.ptr<cv::Vec3b>(it->y);
+                for(int x = it->x_min; x <= it->x_max; ++x)
+                    i += row[x][0];
+            }
+        }
+
+        timer.stop();
+
+        std::cout << "Check value: " << i << " (" << m.runs().size() << " runs)" << std::endl;
+        std::cout << timer.getElapsedTimeInMilliSec() / N << " ms" << std::endl;
+    }
+
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+    {
+        // Left and right half, overlapping in the middle 40 columns. Pixels are added out of order.
+        ed::ImageMask left(640, 480), right(640, 480);
+        for(int y = 479; y >= 0; --y)
+        {
+            for(int x = 339; x >= 0; --x)
+                left.addPoint(x, y);
+            for(int x = 300; x < 640; ++x)
+                right.addPoint(x, y);
+        }
+
+        ed::ImageMask u = left.unite(right);
+        ed::ImageMask s = left.intersect(right);
+
+        std::cout << "Union: " << u.area() << " (expected " << 640 * 480 << "), " << u.runs().size() << " runs" << std::endl;
+        std::cout << "Intersection: " << s.area() << " (expected " << 40 * 480 << "), " << s.runs().size() << " runs" << std::endl;
+
+        // Scaled iteration: every pixel covers a 2x2 block
+        int n = 0;
+        for(ed::ImageMask::const_iterator it = s.begin(1280); it != s.end(); ++it)
+            ++n;
+
+        std::cout << "Scaled intersection: " << n << " (expected " << 4 * 40 * 480 << ")" << std::endl;
+    }
+
     return 0;
 }
@@ -0,0 +1,209 @@
+#include <ed/world_model.h>
+#include <ed/update_request.h>
+#include <ed/entity.h>
+#include <ed/replication/hub.h>
+#include <ed/serialization/serialization.h>
+#include <ed/serialization/shape_store.h>
+#include <ed/io/json_reader.h>
+
+#include <geolib/Shape.h>
+#include <geolib/Box.h>
+
+#include <cmath>
+#include <set>
+#include <sstream>
+
+// ----------------------------------------------------------------------------------------------------
+
+struct Replica
+{
+    Replica(const std::string& name_, unsigned int sync_interval_) : name(name_), sync_interval(sync_interval_), revision(0) {}
+
+    std::string name;
+    unsigned int sync_interval;
+    unsigned long revision;
+    ed::WorldModel world;
+    ed::ShapeStore shape_store;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+bool sync(const ed::replication::Hub& hub, Replica& replica)
+{
+    std::string response;
+    unsigned long new_revision;
+    hub.query(replica.revision, response, new_revision);
+
+    ed::io::JSONReader r(response.c_str());
+    if (!r.ok())
+    {
+        std::cout << replica.name << ": could not parse response: " << r.error() << std::endl;
+        return false;
+    }
+
+    ed::UpdateRequest req;
+    std::vector<ed::UUID> unresolved_shapes;
+    ed::deserialize(r, req, replica.shape_store, unresolved_shapes);
+
+    if (!unresolved_shapes.empty())
+    {
+        std::cout << replica.name << ": received reference to unknown mesh for '" << unresolved_shapes.front() << "'" << std::endl;
+        return false;
+    }
+
+    int full_state = 0;
+    if (r.readValue("full_state", full_state) && full_state)
+    {
+        for(ed::WorldModel::const_iterator it = replica.world.begin(); it != replica.world.end(); ++it)
+        {
+            const ed::EntityConstPtr& e = *it;
+            if (req.updated_entities.find(e->id()) == req.updated_entities.end())
+                req.removeEntity(e->id());
+        }
+    }
+
+    replica.world.update(req);
+    replica.revision = new_revision;
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool compare(const ed::WorldModel& master, const Replica& replica)
+{
+    bool ok = true;
+    std::set<const geo::Shape*> shapes;
+
+    if (master.numEntities() != replica.world.numEntities())
+    {
+        std::cout << replica.name << ": has " << replica.world.numEntities() << " entities, master has " << master.numEntities() << std::endl;
+        ok = false;
+    }
+
+    for(ed::WorldModel::const_iterator it = master.begin(); it != master.end(); ++it)
+    {
+        const ed::EntityConstPtr& e = *it;
+        // Do not use the cached index of the master id
+        ed::EntityConstPtr e_rep = replica.world.getEntity(ed::UUID(e->id().str()));
+
+        if (!e_rep)
+        {
+            std::cout << replica.name << ": missing entity '" << e->id() << "'" << std::endl;
+            ok = false;
+            continue;
+        }
+
+        if (e_rep->type() != e->type() || e_rep->has_pose() != e->has_pose())
+        {
+            std::cout << replica.name << ": type or pose of '" << e->id() << "' differs" << std::endl;
+            ok = false;
+        }
+
+        if (e->has_pose() && (e_rep->pose().t - e->pose().t).length() > 1e-3)
+        {
+            std::cout << replica.name << ": position of '" << e->id() << "' differs" << std::endl;
+            ok = false;
+        }
+
+        if ((e->shape() ? true : false) != (e_rep->shape() ? true : false)
+                || (e->shape() && e->shape()->getMesh().getTriangleIs().size() != e_rep->shape()->getMesh().getTriangleIs().size()))
+        {
+            std::cout << replica.name << ": shape of '" << e->id() << "' differs" << std::endl;
+            ok = false;
+        }
+
+        if (e_rep->shape())
+            shapes.insert(e_rep->shape().get());
+    }
+
+    // All entities have the same box, so they should share one mesh
+    if (shapes.size() > 1)
+    {
+        std::cout << replica.name << ": has " << shapes.size() << " copies of the same mesh" << std::endl;
+        ok = false;
+    }
+
+    return ok;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    ed::WorldModel master;
+    ed::replication::Hub hub(10, 5);
+
+    std::vector<Replica*> replicas;
+    replicas.push_back(new Replica("every revision", 1));
+    replicas.push_back(new Replica("every 7 revisions", 7));
+    replicas.push_back(new Replica("every 25 revisions", 25));
+    replicas.push_back(new Replica("only at the end", 0));
+
+    // Hub that is only started halfway (as on the first sync query), from the world at that time
+    ed::replication::Hub late_hub(10, 5);
+    Replica late_replica("hub started halfway", 3);
+
+    unsigned int N = 60;
+    for(unsigned int i = 0; i < N; ++i)
+    {
+        ed::UpdateRequest req;
+
+        std::stringstream id;
+        id << "e" << i;
+
+        req.setType(id.str(), "object");
+        req.setPose(id.str(), geo::Pose3D(i * 0.5, 1, 0));
+
+        // Different shape objects with the same content
+        if (i % 3 == 0)
+            req.setShape(id.str(), geo::ShapePtr(new geo::Box(geo::Vector3(-0.5, -0.5, 0), geo::Vector3(0.5, 0.5, 1))));
+
+        if (i % 4 == 0 && i >= 2)
+        {
+            std::stringstream id_removed;
+            id_removed << "e" << (i - 2);
+            req.removeEntity(id_removed.str());
+        }
+
+        // Keep moving the first entity
+        if (i % 5 == 0)
+            req.setPose("e1", geo::Pose3D(i, 2, 0));
+
+        master.update(req);
+        hub.addRevision(master, req);
+
+        if (i == N / 2)
+            late_hub.reset(master);
+        else if (i > N / 2)
+            late_hub.addRevision(master, req);
+
+        if (i >= N / 2 && i % late_replica.sync_interval == 0 && !sync(late_hub, late_replica))
+            return 1;
+
+        for(std::vector<Replica*>::iterator it = replicas.begin(); it != replicas.end(); ++it)
+        {
+            Replica& rep = **it;
+            if (rep.sync_interval > 0 && i % rep.sync_interval == 0 && !sync(hub, rep))
+                return 1;
+        }
+    }
+
+    bool ok = sync(late_hub, late_replica) && compare(master, late_replica);
+    if (ok)
+        std::cout << late_replica.name << ": OK (revision " << late_replica.revision << ")" << std::endl;
+
+    for(std::vector<Replica*>::iterator it = replicas.begin(); it != replicas.end(); ++it)
+    {
+        Replica& rep = **it;
+
+        if (sync(hub, rep) && compare(master, rep))
+            std::cout << rep.name << ": OK (revision " << rep.revision << ")" << std::endl;
+        else
+            ok = false;
+
+        delete *it;
+    }
+
+    return ok ? 0 : 1;
+}
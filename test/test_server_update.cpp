@@ -0,0 +1,76 @@
+// Checks that changes made through the update functions of the server (as used by the update services) reach the
+// dirty entities of every plugin, also if the plugin does not make requests itself.
+
+#include <ed/server.h>
+#include <ed/plugin_container.h>
+#include <ed/update_request.h>
+#include <ed/dirty_entity.h>
+
+#include <ros/init.h>
+
+#include <boost/make_shared.hpp>
+
+#include <iostream>
+
+// ----------------------------------------------------------------------------------------------------
+
+// Container without plugin, that shows which entities it would pass to its plugin as dirty
+class DirtyProbe : public ed::PluginContainer
+{
+
+public:
+
+    DirtyProbe() { name_ = "probe"; }
+
+    unsigned int dirty(const ed::UUID& id) const
+    {
+        boost::lock_guard<boost::mutex> lg(mutex_world_);
+        std::map<ed::UUID, unsigned int>::const_iterator it = dirty_.find(id);
+        return it != dirty_.end() ? it->second : 0;
+    }
+
+    bool hasNewWorld() const
+    {
+        boost::lock_guard<boost::mutex> lg(mutex_world_);
+        return world_new_ ? true : false;
+    }
+
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    ros::init(argc, argv, "ed_test_server_update", ros::init_options::AnonymousName | ros::init_options::NoRosout);
+
+    ed::Server server;
+
+    boost::shared_ptr<DirtyProbe> probe = boost::make_shared<DirtyProbe>();
+    server.addPluginContainer(probe);
+
+    // Update request, as passed by /ed/update
+    ed::UpdateRequest req;
+    req.setType("table", "furniture");
+    req.setPose("table", geo::Pose3D(1, 2, 0));
+    server.update(req);
+
+    if (!probe->hasNewWorld() || !(probe->dirty("table") & ed::DirtyEntity::POSE)
+            || !(probe->dirty("table") & ed::DirtyEntity::TYPE))
+    {
+        std::cout << "Pose set with Server::update(req) is not dirty for the plugin" << std::endl;
+        return 1;
+    }
+
+    // YAML update string, as passed by the update service
+    std::string error;
+    server.update("entities: [{id: chair, pose: {x: 3, y: 4, z: 0}}]", error);
+
+    if (!error.empty() || !(probe->dirty("chair") & ed::DirtyEntity::POSE))
+    {
+        std::cout << "Pose set with Server::update(str) is not dirty for the plugin " << error << std::endl;
+        return 1;
+    }
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
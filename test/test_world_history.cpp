@@ -0,0 +1,185 @@
+// Checks that the world history returns entities as they were at past times and revisions, that it drops the
+// revisions outside its window and memory budget, and measures the time of queries in a world with 100k entities.
+
+#include <ed/world_history.h>
+#include <ed/world_model.h>
+#include <ed/update_request.h>
+#include <ed/entity.h>
+
+// Profiling
+#include <tue/profiling/timer.h>
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+// ----------------------------------------------------------------------------------------------------
+
+std::string entityId(const std::string& prefix, unsigned int i)
+{
+    std::stringstream id;
+    id << prefix << i;
+    return id.str();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Entity i is moved to x = c in the cycles c with c % 50 == i % 50. Returns its x at cycle c.
+double expectedX(unsigned int i, unsigned int c)
+{
+    unsigned int k = i % 50;
+    if (c < k)
+        return -1;
+    return c - (c - k) % 50;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+double cycleTime(unsigned int c)
+{
+    return 100 + 0.1 * c;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Checks the entities of the history at cycle c (by time and by revision) against what was done in that cycle
+bool checkCycle(const ed::WorldHistory& history, unsigned int N, unsigned int c, unsigned long revision)
+{
+    ed::WorldHistory::Query q_time;
+    q_time.at_time = cycleTime(c) + 0.05;
+
+    ed::WorldHistory::Query q_rev;
+    q_rev.at_revision = revision;
+
+    for(unsigned int i = 0; i < N; i += 997)
+    {
+        ed::EntityConstPtr e_time, e_rev;
+        if (!history.entity(entityId("e", i), q_time, e_time) || !history.entity(entityId("e", i), q_rev, e_rev))
+        {
+            std::cout << "Cycle " << c << " is not in the history" << std::endl;
+            return false;
+        }
+
+        if (!e_time || e_time != e_rev || e_time->pose().t.x != expectedX(i, c))
+        {
+            std::cout << "Entity " << i << " is wrong at cycle " << c << std::endl;
+            return false;
+        }
+    }
+
+    // Entity new_k exists in cycles k to k + 4
+    std::vector<ed::EntityConstPtr> entities;
+    history.entities(q_time, entities);
+    if (entities.size() != N + std::min(c + 1, 5u))
+    {
+        std::cout << "History has " << entities.size() << " entities at cycle " << c << std::endl;
+        return false;
+    }
+
+    ed::EntityConstPtr e_removed;
+    if (c >= 5 && (!history.entity(entityId("new_", c - 5), q_time, e_removed) || e_removed))
+    {
+        std::cout << "Removed entity is still in the history at cycle " << c << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    unsigned int N = 100000;
+    unsigned int num_cycles = 120;
+
+    // 10 s of history, and at most 20 MB
+    ed::WorldHistory history, history_small;
+    history.configure(10, 0);
+    history_small.configure(10, 20 * 1024 * 1024);
+
+    ed::UpdateRequest req;
+    for(unsigned int i = 0; i < N; ++i)
+    {
+        req.setType(entityId("e", i), "object");
+        req.setPose(entityId("e", i), geo::Pose3D(-1, 0, 0));
+    }
+
+    ed::WorldModelPtr world = boost::make_shared<ed::WorldModel>();
+    world->update(req);
+
+    // Each cycle (at 10 Hz), 2% of the entities move, one entity is added and one is removed
+    std::vector<unsigned long> revisions;
+    for(unsigned int c = 0; c < num_cycles; ++c)
+    {
+        ed::UpdateRequest req_cycle;
+        for(unsigned int i = c % 50; i < N; i += 50)
+            req_cycle.setPose(entityId("e", i), geo::Pose3D(c, 0, 0));
+
+        req_cycle.setType(entityId("new_", c), "object");
+        if (c >= 5)
+            req_cycle.removeEntity(entityId("new_", c - 5));
+
+        // Same as the server: shallow copy of the world model, then apply the request
+        ed::WorldModelPtr new_world = boost::make_shared<ed::WorldModel>(*world);
+        new_world->update(req_cycle);
+        world = new_world;
+
+        history.add(world, cycleTime(c));
+        history_small.add(world, cycleTime(c));
+        revisions.push_back(world->revision());
+    }
+
+    // The cycles of the last 10 s can be queried, older ones not
+    unsigned int c_last = num_cycles - 1;
+    for(unsigned int c = c_last - 100; c <= c_last; c += 5)
+    {
+        if (!checkCycle(history, N, c, revisions[c]))
+            return 1;
+    }
+
+    ed::WorldHistory::Query q_old;
+    q_old.at_time = cycleTime(c_last - 110);
+    std::vector<ed::EntityConstPtr> entities;
+    if (history.entities(q_old, entities))
+    {
+        std::cout << "History is longer than its window" << std::endl;
+        return 1;
+    }
+
+    if (history_small.memoryUsage() > 20 * 1024 * 1024 || history_small.numRevisions() >= history.numRevisions())
+    {
+        std::cout << "History does not stay within its memory budget" << std::endl;
+        return 1;
+    }
+
+    unsigned int c_oldest = c_last - history_small.numRevisions() + 1;
+    if (!checkCycle(history_small, N, c_last, revisions[c_last])
+            || !checkCycle(history_small, N, c_oldest, revisions[c_oldest]))
+        return 1;
+
+    // Query time
+    ed::WorldHistory::Query q;
+    q.at_time = cycleTime(c_last - 50);
+
+    int num_queries = 1000;
+    tue::Timer timer;
+    timer.start();
+    ed::EntityConstPtr e;
+    for(int i = 0; i < num_queries; ++i)
+        history.entity(entityId("e", i * 97), q, e);
+    double t_entity = timer.getElapsedTimeInMicroSec() / num_queries;
+
+    timer.start();
+    history.entities(q, entities);
+    double t_entities = timer.getElapsedTimeInMilliSec();
+
+    std::cout << N << " entities, " << history.numRevisions() << " revisions (" << history.memoryUsage() / (1024 * 1024)
+              << " MB, " << history_small.numRevisions() << " within 20 MB): entity " << t_entity << " us, world "
+              << t_entities << " ms" << std::endl;
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
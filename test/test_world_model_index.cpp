@@ -0,0 +1,470 @@
+// Checks the type, flag, shape, convex hull and id prefix indexes and the dense entity tables of the world model against
+// a scan of all entities, and compares the time of both for worlds of 10k to 100k entities. Also checks that
+// relations, handles and indexes stay consistent when entities are removed and the world is compacted, and that
+// WorldModel::diff() finds the same changes as comparing all entities by id. Also measures the time of copying a
+// world and changing a few entities in the copy.
+
+#include <ed/world_model.h>
+#include <ed/update_request.h>
+#include <ed/entity.h>
+#include <ed/relations/transform_cache.h>
+
+#include <geolib/Shape.h>
+#include <geolib/Box.h>
+
+// Profiling
+#include <tue/profiling/timer.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+// ----------------------------------------------------------------------------------------------------
+
+std::string entityId(unsigned int i)
+{
+    std::stringstream id;
+    id << "e" << i;
+    return id.str();
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void buildWorldModel(ed::WorldModel& wm, unsigned int N)
+{
+    ed::UpdateRequest req;
+
+    geo::ShapePtr box(new geo::Box(geo::Vector3(-0.5, -0.5, 0), geo::Vector3(0.5, 0.5, 1)));
+
+    ed::ConvexHull chull;
+    chull.points.push_back(geo::Vec2f(-0.1, -0.1));
+    chull.points.push_back(geo::Vec2f(0.1, -0.1));
+    chull.points.push_back(geo::Vec2f(0, 0.1));
+    chull.z_min = 0;
+    chull.z_max = 0.3;
+
+    for(unsigned int i = 0; i < N; ++i)
+    {
+        std::string id = entityId(i);
+
+        std::stringstream type;
+        type << "object" << i % 100;
+        req.setType(id, type.str());
+
+        if (i % 10 == 0)
+            req.addType(id, "furniture");
+
+        if (i % 7 == 0)
+            req.addFlag(id, "perception");
+
+        if (i % 3 == 0)
+            req.setShape(id, box);
+        else if (i % 3 == 1)
+            req.setConvexHullNew(id, chull, geo::Pose3D(i, 0, 0), 10.0, "laser");
+
+        if (i % 4 == 1)
+        {
+            boost::shared_ptr<ed::TransformCache> t(new ed::TransformCache());
+            t->insert(0, geo::Pose3D(1, 0, 0));
+            req.setRelation(entityId(i - 1), id, t);
+        }
+    }
+
+    wm.update(req);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Furniture that perception found, by scanning all entities
+void scan(const ed::WorldModel& wm, std::vector<ed::Idx>& result)
+{
+    result.clear();
+    const std::vector<ed::EntityConstPtr>& entities = wm.entities();
+    for(ed::Idx i = 0; i < entities.size(); ++i)
+    {
+        const ed::EntityConstPtr& e = entities[i];
+        if (e && e->hasType("furniture") && e->hasFlag("perception"))
+            result.push_back(i);
+    }
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Furniture that perception found, using the indexes
+void lookup(const ed::WorldModel& wm, std::vector<ed::Idx>& result)
+{
+    ed::WorldModel::intersect(wm.entitiesWithType("furniture"), wm.entitiesWithFlag("perception"), result);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool checkIndexes(const ed::WorldModel& wm)
+{
+    std::vector<ed::Idx> shapes, convex_hulls, live;
+    const std::vector<ed::EntityConstPtr>& entities = wm.entities();
+    for(ed::Idx i = 0; i < entities.size(); ++i)
+    {
+        const ed::EntityConstPtr& e = entities[i];
+        if (e && e->shape())
+            shapes.push_back(i);
+        if (e && !e->convexHull().points.empty())
+            convex_hulls.push_back(i);
+        if (e)
+            live.push_back(i);
+
+        if (wm.entity_alive()[i] != (e ? 1 : 0) || wm.entity_has_pose()[i] != (e && e->has_pose() ? 1 : 0)
+                || wm.entity_boxes()[i].empty() != (!e || e->convexHull().points.empty())
+                || (e && e->has_pose() && (wm.entity_poses()[i].t - e->pose().t).length() != 0))
+        {
+            std::cout << "Tables differ from entity " << i << std::endl;
+            return false;
+        }
+    }
+
+    if (live != wm.live_entities())
+    {
+        std::cout << "Live entities differ from scan" << std::endl;
+        return false;
+    }
+
+    std::vector<ed::Idx> result_scan, result_index;
+    scan(wm, result_scan);
+    lookup(wm, result_index);
+
+    if (result_scan != result_index || shapes != wm.entitiesWithShape() || convex_hulls != wm.entitiesWithConvexHull())
+    {
+        std::cout << "Indexes differ from scan" << std::endl;
+        return false;
+    }
+
+    // Prefix index
+    const char* prefixes[] = { "e1", "new_", "x" };
+    for(unsigned int k = 0; k < 3; ++k)
+    {
+        std::string prefix = prefixes[k];
+
+        std::vector<ed::Idx> prefix_scan, prefix_index;
+        for(ed::Idx i = 0; i < entities.size(); ++i)
+        {
+            if (entities[i] && entities[i]->id().str().compare(0, prefix.size(), prefix) == 0)
+                prefix_scan.push_back(i);
+        }
+
+        wm.entitiesWithPrefix(prefix, prefix_index);
+        std::sort(prefix_index.begin(), prefix_index.end());
+
+        if (prefix_scan != prefix_index)
+        {
+            std::cout << "Prefix index differs from scan for '" << prefix << "'" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Both sides of every relation must exist and agree
+bool checkRelations(const ed::WorldModel& wm)
+{
+    const std::vector<ed::EntityConstPtr>& entities = wm.entities();
+    for(ed::Idx i = 0; i < entities.size(); ++i)
+    {
+        const ed::EntityConstPtr& e = entities[i];
+        if (!e)
+            continue;
+
+        const std::map<ed::Idx, ed::Idx>& relations_to = e->relationsTo();
+        for(std::map<ed::Idx, ed::Idx>::const_iterator it = relations_to.begin(); it != relations_to.end(); ++it)
+        {
+            if (it->first >= entities.size() || !entities[it->first] || entities[it->first]->relationFrom(i) != it->second
+                    || !wm.relations()[it->second])
+            {
+                std::cout << "Relation from entity " << i << " to " << it->first << " is invalid" << std::endl;
+                return false;
+            }
+        }
+
+        const std::map<ed::Idx, ed::Idx>& relations_from = e->relationsFrom();
+        for(std::map<ed::Idx, ed::Idx>::const_iterator it = relations_from.begin(); it != relations_from.end(); ++it)
+        {
+            if (it->first >= entities.size() || !entities[it->first] || entities[it->first]->relationTo(i) != it->second)
+            {
+                std::cout << "Relation to entity " << i << " from " << it->first << " is invalid" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Checks that 'diff' lists each id once, and that the ids of added and changed entities have their index in 'wm'
+bool checkDiffIds(const ed::WorldModel& wm, const std::vector<ed::UUID>& ids, std::set<ed::UUID>& id_set)
+{
+    id_set.clear();
+    for(std::vector<ed::UUID>::const_iterator it = ids.begin(); it != ids.end(); ++it)
+    {
+        if (!id_set.insert(*it).second)
+        {
+            std::cout << "Entity " << *it << " is in the diff twice" << std::endl;
+            return false;
+        }
+
+        if (it->idx != ed::INVALID_IDX && (it->idx >= wm.entities().size() || !wm.entities()[it->idx]
+                                            || wm.entities()[it->idx]->id() != *it))
+        {
+            std::cout << "Entity " << *it << " has the wrong index in the diff" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+// Sets 'diff' to the difference between 'older' and 'newer', and checks it against comparing all entities by id
+bool checkDiff(const ed::WorldModel& older, const ed::WorldModel& newer, ed::WorldDiff& diff)
+{
+    newer.diff(older, diff);
+
+    std::set<ed::UUID> added, removed, changed;
+    for(ed::WorldModel::const_iterator it = newer.begin(); it != newer.end(); ++it)
+    {
+        ed::EntityConstPtr e_old = older.getEntity((*it)->id());
+        if (!e_old)
+            added.insert((*it)->id());
+        else if (e_old != *it)
+            changed.insert((*it)->id());
+    }
+
+    for(ed::WorldModel::const_iterator it = older.begin(); it != older.end(); ++it)
+    {
+        if (!newer.getEntity((*it)->id()))
+            removed.insert((*it)->id());
+    }
+
+    std::vector<ed::UUID> changed_ids;
+    for(std::vector<ed::DirtyEntity>::const_iterator it = diff.changed.begin(); it != diff.changed.end(); ++it)
+        changed_ids.push_back(it->id);
+
+    std::set<ed::UUID> diff_added, diff_removed, diff_changed;
+    if (!checkDiffIds(newer, diff.added, diff_added) || !checkDiffIds(older, diff.removed, diff_removed)
+            || !checkDiffIds(newer, changed_ids, diff_changed))
+        return false;
+
+    if (diff_added != added || diff_removed != removed || diff_changed != changed)
+    {
+        std::cout << "Diff has " << diff.added.size() << " added, " << diff.removed.size() << " removed and "
+                  << diff.changed.size() << " changed entities, but there are " << added.size() << ", "
+                  << removed.size() << " and " << changed.size() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool checkCompaction(const ed::WorldModel& wm)
+{
+    ed::WorldModel wm_compact(wm);
+
+    std::vector<ed::Handle> handles;
+    for(ed::Idx i = 0; i < wm.entities().size(); ++i)
+    {
+        if (wm.entities()[i])
+            handles.push_back(wm.entityHandle(i));
+    }
+
+    ed::CompactionMap map;
+    wm_compact.compact(map);
+
+    if (wm_compact.numFreeEntitySlots() != 0 || wm_compact.entities().size() != wm.numEntities())
+    {
+        std::cout << "Compacted world has empty slots" << std::endl;
+        return false;
+    }
+
+    for(std::vector<ed::Handle>::const_iterator it = handles.begin(); it != handles.end(); ++it)
+    {
+        const ed::EntityConstPtr& e = wm.entities()[it->idx];
+        ed::Idx new_idx = map.entities[it->idx];
+
+        // Handles of entities that moved are invalid, but the entity can be found by id
+        bool moved = (new_idx != it->idx);
+        if (!wm.getEntity(*it) || (wm_compact.getEntity(*it) != 0) != !moved
+                || !wm_compact.getEntity(e->id()) || wm_compact.getEntity(e->id())->id() != e->id()
+                || wm_compact.entities()[new_idx]->id() != e->id())
+        {
+            std::cout << "Handle or id of entity " << it->idx << " is wrong after compaction" << std::endl;
+            return false;
+        }
+    }
+
+    // Only entities whose relations were remapped are copied
+    ed::WorldDiff diff;
+    if (!checkDiff(wm, wm_compact, diff))
+        return false;
+
+    // The original world is not changed
+    return checkIndexes(wm_compact) && checkRelations(wm_compact) && checkIndexes(wm) && checkRelations(wm);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    unsigned int sizes[] = { 10000, 30000, 100000 };
+    int num_queries = 100;
+
+    for(unsigned int k = 0; k < 3; ++k)
+    {
+        unsigned int N = sizes[k];
+
+        ed::WorldModel wm;
+        buildWorldModel(wm, N);
+
+        if (!checkIndexes(wm))
+            return 1;
+
+        std::vector<ed::Idx> result;
+
+        tue::Timer timer;
+        timer.start();
+        for(int i = 0; i < num_queries; ++i)
+            scan(wm, result);
+        double t_scan = timer.getElapsedTimeInMilliSec() / num_queries;
+
+        timer.start();
+        for(int i = 0; i < num_queries; ++i)
+            lookup(wm, result);
+        double t_index = timer.getElapsedTimeInMilliSec() / num_queries;
+
+        std::cout << N << " entities, " << result.size() << " results: scan " << t_scan << " ms, index "
+                  << t_index << " ms" << std::endl;
+
+        // Change and remove entities, and check that the indexes follow
+        geo::ShapePtr box(new geo::Box(geo::Vector3(-0.5, -0.5, 0), geo::Vector3(0.5, 0.5, 1)));
+
+        ed::UpdateRequest req;
+        for(unsigned int i = 0; i < N; i += 5)
+        {
+            std::string id = entityId(i);
+            if (i % 2 == 0)
+            {
+                req.removeEntity(id);
+            }
+            else
+            {
+                req.removeType(id, "furniture");
+                req.addType(id, "furniture_moved");
+                req.removeFlag(id, "perception");
+                req.setShape(id, box);
+
+                if (i % 3 == 1)
+                    req.removeConvexHullNew(id, "laser");
+            }
+        }
+
+        ed::WorldModel wm_updated(wm);
+        wm_updated.update(req);
+
+        // Entities are added in the spots of the removed ones
+        ed::UpdateRequest req_add;
+        for(unsigned int i = 0; i < N / 10; ++i)
+        {
+            std::string id = "new_" + entityId(i);
+            req_add.setType(id, "furniture");
+            req_add.addType(id, "furniture");
+            req_add.addFlag(id, "perception");
+        }
+        wm_updated.update(req_add);
+
+        if (!checkIndexes(wm) || !checkIndexes(wm_updated) || !checkRelations(wm) || !checkRelations(wm_updated))
+            return 1;
+
+        ed::WorldDiff diff;
+        if (!checkDiff(wm, wm_updated, diff))
+            return 1;
+
+        for(std::vector<ed::DirtyEntity>::const_iterator it = diff.changed.begin(); it != diff.changed.end(); ++it)
+        {
+            const std::string& id = it->id.str();
+            unsigned int i = atoi(id.c_str() + 1);
+            bool moved_type = (id[0] == 'e' && i % 10 == 5);
+            if (moved_type != (it->changed(ed::DirtyEntity::TYPE) && it->changed(ed::DirtyEntity::SHAPE)))
+            {
+                std::cout << "Entity " << id << " has the wrong changed components in the diff" << std::endl;
+                return 1;
+            }
+        }
+
+        // The time of a diff depends on the number of changes, not on the number of entities
+        ed::WorldModel wm_moved(wm_updated);
+        ed::UpdateRequest req_move;
+        for(unsigned int i = 1; i < N; i += N / 10)
+            req_move.setPose(entityId(i), geo::Pose3D(i, 1, 0));
+        wm_moved.update(req_move);
+
+        timer.start();
+        for(int i = 0; i < num_queries; ++i)
+            wm_moved.diff(wm_updated, diff);
+        double t_diff = timer.getElapsedTimeInMilliSec() / num_queries;
+
+        if (!checkDiff(wm_updated, wm_moved, diff) || diff.changed.size() != 10
+                || diff.changed[0].components != (ed::DirtyEntity::POSE | ed::DirtyEntity::CONVEX_HULL))
+        {
+            std::cout << "Diff of moved entities is wrong" << std::endl;
+            return 1;
+        }
+
+        // Copying a world and moving a few entities in the copy does not copy its tables and indexes
+        timer.start();
+        for(int i = 0; i < num_queries; ++i)
+        {
+            ed::WorldModel wm_copy(wm_moved);
+            wm_copy.update(req_move);
+        }
+        double t_copy = timer.getElapsedTimeInMilliSec() / num_queries;
+
+        std::cout << N << " entities, " << diff.changed.size() << " moved: diff " << t_diff << " ms, copy and move "
+                  << t_copy << " ms" << std::endl;
+
+        wm_updated.diff(wm_updated, diff);
+        if (!diff.empty())
+        {
+            std::cout << "Diff of a world with itself is not empty" << std::endl;
+            return 1;
+        }
+
+        // Removed entities are fully detached, so new entities in their slots have no relations
+        for(unsigned int i = 0; i < N / 10; ++i)
+        {
+            ed::EntityConstPtr e = wm_updated.getEntity(ed::UUID("new_" + entityId(i)));
+            if (!e || !e->relationsTo().empty() || !e->relationsFrom().empty())
+            {
+                std::cout << "New entity " << i << " took over relations of a removed entity" << std::endl;
+                return 1;
+            }
+        }
+
+        // Remove the new entities again, such that there are empty slots to compact
+        ed::UpdateRequest req_remove;
+        for(unsigned int i = 0; i < N / 10; i += 2)
+            req_remove.removeEntity("new_" + entityId(i));
+        wm_updated.update(req_remove);
+
+        if (!checkCompaction(wm_updated))
+            return 1;
+    }
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
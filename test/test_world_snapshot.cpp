@@ -0,0 +1,191 @@
+#include <ed/world_model.h>
+#include <ed/update_request.h>
+#include <ed/entity.h>
+#include <ed/property_key_db.h>
+#include <ed/relations/transform_cache.h>
+#include <ed/instanced_shape.h>
+#include <ed/io/filesystem/snapshot.h>
+
+#include <geolib/Shape.h>
+#include <geolib/Box.h>
+
+// Profiling
+#include <tue/profiling/timer.h>
+
+#include <cstdio>
+#include <set>
+#include <sstream>
+
+// ----------------------------------------------------------------------------------------------------
+
+void buildWorldModel(ed::WorldModel& wm, unsigned int N)
+{
+    ed::UpdateRequest req;
+
+    geo::ShapePtr box(new geo::Box(geo::Vector3(-0.5, -0.5, 0), geo::Vector3(0.5, 0.5, 1)));
+    geo::ShapePtr table(new geo::Box(geo::Vector3(-1, -0.5, 0), geo::Vector3(1, 0.5, 0.75)));
+
+    // Shares the mesh of the box
+    geo::ShapePtr raised_box(new ed::InstancedShape(box, geo::Pose3D(0, 0, 0.5)));
+
+    req.setType("map", "waypoint");
+
+    for(unsigned int i = 0; i < N; ++i)
+    {
+        std::stringstream id;
+        id << "e" << i;
+
+        req.setType(id.str(), "object");
+        req.addType(id.str(), "furniture");
+        req.setPose(id.str(), geo::Pose3D(i, 2, 0, 0, 0, 0.1 * i));
+        req.setExistenceProbability(id.str(), 0.5);
+
+        // Many entities share the same shape
+        req.setShape(id.str(), i % 3 == 0 ? box : (i % 3 == 1 ? table : raised_box));
+
+        req.addFlag(id.str(), "furniture");
+        if (i % 3 == 0)
+            req.addFlag(id.str(), "locked");
+
+        boost::shared_ptr<ed::TransformCache> t(new ed::TransformCache());
+        t->insert(0, geo::Pose3D(i, 2, 0));
+        req.setRelation("map", id.str(), t);
+    }
+
+    // Perceived entity with a convex hull instead of a shape
+    ed::ConvexHull chull;
+    chull.points.push_back(geo::Vec2f(-0.1, -0.1));
+    chull.points.push_back(geo::Vec2f(0.1, -0.1));
+    chull.points.push_back(geo::Vec2f(0, 0.1));
+    chull.z_min = 0;
+    chull.z_max = 0.3;
+    req.setConvexHullNew("perceived", chull, geo::Pose3D(3, 3, 0.8), 10.0, "laser");
+
+    wm.update(req);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+bool compare(const ed::WorldModel& wm1, const ed::WorldModel& wm2)
+{
+    if (wm1.numEntities() != wm2.numEntities())
+    {
+        std::cout << "Loaded world has " << wm2.numEntities() << " entities, expected " << wm1.numEntities() << std::endl;
+        return false;
+    }
+
+    std::set<const geo::Shape*> shapes;
+    std::set<const geo::Mesh*> meshes;
+
+    for(ed::WorldModel::const_iterator it = wm1.begin(); it != wm1.end(); ++it)
+    {
+        const ed::EntityConstPtr& e1 = *it;
+        ed::EntityConstPtr e2 = wm2.getEntity(ed::UUID(e1->id().str()));
+
+        if (!e2)
+        {
+            std::cout << "Entity '" << e1->id() << "' is missing" << std::endl;
+            return false;
+        }
+
+        if (e1->type() != e2->type() || e1->typeNames() != e2->typeNames() || e1->flagNames() != e2->flagNames()
+                || e1->existenceProbability() != e2->existenceProbability())
+        {
+            std::cout << "Type, flags or existence probability of '" << e1->id() << "' differ" << std::endl;
+            return false;
+        }
+
+        if (e1->has_pose() != e2->has_pose() || (e1->has_pose() && (e1->pose().t - e2->pose().t).length() > 1e-9))
+        {
+            std::cout << "Pose of '" << e1->id() << "' differs" << std::endl;
+            return false;
+        }
+
+        if (e1->convexHull().points.size() != e2->convexHull().points.size())
+        {
+            std::cout << "Convex hull of '" << e1->id() << "' differs" << std::endl;
+            return false;
+        }
+
+        if ((e1->shape() ? true : false) != (e2->shape() ? true : false)
+                || (e1->shape() && e1->shape()->getMesh().getTriangleIs().size() != e2->shape()->getMesh().getTriangleIs().size())
+                || (e1->shape() && e1->shape()->getBoundingBox().getMax().z != e2->shape()->getBoundingBox().getMax().z))
+        {
+            std::cout << "Shape of '" << e1->id() << "' differs" << std::endl;
+            return false;
+        }
+
+        if (e2->shape())
+        {
+            shapes.insert(e2->shape().get());
+
+            geo::Pose3D transform;
+            meshes.insert(&ed::sharedMesh(*e2->shape(), transform));
+        }
+
+        if (e1->relationsFrom().size() != e2->relationsFrom().size())
+        {
+            std::cout << "Relations of '" << e1->id() << "' differ" << std::endl;
+            return false;
+        }
+    }
+
+    if (shapes.size() != 3 || meshes.size() != 2)
+    {
+        std::cout << "Loaded world has " << shapes.size() << " distinct shapes and " << meshes.size()
+                  << " distinct meshes, expected 3 and 2" << std::endl;
+        return false;
+    }
+
+    geo::Pose3D tf1, tf2;
+    if (!wm1.calculateTransform("map", "e10", 0, tf1) || !wm2.calculateTransform("map", "e10", 0, tf2)
+            || (tf1.t - tf2.t).length() > 1e-9)
+    {
+        std::cout << "Transform from 'map' to 'e10' differs" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    unsigned int N = 10000;
+    std::string filename = "/tmp/ed_test_world_snapshot";
+
+    ed::WorldModel wm;
+    buildWorldModel(wm, N);
+
+    tue::Timer timer;
+    timer.start();
+
+    ed::SnapshotHeader header;
+    header.source = "test_world";
+    if (!ed::writeSnapshot(filename, wm, header))
+        return 1;
+
+    std::cout << "Saving " << wm.numEntities() << " entities took " << timer.getElapsedTimeInMilliSec() << " ms" << std::endl;
+
+    timer.start();
+
+    ed::PropertyKeyDB property_key_db;
+    ed::UpdateRequest req;
+    ed::SnapshotHeader header_loaded;
+    if (!ed::readSnapshot(filename, property_key_db, header_loaded, req))
+        return 1;
+
+    ed::WorldModel wm_loaded;
+    wm_loaded.update(req);
+
+    std::cout << "Loading took " << timer.getElapsedTimeInMilliSec() << " ms" << std::endl;
+
+    remove(filename.c_str());
+
+    if (header_loaded.source != header.source || !compare(wm, wm_loaded))
+        return 1;
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Fills the persistent shape cache with the shapes of all models in one or more model directories, such that
+// ED does not have to import or triangulate them at startup.
+//
+//     ed_build_shape_cache CACHE_DIRECTORY MODEL_DIRECTORY...
+//
+// Every directory below MODEL_DIRECTORY that contains a model.yaml is loaded as model.
+
+#include <ed/models/model_loader.h>
+#include <ed/update_request.h>
+
+#include <tue/profiling/timer.h>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+void findModels(const std::string& root, const std::string& type, std::vector<std::string>& types)
+{
+    std::string dir = type.empty() ? root : root + "/" + type;
+
+    struct stat st;
+    if (stat((dir + "/model.yaml").c_str(), &st) == 0)
+        types.push_back(type);
+
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        return;
+
+    std::vector<std::string> sub_dirs;
+    while (dirent* entry = readdir(d))
+    {
+        std::string name = entry->d_name;
+        if (name.empty() || name[0] == '.')
+            continue;
+
+        std::string path = dir + "/" + name;
+        if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+            sub_dirs.push_back(name);
+    }
+    closedir(d);
+
+    for(std::vector<std::string>::const_iterator it = sub_dirs.begin(); it != sub_dirs.end(); ++it)
+        findModels(root, type.empty() ? *it : type + "/" + *it, types);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: ed_build_shape_cache CACHE_DIRECTORY MODEL_DIRECTORY..." << std::endl;
+        return 1;
+    }
+
+    ed::models::ModelLoader model_loader;
+    if (!model_loader.setShapeCacheDirectory(argv[1]))
+        return 1;
+
+    std::vector<std::string> types;
+    for(int i = 2; i < argc; ++i)
+    {
+        model_loader.addModelPath(argv[i]);
+        findModels(argv[i], "", types);
+    }
+
+    tue::Timer timer;
+    timer.start();
+
+    unsigned int num_failed = 0;
+    for(std::vector<std::string>::const_iterator it = types.begin(); it != types.end(); ++it)
+    {
+        ed::UpdateRequest req;
+        std::stringstream error;
+        if (!model_loader.create("_root", *it, req, error))
+        {
+            std::cerr << "Model '" << *it << "' could not be loaded:" << std::endl << error.str() << std::endl;
+            ++num_failed;
+        }
+    }
+
+    ed::models::ShapeCache::Statistics stats = model_loader.shapeCache().statistics();
+
+    std::cout << "Loaded " << (types.size() - num_failed) << " of " << types.size() << " models in "
+              << timer.getElapsedTimeInSec() << " s" << std::endl;
+    std::cout << "Shape cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.writes << " shapes written" << std::endl;
+
+    return num_failed == 0 ? 0 : 1;
+}
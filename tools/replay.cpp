@@ -0,0 +1,126 @@
+// Replays a recording of update requests (see ed::Recorder) into a world model and reports the
+// throughput, the apply latency per request and the peak memory usage.
+//
+//     ed_replay RECORDING_DIRECTORY [--realtime]
+//
+// By default the requests are applied as fast as possible. With --realtime, they are applied with the
+// timing of the recording.
+
+#include <ed/world_model.h>
+#include <ed/update_request.h>
+#include <ed/property_key_db.h>
+#include <ed/io/filesystem/recorder.h>
+
+#include <tue/profiling/timer.h>
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+// ----------------------------------------------------------------------------------------------------
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+
+    std::size_t i = p * (sorted.size() - 1) + 0.5;
+    return sorted[i];
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: ed_replay RECORDING_DIRECTORY [--realtime]" << std::endl;
+        return 1;
+    }
+
+    std::string directory = argv[1];
+    bool realtime = (argc > 2 && strcmp(argv[2], "--realtime") == 0);
+
+    // Property types are registered by plugins, which are not loaded: only properties of known types are replayed
+    ed::PropertyKeyDB property_key_db;
+
+    ed::RecordingReader reader;
+    ed::UpdateRequest req_world;
+    if (!reader.open(directory, property_key_db, req_world))
+        return 1;
+
+    ed::WorldModelPtr world(new ed::WorldModel(&property_key_db));
+    world->update(req_world);
+
+    std::cout << "Initial world: " << world->numEntities() << " entities" << std::endl;
+
+    std::vector<double> latencies;
+    double t_first_record = -1;
+
+    tue::Timer total_timer;
+    total_timer.start();
+
+    double apply_time = 0;
+
+    while(true)
+    {
+        ed::UpdateRequest req;
+        double timestamp;
+        if (!reader.next(property_key_db, timestamp, req))
+            break;
+
+        if (realtime)
+        {
+            if (t_first_record < 0)
+                t_first_record = timestamp;
+
+            double dt = (timestamp - t_first_record) - total_timer.getElapsedTimeInSec();
+            if (dt > 0)
+                usleep(dt * 1e6);
+        }
+
+        tue::Timer timer;
+        timer.start();
+
+        // Same as the server: shallow copy of the world model, then apply the request
+        ed::WorldModelPtr new_world = boost::make_shared<ed::WorldModel>(*world);
+        new_world->update(req);
+        world = new_world;
+
+        timer.stop();
+
+        double latency = timer.getElapsedTimeInMilliSec();
+        latencies.push_back(latency);
+        apply_time += latency;
+    }
+
+    double total_time = total_timer.getElapsedTimeInSec();
+
+    if (latencies.empty())
+    {
+        std::cout << "Recording contains no requests" << std::endl;
+        return 0;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::cout << "Applied " << latencies.size() << " revisions in " << total_time << " s" << std::endl;
+    std::cout << "Final world: " << world->numEntities() << " entities" << std::endl;
+    std::cout << std::endl;
+    if (apply_time > 0)
+        std::cout << "Throughput:    " << (latencies.size() / (apply_time / 1000)) << " revisions/s (apply time only)" << std::endl;
+    std::cout << "Latency (ms):  p50 " << percentile(latencies, 0.5) << ", p90 " << percentile(latencies, 0.9)
+              << ", p99 " << percentile(latencies, 0.99) << ", max " << latencies.back() << std::endl;
+    std::cout << "Peak memory:   " << (usage.ru_maxrss / 1024.0) << " MB" << std::endl;
+
+    return 0;
+}
@@ -2,6 +2,7 @@
 #include <ed/world_model.h>
 #include <ed/update_request.h>
 #include <ed/entity.h>
+#include <ed/instanced_shape.h>
 #include <ed/serialization/serialization.h>
 #include <ed/io/json_reader.h>
 
@@ -259,10 +260,13 @@ int main(int argc, char **argv)
 
         if (e->shape())
         {
-            const std::vector<geo::Vector3>& vertices = e->shape()->getMesh().getPoints();
+            geo::Pose3D shape_transform;
+            const geo::Mesh& mesh = ed::sharedMesh(*e->shape(), shape_transform);
+
+            const std::vector<geo::Vector3>& vertices = mesh.getPoints();
             for(unsigned int i = 0; i < vertices.size(); ++i)
             {
-                const geo::Vector3& p = vertices[i];
+                geo::Vector3 p = shape_transform * vertices[i];
                 const std::string& id = e->id().str();
 
                 if (id.size() < 5 || id.substr(id.size() - 5) != "floor") // Filter ground plane
@@ -278,8 +282,8 @@ int main(int argc, char **argv)
                 }
             }
 
-            n_vertices += e->shape()->getMesh().getPoints().size();
-            n_triangles += e->shape()->getMesh().getTriangleIs().size();
+            n_vertices += mesh.getPoints().size();
+            n_triangles += mesh.getTriangleIs().size();
         }
     }
 
@@ -387,13 +391,17 @@ int main(int argc, char **argv)
                     res.color = cv::Vec3b(255 * COLORS[i_color][2], 255 * COLORS[i_color][1], 255 * COLORS[i_color][0]);
                 }
 
-                res.setMesh(&e->shape()->getMesh());
+                // Render the shared mesh of instanced shapes with the instance transform
+                geo::Pose3D shape_transform;
+                const geo::Mesh& mesh = ed::sharedMesh(*e->shape(), shape_transform);
+
+                res.setMesh(&mesh);
 
 //                cam_pose.inverse() * obj_pose
 
-                geo::Pose3D pose = cam_pose.inverse() * e->pose();
+                geo::Pose3D pose = cam_pose.inverse() * e->pose() * shape_transform;
                 geo::RenderOptions opt;
-                opt.setMesh(e->shape()->getMesh(), pose);
+                opt.setMesh(mesh, pose);
 
                 // Render
                 cam.render(opt, res);